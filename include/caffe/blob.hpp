@@ -229,7 +229,9 @@ class Blob {
   Dtype* mutable_gpu_diff();
   void Update();
   void FromProto(const BlobProto& proto, bool reshape = true);
-  void ToProto(BlobProto* proto, bool write_diff = false) const;
+  /// @brief Writes the blob to proto, with the values in storage.
+  void ToProto(BlobProto* proto, bool write_diff = false,
+      BlobStorage storage = NATIVE) const;
 
   /// @brief Compute the sum of absolute values (L1 norm) of the data.
   Dtype asum_data() const;
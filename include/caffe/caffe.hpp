@@ -15,7 +15,9 @@
 #include "caffe/solver.hpp"
 #include "caffe/solver_factory.hpp"
 #include "caffe/util/benchmark.hpp"
+#include "caffe/util/blas_backend.hpp"
 #include "caffe/util/io.hpp"
+#include "caffe/util/quantization.hpp"
 #include "caffe/util/upgrade_proto.hpp"
 
 #endif  // CAFFE_CAFFE_HPP_
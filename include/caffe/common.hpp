@@ -97,6 +97,8 @@ using std::vector;
 // Currently it initializes google flags and google logging.
 void GlobalInit(int* pargc, char*** pargv);
 
+class ThreadPool;
+
 // A singleton class to hold common caffe stuff, such as the handler that
 // caffe is going to use for cublas, curand, etc.
 class Caffe {
@@ -166,6 +168,13 @@ class Caffe {
   inline static bool multiprocess() { return Get().multiprocess_; }
   inline static void set_multiprocess(bool val) { Get().multiprocess_ = val; }
   inline static bool root_solver() { return Get().solver_rank_ == 0; }
+  // Intra-op parallelism: the number of threads, counting the calling one,
+  // that CPU layers may split their batch over. Values <= 0 select one
+  // thread per hardware core.
+  inline static int cpu_threads() { return Get().cpu_threads_; }
+  static void set_cpu_threads(int threads);
+  // The pool of cpu_threads() threads, created on first use.
+  static ThreadPool* cpu_pool();
 
  protected:
 #ifndef CPU_ONLY
@@ -181,6 +190,10 @@ class Caffe {
   int solver_rank_;
   bool multiprocess_;
 
+  // Intra-op parallelism
+  int cpu_threads_;
+  shared_ptr<ThreadPool> cpu_pool_;
+
  private:
   // The private constructor to avoid duplicate instantiation.
   Caffe();
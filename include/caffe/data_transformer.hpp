@@ -6,6 +6,7 @@
 #include "caffe/blob.hpp"
 #include "caffe/common.hpp"
 #include "caffe/proto/caffe.pb.h"
+#include "caffe/util/tensor_record.hpp"
 
 namespace caffe {
 
@@ -37,6 +38,47 @@ class DataTransformer {
    */
   void Transform(const Datum& datum, Blob<Dtype>* transformed_blob);
 
+  /**
+   * @brief Applies the transformation defined in the data layer's
+   * transform_param block to the pixels of a tensor record, where they are.
+   *
+   * @param record
+   *    TensorRecord pointing at the pixels to be transformed.
+   * @param transformed_blob
+   *    This is destination blob, as for a Datum.
+   */
+  void Transform(const TensorRecord& record, Blob<Dtype>* transformed_blob);
+
+  /**
+   * @brief Draws the crop and the mirror that Transform would apply to an
+   * image of the given size, for a transformation deferred to TransformRaw.
+   *
+   * @param augmentation
+   *    Receives the row and the column of the crop, and 1 to mirror it.
+   */
+  void DrawAugmentation(int channels, int height, int width,
+      int* augmentation);
+
+  /**
+   * @brief Transforms the uint8 images of a batch, each with the augmentation
+   * drawn for it, as Transform does them one by one.
+   *
+   * @param raw_shape
+   *    The shape of the batch, num x channels x height x width.
+   * @param raw
+   *    The pixels of the batch.
+   * @param augmentation
+   *    The 3 values DrawAugmentation drew for each image.
+   * @param transformed_blob
+   *    This is destination blob, of num transformed images.
+   */
+  void TransformRaw(const vector<int>& raw_shape, const uint8_t* raw,
+      const int* augmentation, Blob<Dtype>* transformed_blob);
+  /// @brief TransformRaw with raw and augmentation on the GPU, into the GPU
+  ///        data of transformed_blob.
+  void TransformRaw_gpu(const vector<int>& raw_shape, const uint8_t* raw,
+      const int* augmentation, Blob<Dtype>* transformed_blob);
+
   /**
    * @brief Applies the transformation defined in the data layer's
    * transform_param block to a vector of Datum.
@@ -98,6 +140,14 @@ class DataTransformer {
    *    Datum containing the data to be transformed.
    */
   vector<int> InferBlobShape(const Datum& datum);
+  /**
+   * @brief Infers the shape of transformed_blob will have when
+   *    the transformation is applied to the data.
+   *
+   * @param record
+   *    TensorRecord pointing at the data to be transformed.
+   */
+  vector<int> InferBlobShape(const TensorRecord& record);
   /**
    * @brief Infers the shape of transformed_blob will have when
    *    the transformation is applied to the data.
@@ -139,6 +189,18 @@ class DataTransformer {
   virtual int Rand(int n);
 
   void Transform(const Datum& datum, Dtype* transformed_data);
+  /// @brief Transforms the channels x height x width values at data, uint8
+  ///        pixels or floats, into transformed_data.
+  template <typename T>
+  void Transform(const T* data, int channels, int height, int width,
+      Dtype* transformed_data);
+  /// @brief Checks the mean against an image of the given size and gives
+  ///        mean_values_ a value per channel.
+  void PrepareMean(int channels, int height, int width);
+  /// @brief Checks that transformed_blob holds the transformed data of an
+  ///        image of the given size.
+  void CheckTransformedShape(int channels, int height, int width,
+      const Blob<Dtype>& transformed_blob);
   // Tranformation parameters
   TransformationParameter param_;
 
@@ -147,6 +209,8 @@ class DataTransformer {
   Phase phase_;
   Blob<Dtype> data_mean_;
   vector<Dtype> mean_values_;
+  // mean_values_ for TransformRaw_gpu.
+  Blob<Dtype> mean_values_blob_;
 };
 
 }  // namespace caffe
@@ -164,9 +164,11 @@ class Layer {
   const LayerParameter& layer_param() const { return layer_param_; }
 
   /**
-   * @brief Writes the layer parameter to a protocol buffer
+   * @brief Writes the layer parameter to a protocol buffer, with the values
+   *        of the blobs in storage
    */
-  virtual void ToProto(LayerParameter* param, bool write_diff = false);
+  virtual void ToProto(LayerParameter* param, bool write_diff = false,
+      BlobStorage storage = NATIVE);
 
   /**
    * @brief Returns the scalar loss associated with a top blob at a given index.
@@ -269,6 +271,15 @@ class Layer {
     return true;
   }
 
+  /**
+   * @brief Return whether Forward can run again on the same bottom blobs,
+   *        giving the same top blobs without side effects.
+   *
+   * Nets with checkpoint layers recompute the tops of such layers during
+   * Backward instead of keeping them (see NetParameter.checkpoint_layer).
+   */
+  virtual inline bool AllowRecompute() const { return true; }
+
   /**
    * @brief Specifies whether the layer should compute gradients w.r.t. a
    *        parameter at a particular index given by param_id.
@@ -463,12 +474,13 @@ inline void Layer<Dtype>::Backward(const vector<Blob<Dtype>*>& top,
 
 // Serialize LayerParameter to protocol buffer
 template <typename Dtype>
-void Layer<Dtype>::ToProto(LayerParameter* param, bool write_diff) {
+void Layer<Dtype>::ToProto(LayerParameter* param, bool write_diff,
+    BlobStorage storage) {
   param->Clear();
   param->CopyFrom(layer_param_);
   param->clear_blobs();
   for (int i = 0; i < blobs_.size(); ++i) {
-    blobs_[i]->ToProto(param->add_blobs(), write_diff);
+    blobs_[i]->ToProto(param->add_blobs(), write_diff, storage);
   }
 }
 
@@ -1,12 +1,17 @@
 #ifndef CAFFE_BASE_CONVOLUTION_LAYER_HPP_
 #define CAFFE_BASE_CONVOLUTION_LAYER_HPP_
 
+#include <boost/function.hpp>
+#include <algorithm>
 #include <vector>
 
 #include "caffe/blob.hpp"
 #include "caffe/layer.hpp"
 #include "caffe/proto/caffe.pb.h"
+#include "caffe/util/activation.hpp"
 #include "caffe/util/im2col.hpp"
+#include "caffe/util/int8_gemm.hpp"
+#include "caffe/util/packed_gemm.hpp"
 
 namespace caffe {
 
@@ -18,7 +23,8 @@ template <typename Dtype>
 class BaseConvolutionLayer : public Layer<Dtype> {
  public:
   explicit BaseConvolutionLayer(const LayerParameter& param)
-      : Layer<Dtype>(param) {}
+      : Layer<Dtype>(param), cpu_batch_threads_(1),
+        packed_weights_source_(NULL) {}
   virtual void LayerSetUp(const vector<Blob<Dtype>*>& bottom,
       const vector<Blob<Dtype>*>& top);
   virtual void Reshape(const vector<Blob<Dtype>*>& bottom,
@@ -30,17 +36,66 @@ class BaseConvolutionLayer : public Layer<Dtype> {
 
  protected:
   // Helper functions that abstract away the column buffer and gemm arguments.
-  // The last argument in forward_cpu_gemm is so that we can skip the im2col if
-  // we just called weight_cpu_gemm with the same input.
+  // The skip_im2col argument in forward_cpu_gemm is so that we can skip the
+  // im2col if we just called weight_cpu_gemm with the same input. col_buff
+  // replaces the layer's column buffer, see cpu_col_buffer.
   void forward_cpu_gemm(const Dtype* input, const Dtype* weights,
-      Dtype* output, bool skip_im2col = false);
+      Dtype* output, bool skip_im2col = false, Dtype* col_buff = NULL);
   void forward_cpu_bias(Dtype* output, const Dtype* bias);
+  /**
+   * @brief Packs the weights, at TEST with the builtin BLAS backend, for the
+   *        forward_cpu_gemm calls that follow, or quantizes them for
+   *        forward_cpu_int8. Call before cpu_batch.
+   *
+   * The weights are packed again only when their data changed.
+   */
+  void pack_cpu_weights();
+  /// @brief Whether the CPU forward pass runs in 8 bits: INT8 at TEST.
+  inline bool int8_forward() const {
+    return this->phase_ == TEST &&
+        quantization_.precision() == QuantizationParameter_Precision_INT8;
+  }
+  /**
+   * @brief The output of one image, bias included, from 8-bit products of
+   *        the weights quantized by pack_cpu_weights.
+   */
+  void forward_cpu_int8(const Dtype* input, const Dtype* bias, Dtype* output,
+      Dtype* col_buff = NULL);
   void backward_cpu_gemm(const Dtype* input, const Dtype* weights,
-      Dtype* output);
+      Dtype* output, Dtype* col_buff = NULL);
   void weight_cpu_gemm(const Dtype* input, const Dtype* output, Dtype*
-      weights);
+      weights, Dtype* col_buff = NULL);
   void backward_cpu_bias(Dtype* bias, const Dtype* input);
 
+  /**
+   * @brief Splits the CPU loop over the num_ images of the batch across
+   *        Caffe::cpu_threads() threads and returns when it is done.
+   *
+   * fn(thread) handles the images in cpu_batch_range(thread), with
+   * cpu_col_buffer(thread) as column buffer. When weight_diff is given, fn
+   * accumulates the weight gradient of its images into
+   * cpu_weight_diff(thread, weight_diff); those of the other threads start
+   * from zero and are added to weight_diff in thread order at the end, so the
+   * result does not depend on scheduling. Engines that do not use im2col
+   * pass col_buffers false to leave the column buffers unallocated.
+   */
+  void cpu_batch(const boost::function<void(int)>& fn,
+      Dtype* weight_diff = NULL, bool col_buffers = true);
+  /// @brief The number of threads the next cpu_batch runs on.
+  inline int cpu_batch_threads() const {
+    return std::max(std::min(Caffe::cpu_threads(), num_), 1);
+  }
+  void cpu_batch_range(int thread, int* begin, int* end) const {
+    *begin = num_ * thread / cpu_batch_threads_;
+    *end = num_ * (thread + 1) / cpu_batch_threads_;
+  }
+  inline Dtype* cpu_col_buffer(int thread) {
+    return cpu_col_buffers_[thread];
+  }
+  inline Dtype* cpu_weight_diff(int thread, Dtype* weight_diff) {
+    return thread == 0 ? weight_diff : cpu_weight_diffs_[thread];
+  }
+
 #ifndef CPU_ONLY
   void forward_gpu_gemm(const Dtype* col_input, const Dtype* weights,
       Dtype* output, bool skip_im2col = false);
@@ -92,6 +147,10 @@ class BaseConvolutionLayer : public Layer<Dtype> {
   bool bias_term_;
   bool is_1x1_;
   bool force_nd_im2col_;
+  /// @brief The activation fused into the layer, applied after the bias.
+  ActivationParameter activation_;
+  /// @brief The arithmetic of the forward pass on the CPU at TEST.
+  QuantizationParameter quantization_;
 
  private:
   // wrap im2col/col2im so we don't have to remember the (long) argument lists
@@ -103,6 +162,15 @@ class BaseConvolutionLayer : public Layer<Dtype> {
           pad_.cpu_data()[0], pad_.cpu_data()[1],
           stride_.cpu_data()[0], stride_.cpu_data()[1],
           dilation_.cpu_data()[0], dilation_.cpu_data()[1], col_buff);
+    } else if (!force_nd_im2col_ && num_spatial_axes_ == 3) {
+      im2col_3d_cpu(data, conv_in_channels_,
+          conv_input_shape_.cpu_data()[1], conv_input_shape_.cpu_data()[2],
+          conv_input_shape_.cpu_data()[3], kernel_shape_.cpu_data()[0],
+          kernel_shape_.cpu_data()[1], kernel_shape_.cpu_data()[2],
+          pad_.cpu_data()[0], pad_.cpu_data()[1], pad_.cpu_data()[2],
+          stride_.cpu_data()[0], stride_.cpu_data()[1], stride_.cpu_data()[2],
+          dilation_.cpu_data()[0], dilation_.cpu_data()[1],
+          dilation_.cpu_data()[2], col_buff);
     } else {
       im2col_nd_cpu(data, num_spatial_axes_, conv_input_shape_.cpu_data(),
           col_buffer_shape_.data(), kernel_shape_.cpu_data(),
@@ -117,6 +185,15 @@ class BaseConvolutionLayer : public Layer<Dtype> {
           pad_.cpu_data()[0], pad_.cpu_data()[1],
           stride_.cpu_data()[0], stride_.cpu_data()[1],
           dilation_.cpu_data()[0], dilation_.cpu_data()[1], data);
+    } else if (!force_nd_im2col_ && num_spatial_axes_ == 3) {
+      col2im_3d_cpu(col_buff, conv_in_channels_,
+          conv_input_shape_.cpu_data()[1], conv_input_shape_.cpu_data()[2],
+          conv_input_shape_.cpu_data()[3], kernel_shape_.cpu_data()[0],
+          kernel_shape_.cpu_data()[1], kernel_shape_.cpu_data()[2],
+          pad_.cpu_data()[0], pad_.cpu_data()[1], pad_.cpu_data()[2],
+          stride_.cpu_data()[0], stride_.cpu_data()[1], stride_.cpu_data()[2],
+          dilation_.cpu_data()[0], dilation_.cpu_data()[1],
+          dilation_.cpu_data()[2], data);
     } else {
       col2im_nd_cpu(col_buff, num_spatial_axes_, conv_input_shape_.cpu_data(),
           col_buffer_shape_.data(), kernel_shape_.cpu_data(),
@@ -132,6 +209,15 @@ class BaseConvolutionLayer : public Layer<Dtype> {
           pad_.cpu_data()[0], pad_.cpu_data()[1],
           stride_.cpu_data()[0], stride_.cpu_data()[1],
           dilation_.cpu_data()[0], dilation_.cpu_data()[1], col_buff);
+    } else if (!force_nd_im2col_ && num_spatial_axes_ == 3) {
+      im2col_3d_gpu(data, conv_in_channels_,
+          conv_input_shape_.cpu_data()[1], conv_input_shape_.cpu_data()[2],
+          conv_input_shape_.cpu_data()[3], kernel_shape_.cpu_data()[0],
+          kernel_shape_.cpu_data()[1], kernel_shape_.cpu_data()[2],
+          pad_.cpu_data()[0], pad_.cpu_data()[1], pad_.cpu_data()[2],
+          stride_.cpu_data()[0], stride_.cpu_data()[1], stride_.cpu_data()[2],
+          dilation_.cpu_data()[0], dilation_.cpu_data()[1],
+          dilation_.cpu_data()[2], col_buff);
     } else {
       im2col_nd_gpu(data, num_spatial_axes_, num_kernels_im2col_,
           conv_input_shape_.gpu_data(), col_buffer_.gpu_shape(),
@@ -147,6 +233,15 @@ class BaseConvolutionLayer : public Layer<Dtype> {
           pad_.cpu_data()[0], pad_.cpu_data()[1],
           stride_.cpu_data()[0], stride_.cpu_data()[1],
           dilation_.cpu_data()[0], dilation_.cpu_data()[1], data);
+    } else if (!force_nd_im2col_ && num_spatial_axes_ == 3) {
+      col2im_3d_gpu(col_buff, conv_in_channels_,
+          conv_input_shape_.cpu_data()[1], conv_input_shape_.cpu_data()[2],
+          conv_input_shape_.cpu_data()[3], kernel_shape_.cpu_data()[0],
+          kernel_shape_.cpu_data()[1], kernel_shape_.cpu_data()[2],
+          pad_.cpu_data()[0], pad_.cpu_data()[1], pad_.cpu_data()[2],
+          stride_.cpu_data()[0], stride_.cpu_data()[1], stride_.cpu_data()[2],
+          dilation_.cpu_data()[0], dilation_.cpu_data()[1],
+          dilation_.cpu_data()[2], data);
     } else {
       col2im_nd_gpu(col_buff, num_spatial_axes_, num_kernels_col2im_,
           conv_input_shape_.gpu_data(), col_buffer_.gpu_shape(),
@@ -167,6 +262,21 @@ class BaseConvolutionLayer : public Layer<Dtype> {
 
   Blob<Dtype> col_buffer_;
   Blob<Dtype> bias_multiplier_;
+
+  // State of cpu_batch: the column buffers and weight diffs of the threads
+  // after the first, which uses col_buffer_ and the weight diff itself.
+  int cpu_batch_threads_;
+  Blob<Dtype> thread_col_buffers_;
+  Blob<Dtype> thread_weight_diffs_;
+  vector<Dtype*> cpu_col_buffers_;
+  vector<Dtype*> cpu_weight_diffs_;
+
+  // The weights of each group packed by pack_cpu_weights, and the unpacked
+  // weights they stand for in forward_cpu_gemm, NULL when not packed.
+  vector<shared_ptr<PackedMatrix<Dtype> > > packed_weights_;
+  const Dtype* packed_weights_source_;
+  // The weights of each group quantized by pack_cpu_weights.
+  vector<shared_ptr<Int8Matrix<Dtype> > > int8_weights_;
 };
 
 }  // namespace caffe
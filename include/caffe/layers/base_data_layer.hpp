@@ -9,6 +9,7 @@
 #include "caffe/layer.hpp"
 #include "caffe/proto/caffe.pb.h"
 #include "caffe/util/blocking_queue.hpp"
+#include "caffe/util/math_functions.hpp"
 
 namespace caffe {
 
@@ -46,7 +47,69 @@ class BaseDataLayer : public Layer<Dtype> {
 template <typename Dtype>
 class Batch {
  public:
+  Batch() : label_bits_(0) {}
+
   Blob<Dtype> data_, label_;
+  // Outputs beyond data and label, for layers with more than two tops.
+  vector<shared_ptr<Blob<Dtype> > > extra_;
+  // Bits per element (1 or 8) of the label if it is kept packed in
+  // packed_label_, see DataParameter.packed_label_bits; 0 if it is in label_.
+  // When packed, label_ only carries the shape and the label top is expanded
+  // from packed_label_ when forwarded.
+  int label_bits_;
+  shared_ptr<SyncedMemory> packed_label_;
+  // The uint8 pixels of the items, of shape raw_shape_, and the crop and
+  // mirror drawn for each (see DataTransformer::DrawAugmentation) if the
+  // layer defers its transformation, see DataParameter.defer_transform.
+  // data_ then only carries the shape and the data top is transformed from
+  // raw_data_ when forwarded.
+  vector<int> raw_shape_;
+  shared_ptr<SyncedMemory> raw_data_;
+  shared_ptr<SyncedMemory> augmentation_;
+
+  // The blob backing top i: data, label, then the extra blobs in order.
+  inline Blob<Dtype>* blob(int i) {
+    return i == 0 ? &data_ : (i == 1 ? &label_ : extra_[i - 2].get());
+  }
+
+  // Sizes packed_label_ for the shape of label_ and returns its CPU data.
+  inline uint8_t* mutable_packed_label() {
+    const size_t size = (static_cast<size_t>(label_.count()) * label_bits_ + 7)
+        / 8;
+    if (!packed_label_ || packed_label_->size() != size) {
+      packed_label_.reset(new SyncedMemory(size));
+    }
+    return static_cast<uint8_t*>(packed_label_->mutable_cpu_data());
+  }
+
+  // Sizes raw_data_ and augmentation_ for raw_shape_ and returns their CPU
+  // data.
+  inline uint8_t* mutable_raw_data() {
+    size_t size = raw_shape_.empty() ? 0 : 1;
+    for (int i = 0; i < raw_shape_.size(); ++i) {
+      size *= raw_shape_[i];
+    }
+    if (!raw_data_ || raw_data_->size() != size) {
+      raw_data_.reset(new SyncedMemory(size));
+    }
+    return static_cast<uint8_t*>(raw_data_->mutable_cpu_data());
+  }
+  inline int* mutable_augmentation() {
+    const size_t size = (raw_shape_.empty() ? 0 : raw_shape_[0]) * 3 *
+        sizeof(int);
+    if (!augmentation_ || augmentation_->size() != size) {
+      augmentation_.reset(new SyncedMemory(size));
+    }
+    return static_cast<int*>(augmentation_->mutable_cpu_data());
+  }
+
+  // Packs the label of item n, label_.count(1) values, into packed_label_.
+  inline void PackLabel(int n, const Dtype* values) {
+    const int dim = label_.count(1);
+    const size_t offset = static_cast<size_t>(n) * dim * label_bits_ / 8;
+    caffe_pack_occupancy(dim, label_bits_, values,
+        mutable_packed_label() + offset);
+  }
 };
 
 template <typename Dtype>
@@ -65,14 +128,33 @@ class BasePrefetchingDataLayer :
   virtual void Forward_gpu(const vector<Blob<Dtype>*>& bottom,
       const vector<Blob<Dtype>*>& top);
 
+  /// @brief Has the next batch forwarded be the one after the first batches
+  ///        since setup, as when resuming a snapshot taken after them; only
+  ///        for resumable layers.
+  void Resume(uint64_t batches);
+  /// @brief Whether the layer reads its items in an order that Resume can
+  ///        restore, e.g. a shuffled Data layer.
+  virtual inline bool resumable() const { return false; }
+
  protected:
   virtual void InternalThreadEntry();
   virtual void load_batch(Batch<Dtype>* batch) = 0;
+  /// @brief Sets the source back to the first batches batches since setup,
+  ///        the prefetch thread being stopped, see Resume.
+  virtual void SeekBatches(uint64_t batches) { NOT_IMPLEMENTED; }
+  /// @brief Whether this solver skips the record at offset of a database
+  ///        read in order: solvers take every solver_count-th record from
+  ///        their rank, except in test mode where only rank 0 runs.
+  bool Skip(uint64_t offset) const;
 
   vector<shared_ptr<Batch<Dtype> > > prefetch_;
   BlockingQueue<Batch<Dtype>*> prefetch_free_;
   BlockingQueue<Batch<Dtype>*> prefetch_full_;
   Batch<Dtype>* prefetch_current_;
+  // Set by layers that pack their label, see Batch::label_bits_.
+  int packed_label_bits_;
+  // Set by layers that prefetch raw pixels, see Batch::raw_data_.
+  bool defer_transform_;
 
   Blob<Dtype> transformed_data_;
 };
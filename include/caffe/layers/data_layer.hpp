@@ -1,6 +1,8 @@
 #ifndef CAFFE_DATA_LAYER_HPP_
 #define CAFFE_DATA_LAYER_HPP_
 
+#include <string>
+#include <utility>
 #include <vector>
 
 #include "caffe/blob.hpp"
@@ -10,6 +12,8 @@
 #include "caffe/layers/base_data_layer.hpp"
 #include "caffe/proto/caffe.pb.h"
 #include "caffe/util/db.hpp"
+#include "caffe/util/db_sampler.hpp"
+#include "caffe/util/thread_pool.hpp"
 
 namespace caffe {
 
@@ -24,15 +28,45 @@ class DataLayer : public BasePrefetchingDataLayer<Dtype> {
   virtual inline int ExactNumBottomBlobs() const { return 0; }
   virtual inline int MinTopBlobs() const { return 1; }
   virtual inline int MaxTopBlobs() const { return 2; }
+  /// Only with DataParameter.shuffle.
+  virtual inline bool resumable() const { return sampler_.get() != NULL; }
 
  protected:
   void Next();
-  bool Skip();
   virtual void load_batch(Batch<Dtype>* batch);
+  virtual void SeekBatches(uint64_t batches);
+  /// @brief Parses and transforms the items of the batch being loaded that
+  ///        decode worker worker fills: every num_workers-th from worker.
+  void DecodeItems(int worker);
+  /// @brief Infers the shape of a transformed item from the value at data,
+  ///        and that of its pixels into raw_shape if defer_transform.
+  vector<int> InferItemShape(const char* data, size_t size,
+      vector<int>* raw_shape);
 
   shared_ptr<db::DB> db_;
   shared_ptr<db::Cursor> cursor_;
   uint64_t offset_;
+  /// With shuffle, the keys of the database and the sampler of their
+  /// indices.
+  vector<string> keys_;
+  shared_ptr<db::ShardedSampler> sampler_;
+  /// The decode workers, see DataParameter.decode_threads: their threads
+  /// (NULL for one worker), and the transformer and the item view of each.
+  shared_ptr<ThreadPool> decode_pool_;
+  vector<shared_ptr<DataTransformer<Dtype> > > transformers_;
+  vector<shared_ptr<Blob<Dtype> > > transformed_items_;
+  /// The values of the batch being loaded, as views into the database where
+  /// they stay in place (see db::Cursor::value_view) or else into copies,
+  /// and where its data and labels go.
+  vector<std::pair<const char*, size_t> > views_;
+  vector<string> values_;
+  Dtype* batch_data_;
+  Dtype* batch_labels_;
+  /// Where the pixels and augmentations go instead with defer_transform,
+  /// and the shape of the pixels.
+  uint8_t* batch_raw_data_;
+  int* batch_augmentation_;
+  vector<int> raw_shape_;
 };
 
 }  // namespace caffe
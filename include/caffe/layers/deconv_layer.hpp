@@ -42,6 +42,12 @@ class DeconvolutionLayer : public BaseConvolutionLayer<Dtype> {
       const vector<bool>& propagate_down, const vector<Blob<Dtype>*>& bottom);
   virtual void Backward_gpu(const vector<Blob<Dtype>*>& top,
       const vector<bool>& propagate_down, const vector<Blob<Dtype>*>& bottom);
+  // The share of one thread of cpu_batch in Forward_cpu and Backward_cpu.
+  void forward_cpu_images(const Dtype* bottom_data, const Dtype* weight,
+      const Dtype* bias, Dtype* top_data, int thread);
+  void backward_cpu_images(const Dtype* top_diff, const Dtype* bottom_data,
+      const Dtype* weight, Dtype* weight_diff, Dtype* bottom_diff,
+      int thread);
   virtual inline bool reverse_dimensions() { return true; }
   virtual void compute_output_shape();
 };
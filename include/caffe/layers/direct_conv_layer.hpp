@@ -0,0 +1,52 @@
+#ifndef CAFFE_DIRECT_CONV_LAYER_HPP_
+#define CAFFE_DIRECT_CONV_LAYER_HPP_
+
+#include <vector>
+
+#include "caffe/blob.hpp"
+#include "caffe/layer.hpp"
+#include "caffe/proto/caffe.pb.h"
+
+#include "caffe/layers/conv_layer.hpp"
+
+namespace caffe {
+
+/**
+ * @brief Direct implementation of the CPU forward pass of ConvolutionLayer
+ *        (engine: DIRECT).
+ *
+ * 2D and 3D convolutions are computed from a zero padded copy of the input,
+ * in register tiles of output channels by output columns, instead of from the
+ * kernel size times larger column buffer of im2col. This is fastest for
+ * grouped and depthwise convolutions, whose GEMMs are too small for BLAS, and
+ * otherwise trades some speed for memory, which matters most for volumes.
+ * 1x1 convolutions, which need no im2col, other N-D convolutions, the
+ * backward pass and the GPU fall back to ConvolutionLayer.
+ */
+template <typename Dtype>
+class DirectConvolutionLayer : public ConvolutionLayer<Dtype> {
+ public:
+  explicit DirectConvolutionLayer(const LayerParameter& param)
+      : ConvolutionLayer<Dtype>(param) {}
+  virtual void LayerSetUp(const vector<Blob<Dtype>*>& bottom,
+      const vector<Blob<Dtype>*>& top);
+  virtual void Reshape(const vector<Blob<Dtype>*>& bottom,
+      const vector<Blob<Dtype>*>& top);
+
+ protected:
+  virtual void Forward_cpu(const vector<Blob<Dtype>*>& bottom,
+      const vector<Blob<Dtype>*>& top);
+  // The share of one thread of cpu_batch in Forward_cpu.
+  void direct_cpu_images(const Dtype* bottom_data, const Dtype* weight,
+      const Dtype* bias, Dtype* buffer, Dtype* top_data, int thread);
+  void direct_3d_cpu_images(const Dtype* bottom_data, const Dtype* weight,
+      const Dtype* bias, Dtype* buffer, Dtype* top_data, int thread);
+
+  bool supported_;
+  int buffer_size_;
+  Blob<Dtype> buffer_;
+};
+
+}  // namespace caffe
+
+#endif  // CAFFE_DIRECT_CONV_LAYER_HPP_
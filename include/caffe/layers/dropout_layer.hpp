@@ -39,6 +39,10 @@ class DropoutLayer : public NeuronLayer<Dtype> {
       const vector<Blob<Dtype>*>& top);
 
   virtual inline const char* type() const { return "Dropout"; }
+  /// A new mask is drawn at each training Forward.
+  virtual inline bool AllowRecompute() const {
+    return this->phase_ != TRAIN;
+  }
 
  protected:
   /**
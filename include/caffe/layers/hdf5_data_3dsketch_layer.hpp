@@ -12,52 +12,68 @@
 #include "caffe/proto/caffe.pb.h"
 
 #include "caffe/layers/base_data_layer.hpp"
+#include "caffe/util/hdf5_prefetcher.hpp"
+#include "caffe/util/hdf5_row_cache.hpp"
 #include  <ctime>
 #include  <random>
 
 namespace caffe {
 
 /**
- * @brief Provides data to the Net from HDF5 files.
+ * @brief Provides data to the Net from HDF5 files, aggregating a random number
+ *        of extra views into the first (3D sketch) top.
+ *
+ * Loading and view aggregation run on the prefetch thread; the number of
+ * batches in flight is set by data_param.prefetch.
  *
  * TODO(dox): thorough documentation for Forward and proto params.
  */
 template <typename Dtype>
-class HDF5Data3DSketchLayer : public Layer<Dtype> {
+class HDF5Data3DSketchLayer : public BasePrefetchingDataLayer<Dtype> {
  public:
   explicit HDF5Data3DSketchLayer(const LayerParameter& param)
-	  : Layer<Dtype>(param),  generator_(time(NULL)), distribution_2nd_view(0,12) , distribution_n_views(1,param.hdf5_data_3dsketch_param().nviews()){}
+	  : BasePrefetchingDataLayer<Dtype>(param),  generator_(time(NULL)), distribution_n_views(1,param.hdf5_data_3dsketch_param().nviews()){}
   virtual ~HDF5Data3DSketchLayer();
-  virtual void LayerSetUp(const vector<Blob<Dtype>*>& bottom,
+  virtual void DataLayerSetUp(const vector<Blob<Dtype>*>& bottom,
       const vector<Blob<Dtype>*>& top);
-  // Data layers should be shared by multiple solvers in parallel
-  virtual inline bool ShareInParallel() const { return true; }
-  // Data layers have no bottoms, so reshaping is trivial.
-  virtual void Reshape(const vector<Blob<Dtype>*>& bottom,
-      const vector<Blob<Dtype>*>& top) {}
 
   virtual inline const char* type() const { return "HDF5Data3DSketch"; }
   virtual inline int ExactNumBottomBlobs() const { return 0; }
   virtual inline int MinTopBlobs() const { return 1; }
 
  protected:
-  virtual void Forward_cpu(const vector<Blob<Dtype>*>& bottom,
-      const vector<Blob<Dtype>*>& top);
-  virtual void Backward_cpu(const vector<Blob<Dtype>*>& top,
-      const vector<bool>& propagate_down, const vector<Blob<Dtype>*>& bottom) {}
+  virtual void load_batch(Batch<Dtype>* batch);
   virtual void LoadHDF5FileData(const char* filename);
+  vector<string> DatasetNames() const;
+  vector<int> DatasetShape(int d) const;
+  void CopyRow(int d, int row, Dtype* data);
+  const Dtype* RowData(int d, int row, Dtype* buffer);
+  void ReadHDF5File(const string& filename,
+      vector<shared_ptr<Blob<Dtype> > >* blobs);
+  void PrefetchNextFile();
 
   std::vector<std::string> hdf_filenames_;
   unsigned int num_files_;
   unsigned int current_file_;
   hsize_t current_row_;
-  std::vector<shared_ptr<Blob<Dtype> > > hdf_blobs_;
+  // Datasets of the current file, when it is loaded whole.
+  std::vector<shared_ptr<Blob<Dtype> > > file_blobs_;
+  // Reads rows of the current file on demand, when streaming.
+  shared_ptr<HDF5RowCache<Dtype> > row_cache_;
   std::vector<unsigned int> data_permutation_;
   std::vector<unsigned int> file_permutation_;
+  shared_ptr<HDF5FilePrefetcher<Dtype> > file_prefetcher_;
+  // Label row of one item, before it is packed into the batch.
+  std::vector<Dtype> label_buffer_;
 
-	shared_ptr<Blob<Dtype> > data_update_;
+	// Number of update views of an object in sketch3D_update.
+	static const int kNumUpdateViews = 13;
+	// Views aggregated into a sample, and the rows read for them when
+	// streaming.
+	std::vector<const Dtype*> views_;
+	std::vector<Dtype> view_buffer_;
+	std::vector<int> candidate_views_;
 	std::default_random_engine generator_;
-	std::uniform_int_distribution<int> distribution_2nd_view;
 	std::uniform_int_distribution<int> distribution_n_views;
 };
 
@@ -11,6 +11,7 @@
 #include "caffe/proto/caffe.pb.h"
 
 #include "caffe/layers/base_data_layer.hpp"
+#include "caffe/util/hdf5_prefetcher.hpp"
 
 namespace caffe {
 
@@ -48,6 +49,9 @@ class HDF5DataLayer : public Layer<Dtype> {
   virtual void Backward_gpu(const vector<Blob<Dtype>*>& top,
       const vector<bool>& propagate_down, const vector<Blob<Dtype>*>& bottom) {}
   virtual void LoadHDF5FileData(const char* filename);
+  void ReadHDF5File(const string& filename,
+      vector<shared_ptr<Blob<Dtype> > >* blobs);
+  void PrefetchNextFile();
 
   std::vector<std::string> hdf_filenames_;
   unsigned int num_files_;
@@ -57,6 +61,7 @@ class HDF5DataLayer : public Layer<Dtype> {
   std::vector<unsigned int> data_permutation_;
   std::vector<unsigned int> file_permutation_;
   uint64_t offset_;
+  shared_ptr<HDF5FilePrefetcher<Dtype> > file_prefetcher_;
 };
 
 }  // namespace caffe
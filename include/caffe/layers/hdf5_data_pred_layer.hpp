@@ -12,57 +12,96 @@
 #include "caffe/proto/caffe.pb.h"
 
 #include "caffe/layers/base_data_layer.hpp"
+#include "caffe/util/hdf5_prefetcher.hpp"
+#include "caffe/util/hdf5_row_cache.hpp"
+#include "caffe/util/prediction.hpp"
+#include "caffe/util/thread_pool.hpp"
 #include  <ctime>
 #include  <random>
 
 namespace caffe {
 
 /**
- * @brief Provides data to the Net from HDF5 files.
+ * @brief Provides data to the Net from HDF5 files, replacing a random part of
+ *        the ground truth voxels by the rotated prediction of another view.
+ *
+ * Loading, prediction and rotation run on the prefetch thread; the number of
+ * batches in flight is set by data_param.prefetch.
  *
  * TODO(dox): thorough documentation for Forward and proto params.
  */
 template <typename Dtype>
-class HDF5DataPredLayer : public Layer<Dtype> {
+class HDF5DataPredLayer : public BasePrefetchingDataLayer<Dtype> {
  public:
   explicit HDF5DataPredLayer(const LayerParameter& param)
-    : Layer<Dtype>(param), pred_net_(param.hdf5_data_pred_param().deploy_file(), caffe::TEST), generator_(time(NULL)), distribution_2nd_view(0,7) , distribution_gt(0,1){}
+    : BasePrefetchingDataLayer<Dtype>(param), pred_net_(param.hdf5_data_pred_param().deploy_file(), caffe::TEST), generator_(time(NULL)), distribution_2nd_view(0,7) , distribution_gt(0,1){}
   virtual ~HDF5DataPredLayer();
-  virtual void LayerSetUp(const vector<Blob<Dtype>*>& bottom,
+  virtual void DataLayerSetUp(const vector<Blob<Dtype>*>& bottom,
       const vector<Blob<Dtype>*>& top);
-  // Data layers should be shared by multiple solvers in parallel
-  virtual inline bool ShareInParallel() const { return true; }
-  // Data layers have no bottoms, so reshaping is trivial.
-  virtual void Reshape(const vector<Blob<Dtype>*>& bottom,
-      const vector<Blob<Dtype>*>& top) {}
 
   virtual inline const char* type() const { return "HDF5DataPred"; }
   virtual inline int ExactNumBottomBlobs() const { return 0; }
   virtual inline int MinTopBlobs() const { return 1; }
 
  protected:
-  virtual void Forward_cpu(const vector<Blob<Dtype>*>& bottom,
-      const vector<Blob<Dtype>*>& top);
-  virtual void Backward_cpu(const vector<Blob<Dtype>*>& top,
-      const vector<bool>& propagate_down, const vector<Blob<Dtype>*>& bottom) {}
+  virtual void load_batch(Batch<Dtype>* batch);
   virtual void LoadHDF5FileData(const char* filename);
+  // Datasets read from each file besides the tops, following them in the
+  // order of DatasetNames().
+  enum { VIEWPOINT, VIEW_MAT, PROJ_MAT, DATA_SINGLE, VIEW_MAT_SINGLE };
+  vector<string> DatasetNames() const;
+  inline int ExtraDataset(int e) const {
+    return this->layer_param_.top_size() - 1 + e;
+  }
+  vector<int> DatasetShape(int d) const;
+  void CopyRow(int d, int row, Dtype* data);
+  void ReadHDF5File(const string& filename,
+      vector<shared_ptr<Blob<Dtype> > >* blobs);
+  void PrefetchNextFile();
+  // Runs the prediction net once over all pending items and rotates the
+  // predictions into the last top blob.
+  void ForwardPredictions(Blob<Dtype>* top);
+  void RotateTask(int task);
+  void RotateOnGPU(const Blob<Dtype>* pred, Blob<Dtype>* top);
 
   std::vector<std::string> hdf_filenames_;
   unsigned int num_files_;
   unsigned int current_file_;
   hsize_t current_row_;
-  std::vector<shared_ptr<Blob<Dtype> > > hdf_blobs_;
+  // Datasets of the current file, when it is loaded whole.
+  std::vector<shared_ptr<Blob<Dtype> > > file_blobs_;
+  // Reads rows of the current file on demand, when streaming.
+  shared_ptr<HDF5RowCache<Dtype> > row_cache_;
   std::vector<unsigned int> data_permutation_;
   std::vector<unsigned int> file_permutation_;
+  shared_ptr<HDF5FilePrefetcher<Dtype> > file_prefetcher_;
+  // Label row of one item, before it is packed into the batch.
+  std::vector<Dtype> label_buffer_;
   Net<Dtype> pred_net_;
-	shared_ptr<Blob<Dtype> > viewpoint_;
-	shared_ptr<Blob<Dtype> > view_mat_;
-	shared_ptr<Blob<Dtype> > proj_mat_;
-	shared_ptr<Blob<Dtype> > view_mat_single_;
-	shared_ptr<Blob<Dtype> > data_single_;
 	std::default_random_engine generator_;
 	std::uniform_int_distribution<int> distribution_2nd_view;
 	std::uniform_real_distribution<float> distribution_gt;
+
+  // Items of the current batch waiting for a prediction: position in the
+  // batch, rows of the first and second views, and row of the viewpoint
+  // matrix of the first view.
+  struct PendingItem {
+    int batch_index;
+    int idv1;
+    int idv2;
+    int model1_row;
+  };
+  std::vector<PendingItem> pending_;
+  shared_ptr<ThreadPool> pool_;
+  // Rotation tasks; task t handles z-chunk (t % rotation_chunks_) of item
+  // (t / rotation_chunks_).
+  std::vector<shared_ptr<VoxelRotation<Dtype> > > rotations_;
+  std::vector<const Dtype*> rotation_src_;
+  std::vector<Dtype*> rotation_dst_;
+  int rotation_chunks_;
+  // Parameters and destination items of the rotations, in GPU mode.
+  Blob<Dtype> rotation_params_;
+  Blob<int> rotation_items_;
 };
 
 }  // namespace caffe
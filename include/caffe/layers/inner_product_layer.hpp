@@ -6,6 +6,9 @@
 #include "caffe/blob.hpp"
 #include "caffe/layer.hpp"
 #include "caffe/proto/caffe.pb.h"
+#include "caffe/util/activation.hpp"
+#include "caffe/util/int8_gemm.hpp"
+#include "caffe/util/packed_gemm.hpp"
 
 namespace caffe {
 
@@ -45,6 +48,14 @@ class InnerProductLayer : public Layer<Dtype> {
   bool bias_term_;
   Blob<Dtype> bias_multiplier_;
   bool transpose_;  ///< if true, assume transposed weights
+  /// The activation fused into the layer, applied after the bias.
+  ActivationParameter activation_;
+  /// The weights packed for the builtin BLAS backend in the TEST phase.
+  PackedMatrix<Dtype> packed_weight_;
+  /// The arithmetic of the forward pass on the CPU in the TEST phase.
+  QuantizationParameter quantization_;
+  /// The weights quantized for an INT8 forward pass.
+  Int8Matrix<Dtype> int8_weight_;
 };
 
 }  // namespace caffe
@@ -12,6 +12,9 @@ namespace caffe {
 /**
  * @brief Pools the input image by taking the max, average, etc. within regions.
  *
+ * Bottoms of 5 axes are volumes (num, channels, depth, height, width), which
+ * are pooled in 3D with the MAX and AVE methods.
+ *
  * TODO(dox): thorough documentation for Forward, Backward, and proto params.
  */
 template <typename Dtype>
@@ -33,6 +36,11 @@ class PoolingLayer : public Layer<Dtype> {
     return (this->layer_param_.pooling_param().pool() ==
             PoolingParameter_PoolMethod_MAX) ? 2 : 1;
   }
+  /// Stochastic pooling samples new locations at each training Forward.
+  virtual inline bool AllowRecompute() const {
+    return this->phase_ != TRAIN || this->layer_param_.pooling_param().pool()
+        != PoolingParameter_PoolMethod_STOCHASTIC;
+  }
 
  protected:
   virtual void Forward_cpu(const vector<Blob<Dtype>*>& bottom,
@@ -43,13 +51,26 @@ class PoolingLayer : public Layer<Dtype> {
       const vector<bool>& propagate_down, const vector<Blob<Dtype>*>& bottom);
   virtual void Backward_gpu(const vector<Blob<Dtype>*>& top,
       const vector<bool>& propagate_down, const vector<Blob<Dtype>*>& bottom);
+  // The 3D passes of Forward_cpu and Backward_cpu, which work a row of
+  // outputs at a time so that the inner loops vectorize.
+  void Forward_3d_cpu(const vector<Blob<Dtype>*>& bottom,
+      const vector<Blob<Dtype>*>& top);
+  void Backward_3d_cpu(const vector<Blob<Dtype>*>& top,
+      const vector<Blob<Dtype>*>& bottom);
+#ifndef CPU_ONLY
+  void Forward_3d_gpu(const vector<Blob<Dtype>*>& bottom,
+      const vector<Blob<Dtype>*>& top);
+  void Backward_3d_gpu(const vector<Blob<Dtype>*>& top,
+      const vector<Blob<Dtype>*>& bottom);
+#endif
 
-  int kernel_h_, kernel_w_;
-  int stride_h_, stride_w_;
-  int pad_h_, pad_w_;
+  int num_spatial_axes_;
+  int kernel_d_, kernel_h_, kernel_w_;
+  int stride_d_, stride_h_, stride_w_;
+  int pad_d_, pad_h_, pad_w_;
   int channels_;
-  int height_, width_;
-  int pooled_height_, pooled_width_;
+  int depth_, height_, width_;
+  int pooled_depth_, pooled_height_, pooled_width_;
   bool global_pooling_;
   PoolingParameter_RoundMode round_mode_;
   Blob<Dtype> rand_idx_;
@@ -11,14 +11,19 @@
 #include "caffe/layer.hpp"
 #include "caffe/layers/base_data_layer.hpp"
 #include "caffe/proto/caffe.pb.h"
+#include "caffe/util/db.hpp"
+#include "caffe/util/db_sampler.hpp"
 #include "caffe/util/prediction.hpp"
+#include "caffe/util/thread_pool.hpp"
 
 #include <opencv2/core/core.hpp>
 
 namespace caffe {
 
 /**
- * @brief Provides data to the Net from voxels files.
+ * @brief Provides data to the Net from voxels files: a list of images holding
+ *        the sketch and the voxels atlas, or a database of VoxelDatum built
+ *        by tools/convert_voxels.
  *
  * TODO(dox): thorough documentation for Forward and proto params.
  */
@@ -26,7 +31,8 @@ template <typename Dtype>
 class VoxelsDataLayer : public BasePrefetchingDataLayer<Dtype> {
  public:
   explicit VoxelsDataLayer(const LayerParameter& param)
-      : BasePrefetchingDataLayer<Dtype>(param) {}
+      : BasePrefetchingDataLayer<Dtype>(param), offset_(), batch_data_(NULL),
+        batch_label_(NULL), batch_packed_label_(NULL) {}
   virtual ~VoxelsDataLayer();
   virtual void DataLayerSetUp(const vector<Blob<Dtype>*>& bottom,
       const vector<Blob<Dtype>*>& top);
@@ -34,15 +40,45 @@ class VoxelsDataLayer : public BasePrefetchingDataLayer<Dtype> {
   virtual inline const char* type() const { return "VoxelsData"; }
   virtual inline int ExactNumBottomBlobs() const { return 0; }
   virtual inline int ExactNumTopBlobs() const { return 2; }
+  /// Only VOXEL_DB sources with shuffle.
+  virtual inline bool resumable() const { return sampler_.get() != NULL; }
 
  protected:
   shared_ptr<Caffe::RNG> prefetch_rng_;
   virtual void ShuffleImages();
   virtual void load_batch(Batch<Dtype>* batch);
+  virtual void SeekBatches(uint64_t batches);
+  void DecodeItems(Batch<Dtype>* batch, int task);
+  void StoreVoxels(const VoxelDatum& datum, Batch<Dtype>* batch, int item_id,
+      vector<Dtype>* buffer);
+  void StoreVoxels(const Grid<Dtype>& vox, Batch<Dtype>* batch, int item_id,
+      vector<Dtype>* buffer);
+  void PackVoxels(Batch<Dtype>* batch, int item_id,
+      const vector<Dtype>& voxels);
+  vector<int> ReadImageListSetUp();
+  void NextRecord();
 	void UnpackVoxels(const cv::Mat & cv_img, cv::Mat & data, Grid<Dtype> &vox);
 
   vector<std::string>  lines_;
   int lines_id_;
+  // VoxelDatum database, when source_type is VOXEL_DB.
+  shared_ptr<db::DB> db_;
+  shared_ptr<db::Cursor> cursor_;
+  // The number of records gone through in order, and with shuffle, the keys
+  // of the database and the sampler of their indices.
+  uint64_t offset_;
+  vector<string> keys_;
+  shared_ptr<db::ShardedSampler> sampler_;
+  // Decode threads, and a transformer for each of their tasks.
+  shared_ptr<ThreadPool> pool_;
+  vector<shared_ptr<DataTransformer<Dtype> > > transformers_;
+  // Image names, or record keys and values, of the batch being loaded.
+  vector<string> batch_keys_;
+  vector<string> batch_values_;
+  // Memory of the batch being loaded, taken on the prefetch thread.
+  Dtype* batch_data_;
+  Dtype* batch_label_;
+  uint8_t* batch_packed_label_;
 };
 
 
@@ -0,0 +1,54 @@
+#ifndef CAFFE_WINOGRAD_CONV_LAYER_HPP_
+#define CAFFE_WINOGRAD_CONV_LAYER_HPP_
+
+#include <vector>
+
+#include "caffe/blob.hpp"
+#include "caffe/layer.hpp"
+#include "caffe/proto/caffe.pb.h"
+
+#include "caffe/layers/conv_layer.hpp"
+
+namespace caffe {
+
+/**
+ * @brief Winograd implementation of the CPU forward pass of
+ *        ConvolutionLayer (engine: WINOGRAD).
+ *
+ * 2D convolutions with 3x3 kernels, stride 1 and no dilation are computed with
+ * F(4x4, 3x3), or F(2x2, 3x3) for outputs under 8 pixels wide or high, which
+ * needs 4 (resp. 2.25) times fewer multiplications than im2col + GEMM and no
+ * column buffer. Other shapes, the backward pass and the GPU fall back to
+ * ConvolutionLayer.
+ */
+template <typename Dtype>
+class WinogradConvolutionLayer : public ConvolutionLayer<Dtype> {
+ public:
+  explicit WinogradConvolutionLayer(const LayerParameter& param)
+      : ConvolutionLayer<Dtype>(param), tile_(0) {}
+  virtual void LayerSetUp(const vector<Blob<Dtype>*>& bottom,
+      const vector<Blob<Dtype>*>& top);
+  virtual void Reshape(const vector<Blob<Dtype>*>& bottom,
+      const vector<Blob<Dtype>*>& top);
+
+  /// @brief The output tile size, or 0 when falling back to im2col.
+  inline int tile() const { return tile_; }
+
+ protected:
+  virtual void Forward_cpu(const vector<Blob<Dtype>*>& bottom,
+      const vector<Blob<Dtype>*>& top);
+  // The share of one thread of cpu_batch in Forward_cpu.
+  void winograd_cpu_images(const Dtype* bottom_data,
+      const Dtype* transformed_weights, const Dtype* bias, Dtype* buffer,
+      Dtype* top_data, int thread);
+
+  bool supported_;
+  int tile_;
+  int buffer_size_;
+  Blob<Dtype> transformed_weights_;
+  Blob<Dtype> buffer_;
+};
+
+}  // namespace caffe
+
+#endif  // CAFFE_WINOGRAD_CONV_LAYER_HPP_
@@ -1,6 +1,7 @@
 #ifndef CAFFE_NET_HPP_
 #define CAFFE_NET_HPP_
 
+#include <boost/weak_ptr.hpp>
 #include <map>
 #include <set>
 #include <string>
@@ -11,6 +12,8 @@
 #include "caffe/common.hpp"
 #include "caffe/layer.hpp"
 #include "caffe/proto/caffe.pb.h"
+#include "caffe/util/task_graph.hpp"
+#include "caffe/util/thread_pool.hpp"
 
 namespace caffe {
 
@@ -82,6 +85,42 @@ class Net {
    */
   void Reshape();
 
+  /**
+   * @brief Places the activations that are never live at the same time at
+   *        shared offsets of one arena, see NetParameter.plan_memory.
+   *
+   * Blobs sharing memory (in-place layers, Split, Reshape...) are planned as
+   * one buffer live from the first layer producing any of them to the last
+   * layer using any of them. Memory also held outside the net, or already
+   * written when the net is first planned (e.g. constant DummyData tops), is
+   * left alone. Called by Init and Reshape when plan_memory is set.
+   */
+  void PlanMemory();
+  /**
+   * @brief Places the activations only used within one segment between
+   *        checkpoint layers at offsets shared by all the segments, see
+   *        NetParameter.checkpoint_layer.
+   *
+   * The layers producing them are rerun segment by segment by Backward.
+   * Called by Init and Reshape when the net has checkpoint layers.
+   */
+  void PlanCheckpoints();
+  /**
+   * @brief Finds the layers after which each activation is idle, see
+   *        NetParameter.activation_storage.
+   *
+   * Blobs sharing memory are compressed after the last layer accessing any
+   * of them in Forward, and after the first in Backward, which is the last
+   * to read them there. Called by Init and Reshape when activation_storage
+   * is set.
+   */
+  void PlanActivationStorage();
+  /// Bytes of the activation arena, 0 if the memory is neither planned nor
+  /// checkpointed.
+  inline size_t planned_memory() const {
+    return memory_arena_ ? memory_arena_->size() : 0;
+  }
+
   Dtype ForwardBackward() {
     Dtype loss;
     Forward(&loss);
@@ -114,8 +153,9 @@ class Net {
   void CopyTrainedLayersFrom(const string& trained_filename);
   void CopyTrainedLayersFromBinaryProto(const string& trained_filename);
   void CopyTrainedLayersFromHDF5(const string& trained_filename);
-  /// @brief Writes the net to a proto.
-  void ToProto(NetParameter* param, bool write_diff = false) const;
+  /// @brief Writes the net to a proto, with the weights in storage.
+  void ToProto(NetParameter* param, bool write_diff = false,
+      BlobStorage storage = NATIVE) const;
   /// @brief Writes the net to an HDF5 file.
   void ToHDF5(const string& filename, bool write_diff = false) const;
 
@@ -270,6 +310,27 @@ class Net {
   void ForwardDebugInfo(const int layer_id);
   /// @brief Helper for displaying debug info in Backward.
   void BackwardDebugInfo(const int layer_id);
+  /// @brief Reruns the recomputed layers of the segment of layer_id, up to
+  ///        layer_id, unless their tops are still in memory.
+  void RecomputeSegment(const int layer_id);
+  /**
+   * @brief Builds the graphs of the layers Forward and Backward can run at
+   *        the same time, see NetParameter.layer_threads.
+   *
+   * A layer waits for the last layer before it writing memory it accesses,
+   * and for the layers before it reading memory it writes, so the results
+   * are those of running the layers in order. Layers that cannot run Forward
+   * twice (data layers, training Dropout...) run on the calling thread, in
+   * order, so that random numbers are drawn as in sequential mode.
+   */
+  void BuildLayerGraphs();
+  /// Whether ForwardFromTo and BackwardFromTo run layers in parallel.
+  bool LayersInParallel() const;
+  void ForwardLayer(int layer_id);
+  void BackwardLayer(int layer_id);
+  /// @brief Compresses the data of the blobs of blob_ids to
+  ///        activation_storage_, in CPU mode.
+  void CompressActivations(const vector<int>& blob_ids);
   /// @brief Helper for displaying debug info in Update.
   void UpdateDebugInfo(const int param_id);
 
@@ -328,6 +389,34 @@ class Net {
   vector<bool> has_params_decay_;
   /// The bytes of memory used by this net
   size_t memory_used_;
+  /// Whether activations are planned, the blobs that keep their own memory,
+  /// the blobs the first plan found plannable, the arena they share and the
+  /// memory placed in it.
+  bool plan_memory_;
+  set<string> pinned_blobs_;
+  vector<bool> plannable_blobs_;
+  shared_ptr<SyncedMemory> memory_arena_;
+  vector<boost::weak_ptr<SyncedMemory> > arena_memory_;
+  /// With checkpoint layers: the segment of each layer, the first layer of
+  /// each segment, the layers Backward recomputes, the blobs whose diff the
+  /// first plan found plannable, and the last recomputed layer whose tops
+  /// are in memory (-1 if none).
+  vector<int> layer_segment_;
+  vector<int> segment_begin_;
+  vector<bool> layer_recompute_;
+  vector<bool> plannable_diffs_;
+  int resident_layer_;
+  /// The storage of idle activations, and the blobs whose data is compressed
+  /// after the Forward and after the Backward of each layer.
+  BlobStorage activation_storage_;
+  vector<vector<int> > compress_after_forward_;
+  vector<vector<int> > compress_after_backward_;
+  /// The threads running layers in parallel, NULL in sequential mode, the
+  /// graphs of their dependencies, and the loss of each layer.
+  shared_ptr<ThreadPool> layer_pool_;
+  shared_ptr<TaskGraph> forward_graph_;
+  shared_ptr<TaskGraph> backward_graph_;
+  vector<Dtype> layer_losses_;
   /// Whether to compute and display debug info for the net.
   bool debug_info_;
   // Callbacks
@@ -8,6 +8,7 @@
 #endif
 
 #include "caffe/common.hpp"
+#include "caffe/proto/caffe.pb.h"
 
 namespace caffe {
 
@@ -68,6 +69,32 @@ class SyncedMemory {
   enum SyncedHead { UNINITIALIZED, HEAD_AT_CPU, HEAD_AT_GPU, SYNCED };
   SyncedHead head() const { return head_; }
   size_t size() const { return size_; }
+  /**
+   * @brief Counts the calls that may have changed the data: mutable_*_data
+   *        and set_*_data. Caches of values derived from the data, such as
+   *        PackedMatrix, compare it to know when to recompute them.
+   */
+  uint64_t version() const { return version_; }
+  /**
+   * @brief Converts the data, of Dtype, to the 16-bit storage and releases
+   *        the host memory, until the data is next accessed.
+   *
+   * The next access converts the data back, rounded to storage, into newly
+   * allocated host memory; pointers to the data returned before are then
+   * invalid. The 16-bit copy is kept while the data is only read, so that
+   * compressing it again only releases the host memory. Only data at the CPU
+   * in memory owned by this SyncedMemory is compressed.
+   */
+  template <typename Dtype>
+  void compress(const BlobStorage storage);
+  /// @brief Whether the data is only held in 16 bits, see compress.
+  bool compressed() const { return cpu_ptr_ == NULL && half_ptr_ != NULL; }
+  /**
+   * @brief Copies the data set by set_cpu_data or set_gpu_data into memory
+   *        owned by this SyncedMemory, so that the memory set can be released.
+   *        Pointers to the data returned before are then invalid.
+   */
+  void own_data();
 
 #ifndef CPU_ONLY
   void async_gpu_push(const cudaStream_t& stream);
@@ -78,6 +105,8 @@ class SyncedMemory {
 
   void to_cpu();
   void to_gpu();
+  void expand();
+  void release_half();
   void* cpu_ptr_;
   void* gpu_ptr_;
   size_t size_;
@@ -86,6 +115,11 @@ class SyncedMemory {
   bool cpu_malloc_use_cuda_;
   bool own_gpu_data_;
   int device_;
+  uint64_t version_;
+  // The 16-bit copy of compress, its storage, and whether it holds doubles.
+  uint16_t* half_ptr_;
+  BlobStorage half_storage_;
+  bool half_double_;
 
   DISABLE_COPY_AND_ASSIGN(SyncedMemory);
 };  // class SyncedMemory
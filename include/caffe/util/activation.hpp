@@ -0,0 +1,22 @@
+#ifndef CAFFE_UTIL_ACTIVATION_HPP_
+#define CAFFE_UTIL_ACTIVATION_HPP_
+
+#include "caffe/proto/caffe.pb.h"
+
+namespace caffe {
+
+/**
+ * @brief Applies the activation of param in place to the count elements of
+ *        data, as the layer of its type would; a no-op for NONE.
+ */
+template <typename Dtype>
+void caffe_cpu_activation(const ActivationParameter& param, const int count,
+    Dtype* data);
+
+template <typename Dtype>
+void caffe_gpu_activation(const ActivationParameter& param, const int count,
+    Dtype* data);
+
+}  // namespace caffe
+
+#endif  // CAFFE_UTIL_ACTIVATION_HPP_
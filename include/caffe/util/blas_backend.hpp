@@ -0,0 +1,54 @@
+#ifndef CAFFE_UTIL_BLAS_BACKEND_HPP_
+#define CAFFE_UTIL_BLAS_BACKEND_HPP_
+
+#include <string>
+
+namespace caffe {
+
+/**
+ * @brief Where caffe_cpu_gemm and caffe_cpu_gemv run.
+ *
+ * BLAS_LINKED calls the cblas Caffe was built against (see mkl_alternate.hpp),
+ * BLAS_LIBRARY the cblas of a library loaded at run time, and BLAS_BUILTIN the
+ * portable GEMM of packed_gemm.hpp, which is also the only one whose operands
+ * layers can keep packed (see PackedMatrix). The other BLAS routines always
+ * use the linked library: they are bound by memory, not by the backend.
+ */
+enum BlasBackend { BLAS_LINKED, BLAS_LIBRARY, BLAS_BUILTIN };
+
+/// @brief The GEMM and GEMV of a cblas loaded by caffe_set_blas_backend.
+struct BlasLibrary {
+  void (*sgemm)(int order, int trans_a, int trans_b, int m, int n, int k,
+      float alpha, const float* a, int lda, const float* b, int ldb,
+      float beta, float* c, int ldc);
+  void (*dgemm)(int order, int trans_a, int trans_b, int m, int n, int k,
+      double alpha, const double* a, int lda, const double* b, int ldb,
+      double beta, double* c, int ldc);
+  void (*sgemv)(int order, int trans, int m, int n, float alpha,
+      const float* a, int lda, const float* x, int incx, float beta,
+      float* y, int incy);
+  void (*dgemv)(int order, int trans, int m, int n, double alpha,
+      const double* a, int lda, const double* x, int incx, double beta,
+      double* y, int incy);
+};
+
+/**
+ * @brief Selects the BLAS backend of the process by name.
+ *
+ * "linked" and "builtin" select BLAS_LINKED and BLAS_BUILTIN; "openblas",
+ * "mkl" and "blis" load the usual shared library of that implementation, and
+ * anything else is taken as the path of a shared library exporting cblas.
+ * Unlike the Caffe mode, the backend is shared by all threads, and must not
+ * be changed while other threads compute.
+ */
+void caffe_set_blas_backend(const std::string& name);
+
+BlasBackend caffe_blas_backend();
+/// @brief The name the current backend was selected with.
+const std::string& caffe_blas_backend_name();
+/// @brief The library of BLAS_LIBRARY.
+const BlasLibrary& caffe_blas_library();
+
+}  // namespace caffe
+
+#endif  // CAFFE_UTIL_BLAS_BACKEND_HPP_
@@ -19,6 +19,25 @@ class Cursor {
   virtual string key() = 0;
   virtual string value() = 0;
   virtual bool valid() = 0;
+  /**
+   * @brief Moves the cursor to the value of key and returns whether the
+   *        database has it; Next then continues from there.
+   */
+  virtual bool Seek(const string& key) = 0;
+  /**
+   * @brief Points data at the size bytes of the value, without copying them
+   *        where the database allows. The view is valid until the cursor
+   *        moves, or for as long as the cursor lives if stable_values().
+   */
+  virtual void value_view(const char** data, size_t* size) {
+    value_ = value();
+    *data = value_.data();
+    *size = value_.size();
+  }
+  virtual bool stable_values() const { return false; }
+
+ private:
+  string value_;
 
   DISABLE_COPY_AND_ASSIGN(Cursor);
 };
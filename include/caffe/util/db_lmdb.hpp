@@ -35,6 +35,20 @@ class LMDBCursor : public Cursor {
         mdb_value_.mv_size);
   }
   virtual bool valid() { return valid_; }
+  // A lookup in the B-tree of the memory map, without moving the values.
+  virtual bool Seek(const string& key) {
+    mdb_key_.mv_size = key.size();
+    mdb_key_.mv_data = const_cast<char*>(key.data());
+    Seek(MDB_SET_KEY);
+    return valid_;
+  }
+  // The values are in the memory map, which the read-only transaction of the
+  // cursor keeps in place until it is aborted.
+  virtual void value_view(const char** data, size_t* size) {
+    *data = static_cast<const char*>(mdb_value_.mv_data);
+    *size = mdb_value_.mv_size;
+  }
+  virtual bool stable_values() const { return true; }
 
  private:
   void Seek(MDB_cursor_op op) {
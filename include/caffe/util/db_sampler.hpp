@@ -0,0 +1,65 @@
+#ifndef CAFFE_UTIL_DB_SAMPLER_HPP_
+#define CAFFE_UTIL_DB_SAMPLER_HPP_
+
+#include <stdint.h>
+
+#include <string>
+#include <vector>
+
+#include "caffe/common.hpp"
+#include "caffe/util/db.hpp"
+
+namespace caffe { namespace db {
+
+/// @brief Reads the keys of the database of cursor, in order, into keys.
+void ReadKeys(Cursor* cursor, vector<string>* keys);
+
+/**
+ * @brief Reads the keys of a database from the key index filename into keys
+ *        if the file exists, or else from cursor, writing the file for the
+ *        next time if write_index.
+ */
+void ReadOrWriteKeyIndex(const string& filename, Cursor* cursor,
+    bool write_index, vector<string>* keys);
+
+/**
+ * @brief Draws the items of a database of num_keys keys for one of
+ *        num_shards solvers, in a random order that changes every epoch.
+ *
+ * The samples of all solvers together go through a permutation of the keys
+ * per epoch, drawn from seed and the epoch alone, and solver shard takes
+ * every num_shards-th of them from the shard-th: the shards are disjoint and
+ * every solver computes its own without reading the others' items. The
+ * offset, the number of samples this solver has taken, is all the state
+ * there is, so that a sampler set back to an offset draws the same samples
+ * from there on.
+ */
+class ShardedSampler {
+ public:
+  ShardedSampler(int num_keys, uint32_t seed, int shard, int num_shards);
+
+  /// @brief Returns the index of the key of the next sample.
+  int Next();
+
+  inline uint64_t offset() const { return offset_; }
+  inline void set_offset(uint64_t offset) { offset_ = offset; }
+
+ private:
+  void Shuffle(uint64_t epoch);
+
+  int num_keys_;
+  uint32_t seed_;
+  int shard_;
+  int num_shards_;
+  uint64_t offset_;
+  /// The permutation of the keys for epoch_.
+  uint64_t epoch_;
+  vector<int> permutation_;
+
+  DISABLE_COPY_AND_ASSIGN(ShardedSampler);
+};
+
+}  // namespace db
+}  // namespace caffe
+
+#endif  // CAFFE_UTIL_DB_SAMPLER_HPP_
@@ -0,0 +1,54 @@
+#ifndef _CAFFE_UTIL_DIRECT_CONV_HPP_
+#define _CAFFE_UTIL_DIRECT_CONV_HPP_
+
+namespace caffe {
+
+/// @brief The size of the buffer conv_direct_cpu needs to pad the image.
+inline int direct_conv_buffer_size(int channels, int height, int width,
+    int pad_h, int pad_w) {
+  return pad_h || pad_w ?
+      channels * (height + 2 * pad_h) * (width + 2 * pad_w) : 0;
+}
+
+/**
+ * @brief Computes a 2D convolution of one image without a column buffer.
+ *
+ * The image is zero padded into buffer, of direct_conv_buffer_size elements,
+ * instead of being unrolled kernel_h * kernel_w times by im2col. Outputs are
+ * then accumulated in register tiles of a few channels by a few columns, the
+ * columns being contiguous in the input for stride 1. weights are
+ * num_output x channels x kernel_h x kernel_w and output, of
+ * num_output x height_out x width_out, is overwritten.
+ */
+template <typename Dtype>
+void conv_direct_cpu(const Dtype* data, const int channels,
+    const int height, const int width, const Dtype* weights,
+    const int num_output, const int kernel_h, const int kernel_w,
+    const int pad_h, const int pad_w, const int stride_h, const int stride_w,
+    const int dilation_h, const int dilation_w, const int height_out,
+    const int width_out, Dtype* buffer, Dtype* output);
+
+/// @brief The size of the buffer conv_direct_3d_cpu needs to pad the volume.
+inline int direct_conv_3d_buffer_size(int channels, int depth, int height,
+    int width, int pad_d, int pad_h, int pad_w) {
+  return pad_d || pad_h || pad_w ? channels * (depth + 2 * pad_d) *
+      (height + 2 * pad_h) * (width + 2 * pad_w) : 0;
+}
+
+/**
+ * @brief conv_direct_cpu for volumes of channels x depth x height x width,
+ *        with num_output x channels x kernel_d x kernel_h x kernel_w weights.
+ */
+template <typename Dtype>
+void conv_direct_3d_cpu(const Dtype* data, const int channels,
+    const int depth, const int height, const int width, const Dtype* weights,
+    const int num_output, const int kernel_d, const int kernel_h,
+    const int kernel_w, const int pad_d, const int pad_h, const int pad_w,
+    const int stride_d, const int stride_h, const int stride_w,
+    const int dilation_d, const int dilation_h, const int dilation_w,
+    const int depth_out, const int height_out, const int width_out,
+    Dtype* buffer, Dtype* output);
+
+}  // namespace caffe
+
+#endif  // _CAFFE_UTIL_DIRECT_CONV_HPP_
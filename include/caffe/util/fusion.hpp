@@ -0,0 +1,27 @@
+#ifndef CAFFE_UTIL_FUSION_HPP_
+#define CAFFE_UTIL_FUSION_HPP_
+
+#include "caffe/proto/caffe.pb.h"
+
+namespace caffe {
+
+/**
+ * @brief Rewrites an inference net so that each Convolution and InnerProduct
+ *        layer also does the work of the layers that directly follow it.
+ *
+ * BatchNorm (with global statistics) and per-channel Scale layers are folded
+ * into the weights and bias of the layer before them, and a ReLU, Swish, Clip
+ * or ELU layer after those becomes its fused activation, so that a
+ * Conv -> BatchNorm -> Scale -> ReLU chain reads and writes its output once
+ * instead of four times. A layer is only fused when it is next in param and
+ * its bottom is read by no other layer.
+ *
+ * param must be a TEST net whose layers carry their weights, as does a
+ * prototxt whose layers were given the blobs of its caffemodel (see
+ * tools/fuse_net.cpp). Returns the number of layers fused.
+ */
+int FuseNet(const NetParameter& param, NetParameter* fused);
+
+}  // namespace caffe
+
+#endif  // CAFFE_UTIL_FUSION_HPP_
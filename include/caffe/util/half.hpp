@@ -0,0 +1,35 @@
+#ifndef CAFFE_UTIL_HALF_HPP_
+#define CAFFE_UTIL_HALF_HPP_
+
+#include <stdint.h>
+
+#include "caffe/proto/caffe.pb.h"
+
+namespace caffe {
+
+/// @brief The IEEE half nearest to x, ties to even. Magnitudes from 65520
+///        round to infinity; NaN stays NaN.
+uint16_t caffe_float_to_half(float x);
+float caffe_half_to_float(uint16_t h);
+/// @brief The bfloat16 nearest to x, ties to even; NaN stays NaN.
+uint16_t caffe_float_to_bfloat16(float x);
+float caffe_bfloat16_to_float(uint16_t h);
+
+/**
+ * @brief y = x rounded to storage, FLOAT16 or BFLOAT16.
+ *
+ * Doubles are rounded to float first. The conversions use F16C and AVX2 on
+ * CPUs that have them, with the same results as the scalar functions above.
+ */
+template <typename Dtype>
+void caffe_cpu_to_half(const BlobStorage storage, const int n, const Dtype* x,
+    uint16_t* y);
+
+/// @brief y = x, read from storage, FLOAT16 or BFLOAT16.
+template <typename Dtype>
+void caffe_cpu_from_half(const BlobStorage storage, const int n,
+    const uint16_t* x, Dtype* y);
+
+}  // namespace caffe
+
+#endif  // CAFFE_UTIL_HALF_HPP_
@@ -11,6 +11,21 @@
 
 namespace caffe {
 
+/**
+ * @brief Serializes calls into the HDF5 library, which is not thread-safe
+ *        unless built with --enable-threadsafe, while in scope.
+ */
+class HDF5Lock {
+ public:
+  HDF5Lock();
+  ~HDF5Lock();
+
+DISABLE_COPY_AND_ASSIGN(HDF5Lock);
+};
+
+vector<int> hdf5_get_dataset_shape(
+    hid_t file_id, const char* dataset_name_, int min_dim, int max_dim);
+
 template <typename Dtype>
 void hdf5_load_nd_dataset_helper(
     hid_t file_id, const char* dataset_name_, int min_dim, int max_dim,
@@ -21,6 +36,13 @@ void hdf5_load_nd_dataset(
     hid_t file_id, const char* dataset_name_, int min_dim, int max_dim,
     Blob<Dtype>* blob, bool reshape = false);
 
+// Reads num_rows rows of the dataset starting at row_begin, the first axis
+// being the row axis, into data without loading the rest of the dataset.
+template <typename Dtype>
+void hdf5_load_nd_dataset_rows(
+    hid_t file_id, const char* dataset_name_, int row_begin, int num_rows,
+    Dtype* data);
+
 template <typename Dtype>
 void hdf5_save_nd_dataset(
     const hid_t file_id, const string& dataset_name, const Blob<Dtype>& blob,
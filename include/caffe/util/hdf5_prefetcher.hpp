@@ -0,0 +1,68 @@
+#ifndef CAFFE_UTIL_HDF5_PREFETCHER_HPP_
+#define CAFFE_UTIL_HDF5_PREFETCHER_HPP_
+
+#include <string>
+#include <vector>
+
+#include <boost/function.hpp>
+
+#include "caffe/blob.hpp"
+#include "caffe/internal_thread.hpp"
+#include "caffe/util/blocking_queue.hpp"
+
+namespace caffe {
+
+/**
+ * @brief The datasets of one HDF5 file, as read by an HDF5FilePrefetcher.
+ */
+template <typename Dtype>
+class HDF5FileData {
+ public:
+  string filename;
+  vector<shared_ptr<Blob<Dtype> > > blobs;
+  // Time spent reading the file, in milliseconds.
+  float read_ms;
+};
+
+/**
+ * @brief Reads the next HDF5 file of a data layer on a background thread while
+ *        the current one is consumed.
+ *
+ * The layer supplies the function that reads a file into a set of blobs. It
+ * calls Prefetch() with the name of the file it will need next and Take()
+ * when it needs it; Take() only blocks for the part of the read that has not
+ * overlapped with the layer's work. Reads from all prefetchers, and the
+ * synchronous reads done by Take() for files that were not prefetched, are
+ * serialized since the HDF5 library is not thread-safe by default.
+ */
+template <typename Dtype>
+class HDF5FilePrefetcher : public InternalThread {
+ public:
+  typedef boost::function<void(const string&,
+      vector<shared_ptr<Blob<Dtype> > >*)> Reader;
+
+  explicit HDF5FilePrefetcher(const Reader& reader);
+  virtual ~HDF5FilePrefetcher();
+
+  /// Starts reading filename in the background.
+  void Prefetch(const string& filename);
+  /// Fills blobs with the datasets of filename, waiting for the background
+  /// read if it is the prefetched file and reading it now otherwise.
+  void Take(const string& filename, vector<shared_ptr<Blob<Dtype> > >* blobs);
+
+ protected:
+  virtual void InternalThreadEntry();
+  void Read(HDF5FileData<Dtype>* data);
+
+  Reader reader_;
+  // Name of the file being prefetched, empty if none.
+  string pending_;
+  BlockingQueue<string> requests_;
+  BlockingQueue<HDF5FileData<Dtype>*> results_;
+
+DISABLE_COPY_AND_ASSIGN(HDF5FilePrefetcher);
+};
+
+}  // namespace caffe
+
+#endif  // CAFFE_UTIL_HDF5_PREFETCHER_HPP_
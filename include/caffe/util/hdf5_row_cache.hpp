@@ -0,0 +1,79 @@
+#ifdef USE_HDF5
+#ifndef CAFFE_UTIL_HDF5_ROW_CACHE_HPP_
+#define CAFFE_UTIL_HDF5_ROW_CACHE_HPP_
+
+#include <list>
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "hdf5.h"
+
+#include "caffe/common.hpp"
+
+namespace caffe {
+
+/**
+ * @brief Serves rows of the datasets of an HDF5 file without loading them
+ *        whole.
+ *
+ * Rows are read through hyperslab selections in chunks of chunk_rows
+ * consecutive rows, and the chunks are kept in a least recently used cache
+ * shared by all datasets of the file. Memory is bounded by cache_bytes (or
+ * one chunk, if larger) whatever the size of the file. The first axis of
+ * every dataset is the row axis. Not thread-safe; HDF5 calls are serialized
+ * with HDF5Lock.
+ */
+template <typename Dtype>
+class HDF5RowCache {
+ public:
+  HDF5RowCache(const string& filename, const vector<string>& datasets,
+      int chunk_rows, size_t cache_bytes);
+  ~HDF5RowCache();
+
+  inline int num_datasets() const { return shapes_.size(); }
+  /// Shape of dataset d, as it is stored in the file.
+  inline const vector<int>& shape(int d) const { return shapes_[d]; }
+  inline int num_rows(int d) const { return shapes_[d][0]; }
+  /// Number of elements of a row of dataset d.
+  inline int row_dim(int d) const { return row_dims_[d]; }
+
+  /// Copies row of dataset d to data.
+  void CopyRow(int d, int row, Dtype* data);
+
+  inline uint64_t hits() const { return hits_; }
+  inline uint64_t misses() const { return misses_; }
+
+ protected:
+  // Dataset and index of a chunk.
+  typedef std::pair<int, int> Key;
+  struct Chunk {
+    Key key;
+    vector<Dtype> data;
+  };
+
+  // Returns the chunk, reading it on a miss, and marks it most recently used.
+  const Chunk& Fetch(const Key& key);
+
+  hid_t file_id_;
+  string filename_;
+  vector<string> datasets_;
+  vector<vector<int> > shapes_;
+  vector<int> row_dims_;
+  int chunk_rows_;
+  size_t cache_bytes_;
+  size_t cached_bytes_;
+  // Most recently used first.
+  std::list<Chunk> chunks_;
+  std::map<Key, typename std::list<Chunk>::iterator> index_;
+  uint64_t hits_;
+  uint64_t misses_;
+
+DISABLE_COPY_AND_ASSIGN(HDF5RowCache);
+};
+
+}  // namespace caffe
+
+#endif  // CAFFE_UTIL_HDF5_ROW_CACHE_HPP_
+#endif  // USE_HDF5
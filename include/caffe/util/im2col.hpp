@@ -16,6 +16,18 @@ void im2col_cpu(const Dtype* data_im, const int channels,
     const int stride_w, const int dilation_h, const int dilation_w,
     Dtype* data_col);
 
+/**
+ * @brief im2col of a volume, num_spatial_axes 3 of im2col_nd_cpu with the
+ *        bounds checks hoisted out of the rows.
+ */
+template <typename Dtype>
+void im2col_3d_cpu(const Dtype* data_im, const int channels,
+    const int depth, const int height, const int width, const int kernel_d,
+    const int kernel_h, const int kernel_w, const int pad_d, const int pad_h,
+    const int pad_w, const int stride_d, const int stride_h,
+    const int stride_w, const int dilation_d, const int dilation_h,
+    const int dilation_w, Dtype* data_col);
+
 template <typename Dtype>
 void col2im_nd_cpu(const Dtype* data_col, const int num_spatial_axes,
     const int* im_shape, const int* col_shape,
@@ -29,6 +41,15 @@ void col2im_cpu(const Dtype* data_col, const int channels,
     const int stride_w, const int dilation_h, const int dilation_w,
     Dtype* data_im);
 
+/// @brief The inverse of im2col_3d_cpu, accumulating into data_im.
+template <typename Dtype>
+void col2im_3d_cpu(const Dtype* data_col, const int channels,
+    const int depth, const int height, const int width, const int kernel_d,
+    const int kernel_h, const int kernel_w, const int pad_d, const int pad_h,
+    const int pad_w, const int stride_d, const int stride_h,
+    const int stride_w, const int dilation_d, const int dilation_h,
+    const int dilation_w, Dtype* data_im);
+
 template <typename Dtype>
 void im2col_nd_gpu(const Dtype* data_im, const int num_spatial_axes,
     const int col_size, const int* im_shape, const int* col_shape,
@@ -42,6 +63,14 @@ void im2col_gpu(const Dtype* data_im, const int channels,
     const int stride_w, const int dilation_h, const int dilation_w,
     Dtype* data_col);
 
+template <typename Dtype>
+void im2col_3d_gpu(const Dtype* data_im, const int channels,
+    const int depth, const int height, const int width, const int kernel_d,
+    const int kernel_h, const int kernel_w, const int pad_d, const int pad_h,
+    const int pad_w, const int stride_d, const int stride_h,
+    const int stride_w, const int dilation_d, const int dilation_h,
+    const int dilation_w, Dtype* data_col);
+
 template <typename Dtype>
 void col2im_nd_gpu(const Dtype* data_col, const int num_spatial_axes,
     const int im_size, const int* im_shape, const int* col_shape,
@@ -55,6 +84,14 @@ void col2im_gpu(const Dtype* data_col, const int channels,
     const int stride_w, const int dilation_h, const int dilation_w,
     Dtype* data_im);
 
+template <typename Dtype>
+void col2im_3d_gpu(const Dtype* data_col, const int channels,
+    const int depth, const int height, const int width, const int kernel_d,
+    const int kernel_h, const int kernel_w, const int pad_d, const int pad_h,
+    const int pad_w, const int stride_d, const int stride_h,
+    const int stride_w, const int dilation_d, const int dilation_h,
+    const int dilation_w, Dtype* data_im);
+
 }  // namespace caffe
 
 #endif  // CAFFE_UTIL_IM2COL_HPP_
@@ -0,0 +1,76 @@
+#ifndef CAFFE_UTIL_INT8_GEMM_HPP_
+#define CAFFE_UTIL_INT8_GEMM_HPP_
+
+#include <stdint.h>
+
+#include <vector>
+
+#include "caffe/blob.hpp"
+#include "caffe/common.hpp"
+#include "caffe/syncedmem.hpp"
+#include "caffe/util/mkl_alternate.hpp"
+
+namespace caffe {
+
+/**
+ * @brief The weights of an 8-bit product: a matrix rounded to integers in
+ *        [-127, 127] with one scale per row, in the panel layout of
+ *        caffe_cpu_gemm_int8.
+ *
+ * Row i stands for scales()[i] times its integers; the scale maps the
+ * largest magnitude of the row to 127, so each output channel keeps the
+ * resolution of its own range. The integers take a quarter of the memory of
+ * float weights, and of the bandwidth of every product.
+ */
+template <typename Dtype>
+class Int8Matrix {
+ public:
+  Int8Matrix()
+      : trans_(CblasNoTrans), rows_(0), cols_(0), offset_(0), version_(0) {}
+
+  /// @brief Quantizes op(data), of rows x cols.
+  void Quantize(CBLAS_TRANSPOSE trans, int rows, int cols, const Dtype* data);
+  /**
+   * @brief Quantizes op(data) of blob from offset, unless that was the last
+   *        thing quantized and the data of blob has not changed since.
+   */
+  void Quantize(CBLAS_TRANSPOSE trans, int rows, int cols,
+      const Blob<Dtype>& blob, int offset = 0);
+
+  inline int rows() const { return rows_; }
+  inline int cols() const { return cols_; }
+  inline const int8_t* data() const { return &data_[0]; }
+  inline const Dtype* scales() const { return &scales_[0]; }
+
+ private:
+  CBLAS_TRANSPOSE trans_;
+  int rows_, cols_;
+  std::vector<int8_t> data_;
+  std::vector<Dtype> scales_;
+  // As in PackedMatrix: the memory last quantized and its version.
+  shared_ptr<SyncedMemory> source_;
+  int offset_;
+  uint64_t version_;
+
+  DISABLE_COPY_AND_ASSIGN(Int8Matrix);
+};
+
+/**
+ * @brief C = A * op(B) + bias, with op(B) rounded to 8 bits and the product
+ *        summed in 32 bits.
+ *
+ * op(B) is A.cols() x N and is quantized with the scale that maps input_max
+ * to 127, saturating larger magnitudes. The 32-bit sums are scaled back to
+ * Dtype, and the bias of their row added, as the last step of each tile, so
+ * that C is written once. C is A.rows() x N, or its transpose N x A.rows()
+ * when TransC is CblasTrans. bias may be NULL.
+ */
+template <typename Dtype>
+void caffe_cpu_gemm_int8(const Int8Matrix<Dtype>& A,
+    const CBLAS_TRANSPOSE TransB, const int N, const Dtype input_max,
+    const Dtype* B, const Dtype* bias, const CBLAS_TRANSPOSE TransC,
+    Dtype* C);
+
+}  // namespace caffe
+
+#endif  // CAFFE_UTIL_INT8_GEMM_HPP_
@@ -70,6 +70,27 @@ void caffe_div(const int N, const Dtype* a, const Dtype* b, Dtype* y);
 template <typename Dtype>
 void caffe_powx(const int n, const Dtype* a, const Dtype b, Dtype* y);
 
+// Element-wise maximum of a and b.
+template <typename Dtype>
+void caffe_max(const int N, const Dtype* a, const Dtype* b, Dtype* y);
+
+// Element-wise maximum of the num vectors x[0], ..., x[num - 1], computed in
+// a single pass over memory; y may be one of the inputs.
+template <typename Dtype>
+void caffe_max(const int N, const int num, const Dtype* const* x, Dtype* y);
+
+// Packs n occupancy values in [0, 1] with bits (1 or 8) bits per value: one
+// bit per value, least significant first, set for values of at least 0.5, or
+// one byte per value holding the value * 255 rounded.
+template <typename Dtype>
+void caffe_pack_occupancy(const int n, const int bits, const Dtype* x,
+    uint8_t* y);
+
+// Expands n occupancy values packed by caffe_pack_occupancy.
+template <typename Dtype>
+void caffe_unpack_occupancy(const int n, const int bits, const uint8_t* x,
+    Dtype* y);
+
 unsigned int caffe_rng_rand();
 
 template <typename Dtype>
@@ -205,6 +226,18 @@ void caffe_gpu_mul(const int N, const Dtype* a, const Dtype* b, Dtype* y);
 template <typename Dtype>
 void caffe_gpu_div(const int N, const Dtype* a, const Dtype* b, Dtype* y);
 
+template <typename Dtype>
+void caffe_gpu_max(const int N, const Dtype* a, const Dtype* b, Dtype* y);
+
+// Element-wise maximum of the num device vectors x[0], ..., x[num - 1], the
+// array x being on the host; y may be one of the inputs.
+template <typename Dtype>
+void caffe_gpu_max(const int N, const int num, const Dtype* const* x, Dtype* y);
+
+template <typename Dtype>
+void caffe_gpu_unpack_occupancy(const int n, const int bits, const uint8_t* x,
+    Dtype* y);
+
 template <typename Dtype>
 void caffe_gpu_abs(const int n, const Dtype* a, Dtype* y);
 
@@ -0,0 +1,94 @@
+#ifndef CAFFE_UTIL_PACKED_GEMM_HPP_
+#define CAFFE_UTIL_PACKED_GEMM_HPP_
+
+#include <vector>
+
+#include "caffe/blob.hpp"
+#include "caffe/common.hpp"
+#include "caffe/syncedmem.hpp"
+#include "caffe/util/mkl_alternate.hpp"
+
+namespace caffe {
+
+/**
+ * @brief An operand of caffe_cpu_gemm_packed, copied into the panel layout
+ *        of the builtin GEMM.
+ *
+ * The builtin GEMM reads the left operand A in panels of a few rows and the
+ * right operand B in panels of a few columns, each contiguous along K, and
+ * normally packs both on every call. Packing an operand that does not change,
+ * such as the weights of a layer at inference, once saves a pass over it in
+ * every product, which is a large part of the time of small batches.
+ */
+template <typename Dtype>
+class PackedMatrix {
+ public:
+  enum Side { LEFT, RIGHT };
+
+  PackedMatrix()
+      : side_(LEFT), trans_(CblasNoTrans), rows_(0), cols_(0), offset_(0),
+        version_(0) {}
+
+  /**
+   * @brief Packs op(data), of rows x cols, as the side operand of a product:
+   *        A of rows = M by cols = K, or B of rows = K by cols = N.
+   */
+  void Pack(Side side, CBLAS_TRANSPOSE trans, int rows, int cols,
+      const Dtype* data);
+  /**
+   * @brief Packs op(data) of blob from offset, unless that was the last thing
+   *        packed and the data of blob has not changed since.
+   */
+  void Pack(Side side, CBLAS_TRANSPOSE trans, int rows, int cols,
+      const Blob<Dtype>& blob, int offset = 0);
+
+  inline Side side() const { return side_; }
+  inline int rows() const { return rows_; }
+  inline int cols() const { return cols_; }
+  inline const Dtype* data() const { return &data_[0]; }
+
+ private:
+  Side side_;
+  CBLAS_TRANSPOSE trans_;
+  int rows_, cols_;
+  std::vector<Dtype> data_;
+  // The memory of the blob last packed, held so that its address cannot be
+  // reused, and its version at the time.
+  shared_ptr<SyncedMemory> source_;
+  int offset_;
+  uint64_t version_;
+
+  DISABLE_COPY_AND_ASSIGN(PackedMatrix);
+};
+
+/**
+ * @brief C = alpha * op(A) * op(B) + beta * C, row major, with the builtin
+ *        GEMM. This is caffe_cpu_gemm on the BLAS_BUILTIN backend.
+ */
+template <typename Dtype>
+void caffe_cpu_gemm_builtin(const CBLAS_TRANSPOSE TransA,
+    const CBLAS_TRANSPOSE TransB, const int M, const int N, const int K,
+    const Dtype alpha, const Dtype* A, const Dtype* B, const Dtype beta,
+    Dtype* C);
+
+/// @brief y = alpha * op(A) * x + beta * y, caffe_cpu_gemv on BLAS_BUILTIN.
+template <typename Dtype>
+void caffe_cpu_gemv_builtin(const CBLAS_TRANSPOSE TransA, const int M,
+    const int N, const Dtype alpha, const Dtype* A, const Dtype* x,
+    const Dtype beta, Dtype* y);
+
+/// @brief caffe_cpu_gemm_builtin with A packed: C is A.rows() x N.
+template <typename Dtype>
+void caffe_cpu_gemm_packed(const PackedMatrix<Dtype>& A,
+    const CBLAS_TRANSPOSE TransB, const int N, const Dtype alpha,
+    const Dtype* B, const Dtype beta, Dtype* C);
+
+/// @brief caffe_cpu_gemm_builtin with B packed: C is M x B.cols().
+template <typename Dtype>
+void caffe_cpu_gemm_packed(const CBLAS_TRANSPOSE TransA, const int M,
+    const Dtype alpha, const Dtype* A, const PackedMatrix<Dtype>& B,
+    const Dtype beta, Dtype* C);
+
+}  // namespace caffe
+
+#endif  // CAFFE_UTIL_PACKED_GEMM_HPP_
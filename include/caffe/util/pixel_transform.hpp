@@ -0,0 +1,50 @@
+#ifndef CAFFE_UTIL_PIXEL_TRANSFORM_HPP_
+#define CAFFE_UTIL_PIXEL_TRANSFORM_HPP_
+
+#include <stdint.h>
+
+namespace caffe {
+
+/**
+ * @brief Transforms a cropped image row for DataTransformer:
+ *        y[i] = (x[i * stride] - mean) * scale for i < n, where mean is
+ *        mean_row[i], or mean_value if mean_row is NULL, with y written from
+ *        its end if mirror.
+ *
+ * The stride steps over the interleaved channels of an image, 1 for planar
+ * data. Rows of bytes with stride 1 or 3 and rows of floats with stride 1 are
+ * vectorized with AVX2 on CPUs that have it, with the same results as the
+ * scalar loop.
+ */
+template <typename T, typename Dtype>
+void caffe_cpu_transform_row(const int n, const T* x, const int stride,
+    const Dtype* mean_row, const Dtype mean_value, const Dtype scale,
+    const bool mirror, Dtype* y);
+
+/**
+ * @brief Transforms num uint8 images of channels x height x width at x into
+ *        y, num x channels x crop_height x crop_width, as DataTransformer
+ *        does image by image.
+ *
+ * Image n is cropped from row augmentation[3 * n] and column
+ * augmentation[3 * n + 1], and mirrored if augmentation[3 * n + 2]. mean is
+ * NULL or a channels x height x width image, mean_values NULL or one value
+ * per channel.
+ */
+template <typename Dtype>
+void caffe_cpu_transform_batch(const int num, const int channels,
+    const int height, const int width, const uint8_t* x,
+    const int* augmentation, const int crop_height, const int crop_width,
+    const Dtype* mean, const Dtype* mean_values, const Dtype scale, Dtype* y);
+
+/// @brief caffe_cpu_transform_batch with the arrays on the GPU, with the
+///        same results.
+template <typename Dtype>
+void caffe_gpu_transform_batch(const int num, const int channels,
+    const int height, const int width, const uint8_t* x,
+    const int* augmentation, const int crop_height, const int crop_width,
+    const Dtype* mean, const Dtype* mean_values, const Dtype scale, Dtype* y);
+
+}  // namespace caffe
+
+#endif  // CAFFE_UTIL_PIXEL_TRANSFORM_HPP_
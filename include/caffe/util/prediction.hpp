@@ -6,6 +6,7 @@
 #include <Eigen/LU>
 #include <iostream>
 #include "caffe/blob.hpp"
+#include "caffe/util/voxel_rotation.hpp"
 
 namespace caffe {
 
@@ -43,6 +44,56 @@ namespace caffe {
 										   const Eigen::Matrix<Dtype,4,4> &model2,
 										   const Eigen::Matrix<Dtype,4,4> &view2,
 										   const Eigen::Matrix<Dtype,4,4> &proj);
+	/**
+	 * @brief Nearest-neighbour, or trilinear, resampling of a size^3 voxel
+	 *        grid from one viewpoint (model2, view2) to another
+	 *        (model1, view1).
+	 *
+	 * The combined transform proj*view1*model1*(proj*view2*model2)^-1 is built
+	 * once at construction, into the parameters read by rotate_grid_cpu and
+	 * rotate_blobs_gpu. Apply() then walks the output grid slice by slice,
+	 * stepping the homogeneous coordinates incrementally along each row, so the
+	 * per-voxel cost is a few multiply-adds and one gather instead of a 4x4
+	 * inversion. Grids are stored z-major: vox[(z * size + i) * size + j].
+	 */
+	template <typename Dtype>
+	class VoxelRotation {
+	 public:
+	  EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+
+	  VoxelRotation(int size,
+	                const Dtype* model1,
+	                const Dtype* view_mat1,
+	                const Dtype* model2,
+	                const Dtype* view_mat2,
+	                const Dtype* proj_mat,
+	                bool trilinear = false);
+
+	  /// Rotate the output z-slices [z_begin, z_end) of vox into output,
+	  /// which points at the start of the full output grid.
+	  void Apply(const Dtype* vox, Dtype* output, int z_begin, int z_end) const;
+	  void Apply(const Dtype* vox, Dtype* output) const {
+	    Apply(vox, output, 0, size_);
+	  }
+
+	  inline int size() const { return size_; }
+	  /// voxel_rotation_num_params(size) values describing the rotation.
+	  inline const Dtype* params() const { return params_.data(); }
+
+	 protected:
+	  int size_;
+	  bool trilinear_;
+	  std::vector<Dtype> params_;
+	};
+
+	/// Offset of the voxel grid in each item of a prediction blob, past the
+	/// leading classification slice when the net outputs one.
+	template <typename Dtype>
+	int prediction_voxels_offset(const Blob<Dtype>* pred);
+	/// Start of the voxel grid of item n of a prediction blob.
+	template <typename Dtype>
+	const Dtype* prediction_voxels(const Blob<Dtype>* pred, int n);
+
 	template <typename Dtype>
 	void rotate_blobs(const Blob<Dtype> * pred,
 					  const Dtype* model1,
@@ -54,6 +105,14 @@ namespace caffe {
 
 		template <typename Dtype>
 		Grid<Dtype> unpack_pred_in_image( cv::Mat &image, int grid_rows, int grid_cols);
+	/**
+	 * Splits a voxels image, the img_size x img_size RGB sketch followed by
+	 * the atlas of the voxels_size^3 occupancy grid, into the 3-channel
+	 * sketch and the grid.
+	 */
+	template <typename Dtype>
+	void unpack_voxels_image(const cv::Mat &image, int img_size, int voxels_size,
+	                         cv::Mat *sketch, Grid<Dtype> *vox);
 	template <typename Dtype>
 	int CV_type();
 
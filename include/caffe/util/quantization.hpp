@@ -0,0 +1,25 @@
+#ifndef CAFFE_UTIL_QUANTIZATION_HPP_
+#define CAFFE_UTIL_QUANTIZATION_HPP_
+
+#include "caffe/net.hpp"
+#include "caffe/proto/caffe.pb.h"
+
+namespace caffe {
+
+/**
+ * @brief Switches the Convolution and InnerProduct layers of param to 8-bit
+ *        arithmetic, with the input ranges they see in net.
+ *
+ * Runs net forward iterations times, layer by layer, and records the largest
+ * magnitude of the input of each such layer as the input_max of its
+ * QuantizationParameter, with precision INT8, in the layer of the same name
+ * in param. net is a TEST net built from param with its trained weights; the
+ * batches it reads should be representative of those it will serve. Returns
+ * the number of layers quantized.
+ */
+template <typename Dtype>
+int CalibrateNet(Net<Dtype>* net, int iterations, NetParameter* param);
+
+}  // namespace caffe
+
+#endif  // CAFFE_UTIL_QUANTIZATION_HPP_
@@ -0,0 +1,58 @@
+#ifndef CAFFE_UTIL_TASK_GRAPH_HPP_
+#define CAFFE_UTIL_TASK_GRAPH_HPP_
+
+#include <boost/function.hpp>
+#include <vector>
+
+#include "caffe/common.hpp"
+#include "caffe/util/thread_pool.hpp"
+
+namespace caffe {
+
+/**
+ * @brief A dependency graph of tasks, run on a ThreadPool as soon as the
+ *        tasks they depend on are done.
+ *
+ * Each thread of the pool keeps the tasks it made ready in its own queue and
+ * runs the most recent first, so that chains of tasks stay on one thread;
+ * threads out of work steal the oldest task of another queue. Tasks marked
+ * on_caller only run on the thread calling Run, e.g. because they draw from
+ * its random number generator.
+ */
+class TaskGraph {
+ public:
+  explicit TaskGraph(int num_tasks);
+
+  /// Makes task after wait for task before to be done.
+  void AddDependency(int before, int after);
+  void set_on_caller(int task, bool on_caller) {
+    on_caller_[task] = on_caller;
+  }
+
+  /**
+   * @brief Calls fn(task) for the tasks in [first, last], taking the tasks
+   *        out of that range as done, and returns when all of them are.
+   */
+  void Run(ThreadPool* pool, const boost::function<void(int)>& fn, int first,
+      int last);
+  void Run(ThreadPool* pool, const boost::function<void(int)>& fn) {
+    Run(pool, fn, 0, num_tasks() - 1);
+  }
+
+  inline int num_tasks() const { return successors_.size(); }
+
+ protected:
+  class state;
+
+  void RunTasks(state* s, const boost::function<void(int)>& fn, int queue);
+
+  vector<vector<int> > successors_;
+  vector<vector<int> > predecessors_;
+  vector<bool> on_caller_;
+
+DISABLE_COPY_AND_ASSIGN(TaskGraph);
+};
+
+}  // namespace caffe
+
+#endif  // CAFFE_UTIL_TASK_GRAPH_HPP_
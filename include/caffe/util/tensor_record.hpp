@@ -0,0 +1,51 @@
+#ifndef CAFFE_UTIL_TENSOR_RECORD_HPP_
+#define CAFFE_UTIL_TENSOR_RECORD_HPP_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <string>
+
+#include "caffe/common.hpp"
+#include "caffe/proto/caffe.pb.h"
+
+namespace caffe {
+
+/**
+ * @brief A database value holding the uint8 pixels of an image as they are,
+ *        read in place where a Datum would be parsed and copied.
+ *
+ * The value is a header of kTensorRecordHeaderSize bytes, the four bytes of
+ * the magic "\0CTR" and the int32 label, channels, height and width in host
+ * byte order, followed by the channels * height * width pixels in CHW order.
+ * A serialized Datum never starts with a zero byte, so both kinds of values
+ * can share a database.
+ */
+struct TensorRecord {
+  int label;
+  int channels;
+  int height;
+  int width;
+  /// The pixels, inside the value the record was read from.
+  const uint8_t* data;
+};
+
+const size_t kTensorRecordHeaderSize = 20;
+
+/// @brief Whether the size bytes at value hold a tensor record.
+bool IsTensorRecord(const char* value, size_t size);
+
+/// @brief Points record at the tensor record in value, without copying.
+void ReadTensorRecord(const char* value, size_t size, TensorRecord* record);
+
+/// @brief Points record at the pixels of datum, if it holds uint8 pixels
+///        that are not encoded, and returns whether it does.
+bool DatumAsTensorRecord(const Datum& datum, TensorRecord* record);
+
+/// @brief Writes the uint8 pixels of datum, which must not be encoded, and
+///        its label as a tensor record.
+void DatumToTensorRecord(const Datum& datum, string* value);
+
+}  // namespace caffe
+
+#endif  // CAFFE_UTIL_TENSOR_RECORD_HPP_
@@ -0,0 +1,48 @@
+#ifndef CAFFE_UTIL_THREAD_POOL_HPP_
+#define CAFFE_UTIL_THREAD_POOL_HPP_
+
+#include <boost/function.hpp>
+
+#include "caffe/common.hpp"
+
+namespace caffe {
+
+/**
+ * @brief A fixed set of worker threads that run data-parallel loops.
+ *
+ * Run(n, fn) calls fn(i) once for every i in [0, n), spreading the calls over
+ * the workers and the calling thread, and returns when all of them are done.
+ * Workers inherit the Caffe mode, device and cpu_threads of the thread that
+ * created the pool, like InternalThread. Run is not reentrant: a task must not
+ * call Run on the pool that is executing it.
+ */
+class ThreadPool {
+ public:
+  /// num_threads counts the calling thread; values <= 0 select one thread per
+  /// hardware core.
+  explicit ThreadPool(int num_threads);
+  virtual ~ThreadPool();
+
+  void Run(int n, const boost::function<void(int)>& fn);
+
+  inline int num_threads() const { return num_threads_; }
+
+ protected:
+  /**
+   Move synchronization fields out instead of including boost/thread.hpp
+   to avoid a boost/NVCC issues (#1009, #1010) on OSX.
+   */
+  class sync;
+
+  void entry(int device, Caffe::Brew mode, int rand_seed, int cpu_threads);
+  void RunTasks();
+
+  int num_threads_;
+  shared_ptr<sync> sync_;
+
+DISABLE_COPY_AND_ASSIGN(ThreadPool);
+};
+
+}  // namespace caffe
+
+#endif  // CAFFE_UTIL_THREAD_POOL_HPP_
@@ -0,0 +1,27 @@
+#ifndef CAFFE_UTIL_VOXEL_DATUM_HPP_
+#define CAFFE_UTIL_VOXEL_DATUM_HPP_
+
+#include "caffe/common.hpp"
+#include "caffe/proto/caffe.pb.h"
+
+namespace caffe {
+
+/**
+ * @brief Stores the size^3 occupancy values in [0, 1] of voxels into datum,
+ *        one byte per voxel or, if bit_packed, one bit per voxel (values of
+ *        at least 0.5 are occupied).
+ */
+template <typename Dtype>
+void EncodeVoxels(int size, const Dtype* voxels, bool bit_packed,
+    VoxelDatum* datum);
+
+/**
+ * @brief Writes the occupancy values of datum to voxels, which must hold
+ *        voxels_size^3 values.
+ */
+template <typename Dtype>
+void DecodeVoxels(const VoxelDatum& datum, Dtype* voxels);
+
+}  // namespace caffe
+
+#endif  // CAFFE_UTIL_VOXEL_DATUM_HPP_
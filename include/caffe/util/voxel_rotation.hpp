@@ -0,0 +1,220 @@
+#ifndef CAFFE_UTIL_VOXEL_ROTATION_HPP_
+#define CAFFE_UTIL_VOXEL_ROTATION_HPP_
+
+#include <cmath>
+
+#include "caffe/common.hpp"
+
+namespace caffe {
+
+// The per-voxel arithmetic of the rotation below is shared by the CPU and GPU
+// implementations. On the device every operation is rounded to nearest so
+// that nvcc does not contract them into fused multiply-adds: both paths then
+// compute bit-identical source coordinates, hence identical outputs. The host
+// side relies on voxel_rotation.cpp being built with -ffp-contract=off (see
+// the Makefile and src/caffe/CMakeLists.txt), as g++ contracts by default
+// once FMA is enabled, e.g. by -march=native.
+#ifdef __CUDACC__
+#define VOXEL_ROTATION_FUNC __host__ __device__ inline
+#else
+#define VOXEL_ROTATION_FUNC inline
+#endif
+
+VOXEL_ROTATION_FUNC float rot_add(float a, float b) {
+#ifdef __CUDA_ARCH__
+  return __fadd_rn(a, b);
+#else
+  return a + b;
+#endif
+}
+VOXEL_ROTATION_FUNC double rot_add(double a, double b) {
+#ifdef __CUDA_ARCH__
+  return __dadd_rn(a, b);
+#else
+  return a + b;
+#endif
+}
+VOXEL_ROTATION_FUNC float rot_mul(float a, float b) {
+#ifdef __CUDA_ARCH__
+  return __fmul_rn(a, b);
+#else
+  return a * b;
+#endif
+}
+VOXEL_ROTATION_FUNC double rot_mul(double a, double b) {
+#ifdef __CUDA_ARCH__
+  return __dmul_rn(a, b);
+#else
+  return a * b;
+#endif
+}
+VOXEL_ROTATION_FUNC float rot_div(float a, float b) {
+#ifdef __CUDA_ARCH__
+  return __fdiv_rn(a, b);
+#else
+  return a / b;
+#endif
+}
+VOXEL_ROTATION_FUNC double rot_div(double a, double b) {
+#ifdef __CUDA_ARCH__
+  return __ddiv_rn(a, b);
+#else
+  return a / b;
+#endif
+}
+template <typename Dtype>
+VOXEL_ROTATION_FUNC Dtype rot_sub(Dtype a, Dtype b) {
+  return rot_add(a, -b);
+}
+template <typename Dtype>
+VOXEL_ROTATION_FUNC Dtype rot_clamp(Dtype x, Dtype lo, Dtype hi) {
+  return x < lo ? lo : (x > hi ? hi : x);
+}
+VOXEL_ROTATION_FUNC float rot_floor(float x) { return floorf(x); }
+VOXEL_ROTATION_FUNC double rot_floor(double x) { return floor(x); }
+VOXEL_ROTATION_FUNC float rot_round(float x) { return roundf(x); }
+VOXEL_ROTATION_FUNC double rot_round(double x) { return round(x); }
+
+/**
+ * Parameters of the rotation of one size^3 grid, see VoxelRotation: the 4x4
+ * transform from output to source NDC (row-major), proj(2,2) and proj(2,3) of
+ * the projection, then the NDC depth of each of the size output slices.
+ */
+enum {
+  kRotationTransform = 0,
+  kRotationP22 = 16,
+  kRotationP23 = 17,
+  kRotationDepths = 18
+};
+inline int voxel_rotation_num_params(int size) {
+  return kRotationDepths + size;
+}
+
+// Homogeneous source coordinates of the first voxel of row i of output slice
+// c.
+template <typename Dtype>
+VOXEL_ROTATION_FUNC void voxel_rotation_row(const Dtype* params, int size,
+    int c, int i, Dtype* base) {
+  const Dtype nx = rot_sub(rot_mul(rot_div(Dtype(0.5), Dtype(size)), Dtype(2)),
+                           Dtype(1));
+  const Dtype y = rot_sub(Dtype(1),
+                          rot_div(rot_add(Dtype(i), Dtype(0.5)), Dtype(size)));
+  const Dtype ny = rot_sub(rot_mul(y, Dtype(2)), Dtype(1));
+  const Dtype nz = params[kRotationDepths + c];
+  const Dtype* t = params + kRotationTransform;
+  for (int r = 0; r < 4; ++r) {
+    base[r] = rot_add(rot_add(rot_add(rot_mul(t[4 * r], nx),
+                                      rot_mul(t[4 * r + 1], ny)),
+                              rot_mul(t[4 * r + 2], nz)),
+                      t[4 * r + 3]);
+  }
+}
+
+// Source position of voxel j of the row starting at base: uz in slices, ui
+// and uj in rows and columns scaled to [0, size), so that the nearest voxel is
+// (round(uz), floor(ui), floor(uj)).
+template <typename Dtype>
+VOXEL_ROTATION_FUNC void voxel_rotation_source(const Dtype* params, int size,
+    const Dtype* base, int j, Dtype* uz, Dtype* ui, Dtype* uj) {
+  // NDC x advances by 2/size per output column, so the homogeneous
+  // coordinates advance by a constant column of the transform.
+  const Dtype* t = params + kRotationTransform;
+  const Dtype dx = rot_div(Dtype(2), Dtype(size));
+  const Dtype jd = Dtype(j);
+  const Dtype inv_w = rot_div(Dtype(1),
+      rot_add(base[3], rot_mul(jd, rot_mul(t[12], dx))));
+  Dtype coords[3];
+  for (int r = 0; r < 3; ++r) {
+    const Dtype h = rot_add(base[r], rot_mul(jd, rot_mul(t[4 * r], dx)));
+    coords[r] = rot_clamp(
+        rot_add(rot_div(rot_mul(h, inv_w), Dtype(2)), Dtype(0.5)),
+        Dtype(0.01), Dtype(0.99));
+  }
+  *ui = rot_mul(rot_sub(Dtype(1), coords[1]), Dtype(size));
+  *uj = rot_mul(coords[0], Dtype(size));
+  // Inverse of z_to_depth, see depth_to_z.
+  const Dtype d = rot_div(-params[kRotationP23],
+      rot_add(rot_sub(rot_mul(coords[2], Dtype(2)), Dtype(1)),
+              params[kRotationP22]));
+  const Dtype z = rot_sub(
+      rot_mul(rot_div(-rot_add(d, Dtype(2.5)), Dtype(5.5)), Dtype(size)),
+      Dtype(0.5));
+  *uz = rot_div(rot_sub(z, Dtype(size / 16)), Dtype(0.8));
+}
+
+// Offset of the voxel nearest to a source position.
+template <typename Dtype>
+VOXEL_ROTATION_FUNC int voxel_rotation_nearest(int size, Dtype uz, Dtype ui,
+    Dtype uj) {
+  int z = static_cast<int>(rot_round(uz));
+  z = z < 0 ? 0 : (z > size - 1 ? size - 1 : z);
+  const int i = static_cast<int>(rot_floor(ui));
+  const int j = static_cast<int>(rot_floor(uj));
+  return (z * size + i) * size + j;
+}
+
+// Trilinear interpolation of vox at a source position. Slices are centered on
+// integer uz, rows and columns on half-integer ui and uj; samples beyond the
+// outer centers take the border values.
+template <typename Dtype>
+VOXEL_ROTATION_FUNC Dtype voxel_rotation_trilinear(const Dtype* vox, int size,
+    Dtype uz, Dtype ui, Dtype uj) {
+  const Dtype last = Dtype(size - 1);
+  const Dtype p[3] = {
+    rot_clamp(uz, Dtype(0), last),
+    rot_clamp(rot_sub(ui, Dtype(0.5)), Dtype(0), last),
+    rot_clamp(rot_sub(uj, Dtype(0.5)), Dtype(0), last)
+  };
+  int lo[3], hi[3];
+  Dtype w[3];
+  for (int a = 0; a < 3; ++a) {
+    lo[a] = static_cast<int>(rot_floor(p[a]));
+    hi[a] = lo[a] < size - 1 ? lo[a] + 1 : lo[a];
+    w[a] = rot_sub(p[a], Dtype(lo[a]));
+  }
+  Dtype planes[2];
+  for (int dz = 0; dz < 2; ++dz) {
+    const Dtype* slice = vox + (dz ? hi[0] : lo[0]) * size * size;
+    Dtype rows[2];
+    for (int di = 0; di < 2; ++di) {
+      const Dtype* row = slice + (di ? hi[1] : lo[1]) * size;
+      rows[di] = rot_add(row[lo[2]],
+                         rot_mul(rot_sub(row[hi[2]], row[lo[2]]), w[2]));
+    }
+    planes[dz] = rot_add(rows[0], rot_mul(rot_sub(rows[1], rows[0]), w[1]));
+  }
+  return rot_add(planes[0], rot_mul(rot_sub(planes[1], planes[0]), w[0]));
+}
+
+/**
+ * @brief Resamples the output z-slices [z_begin, z_end) of the size^3 grid
+ *        vox into output, which points at the start of the full output grid,
+ *        with the rotation params (see voxel_rotation_num_params). Grids are
+ *        stored z-major: vox[(z * size + i) * size + j].
+ */
+template <typename Dtype>
+void rotate_grid_cpu(const Dtype* params, int size, bool trilinear,
+    const Dtype* vox, Dtype* output, int z_begin, int z_end);
+
+/**
+ * @brief Rotates a batch of num size^3 grids: grid n, at pred + n *
+ *        pred_stride, is resampled with params + n *
+ *        voxel_rotation_num_params(size) into output + items[n] *
+ *        output_stride.
+ *
+ * rotate_blobs_gpu takes device pointers and gives the same results bit for
+ * bit; rotate_blobs_cpu is its reference.
+ */
+template <typename Dtype>
+void rotate_blobs_cpu(int num, int size, const Dtype* params,
+    const Dtype* pred, int pred_stride, const int* items, bool trilinear,
+    Dtype* output, int output_stride);
+
+template <typename Dtype>
+void rotate_blobs_gpu(int num, int size, const Dtype* params,
+    const Dtype* pred, int pred_stride, const int* items, bool trilinear,
+    Dtype* output, int output_stride);
+
+}  // namespace caffe
+
+#endif  // CAFFE_UTIL_VOXEL_ROTATION_HPP_
@@ -0,0 +1,47 @@
+#ifndef _CAFFE_UTIL_WINOGRAD_HPP_
+#define _CAFFE_UTIL_WINOGRAD_HPP_
+
+namespace caffe {
+
+// Winograd minimal filtering F(tile x tile, 3 x 3) for tile 2 or 4 (Lavin &
+// Gray, 2015): the output is computed tile x tile at a time from input tiles
+// of (tile + 2) x (tile + 2), with one small GEMM per element of the
+// transformed tile instead of an im2col over the 3 x 3 kernel.
+
+/// @brief The number of elements of a transformed input or filter tile.
+inline int winograd_tile_elements(int tile) {
+  return (tile + 2) * (tile + 2);
+}
+
+/// @brief The size of the buffer conv_winograd_cpu needs.
+inline int winograd_buffer_size(int tile, int channels, int num_output,
+    int height_out, int width_out) {
+  const int tiles = ((height_out + tile - 1) / tile) *
+      ((width_out + tile - 1) / tile);
+  return winograd_tile_elements(tile) * (channels + num_output) * tiles;
+}
+
+/**
+ * @brief Transforms the num_output x channels x 3 x 3 weights into
+ *        winograd_tile_elements(tile) matrices of num_output x channels.
+ */
+template <typename Dtype>
+void winograd_weight_transform_cpu(const int tile, const Dtype* weights,
+    const int num_output, const int channels, Dtype* transformed);
+
+/**
+ * @brief Computes a stride 1, 3 x 3 convolution of one image.
+ *
+ * transformed_weights comes from winograd_weight_transform_cpu, buffer holds
+ * winograd_buffer_size elements and output, of num_output x height_out x
+ * width_out, is overwritten.
+ */
+template <typename Dtype>
+void conv_winograd_cpu(const int tile, const Dtype* data, const int channels,
+    const int height, const int width, const int pad_h, const int pad_w,
+    const Dtype* transformed_weights, const int num_output,
+    const int height_out, const int width_out, Dtype* buffer, Dtype* output);
+
+}  // namespace caffe
+
+#endif  // _CAFFE_UTIL_WINOGRAD_HPP_
@@ -1,9 +1,12 @@
+#include <algorithm>
 #include <climits>
+#include <string>
 #include <vector>
 
 #include "caffe/blob.hpp"
 #include "caffe/common.hpp"
 #include "caffe/syncedmem.hpp"
+#include "caffe/util/half.hpp"
 #include "caffe/util/math_functions.hpp"
 
 namespace caffe {
@@ -462,6 +465,28 @@ void Blob<Dtype>::CopyFrom(const Blob& source, bool copy_diff, bool reshape) {
   }
 }
 
+// Reads the count values of bytes, in storage, into y.
+template <typename Dtype>
+static void ReadHalf(const BlobStorage storage, const string& bytes,
+    const int count, Dtype* y) {
+  CHECK_EQ(count * sizeof(uint16_t), bytes.size());
+  vector<float> values(count);
+  caffe_cpu_from_half(storage, count,
+      reinterpret_cast<const uint16_t*>(bytes.data()), values.data());
+  std::copy(values.begin(), values.end(), y);
+}
+
+// Writes the count values of x to bytes, in storage.
+template <typename Dtype>
+static void WriteHalf(const BlobStorage storage, const int count,
+    const Dtype* x, string* bytes) {
+  bytes->resize(count * sizeof(uint16_t));
+  if (count > 0) {
+    caffe_cpu_to_half(storage, count, x,
+        reinterpret_cast<uint16_t*>(&(*bytes)[0]));
+  }
+}
+
 template <typename Dtype>
 void Blob<Dtype>::FromProto(const BlobProto& proto, bool reshape) {
   if (reshape) {
@@ -487,7 +512,9 @@ void Blob<Dtype>::FromProto(const BlobProto& proto, bool reshape) {
   }
   // copy data
   Dtype* data_vec = mutable_cpu_data();
-  if (proto.double_data_size() > 0) {
+  if (proto.storage() != NATIVE) {
+    ReadHalf(proto.storage(), proto.half_data(), count_, data_vec);
+  } else if (proto.double_data_size() > 0) {
     CHECK_EQ(count_, proto.double_data_size());
     for (int i = 0; i < count_; ++i) {
       data_vec[i] = proto.double_data(i);
@@ -498,7 +525,9 @@ void Blob<Dtype>::FromProto(const BlobProto& proto, bool reshape) {
       data_vec[i] = proto.data(i);
     }
   }
-  if (proto.double_diff_size() > 0) {
+  if (proto.has_half_diff()) {
+    ReadHalf(proto.storage(), proto.half_diff(), count_, mutable_cpu_diff());
+  } else if (proto.double_diff_size() > 0) {
     CHECK_EQ(count_, proto.double_diff_size());
     Dtype* diff_vec = mutable_cpu_diff();
     for (int i = 0; i < count_; ++i) {
@@ -514,14 +543,26 @@ void Blob<Dtype>::FromProto(const BlobProto& proto, bool reshape) {
 }
 
 template <>
-void Blob<double>::ToProto(BlobProto* proto, bool write_diff) const {
+void Blob<double>::ToProto(BlobProto* proto, bool write_diff,
+    BlobStorage storage) const {
   proto->clear_shape();
   for (int i = 0; i < shape_.size(); ++i) {
     proto->mutable_shape()->add_dim(shape_[i]);
   }
   proto->clear_double_data();
   proto->clear_double_diff();
+  proto->clear_storage();
+  proto->clear_half_data();
+  proto->clear_half_diff();
   const double* data_vec = cpu_data();
+  if (storage != NATIVE) {
+    proto->set_storage(storage);
+    WriteHalf(storage, count_, data_vec, proto->mutable_half_data());
+    if (write_diff) {
+      WriteHalf(storage, count_, cpu_diff(), proto->mutable_half_diff());
+    }
+    return;
+  }
   for (int i = 0; i < count_; ++i) {
     proto->add_double_data(data_vec[i]);
   }
@@ -534,14 +575,26 @@ void Blob<double>::ToProto(BlobProto* proto, bool write_diff) const {
 }
 
 template <>
-void Blob<float>::ToProto(BlobProto* proto, bool write_diff) const {
+void Blob<float>::ToProto(BlobProto* proto, bool write_diff,
+    BlobStorage storage) const {
   proto->clear_shape();
   for (int i = 0; i < shape_.size(); ++i) {
     proto->mutable_shape()->add_dim(shape_[i]);
   }
   proto->clear_data();
   proto->clear_diff();
+  proto->clear_storage();
+  proto->clear_half_data();
+  proto->clear_half_diff();
   const float* data_vec = cpu_data();
+  if (storage != NATIVE) {
+    proto->set_storage(storage);
+    WriteHalf(storage, count_, data_vec, proto->mutable_half_data());
+    if (write_diff) {
+      WriteHalf(storage, count_, cpu_diff(), proto->mutable_half_diff());
+    }
+    return;
+  }
   for (int i = 0; i < count_; ++i) {
     proto->add_data(data_vec[i]);
   }
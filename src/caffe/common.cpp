@@ -1,11 +1,13 @@
 #include <boost/thread.hpp>
 #include <glog/logging.h>
+#include <algorithm>
 #include <cmath>
 #include <cstdio>
 #include <ctime>
 
 #include "caffe/common.hpp"
 #include "caffe/util/rng.hpp"
+#include "caffe/util/thread_pool.hpp"
 
 namespace caffe {
 
@@ -49,11 +51,29 @@ void GlobalInit(int* pargc, char*** pargv) {
   ::google::InstallFailureSignalHandler();
 }
 
+void Caffe::set_cpu_threads(int threads) {
+  if (threads <= 0) {
+    threads = std::max<int>(boost::thread::hardware_concurrency(), 1);
+  }
+  if (threads != Get().cpu_threads_) {
+    Get().cpu_threads_ = threads;
+    Get().cpu_pool_.reset();
+  }
+}
+
+ThreadPool* Caffe::cpu_pool() {
+  if (!Get().cpu_pool_) {
+    Get().cpu_pool_.reset(new ThreadPool(Get().cpu_threads_));
+  }
+  return Get().cpu_pool_.get();
+}
+
 #ifdef CPU_ONLY  // CPU-only Caffe.
 
 Caffe::Caffe()
     : random_generator_(), mode_(Caffe::CPU),
-      solver_count_(1), solver_rank_(0), multiprocess_(false) { }
+      solver_count_(1), solver_rank_(0), multiprocess_(false),
+      cpu_threads_(1) { }
 
 Caffe::~Caffe() { }
 
@@ -107,7 +127,8 @@ void* Caffe::RNG::generator() {
 Caffe::Caffe()
     : cublas_handle_(NULL), curand_generator_(NULL), random_generator_(),
     mode_(Caffe::CPU),
-    solver_count_(1), solver_rank_(0), multiprocess_(false) {
+    solver_count_(1), solver_rank_(0), multiprocess_(false),
+    cpu_threads_(1) {
   // Try to create a cublas handler, and report an error if failed (but we will
   // keep the program running as one might just want to run CPU code).
   if (cublasCreate(&cublas_handle_) != CUBLAS_STATUS_SUCCESS) {
@@ -8,6 +8,7 @@
 #include "caffe/data_transformer.hpp"
 #include "caffe/util/io.hpp"
 #include "caffe/util/math_functions.hpp"
+#include "caffe/util/pixel_transform.hpp"
 #include "caffe/util/rng.hpp"
 
 namespace caffe {
@@ -42,47 +43,56 @@ template<typename Dtype>
 void DataTransformer<Dtype>::Transform(const Datum& datum,
                                        Dtype* transformed_data) {
   const string& data = datum.data();
-  const int datum_channels = datum.channels();
-  const int datum_height = datum.height();
-  const int datum_width = datum.width();
+  if (data.size() > 0) {
+    Transform(reinterpret_cast<const uint8_t*>(data.data()),
+        datum.channels(), datum.height(), datum.width(), transformed_data);
+  } else {
+    Transform(datum.float_data().data(), datum.channels(), datum.height(),
+        datum.width(), transformed_data);
+  }
+}
 
+template<typename Dtype>
+template<typename T>
+void DataTransformer<Dtype>::Transform(const T* data,
+    const int datum_channels, const int datum_height, const int datum_width,
+    Dtype* transformed_data) {
+  int augmentation[3];
+  DrawAugmentation(datum_channels, datum_height, datum_width, augmentation);
+  PrepareMean(datum_channels, datum_height, datum_width);
   const int crop_size = param_.crop_size();
   const Dtype scale = param_.scale();
-  const bool do_mirror = param_.mirror() && Rand(2);
-  const bool has_mean_file = param_.has_mean_file();
-  const bool has_uint8 = data.size() > 0;
+  const Dtype* mean = param_.has_mean_file() ? data_mean_.cpu_data() : NULL;
   const bool has_mean_values = mean_values_.size() > 0;
+  const int height = crop_size ? crop_size : datum_height;
+  const int width = crop_size ? crop_size : datum_width;
 
-  CHECK_GT(datum_channels, 0);
-  CHECK_GE(datum_height, crop_size);
-  CHECK_GE(datum_width, crop_size);
-
-  Dtype* mean = NULL;
-  if (has_mean_file) {
-    CHECK_EQ(datum_channels, data_mean_.channels());
-    CHECK_EQ(datum_height, data_mean_.height());
-    CHECK_EQ(datum_width, data_mean_.width());
-    mean = data_mean_.mutable_cpu_data();
-  }
-  if (has_mean_values) {
-    CHECK(mean_values_.size() == 1 || mean_values_.size() == datum_channels) <<
-     "Specify either 1 mean_value or as many as channels: " << datum_channels;
-    if (datum_channels > 1 && mean_values_.size() == 1) {
-      // Replicate the mean_value for simplicity
-      for (int c = 1; c < datum_channels; ++c) {
-        mean_values_.push_back(mean_values_[0]);
-      }
+  // The crop is an offset into each row of the data and the mean.
+  for (int c = 0; c < datum_channels; ++c) {
+    const Dtype mean_value = has_mean_values ? mean_values_[c] : Dtype(0);
+    for (int h = 0; h < height; ++h) {
+      const int data_index = (c * datum_height + augmentation[0] + h) *
+          datum_width + augmentation[1];
+      caffe_cpu_transform_row(width, data + data_index, 1,
+          mean ? mean + data_index : NULL, mean_value, scale,
+          augmentation[2] != 0, transformed_data + (c * height + h) * width);
     }
   }
+}
 
-  int height = datum_height;
-  int width = datum_width;
+template<typename Dtype>
+void DataTransformer<Dtype>::DrawAugmentation(const int datum_channels,
+    const int datum_height, const int datum_width, int* augmentation) {
+  const int crop_size = param_.crop_size();
+  const bool do_mirror = param_.mirror() && Rand(2);
+
+  CHECK_GT(datum_channels, 0);
+  CHECK_GE(datum_height, crop_size);
+  CHECK_GE(datum_width, crop_size);
 
   int h_off = 0;
   int w_off = 0;
   if (crop_size) {
-    height = crop_size;
-    width = crop_size;
     // We only do random crop when we do training.
     if (phase_ == TRAIN) {
       h_off = Rand(datum_height - crop_size + 1);
@@ -92,40 +102,54 @@ void DataTransformer<Dtype>::Transform(const Datum& datum,
       w_off = (datum_width - crop_size) / 2;
     }
   }
+  augmentation[0] = h_off;
+  augmentation[1] = w_off;
+  augmentation[2] = do_mirror;
+}
 
-  Dtype datum_element;
-  int top_index, data_index;
-  for (int c = 0; c < datum_channels; ++c) {
-    for (int h = 0; h < height; ++h) {
-      for (int w = 0; w < width; ++w) {
-        data_index = (c * datum_height + h_off + h) * datum_width + w_off + w;
-        if (do_mirror) {
-          top_index = (c * height + h) * width + (width - 1 - w);
-        } else {
-          top_index = (c * height + h) * width + w;
-        }
-        if (has_uint8) {
-          datum_element =
-            static_cast<Dtype>(static_cast<uint8_t>(data[data_index]));
-        } else {
-          datum_element = datum.float_data(data_index);
-        }
-        if (has_mean_file) {
-          transformed_data[top_index] =
-            (datum_element - mean[data_index]) * scale;
-        } else {
-          if (has_mean_values) {
-            transformed_data[top_index] =
-              (datum_element - mean_values_[c]) * scale;
-          } else {
-            transformed_data[top_index] = datum_element * scale;
-          }
-        }
+template<typename Dtype>
+void DataTransformer<Dtype>::PrepareMean(const int datum_channels,
+    const int datum_height, const int datum_width) {
+  if (param_.has_mean_file()) {
+    CHECK_EQ(datum_channels, data_mean_.channels());
+    CHECK_EQ(datum_height, data_mean_.height());
+    CHECK_EQ(datum_width, data_mean_.width());
+  }
+  if (mean_values_.size() > 0) {
+    CHECK(mean_values_.size() == 1 || mean_values_.size() == datum_channels) <<
+     "Specify either 1 mean_value or as many as channels: " << datum_channels;
+    if (datum_channels > 1 && mean_values_.size() == 1) {
+      // Replicate the mean_value for simplicity
+      for (int c = 1; c < datum_channels; ++c) {
+        mean_values_.push_back(mean_values_[0]);
       }
     }
   }
 }
 
+template<typename Dtype>
+void DataTransformer<Dtype>::CheckTransformedShape(const int datum_channels,
+    const int datum_height, const int datum_width,
+    const Blob<Dtype>& transformed_blob) {
+  const int crop_size = param_.crop_size();
+  const int channels = transformed_blob.channels();
+  const int height = transformed_blob.height();
+  const int width = transformed_blob.width();
+  const int num = transformed_blob.num();
+
+  CHECK_EQ(channels, datum_channels);
+  CHECK_LE(height, datum_height);
+  CHECK_LE(width, datum_width);
+  CHECK_GE(num, 1);
+
+  if (crop_size) {
+    CHECK_EQ(crop_size, height);
+    CHECK_EQ(crop_size, width);
+  } else {
+    CHECK_EQ(datum_height, height);
+    CHECK_EQ(datum_width, width);
+  }
+}
 
 template<typename Dtype>
 void DataTransformer<Dtype>::Transform(const Datum& datum,
@@ -153,32 +177,66 @@ void DataTransformer<Dtype>::Transform(const Datum& datum,
     }
   }
 
-  const int crop_size = param_.crop_size();
-  const int datum_channels = datum.channels();
-  const int datum_height = datum.height();
-  const int datum_width = datum.width();
+  CheckTransformedShape(datum.channels(), datum.height(), datum.width(),
+      *transformed_blob);
+  Dtype* transformed_data = transformed_blob->mutable_cpu_data();
+  Transform(datum, transformed_data);
+}
 
-  // Check dimensions.
-  const int channels = transformed_blob->channels();
-  const int height = transformed_blob->height();
-  const int width = transformed_blob->width();
-  const int num = transformed_blob->num();
+template<typename Dtype>
+void DataTransformer<Dtype>::Transform(const TensorRecord& record,
+                                       Blob<Dtype>* transformed_blob) {
+  CheckTransformedShape(record.channels, record.height, record.width,
+      *transformed_blob);
+  Transform(record.data, record.channels, record.height, record.width,
+      transformed_blob->mutable_cpu_data());
+}
 
-  CHECK_EQ(channels, datum_channels);
-  CHECK_LE(height, datum_height);
-  CHECK_LE(width, datum_width);
-  CHECK_GE(num, 1);
+template<typename Dtype>
+void DataTransformer<Dtype>::TransformRaw(const vector<int>& raw_shape,
+    const uint8_t* raw, const int* augmentation,
+    Blob<Dtype>* transformed_blob) {
+  CHECK_EQ(raw_shape.size(), 4);
+  PrepareMean(raw_shape[1], raw_shape[2], raw_shape[3]);
+  CheckTransformedShape(raw_shape[1], raw_shape[2], raw_shape[3],
+      *transformed_blob);
+  CHECK_EQ(raw_shape[0], transformed_blob->num());
+  caffe_cpu_transform_batch(raw_shape[0], raw_shape[1], raw_shape[2],
+      raw_shape[3], raw, augmentation, transformed_blob->height(),
+      transformed_blob->width(),
+      param_.has_mean_file() ? data_mean_.cpu_data() : NULL,
+      mean_values_.size() > 0 ? &mean_values_[0] : NULL,
+      Dtype(param_.scale()), transformed_blob->mutable_cpu_data());
+}
 
-  if (crop_size) {
-    CHECK_EQ(crop_size, height);
-    CHECK_EQ(crop_size, width);
-  } else {
-    CHECK_EQ(datum_height, height);
-    CHECK_EQ(datum_width, width);
+template<typename Dtype>
+void DataTransformer<Dtype>::TransformRaw_gpu(const vector<int>& raw_shape,
+    const uint8_t* raw, const int* augmentation,
+    Blob<Dtype>* transformed_blob) {
+#ifndef CPU_ONLY
+  CHECK_EQ(raw_shape.size(), 4);
+  PrepareMean(raw_shape[1], raw_shape[2], raw_shape[3]);
+  CheckTransformedShape(raw_shape[1], raw_shape[2], raw_shape[3],
+      *transformed_blob);
+  CHECK_EQ(raw_shape[0], transformed_blob->num());
+  const Dtype* mean_values = NULL;
+  if (mean_values_.size() > 0) {
+    const int channels = mean_values_.size();
+    if (mean_values_blob_.count() != channels) {
+      mean_values_blob_.Reshape(vector<int>(1, channels));
+      caffe_copy(channels, &mean_values_[0],
+          mean_values_blob_.mutable_cpu_data());
+    }
+    mean_values = mean_values_blob_.gpu_data();
   }
-
-  Dtype* transformed_data = transformed_blob->mutable_cpu_data();
-  Transform(datum, transformed_data);
+  caffe_gpu_transform_batch(raw_shape[0], raw_shape[1], raw_shape[2],
+      raw_shape[3], raw, augmentation, transformed_blob->height(),
+      transformed_blob->width(),
+      param_.has_mean_file() ? data_mean_.gpu_data() : NULL, mean_values,
+      Dtype(param_.scale()), transformed_blob->mutable_gpu_data());
+#else
+  NO_GPU;
+#endif
 }
 
 template<typename Dtype>
@@ -293,33 +351,16 @@ void DataTransformer<Dtype>::Transform(const cv::Mat& cv_img,
 
   CHECK(cv_cropped_img.data);
 
+  // Each channel of a row steps over the interleaved channels of the image.
   Dtype* transformed_data = transformed_blob->mutable_cpu_data();
-  int top_index;
   for (int h = 0; h < height; ++h) {
     const uchar* ptr = cv_cropped_img.ptr<uchar>(h);
-    int img_index = 0;
-    for (int w = 0; w < width; ++w) {
-      for (int c = 0; c < img_channels; ++c) {
-        if (do_mirror) {
-          top_index = (c * height + h) * width + (width - 1 - w);
-        } else {
-          top_index = (c * height + h) * width + w;
-        }
-        // int top_index = (c * height + h) * width + w;
-        Dtype pixel = static_cast<Dtype>(ptr[img_index++]);
-        if (has_mean_file) {
-          int mean_index = (c * img_height + h_off + h) * img_width + w_off + w;
-          transformed_data[top_index] =
-            (pixel - mean[mean_index]) * scale;
-        } else {
-          if (has_mean_values) {
-            transformed_data[top_index] =
-              (pixel - mean_values_[c]) * scale;
-          } else {
-            transformed_data[top_index] = pixel * scale;
-          }
-        }
-      }
+    for (int c = 0; c < img_channels; ++c) {
+      const int mean_index = (c * img_height + h_off + h) * img_width + w_off;
+      caffe_cpu_transform_row(width, ptr + c, img_channels,
+          has_mean_file ? mean + mean_index : NULL,
+          has_mean_values ? mean_values_[c] : Dtype(0), scale, do_mirror,
+          transformed_data + (c * height + h) * width);
     }
   }
 }
@@ -474,6 +515,20 @@ vector<int> DataTransformer<Dtype>::InferBlobShape(const Datum& datum) {
   return shape;
 }
 
+template<typename Dtype>
+vector<int> DataTransformer<Dtype>::InferBlobShape(
+    const TensorRecord& record) {
+  const int crop_size = param_.crop_size();
+  CHECK_GE(record.height, crop_size);
+  CHECK_GE(record.width, crop_size);
+  vector<int> shape(4);
+  shape[0] = 1;
+  shape[1] = record.channels;
+  shape[2] = (crop_size)? crop_size: record.height;
+  shape[3] = (crop_size)? crop_size: record.width;
+  return shape;
+}
+
 template<typename Dtype>
 vector<int> DataTransformer<Dtype>::InferBlobShape(
     const vector<Datum> & datum_vector) {
@@ -3,8 +3,10 @@
 
 #include "caffe/filler.hpp"
 #include "caffe/layers/base_conv_layer.hpp"
+#include "caffe/util/blas_backend.hpp"
 #include "caffe/util/im2col.hpp"
 #include "caffe/util/math_functions.hpp"
+#include "caffe/util/thread_pool.hpp"
 
 namespace caffe {
 
@@ -138,6 +140,14 @@ void BaseConvolutionLayer<Dtype>::LayerSetUp(const vector<Blob<Dtype>*>& bottom,
     weight_shape.push_back(kernel_shape_data[i]);
   }
   bias_term_ = this->layer_param_.convolution_param().bias_term();
+  activation_ = this->layer_param_.convolution_param().activation();
+  CHECK(!reverse_dimensions() ||
+      activation_.type() == ActivationParameter_Type_NONE)
+      << "Deconvolution has no fused activation.";
+  quantization_ = this->layer_param_.convolution_param().quantization();
+  CHECK(!reverse_dimensions() || quantization_.precision() ==
+      QuantizationParameter_Precision_FLOAT)
+      << "Deconvolution only runs in floating point.";
   vector<int> bias_shape(bias_term_, num_output_);
   if (this->blobs_.size() > 0) {
     CHECK_EQ(1 + bias_term_, this->blobs_.size())
@@ -256,22 +266,80 @@ void BaseConvolutionLayer<Dtype>::Reshape(const vector<Blob<Dtype>*>& bottom,
 
 template <typename Dtype>
 void BaseConvolutionLayer<Dtype>::forward_cpu_gemm(const Dtype* input,
-    const Dtype* weights, Dtype* output, bool skip_im2col) {
-  const Dtype* col_buff = input;
+    const Dtype* weights, Dtype* output, bool skip_im2col, Dtype* col_buff) {
+  const Dtype* gemm_input = input;
   if (!is_1x1_) {
+    if (!col_buff) {
+      col_buff = col_buffer_.mutable_cpu_data();
+    }
     if (!skip_im2col) {
-      conv_im2col_cpu(input, col_buffer_.mutable_cpu_data());
+      conv_im2col_cpu(input, col_buff);
     }
-    col_buff = col_buffer_.cpu_data();
+    gemm_input = col_buff;
   }
   for (int g = 0; g < group_; ++g) {
+    if (weights == packed_weights_source_) {
+      caffe_cpu_gemm_packed<Dtype>(*packed_weights_[g], CblasNoTrans,
+          conv_out_spatial_dim_, (Dtype)1., gemm_input + col_offset_ * g,
+          (Dtype)0., output + output_offset_ * g);
+      continue;
+    }
     caffe_cpu_gemm<Dtype>(CblasNoTrans, CblasNoTrans, conv_out_channels_ /
         group_, conv_out_spatial_dim_, kernel_dim_,
-        (Dtype)1., weights + weight_offset_ * g, col_buff + col_offset_ * g,
+        (Dtype)1., weights + weight_offset_ * g, gemm_input + col_offset_ * g,
         (Dtype)0., output + output_offset_ * g);
   }
 }
 
+template <typename Dtype>
+void BaseConvolutionLayer<Dtype>::pack_cpu_weights() {
+  packed_weights_source_ = NULL;
+  if (int8_forward()) {
+    int8_weights_.resize(group_);
+    for (int g = 0; g < group_; ++g) {
+      if (!int8_weights_[g]) {
+        int8_weights_[g].reset(new Int8Matrix<Dtype>());
+      }
+      int8_weights_[g]->Quantize(CblasNoTrans, conv_out_channels_ / group_,
+          kernel_dim_, *this->blobs_[0], weight_offset_ * g);
+    }
+    return;
+  }
+  if (this->phase_ != TEST || caffe_blas_backend() != BLAS_BUILTIN) {
+    return;
+  }
+  packed_weights_.resize(group_);
+  for (int g = 0; g < group_; ++g) {
+    if (!packed_weights_[g]) {
+      packed_weights_[g].reset(new PackedMatrix<Dtype>());
+    }
+    packed_weights_[g]->Pack(PackedMatrix<Dtype>::LEFT, CblasNoTrans,
+        conv_out_channels_ / group_, kernel_dim_, *this->blobs_[0],
+        weight_offset_ * g);
+  }
+  packed_weights_source_ = this->blobs_[0]->cpu_data();
+}
+
+template <typename Dtype>
+void BaseConvolutionLayer<Dtype>::forward_cpu_int8(const Dtype* input,
+    const Dtype* bias, Dtype* output, Dtype* col_buff) {
+  const Dtype* gemm_input = input;
+  if (!is_1x1_) {
+    if (!col_buff) {
+      col_buff = col_buffer_.mutable_cpu_data();
+    }
+    conv_im2col_cpu(input, col_buff);
+    gemm_input = col_buff;
+  }
+  const int group_outputs = conv_out_channels_ / group_;
+  for (int g = 0; g < group_; ++g) {
+    caffe_cpu_gemm_int8<Dtype>(*int8_weights_[g], CblasNoTrans,
+        conv_out_spatial_dim_, quantization_.input_max(),
+        gemm_input + col_offset_ * g, bias ? bias + group_outputs * g : NULL,
+        CblasNoTrans, output + output_offset_ * g);
+  }
+}
+
 template <typename Dtype>
 void BaseConvolutionLayer<Dtype>::forward_cpu_bias(Dtype* output,
     const Dtype* bias) {
@@ -282,10 +350,11 @@ void BaseConvolutionLayer<Dtype>::forward_cpu_bias(Dtype* output,
 
 template <typename Dtype>
 void BaseConvolutionLayer<Dtype>::backward_cpu_gemm(const Dtype* output,
-    const Dtype* weights, Dtype* input) {
-  Dtype* col_buff = col_buffer_.mutable_cpu_data();
+    const Dtype* weights, Dtype* input, Dtype* col_buff) {
   if (is_1x1_) {
     col_buff = input;
+  } else if (!col_buff) {
+    col_buff = col_buffer_.mutable_cpu_data();
   }
   for (int g = 0; g < group_; ++g) {
     caffe_cpu_gemm<Dtype>(CblasTrans, CblasNoTrans, kernel_dim_,
@@ -300,16 +369,19 @@ void BaseConvolutionLayer<Dtype>::backward_cpu_gemm(const Dtype* output,
 
 template <typename Dtype>
 void BaseConvolutionLayer<Dtype>::weight_cpu_gemm(const Dtype* input,
-    const Dtype* output, Dtype* weights) {
-  const Dtype* col_buff = input;
+    const Dtype* output, Dtype* weights, Dtype* col_buff) {
+  const Dtype* gemm_input = input;
   if (!is_1x1_) {
-    conv_im2col_cpu(input, col_buffer_.mutable_cpu_data());
-    col_buff = col_buffer_.cpu_data();
+    if (!col_buff) {
+      col_buff = col_buffer_.mutable_cpu_data();
+    }
+    conv_im2col_cpu(input, col_buff);
+    gemm_input = col_buff;
   }
   for (int g = 0; g < group_; ++g) {
     caffe_cpu_gemm<Dtype>(CblasNoTrans, CblasTrans, conv_out_channels_ / group_,
         kernel_dim_, conv_out_spatial_dim_,
-        (Dtype)1., output + output_offset_ * g, col_buff + col_offset_ * g,
+        (Dtype)1., output + output_offset_ * g, gemm_input + col_offset_ * g,
         (Dtype)1., weights + weight_offset_ * g);
   }
 }
@@ -321,6 +393,54 @@ void BaseConvolutionLayer<Dtype>::backward_cpu_bias(Dtype* bias,
       input, bias_multiplier_.cpu_data(), 1., bias);
 }
 
+template <typename Dtype>
+void BaseConvolutionLayer<Dtype>::cpu_batch(
+    const boost::function<void(int)>& fn, Dtype* weight_diff,
+    bool col_buffers) {
+  cpu_batch_threads_ = cpu_batch_threads();
+  const int threads = cpu_batch_threads_;
+  // Take the buffers to the CPU here: their state is not safe to change
+  // from several threads.
+  cpu_col_buffers_.assign(threads, NULL);
+  cpu_weight_diffs_.assign(threads, NULL);
+  col_buffers = col_buffers && !is_1x1_;
+  if (col_buffers) {
+    cpu_col_buffers_[0] = col_buffer_.mutable_cpu_data();
+  }
+  if (bias_term_) {
+    bias_multiplier_.cpu_data();
+  }
+  if (threads == 1) {
+    fn(0);
+    return;
+  }
+  const int weight_count = this->blobs_[0]->count();
+  vector<int> shape(2, threads - 1);
+  if (col_buffers) {
+    shape[1] = col_buffer_.count();
+    thread_col_buffers_.Reshape(shape);
+    Dtype* data = thread_col_buffers_.mutable_cpu_data();
+    for (int t = 1; t < threads; ++t) {
+      cpu_col_buffers_[t] = data + (t - 1) * shape[1];
+    }
+  }
+  if (weight_diff) {
+    shape[1] = weight_count;
+    thread_weight_diffs_.Reshape(shape);
+    Dtype* data = thread_weight_diffs_.mutable_cpu_data();
+    caffe_set(thread_weight_diffs_.count(), Dtype(0), data);
+    for (int t = 1; t < threads; ++t) {
+      cpu_weight_diffs_[t] = data + (t - 1) * weight_count;
+    }
+  }
+  Caffe::cpu_pool()->Run(threads, fn);
+  if (weight_diff) {
+    for (int t = 1; t < threads; ++t) {
+      caffe_axpy(weight_count, Dtype(1), cpu_weight_diffs_[t], weight_diff);
+    }
+  }
+}
+
 #ifndef CPU_ONLY
 
 template <typename Dtype>
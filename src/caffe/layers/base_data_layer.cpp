@@ -8,6 +8,7 @@
 #include "caffe/layers/base_data_layer.hpp"
 #include "caffe/proto/caffe.pb.h"
 #include "caffe/util/blocking_queue.hpp"
+#include "caffe/util/math_functions.hpp"
 
 namespace caffe {
 
@@ -37,7 +38,8 @@ BasePrefetchingDataLayer<Dtype>::BasePrefetchingDataLayer(
     const LayerParameter& param)
     : BaseDataLayer<Dtype>(param),
       prefetch_(param.data_param().prefetch()),
-      prefetch_free_(), prefetch_full_(), prefetch_current_() {
+      prefetch_free_(), prefetch_full_(), prefetch_current_(),
+      packed_label_bits_(0), defer_transform_(false) {
   for (int i = 0; i < prefetch_.size(); ++i) {
     prefetch_[i].reset(new Batch<Dtype>());
     prefetch_free_.push(prefetch_[i].get());
@@ -47,25 +49,63 @@ BasePrefetchingDataLayer<Dtype>::BasePrefetchingDataLayer(
 template <typename Dtype>
 void BasePrefetchingDataLayer<Dtype>::LayerSetUp(
     const vector<Blob<Dtype>*>& bottom, const vector<Blob<Dtype>*>& top) {
+  // Tops past data and label are backed by the extra blobs of each batch.
+  for (int i = 0; i < prefetch_.size(); ++i) {
+    prefetch_[i]->extra_.clear();
+    for (int j = 2; j < top.size(); ++j) {
+      prefetch_[i]->extra_.push_back(
+          shared_ptr<Blob<Dtype> >(new Blob<Dtype>()));
+    }
+  }
   BaseDataLayer<Dtype>::LayerSetUp(bottom, top);
+  if (packed_label_bits_) {
+    CHECK(packed_label_bits_ == 1 || packed_label_bits_ == 8)
+        << "Labels are packed with 1 or 8 bits";
+    CHECK(this->output_labels_) << "There is no label to pack";
+    for (int i = 0; i < prefetch_.size(); ++i) {
+      prefetch_[i]->label_bits_ = packed_label_bits_;
+      CHECK_EQ(prefetch_[i]->label_.count(1) * packed_label_bits_ % 8, 0)
+          << "Packed labels of an item must fill whole bytes";
+    }
+  }
 
   // Before starting the prefetch thread, we make cpu_data and gpu_data
   // calls so that the prefetch thread does not accidentally make simultaneous
   // cudaMalloc calls when the main thread is running. In some GPUs this
   // seems to cause failures if we do not so.
   for (int i = 0; i < prefetch_.size(); ++i) {
-    prefetch_[i]->data_.mutable_cpu_data();
-    if (this->output_labels_) {
+    if (defer_transform_) {
+      prefetch_[i]->mutable_raw_data();
+      prefetch_[i]->mutable_augmentation();
+    } else {
+      prefetch_[i]->data_.mutable_cpu_data();
+    }
+    if (packed_label_bits_) {
+      prefetch_[i]->mutable_packed_label();
+    } else if (this->output_labels_) {
       prefetch_[i]->label_.mutable_cpu_data();
     }
+    for (int j = 0; j < prefetch_[i]->extra_.size(); ++j) {
+      prefetch_[i]->extra_[j]->mutable_cpu_data();
+    }
   }
 #ifndef CPU_ONLY
   if (Caffe::mode() == Caffe::GPU) {
     for (int i = 0; i < prefetch_.size(); ++i) {
-      prefetch_[i]->data_.mutable_gpu_data();
-      if (this->output_labels_) {
+      if (defer_transform_) {
+        prefetch_[i]->raw_data_->mutable_gpu_data();
+        prefetch_[i]->augmentation_->mutable_gpu_data();
+      } else {
+        prefetch_[i]->data_.mutable_gpu_data();
+      }
+      if (packed_label_bits_) {
+        prefetch_[i]->packed_label_->mutable_gpu_data();
+      } else if (this->output_labels_) {
         prefetch_[i]->label_.mutable_gpu_data();
       }
+      for (int j = 0; j < prefetch_[i]->extra_.size(); ++j) {
+        prefetch_[i]->extra_[j]->mutable_gpu_data();
+      }
     }
   }
 #endif
@@ -75,6 +115,44 @@ void BasePrefetchingDataLayer<Dtype>::LayerSetUp(
   DLOG(INFO) << "Prefetch initialized.";
 }
 
+template <typename Dtype>
+void BasePrefetchingDataLayer<Dtype>::Resume(uint64_t batches) {
+  CHECK(resumable()) << this->type() << " layer " << this->layer_param_.name()
+      << " cannot resume";
+  StopInternalThread();
+  // Drop the batches prefetched from the old position, and any the thread
+  // was loading when stopped.
+  Batch<Dtype>* batch;
+  while (prefetch_full_.try_pop(&batch)) {}
+  while (prefetch_free_.try_pop(&batch)) {}
+  for (int i = 0; i < prefetch_.size(); ++i) {
+    if (prefetch_[i].get() != prefetch_current_) {
+      prefetch_free_.push(prefetch_[i].get());
+    }
+  }
+  SeekBatches(batches);
+  StartInternalThread();
+}
+
+template <typename Dtype>
+bool BasePrefetchingDataLayer<Dtype>::Skip(uint64_t offset) const {
+  int size = Caffe::solver_count();
+  int rank = Caffe::solver_rank();
+  bool keep = (offset % size) == rank ||
+              // In test mode, only rank 0 runs, so avoid skipping
+              this->layer_param_.phase() == TEST;
+  return !keep;
+}
+
+#ifndef CPU_ONLY
+// Pushes mem to the GPU, unless load_batch filled it on the GPU already.
+static void PushToGPU(SyncedMemory* mem, const cudaStream_t& stream) {
+  if (mem->head() == SyncedMemory::HEAD_AT_CPU) {
+    mem->async_gpu_push(stream);
+  }
+}
+#endif
+
 template <typename Dtype>
 void BasePrefetchingDataLayer<Dtype>::InternalThreadEntry() {
 #ifndef CPU_ONLY
@@ -90,9 +168,19 @@ void BasePrefetchingDataLayer<Dtype>::InternalThreadEntry() {
       load_batch(batch);
 #ifndef CPU_ONLY
       if (Caffe::mode() == Caffe::GPU) {
-        batch->data_.data().get()->async_gpu_push(stream);
-        if (this->output_labels_) {
-          batch->label_.data().get()->async_gpu_push(stream);
+        if (defer_transform_) {
+          PushToGPU(batch->raw_data_.get(), stream);
+          PushToGPU(batch->augmentation_.get(), stream);
+        } else {
+          PushToGPU(batch->data_.data().get(), stream);
+        }
+        if (batch->label_bits_) {
+          PushToGPU(batch->packed_label_.get(), stream);
+        } else if (this->output_labels_) {
+          PushToGPU(batch->label_.data().get(), stream);
+        }
+        for (int i = 0; i < batch->extra_.size(); ++i) {
+          PushToGPU(batch->extra_[i]->data().get(), stream);
         }
         CUDA_CHECK(cudaStreamSynchronize(stream));
       }
@@ -118,12 +206,32 @@ void BasePrefetchingDataLayer<Dtype>::Forward_cpu(
   prefetch_current_ = prefetch_full_.pop("Waiting for data");
   // Reshape to loaded data.
   top[0]->ReshapeLike(prefetch_current_->data_);
-  top[0]->set_cpu_data(prefetch_current_->data_.mutable_cpu_data());
-  if (this->output_labels_) {
+  if (defer_transform_) {
+    // Transform the raw pixels into the top's own memory.
+    this->data_transformer_->TransformRaw(prefetch_current_->raw_shape_,
+        static_cast<const uint8_t*>(prefetch_current_->raw_data_->cpu_data()),
+        static_cast<const int*>(prefetch_current_->augmentation_->cpu_data()),
+        top[0]);
+  } else {
+    top[0]->set_cpu_data(prefetch_current_->data_.mutable_cpu_data());
+  }
+  if (prefetch_current_->label_bits_) {
+    // Expand the packed labels into the top's own memory.
+    top[1]->ReshapeLike(prefetch_current_->label_);
+    const uint8_t* packed = static_cast<const uint8_t*>(
+        prefetch_current_->packed_label_->cpu_data());
+    caffe_unpack_occupancy(top[1]->count(), prefetch_current_->label_bits_,
+        packed, top[1]->mutable_cpu_data());
+  } else if (this->output_labels_) {
     // Reshape to loaded labels.
     top[1]->ReshapeLike(prefetch_current_->label_);
     top[1]->set_cpu_data(prefetch_current_->label_.mutable_cpu_data());
   }
+  for (int i = 0; i < prefetch_current_->extra_.size(); ++i) {
+    Blob<Dtype>* extra = prefetch_current_->extra_[i].get();
+    top[i + 2]->ReshapeLike(*extra);
+    top[i + 2]->set_cpu_data(extra->mutable_cpu_data());
+  }
 }
 
 #ifdef CPU_ONLY
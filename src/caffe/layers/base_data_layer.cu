@@ -1,6 +1,7 @@
 #include <vector>
 
 #include "caffe/layers/base_data_layer.hpp"
+#include "caffe/util/math_functions.hpp"
 
 namespace caffe {
 
@@ -13,12 +14,32 @@ void BasePrefetchingDataLayer<Dtype>::Forward_gpu(
   prefetch_current_ = prefetch_full_.pop("Waiting for data");
   // Reshape to loaded data.
   top[0]->ReshapeLike(prefetch_current_->data_);
-  top[0]->set_gpu_data(prefetch_current_->data_.mutable_gpu_data());
-  if (this->output_labels_) {
+  if (defer_transform_) {
+    // Transform the raw pixels into the top's own memory.
+    this->data_transformer_->TransformRaw_gpu(prefetch_current_->raw_shape_,
+        static_cast<const uint8_t*>(prefetch_current_->raw_data_->gpu_data()),
+        static_cast<const int*>(prefetch_current_->augmentation_->gpu_data()),
+        top[0]);
+  } else {
+    top[0]->set_gpu_data(prefetch_current_->data_.mutable_gpu_data());
+  }
+  if (prefetch_current_->label_bits_) {
+    // Expand the packed labels into the top's own memory.
+    top[1]->ReshapeLike(prefetch_current_->label_);
+    const uint8_t* packed = static_cast<const uint8_t*>(
+        prefetch_current_->packed_label_->gpu_data());
+    caffe_gpu_unpack_occupancy(top[1]->count(), prefetch_current_->label_bits_,
+        packed, top[1]->mutable_gpu_data());
+  } else if (this->output_labels_) {
     // Reshape to loaded labels.
     top[1]->ReshapeLike(prefetch_current_->label_);
     top[1]->set_gpu_data(prefetch_current_->label_.mutable_gpu_data());
   }
+  for (int i = 0; i < prefetch_current_->extra_.size(); ++i) {
+    Blob<Dtype>* extra = prefetch_current_->extra_[i].get();
+    top[i + 2]->ReshapeLike(*extra);
+    top[i + 2]->set_gpu_data(extra->mutable_gpu_data());
+  }
 }
 
 INSTANTIATE_LAYER_GPU_FORWARD(BasePrefetchingDataLayer);
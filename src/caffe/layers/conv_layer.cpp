@@ -1,3 +1,4 @@
+#include <boost/bind.hpp>
 #include <vector>
 
 #include "caffe/layers/conv_layer.hpp"
@@ -21,20 +22,60 @@ void ConvolutionLayer<Dtype>::compute_output_shape() {
   }
 }
 
+template <typename Dtype>
+void ConvolutionLayer<Dtype>::forward_cpu_images(const Dtype* bottom_data,
+    const Dtype* weight, const Dtype* bias, Dtype* top_data, int thread) {
+  Dtype* col_buff = this->cpu_col_buffer(thread);
+  int begin, end;
+  this->cpu_batch_range(thread, &begin, &end);
+  for (int n = begin; n < end; ++n) {
+    if (this->int8_forward()) {
+      this->forward_cpu_int8(bottom_data + n * this->bottom_dim_, bias,
+          top_data + n * this->top_dim_, col_buff);
+    } else {
+      this->forward_cpu_gemm(bottom_data + n * this->bottom_dim_, weight,
+          top_data + n * this->top_dim_, false, col_buff);
+      if (bias) {
+        this->forward_cpu_bias(top_data + n * this->top_dim_, bias);
+      }
+    }
+    caffe_cpu_activation(this->activation_, this->top_dim_,
+        top_data + n * this->top_dim_);
+  }
+}
+
 template <typename Dtype>
 void ConvolutionLayer<Dtype>::Forward_cpu(const vector<Blob<Dtype>*>& bottom,
       const vector<Blob<Dtype>*>& top) {
+  this->pack_cpu_weights();
   const Dtype* weight = this->blobs_[0]->cpu_data();
+  const Dtype* bias = this->bias_term_ ? this->blobs_[1]->cpu_data() : NULL;
   for (int i = 0; i < bottom.size(); ++i) {
     const Dtype* bottom_data = bottom[i]->cpu_data();
     Dtype* top_data = top[i]->mutable_cpu_data();
-    for (int n = 0; n < this->num_; ++n) {
-      this->forward_cpu_gemm(bottom_data + n * this->bottom_dim_, weight,
-          top_data + n * this->top_dim_);
-      if (this->bias_term_) {
-        const Dtype* bias = this->blobs_[1]->cpu_data();
-        this->forward_cpu_bias(top_data + n * this->top_dim_, bias);
-      }
+    this->cpu_batch(boost::bind(&ConvolutionLayer<Dtype>::forward_cpu_images,
+        this, bottom_data, weight, bias, top_data, _1));
+  }
+}
+
+template <typename Dtype>
+void ConvolutionLayer<Dtype>::backward_cpu_images(const Dtype* top_diff,
+    const Dtype* bottom_data, const Dtype* weight, Dtype* weight_diff,
+    Dtype* bottom_diff, int thread) {
+  Dtype* col_buff = this->cpu_col_buffer(thread);
+  weight_diff = this->cpu_weight_diff(thread, weight_diff);
+  int begin, end;
+  this->cpu_batch_range(thread, &begin, &end);
+  for (int n = begin; n < end; ++n) {
+    // gradient w.r.t. weight. Note that we will accumulate diffs.
+    if (weight_diff) {
+      this->weight_cpu_gemm(bottom_data + n * this->bottom_dim_,
+          top_diff + n * this->top_dim_, weight_diff, col_buff);
+    }
+    // gradient w.r.t. bottom data, if necessary.
+    if (bottom_diff) {
+      this->backward_cpu_gemm(top_diff + n * this->top_dim_, weight,
+          bottom_diff + n * this->bottom_dim_, col_buff);
     }
   }
 }
@@ -42,12 +83,13 @@ void ConvolutionLayer<Dtype>::Forward_cpu(const vector<Blob<Dtype>*>& bottom,
 template <typename Dtype>
 void ConvolutionLayer<Dtype>::Backward_cpu(const vector<Blob<Dtype>*>& top,
       const vector<bool>& propagate_down, const vector<Blob<Dtype>*>& bottom) {
+  CHECK_EQ(this->activation_.type(), ActivationParameter_Type_NONE)
+      << "Layers with a fused activation have no backward pass.";
   const Dtype* weight = this->blobs_[0]->cpu_data();
   Dtype* weight_diff = this->blobs_[0]->mutable_cpu_diff();
   for (int i = 0; i < top.size(); ++i) {
     const Dtype* top_diff = top[i]->cpu_diff();
     const Dtype* bottom_data = bottom[i]->cpu_data();
-    Dtype* bottom_diff = bottom[i]->mutable_cpu_diff();
     // Bias gradient, if necessary.
     if (this->bias_term_ && this->param_propagate_down_[1]) {
       Dtype* bias_diff = this->blobs_[1]->mutable_cpu_diff();
@@ -56,18 +98,14 @@ void ConvolutionLayer<Dtype>::Backward_cpu(const vector<Blob<Dtype>*>& top,
       }
     }
     if (this->param_propagate_down_[0] || propagate_down[i]) {
-      for (int n = 0; n < this->num_; ++n) {
-        // gradient w.r.t. weight. Note that we will accumulate diffs.
-        if (this->param_propagate_down_[0]) {
-          this->weight_cpu_gemm(bottom_data + n * this->bottom_dim_,
-              top_diff + n * this->top_dim_, weight_diff);
-        }
-        // gradient w.r.t. bottom data, if necessary.
-        if (propagate_down[i]) {
-          this->backward_cpu_gemm(top_diff + n * this->top_dim_, weight,
-              bottom_diff + n * this->bottom_dim_);
-        }
-      }
+      Dtype* thread_weight_diff =
+          this->param_propagate_down_[0] ? weight_diff : NULL;
+      Dtype* bottom_diff =
+          propagate_down[i] ? bottom[i]->mutable_cpu_diff() : NULL;
+      this->cpu_batch(boost::bind(
+          &ConvolutionLayer<Dtype>::backward_cpu_images, this, top_diff,
+          bottom_data, weight, thread_weight_diff, bottom_diff, _1),
+          thread_weight_diff);
     }
   }
 }
@@ -2,19 +2,25 @@
 #include <opencv2/core/core.hpp>
 #endif  // USE_OPENCV
 #include <stdint.h>
+#include <string.h>
 
+#include <boost/bind.hpp>
+#include <string>
+#include <utility>
 #include <vector>
 
 #include "caffe/data_transformer.hpp"
 #include "caffe/layers/data_layer.hpp"
 #include "caffe/util/benchmark.hpp"
+#include "caffe/util/tensor_record.hpp"
 
 namespace caffe {
 
 template <typename Dtype>
 DataLayer<Dtype>::DataLayer(const LayerParameter& param)
   : BasePrefetchingDataLayer<Dtype>(param),
-    offset_() {
+    offset_(), batch_data_(NULL), batch_labels_(NULL),
+    batch_raw_data_(NULL), batch_augmentation_(NULL) {
   db_.reset(db::GetDB(param.data_param().backend()));
   db_->Open(param.data_param().source(), db::READ);
   cursor_.reset(db_->NewCursor());
@@ -28,19 +34,37 @@ DataLayer<Dtype>::~DataLayer() {
 template <typename Dtype>
 void DataLayer<Dtype>::DataLayerSetUp(const vector<Blob<Dtype>*>& bottom,
       const vector<Blob<Dtype>*>& top) {
-  const int batch_size = this->layer_param_.data_param().batch_size();
+  const DataParameter& data_param = this->layer_param_.data_param();
+  const int batch_size = data_param.batch_size();
+  // Keep the raw pixels of the batches until forwarded if asked to.
+  this->defer_transform_ = data_param.defer_transform();
+  // Index the keys to read the items at random. In test mode, only rank 0
+  // runs, so it takes all of them.
+  if (data_param.shuffle()) {
+    db::ReadOrWriteKeyIndex(data_param.key_index(), cursor_.get(),
+        Caffe::root_solver(), &keys_);
+    const bool test = this->phase_ == TEST;
+    sampler_.reset(new db::ShardedSampler(keys_.size(),
+        data_param.shuffle_seed(), test ? 0 : Caffe::solver_rank(),
+        test ? 1 : Caffe::solver_count()));
+    LOG_IF(INFO, Caffe::root_solver())
+        << "Shuffling " << keys_.size() << " keys";
+  }
   // Read a data point, and use it to initialize the top blob.
-  Datum datum;
-  datum.ParseFromString(cursor_->value());
-
-  // Use data_transformer to infer the expected blob shape from datum.
-  vector<int> top_shape = this->data_transformer_->InferBlobShape(datum);
+  const char* data;
+  size_t size;
+  cursor_->value_view(&data, &size);
+  vector<int> top_shape = InferItemShape(data, size, &raw_shape_);
   this->transformed_data_.Reshape(top_shape);
   // Reshape top[0] and prefetch_data according to the batch_size.
   top_shape[0] = batch_size;
+  raw_shape_[0] = batch_size;
   top[0]->Reshape(top_shape);
   for (int i = 0; i < this->prefetch_.size(); ++i) {
     this->prefetch_[i]->data_.Reshape(top_shape);
+    if (this->defer_transform_) {
+      this->prefetch_[i]->raw_shape_ = raw_shape_;
+    }
   }
   LOG_IF(INFO, Caffe::root_solver())
       << "output data size: " << top[0]->num() << ","
@@ -54,16 +78,29 @@ void DataLayer<Dtype>::DataLayerSetUp(const vector<Blob<Dtype>*>& bottom,
       this->prefetch_[i]->label_.Reshape(label_shape);
     }
   }
+  // The first worker uses the transformer of the layer.
+  const int decode_threads = this->layer_param_.data_param().decode_threads();
+  decode_pool_.reset();
+  if (decode_threads != 1) {
+    decode_pool_.reset(new ThreadPool(decode_threads));
+  }
+  const int num_workers = decode_pool_ ? decode_pool_->num_threads() : 1;
+  transformers_.assign(1, this->data_transformer_);
+  transformed_items_.clear();
+  for (int i = 0; i < num_workers; ++i) {
+    if (i > 0) {
+      transformers_.push_back(shared_ptr<DataTransformer<Dtype> >(
+          new DataTransformer<Dtype>(this->transform_param_, this->phase_)));
+      transformers_.back()->InitRand();
+    }
+    transformed_items_.push_back(shared_ptr<Blob<Dtype> >(new Blob<Dtype>()));
+  }
 }
 
 template <typename Dtype>
-bool DataLayer<Dtype>::Skip() {
-  int size = Caffe::solver_count();
-  int rank = Caffe::solver_rank();
-  bool keep = (offset_ % size) == rank ||
-              // In test mode, only rank 0 runs, so avoid skipping
-              this->layer_param_.phase() == TEST;
-  return !keep;
+void DataLayer<Dtype>::SeekBatches(uint64_t batches) {
+  sampler_->set_offset(batches *
+      this->layer_param_.data_param().batch_size());
 }
 
 template<typename Dtype>
@@ -89,40 +126,65 @@ void DataLayer<Dtype>::load_batch(Batch<Dtype>* batch) {
   CHECK(this->transformed_data_.count());
   const int batch_size = this->layer_param_.data_param().batch_size();
 
-  Datum datum;
+  // Read the items of this solver, in order or by the keys the sampler
+  // draws, copying the values only if the cursor moves them.
+  timer.Start();
+  views_.resize(batch_size);
+  values_.resize(cursor_->stable_values() ? 0 : batch_size);
   for (int item_id = 0; item_id < batch_size; ++item_id) {
-    timer.Start();
-    while (Skip()) {
-      Next();
+    if (sampler_) {
+      const string& key = keys_[sampler_->Next()];
+      CHECK(cursor_->Seek(key)) << "Key " << key << " is not in "
+          << this->layer_param_.data_param().source();
+    } else {
+      while (this->Skip(offset_)) {
+        Next();
+      }
     }
-    datum.ParseFromString(cursor_->value());
-    read_time += timer.MicroSeconds();
-
-    if (item_id == 0) {
-      // Reshape according to the first datum of each batch
-      // on single input batches allows for inputs of varying dimension.
-      // Use data_transformer to infer the expected blob shape from datum.
-      vector<int> top_shape = this->data_transformer_->InferBlobShape(datum);
-      this->transformed_data_.Reshape(top_shape);
-      // Reshape batch according to the batch_size.
-      top_shape[0] = batch_size;
-      batch->data_.Reshape(top_shape);
+    const char* data;
+    size_t size;
+    cursor_->value_view(&data, &size);
+    if (!cursor_->stable_values()) {
+      values_[item_id].assign(data, size);
+      data = values_[item_id].data();
     }
-
-    // Apply data transformations (mirror, scale, crop...)
-    timer.Start();
-    int offset = batch->data_.offset(item_id);
-    Dtype* top_data = batch->data_.mutable_cpu_data();
-    this->transformed_data_.set_cpu_data(top_data + offset);
-    this->data_transformer_->Transform(datum, &(this->transformed_data_));
-    // Copy label.
-    if (this->output_labels_) {
-      Dtype* top_label = batch->label_.mutable_cpu_data();
-      top_label[item_id] = datum.label();
+    views_[item_id] = std::make_pair(data, size);
+    if (!sampler_) {
+      Next();
     }
-    trans_time += timer.MicroSeconds();
-    Next();
   }
+  // Reshape according to the first datum of each batch
+  // on single input batches allows for inputs of varying dimension.
+  vector<int> top_shape =
+      InferItemShape(views_[0].first, views_[0].second, &raw_shape_);
+  this->transformed_data_.Reshape(top_shape);
+  for (int i = 0; i < transformed_items_.size(); ++i) {
+    transformed_items_[i]->Reshape(top_shape);
+  }
+  // Reshape batch according to the batch_size.
+  top_shape[0] = batch_size;
+  batch->data_.Reshape(top_shape);
+  raw_shape_[0] = batch_size;
+  read_time += timer.MicroSeconds();
+
+  // Parse and transform the items, in parallel with decode_threads.
+  timer.Start();
+  if (this->defer_transform_) {
+    batch->raw_shape_ = raw_shape_;
+    batch_raw_data_ = batch->mutable_raw_data();
+    batch_augmentation_ = batch->mutable_augmentation();
+  } else {
+    batch_data_ = batch->data_.mutable_cpu_data();
+  }
+  batch_labels_ = this->output_labels_ ?
+      batch->label_.mutable_cpu_data() : NULL;
+  if (decode_pool_) {
+    decode_pool_->Run(transformers_.size(),
+        boost::bind(&DataLayer<Dtype>::DecodeItems, this, _1));
+  } else {
+    DecodeItems(0);
+  }
+  trans_time += timer.MicroSeconds();
   timer.Stop();
   batch_timer.Stop();
   DLOG(INFO) << "Prefetch batch: " << batch_timer.MilliSeconds() << " ms.";
@@ -130,6 +192,79 @@ void DataLayer<Dtype>::load_batch(Batch<Dtype>* batch) {
   DLOG(INFO) << "Transform time: " << trans_time / 1000 << " ms.";
 }
 
+template<typename Dtype>
+vector<int> DataLayer<Dtype>::InferItemShape(const char* data, size_t size,
+    vector<int>* raw_shape) {
+  TensorRecord record;
+  Datum datum;
+  const bool is_record = IsTensorRecord(data, size);
+  if (is_record) {
+    ReadTensorRecord(data, size, &record);
+  } else {
+    CHECK(datum.ParseFromArray(data, size)) << "Failed to parse datum";
+  }
+  raw_shape->resize(4);
+  if (this->defer_transform_) {
+    CHECK(is_record || DatumAsTensorRecord(datum, &record))
+        << "defer_transform needs items of uint8 pixels";
+    (*raw_shape)[0] = 1;
+    (*raw_shape)[1] = record.channels;
+    (*raw_shape)[2] = record.height;
+    (*raw_shape)[3] = record.width;
+  }
+  // Use data_transformer to infer the expected blob shape from the value.
+  return is_record ? this->data_transformer_->InferBlobShape(record) :
+      this->data_transformer_->InferBlobShape(datum);
+}
+
+template<typename Dtype>
+void DataLayer<Dtype>::DecodeItems(int worker) {
+  const int num_workers = transformers_.size();
+  Blob<Dtype>* item = transformed_items_[worker].get();
+  Datum datum;
+  TensorRecord record;
+  for (int item_id = worker; item_id < views_.size();
+       item_id += num_workers) {
+    const char* data = views_[item_id].first;
+    const size_t size = views_[item_id].second;
+    const bool is_record = IsTensorRecord(data, size);
+    int label;
+    if (is_record) {
+      ReadTensorRecord(data, size, &record);
+      label = record.label;
+    } else {
+      datum.ParseFromArray(data, size);
+      label = datum.label();
+    }
+    if (this->defer_transform_) {
+      // Keep the pixels with the crop and mirror to apply when forwarded.
+      CHECK(is_record || DatumAsTensorRecord(datum, &record))
+          << "defer_transform needs items of uint8 pixels";
+      CHECK(record.channels == raw_shape_[1] &&
+            record.height == raw_shape_[2] && record.width == raw_shape_[3])
+          << "defer_transform needs items of one size per batch";
+      const size_t raw_count = static_cast<size_t>(record.channels) *
+          record.height * record.width;
+      memcpy(batch_raw_data_ + item_id * raw_count, record.data, raw_count);
+      transformers_[worker]->DrawAugmentation(record.channels, record.height,
+          record.width, batch_augmentation_ + 3 * item_id);
+    } else {
+      // Apply data transformations (mirror, scale, crop...); the pixels of
+      // tensor records go from the database to the batch.
+      item->set_cpu_data(batch_data_ + item_id * item->count());
+      if (is_record) {
+        transformers_[worker]->Transform(record, item);
+      } else {
+        transformers_[worker]->Transform(datum, item);
+      }
+    }
+    // Copy label.
+    if (batch_labels_) {
+      batch_labels_[item_id] = label;
+    }
+  }
+}
+
 INSTANTIATE_CLASS(DataLayer);
 REGISTER_LAYER_CLASS(Data);
 
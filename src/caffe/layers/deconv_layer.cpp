@@ -1,3 +1,4 @@
+#include <boost/bind.hpp>
 #include <vector>
 
 #include "caffe/layers/deconv_layer.hpp"
@@ -21,20 +22,54 @@ void DeconvolutionLayer<Dtype>::compute_output_shape() {
   }
 }
 
+template <typename Dtype>
+void DeconvolutionLayer<Dtype>::forward_cpu_images(const Dtype* bottom_data,
+    const Dtype* weight, const Dtype* bias, Dtype* top_data, int thread) {
+  Dtype* col_buff = this->cpu_col_buffer(thread);
+  int begin, end;
+  this->cpu_batch_range(thread, &begin, &end);
+  for (int n = begin; n < end; ++n) {
+    this->backward_cpu_gemm(bottom_data + n * this->bottom_dim_, weight,
+        top_data + n * this->top_dim_, col_buff);
+    if (bias) {
+      this->forward_cpu_bias(top_data + n * this->top_dim_, bias);
+    }
+  }
+}
+
 template <typename Dtype>
 void DeconvolutionLayer<Dtype>::Forward_cpu(const vector<Blob<Dtype>*>& bottom,
       const vector<Blob<Dtype>*>& top) {
   const Dtype* weight = this->blobs_[0]->cpu_data();
+  const Dtype* bias = this->bias_term_ ? this->blobs_[1]->cpu_data() : NULL;
   for (int i = 0; i < bottom.size(); ++i) {
     const Dtype* bottom_data = bottom[i]->cpu_data();
     Dtype* top_data = top[i]->mutable_cpu_data();
-    for (int n = 0; n < this->num_; ++n) {
-      this->backward_cpu_gemm(bottom_data + n * this->bottom_dim_, weight,
-          top_data + n * this->top_dim_);
-      if (this->bias_term_) {
-        const Dtype* bias = this->blobs_[1]->cpu_data();
-        this->forward_cpu_bias(top_data + n * this->top_dim_, bias);
-      }
+    this->cpu_batch(boost::bind(
+        &DeconvolutionLayer<Dtype>::forward_cpu_images, this, bottom_data,
+        weight, bias, top_data, _1));
+  }
+}
+
+template <typename Dtype>
+void DeconvolutionLayer<Dtype>::backward_cpu_images(const Dtype* top_diff,
+    const Dtype* bottom_data, const Dtype* weight, Dtype* weight_diff,
+    Dtype* bottom_diff, int thread) {
+  Dtype* col_buff = this->cpu_col_buffer(thread);
+  weight_diff = this->cpu_weight_diff(thread, weight_diff);
+  int begin, end;
+  this->cpu_batch_range(thread, &begin, &end);
+  for (int n = begin; n < end; ++n) {
+    // Gradient w.r.t. weight. Note that we will accumulate diffs.
+    if (weight_diff) {
+      this->weight_cpu_gemm(top_diff + n * this->top_dim_,
+          bottom_data + n * this->bottom_dim_, weight_diff, col_buff);
+    }
+    // Gradient w.r.t. bottom data, if necessary, reusing the column buffer
+    // we might have just computed above.
+    if (bottom_diff) {
+      this->forward_cpu_gemm(top_diff + n * this->top_dim_, weight,
+          bottom_diff + n * this->bottom_dim_, weight_diff != NULL, col_buff);
     }
   }
 }
@@ -47,7 +82,6 @@ void DeconvolutionLayer<Dtype>::Backward_cpu(const vector<Blob<Dtype>*>& top,
   for (int i = 0; i < top.size(); ++i) {
     const Dtype* top_diff = top[i]->cpu_diff();
     const Dtype* bottom_data = bottom[i]->cpu_data();
-    Dtype* bottom_diff = bottom[i]->mutable_cpu_diff();
     // Bias gradient, if necessary.
     if (this->bias_term_ && this->param_propagate_down_[1]) {
       Dtype* bias_diff = this->blobs_[1]->mutable_cpu_diff();
@@ -56,20 +90,14 @@ void DeconvolutionLayer<Dtype>::Backward_cpu(const vector<Blob<Dtype>*>& top,
       }
     }
     if (this->param_propagate_down_[0] || propagate_down[i]) {
-      for (int n = 0; n < this->num_; ++n) {
-        // Gradient w.r.t. weight. Note that we will accumulate diffs.
-        if (this->param_propagate_down_[0]) {
-          this->weight_cpu_gemm(top_diff + n * this->top_dim_,
-              bottom_data + n * this->bottom_dim_, weight_diff);
-        }
-        // Gradient w.r.t. bottom data, if necessary, reusing the column buffer
-        // we might have just computed above.
-        if (propagate_down[i]) {
-          this->forward_cpu_gemm(top_diff + n * this->top_dim_, weight,
-              bottom_diff + n * this->bottom_dim_,
-              this->param_propagate_down_[0]);
-        }
-      }
+      Dtype* thread_weight_diff =
+          this->param_propagate_down_[0] ? weight_diff : NULL;
+      Dtype* bottom_diff =
+          propagate_down[i] ? bottom[i]->mutable_cpu_diff() : NULL;
+      this->cpu_batch(boost::bind(
+          &DeconvolutionLayer<Dtype>::backward_cpu_images, this, top_diff,
+          bottom_data, weight, thread_weight_diff, bottom_diff, _1),
+          thread_weight_diff);
     }
   }
 }
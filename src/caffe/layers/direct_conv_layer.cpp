@@ -0,0 +1,136 @@
+#include <boost/bind.hpp>
+#include <vector>
+
+#include "caffe/layers/direct_conv_layer.hpp"
+#include "caffe/util/direct_conv.hpp"
+
+namespace caffe {
+
+template <typename Dtype>
+void DirectConvolutionLayer<Dtype>::LayerSetUp(
+    const vector<Blob<Dtype>*>& bottom, const vector<Blob<Dtype>*>& top) {
+  ConvolutionLayer<Dtype>::LayerSetUp(bottom, top);
+  supported_ = (this->num_spatial_axes_ == 2 ||
+      this->num_spatial_axes_ == 3) && !this->is_1x1_;
+  if (!supported_) {
+    LOG(INFO) << "Layer " << this->layer_param_.name() << " uses "
+        << (this->is_1x1_ ? "GEMM" : "im2col")
+        << ": the direct engine needs 2D or 3D kernels larger than 1x1.";
+  }
+}
+
+template <typename Dtype>
+void DirectConvolutionLayer<Dtype>::Reshape(
+    const vector<Blob<Dtype>*>& bottom, const vector<Blob<Dtype>*>& top) {
+  ConvolutionLayer<Dtype>::Reshape(bottom, top);
+  if (!supported_) {
+    return;
+  }
+  const int* pad = this->pad_.cpu_data();
+  if (this->num_spatial_axes_ == 3) {
+    buffer_size_ = direct_conv_3d_buffer_size(this->channels_ / this->group_,
+        this->input_shape(1), this->input_shape(2), this->input_shape(3),
+        pad[0], pad[1], pad[2]);
+  } else {
+    buffer_size_ = direct_conv_buffer_size(this->channels_ / this->group_,
+        this->input_shape(1), this->input_shape(2), pad[0], pad[1]);
+  }
+}
+
+template <typename Dtype>
+void DirectConvolutionLayer<Dtype>::direct_cpu_images(
+    const Dtype* bottom_data, const Dtype* weight, const Dtype* bias,
+    Dtype* buffer, Dtype* top_data, int thread) {
+  if (this->num_spatial_axes_ == 3) {
+    direct_3d_cpu_images(bottom_data, weight, bias, buffer, top_data, thread);
+    return;
+  }
+  const int channels = this->channels_ / this->group_;
+  const int num_output = this->num_output_ / this->group_;
+  const int height = this->input_shape(1);
+  const int width = this->input_shape(2);
+  const int height_out = this->output_shape_[0];
+  const int width_out = this->output_shape_[1];
+  const int* kernel = this->kernel_shape_.cpu_data();
+  const int* pad = this->pad_.cpu_data();
+  const int* stride = this->stride_.cpu_data();
+  const int* dilation = this->dilation_.cpu_data();
+  buffer += thread * buffer_size_;
+  int begin, end;
+  this->cpu_batch_range(thread, &begin, &end);
+  for (int n = begin; n < end; ++n) {
+    for (int g = 0; g < this->group_; ++g) {
+      conv_direct_cpu(bottom_data + n * this->bottom_dim_ +
+          g * channels * height * width, channels, height, width,
+          weight + this->weight_offset_ * g, num_output, kernel[0],
+          kernel[1], pad[0], pad[1], stride[0], stride[1], dilation[0],
+          dilation[1], height_out, width_out, buffer, top_data +
+          n * this->top_dim_ + g * num_output * height_out * width_out);
+    }
+    if (bias) {
+      this->forward_cpu_bias(top_data + n * this->top_dim_, bias);
+    }
+    caffe_cpu_activation(this->activation_, this->top_dim_,
+        top_data + n * this->top_dim_);
+  }
+}
+
+template <typename Dtype>
+void DirectConvolutionLayer<Dtype>::direct_3d_cpu_images(
+    const Dtype* bottom_data, const Dtype* weight, const Dtype* bias,
+    Dtype* buffer, Dtype* top_data, int thread) {
+  const int channels = this->channels_ / this->group_;
+  const int num_output = this->num_output_ / this->group_;
+  const int depth = this->input_shape(1);
+  const int height = this->input_shape(2);
+  const int width = this->input_shape(3);
+  const int* out = this->output_shape_.data();
+  const int* kernel = this->kernel_shape_.cpu_data();
+  const int* pad = this->pad_.cpu_data();
+  const int* stride = this->stride_.cpu_data();
+  const int* dilation = this->dilation_.cpu_data();
+  buffer += thread * buffer_size_;
+  int begin, end;
+  this->cpu_batch_range(thread, &begin, &end);
+  for (int n = begin; n < end; ++n) {
+    for (int g = 0; g < this->group_; ++g) {
+      conv_direct_3d_cpu(bottom_data + n * this->bottom_dim_ +
+          g * channels * depth * height * width, channels, depth, height,
+          width, weight + this->weight_offset_ * g, num_output, kernel[0],
+          kernel[1], kernel[2], pad[0], pad[1], pad[2], stride[0], stride[1],
+          stride[2], dilation[0], dilation[1], dilation[2], out[0], out[1],
+          out[2], buffer, top_data + n * this->top_dim_ +
+          g * num_output * out[0] * out[1] * out[2]);
+    }
+    if (bias) {
+      this->forward_cpu_bias(top_data + n * this->top_dim_, bias);
+    }
+    caffe_cpu_activation(this->activation_, this->top_dim_,
+        top_data + n * this->top_dim_);
+  }
+}
+
+template <typename Dtype>
+void DirectConvolutionLayer<Dtype>::Forward_cpu(
+    const vector<Blob<Dtype>*>& bottom, const vector<Blob<Dtype>*>& top) {
+  if (!supported_) {
+    ConvolutionLayer<Dtype>::Forward_cpu(bottom, top);
+    return;
+  }
+  vector<int> buffer_shape(2, this->cpu_batch_threads());
+  buffer_shape[1] = buffer_size_;
+  buffer_.Reshape(buffer_shape);
+  Dtype* buffer = buffer_size_ ? buffer_.mutable_cpu_data() : NULL;
+  const Dtype* weight = this->blobs_[0]->cpu_data();
+  const Dtype* bias = this->bias_term_ ? this->blobs_[1]->cpu_data() : NULL;
+  for (int i = 0; i < bottom.size(); ++i) {
+    this->cpu_batch(boost::bind(
+        &DirectConvolutionLayer<Dtype>::direct_cpu_images, this,
+        bottom[i]->cpu_data(), weight, bias, buffer,
+        top[i]->mutable_cpu_data(), _1), NULL, false);
+  }
+}
+
+INSTANTIATE_CLASS(DirectConvolutionLayer);
+
+}  // namespace caffe
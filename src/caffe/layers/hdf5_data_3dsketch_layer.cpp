@@ -1,22 +1,23 @@
 /*
 TODO:
-- load file in a separate thread ("prefetch")
 - can be smarter about the memcpy call instead of doing it row-by-row
   :: use util functions caffe_copy, and Blob->offset()
   :: don't forget to update hdf5_daa_layer.cu accordingly
 - add ability to shuffle filenames if flag is set
 */
+#include <boost/bind.hpp>
 #include <fstream>  // NOLINT(readability/streams)
 #include <string>
 #include <vector>
-#include <unordered_set>
 
 #include "hdf5.h"
 #include "hdf5_hl.h"
 #include "stdint.h"
 
 #include "caffe/layers/hdf5_data_3dsketch_layer.hpp"
+#include "caffe/util/benchmark.hpp"
 #include "caffe/util/hdf5.hpp"
+#include "caffe/util/math_functions.hpp"
 #include "caffe/util/prediction.hpp"
 
 #include <opencv2/core/core.hpp>
@@ -27,70 +28,151 @@ TODO:
 namespace caffe {
 
 template <typename Dtype>
-HDF5Data3DSketchLayer<Dtype>::~HDF5Data3DSketchLayer<Dtype>() { }
+const int HDF5Data3DSketchLayer<Dtype>::kNumUpdateViews;
 
-// Load data and label from HDF5 filename into the class property blobs.
 template <typename Dtype>
-void HDF5Data3DSketchLayer<Dtype>::LoadHDF5FileData(const char* filename) {
+HDF5Data3DSketchLayer<Dtype>::~HDF5Data3DSketchLayer<Dtype>() {
+  this->StopInternalThread();
+}
+
+// Names of the datasets of a file: one per top (single view sketch and voxel
+// gt), then the sketches of the update views.
+template <typename Dtype>
+vector<string> HDF5Data3DSketchLayer<Dtype>::DatasetNames() const {
+  vector<string> names(this->layer_param_.top().begin(),
+                       this->layer_param_.top().end());
+  //WARNING load data for rotation
+  names.push_back("sketch3D_update");
+  return names;
+}
+
+// Read the datasets of HDF5 filename into blobs, in the order of
+// DatasetNames(). May be called on the file prefetch thread; the caller
+// holds HDF5Lock.
+template <typename Dtype>
+void HDF5Data3DSketchLayer<Dtype>::ReadHDF5File(const string& filename,
+    vector<shared_ptr<Blob<Dtype> > >* blobs) {
   DLOG(INFO) << "Loading HDF5 file: " << filename;
-  hid_t file_id = H5Fopen(filename, H5F_ACC_RDONLY, H5P_DEFAULT);
+  hid_t file_id = H5Fopen(filename.c_str(), H5F_ACC_RDONLY, H5P_DEFAULT);
   if (file_id < 0) {
     LOG(FATAL) << "Failed opening HDF5 file: " << filename;
   }
 
-  int top_size = this->layer_param_.top_size(); //WARNING change -1 
-  hdf_blobs_.resize(top_size);
+  const vector<string> names = DatasetNames();
+  blobs->clear();
 
   const int MIN_DATA_DIM = 1;
   const int MAX_DATA_DIM = INT_MAX;
 
-  //load single view sketch and voxel gt
-  for (int i = 0; i < top_size; ++i) {
-	DLOG(INFO) << "Loading dataset  " << this->layer_param_.top(i).c_str();
-    hdf_blobs_[i] = shared_ptr<Blob<Dtype> >(new Blob<Dtype>());
-    hdf5_load_nd_dataset(file_id, this->layer_param_.top(i).c_str(),
-						 MIN_DATA_DIM, MAX_DATA_DIM, hdf_blobs_[i].get(),true);
+  for (int i = 0; i < names.size(); ++i) {
+	DLOG(INFO) << "Loading dataset  " << names[i];
+    blobs->push_back(shared_ptr<Blob<Dtype> >(new Blob<Dtype>()));
+    hdf5_load_nd_dataset(file_id, names[i].c_str(),
+						 MIN_DATA_DIM, MAX_DATA_DIM, blobs->back().get(),true);
   }
 
+  herr_t status = H5Fclose(file_id);
+  CHECK_GE(status, 0) << "Failed to close HDF5 file: " << filename;
+}
 
-  //WARNING load data for rotation
-  data_update_ = shared_ptr<Blob<Dtype> >(new Blob<Dtype>());
-  hdf5_load_nd_dataset(file_id, "sketch3D_update",
-        MIN_DATA_DIM, MAX_DATA_DIM, data_update_.get(),true);
+template <typename Dtype>
+vector<int> HDF5Data3DSketchLayer<Dtype>::DatasetShape(int d) const {
+  return row_cache_ ? row_cache_->shape(d) : file_blobs_[d]->shape();
+}
 
+// Row of dataset d of the current file. Points to the dataset when it is
+// loaded whole, otherwise the row is read into buffer.
+template <typename Dtype>
+const Dtype* HDF5Data3DSketchLayer<Dtype>::RowData(int d, int row,
+    Dtype* buffer) {
+  if (row_cache_) {
+    row_cache_->CopyRow(d, row, buffer);
+    return buffer;
+  }
+  return file_blobs_[d]->cpu_data() + row * file_blobs_[d]->count(1);
+}
 
+// Copy a row of dataset d of the current file, reading it if streaming.
+template <typename Dtype>
+void HDF5Data3DSketchLayer<Dtype>::CopyRow(int d, int row, Dtype* data) {
+  if (row_cache_) {
+    row_cache_->CopyRow(d, row, data);
+  } else {
+    const int dim = file_blobs_[d]->count(1);
+    caffe_copy(dim, file_blobs_[d]->cpu_data() + row * dim, data);
+  }
+}
 
-  herr_t status = H5Fclose(file_id);
-  CHECK_GE(status, 0) << "Failed to close HDF5 file: " << filename;
+// Load data and label from HDF5 filename into the class property blobs.
+template <typename Dtype>
+void HDF5Data3DSketchLayer<Dtype>::LoadHDF5FileData(const char* filename) {
+  const HDF5Data3DSketchParameter& param =
+      this->layer_param_.hdf5_data_3dsketch_param();
+  // Close the previous file before opening the next one.
+  row_cache_.reset();
+  file_blobs_.clear();
+  if (param.stream_cache_mb() > 0) {
+    DLOG(INFO) << "Streaming HDF5 file: " << filename;
+    row_cache_.reset(new HDF5RowCache<Dtype>(filename, DatasetNames(),
+        param.stream_chunk_rows(), size_t(param.stream_cache_mb()) << 20));
+  } else if (file_prefetcher_) {
+    file_prefetcher_->Take(filename, &file_blobs_);
+  } else {
+    // Other layers may read HDF5 files on their threads meanwhile.
+    HDF5Lock lock;
+    ReadHDF5File(filename, &file_blobs_);
+  }
+  int top_size = this->layer_param_.top_size();
 
   // MinTopBlobs==1 guarantees at least one top blob
-  CHECK_GE(hdf_blobs_[0]->num_axes(), 1) << "Input must have at least 1 axis.";
-  const int num = hdf_blobs_[0]->shape(0);
+  CHECK_GE(DatasetShape(0).size(), 1) << "Input must have at least 1 axis.";
+  const int num = DatasetShape(0)[0];
   for (int i = 1; i < top_size; ++i) {
-    CHECK_EQ(hdf_blobs_[i]->shape(0), num);
+    CHECK_EQ(DatasetShape(i)[0], num);
   }
   // Default to identity permutation.
   data_permutation_.clear();
-  data_permutation_.resize(hdf_blobs_[0]->shape(0));
-  for (int i = 0; i < hdf_blobs_[0]->shape(0); i++)
+  data_permutation_.resize(num);
+  for (int i = 0; i < num; i++)
     data_permutation_[i] = i;
 
   // Shuffle if needed.
   if (this->layer_param_.hdf5_data_3dsketch_param().shuffle()) {
     std::random_shuffle(data_permutation_.begin(), data_permutation_.end());
-    DLOG(INFO) << "Successully loaded " << hdf_blobs_[0]->shape(0)
-               << " rows (shuffled)";
+    DLOG(INFO) << "Successully loaded " << num << " rows (shuffled)";
   } else {
-    DLOG(INFO) << "Successully loaded " << hdf_blobs_[0]->shape(0) << " rows";
+    DLOG(INFO) << "Successully loaded " << num << " rows";
+  }
+  PrefetchNextFile();
+}
+
+// Start reading the file that follows the current one.
+template <typename Dtype>
+void HDF5Data3DSketchLayer<Dtype>::PrefetchNextFile() {
+  if (!file_prefetcher_) {
+    return;
+  }
+  unsigned int next_file = current_file_ + 1;
+  if (next_file == num_files_) {
+    next_file = 0;
+    // The next pass starts with the prefetched file, so its order is drawn
+    // now rather than when looping around.
+    if (this->layer_param_.hdf5_data_3dsketch_param().shuffle()) {
+      std::random_shuffle(file_permutation_.begin(), file_permutation_.end());
+    }
   }
+  file_prefetcher_->Prefetch(hdf_filenames_[file_permutation_[next_file]]);
 }
 
 template <typename Dtype>
-void HDF5Data3DSketchLayer<Dtype>::LayerSetUp(const vector<Blob<Dtype>*>& bottom,
-      const vector<Blob<Dtype>*>& top) {
+void HDF5Data3DSketchLayer<Dtype>::DataLayerSetUp(
+      const vector<Blob<Dtype>*>& bottom, const vector<Blob<Dtype>*>& top) {
   // Refuse transformation parameters since HDF5 is totally generic.
   CHECK(!this->layer_param_.has_transform_param()) <<
       this->type() << " does not transform data.";
+  CHECK_LE(this->layer_param_.hdf5_data_3dsketch_param().nviews(),
+           kNumUpdateViews) << "Views are drawn without replacement among "
+           << kNumUpdateViews << " update views.";
   // Read the source to parse the filenames.
   const string& source = this->layer_param_.hdf5_data_3dsketch_param().source();
   LOG(INFO) << "Loading list of HDF5 filenames from: " << source;
@@ -123,6 +205,13 @@ void HDF5Data3DSketchLayer<Dtype>::LayerSetUp(const vector<Blob<Dtype>*>& bottom
     std::random_shuffle(file_permutation_.begin(), file_permutation_.end());
   }
 
+  if (this->layer_param_.hdf5_data_3dsketch_param().prefetch_next_file() &&
+      this->layer_param_.hdf5_data_3dsketch_param().stream_cache_mb() == 0 &&
+      num_files_ > 1) {
+    file_prefetcher_.reset(new HDF5FilePrefetcher<Dtype>(
+        boost::bind(&HDF5Data3DSketchLayer<Dtype>::ReadHDF5File, this, _1, _2)));
+  }
+
   // Load the first HDF5 file and initialize the line counter.
   LoadHDF5FileData(hdf_filenames_[file_permutation_[current_file_]].c_str());
   current_row_ = 0;
@@ -132,24 +221,32 @@ void HDF5Data3DSketchLayer<Dtype>::LayerSetUp(const vector<Blob<Dtype>*>& bottom
   const int top_size = this->layer_param_.top_size(); //WARNING -1 to avoid last blob
   vector<int> top_shape;
   for (int i = 0; i < top_size; ++i) {
-	  top_shape.resize(hdf_blobs_[i]->num_axes());
+    top_shape = DatasetShape(i);
     top_shape[0] = batch_size;
-    for (int j = 1; j < top_shape.size(); ++j) {
-      top_shape[j] = hdf_blobs_[i]->shape(j);
-    }
     top[i]->Reshape(top_shape);
+    for (int k = 0; k < this->prefetch_.size(); ++k) {
+      this->prefetch_[k]->blob(i)->Reshape(top_shape);
+    }
   }
+  this->packed_label_bits_ =
+      this->layer_param_.data_param().packed_label_bits();
 
 }
 #define mod(a,b) ((a)<0?(a)+(b):(a)%(b))
 
+// This function is called on prefetch thread
 template <typename Dtype>
-void HDF5Data3DSketchLayer<Dtype>::Forward_cpu(const vector<Blob<Dtype>*>& bottom,
-      const vector<Blob<Dtype>*>& top) {
+void HDF5Data3DSketchLayer<Dtype>::load_batch(Batch<Dtype>* batch) {
+  CPUTimer batch_timer;
+  batch_timer.Start();
   const int batch_size = this->layer_param_.hdf5_data_3dsketch_param().batch_size();
+  vector<Blob<Dtype>*> top(this->layer_param_.top_size());
+  for (int j = 0; j < top.size(); ++j) {
+    top[j] = batch->blob(j);
+  }
   //parcours images du batch
   for (int i = 0; i < batch_size; ++i, ++current_row_) {
-    if (current_row_ == hdf_blobs_[0]->shape(0)) {
+    if (current_row_ == data_permutation_.size()) {
 		//si fin du fichier
       if (num_files_ > 1) {
 		  //prochain fichier
@@ -157,7 +254,8 @@ void HDF5Data3DSketchLayer<Dtype>::Forward_cpu(const vector<Blob<Dtype>*>& botto
         if (current_file_ == num_files_) {
 			//si dernier fichier, revenir a 0 et shuffle
           current_file_ = 0;
-          if (this->layer_param_.hdf5_data_3dsketch_param().shuffle()) {
+          if (this->layer_param_.hdf5_data_3dsketch_param().shuffle() &&
+              !file_prefetcher_) {
             std::random_shuffle(file_permutation_.begin(),
                                 file_permutation_.end());
           }
@@ -178,56 +276,50 @@ void HDF5Data3DSketchLayer<Dtype>::Forward_cpu(const vector<Blob<Dtype>*>& botto
 	//donner donnees (sauf premier blob : combine sketches)
     for (int j = 1; j < this->layer_param_.top_size(); ++j) { //WARNING 1 to avoid first blob
       int data_dim = top[j]->count() / top[j]->shape(0);
-      caffe_copy(data_dim,
-          &hdf_blobs_[j]->cpu_data()[data_permutation_[current_row_]
-            * data_dim], &top[j]->mutable_cpu_data()[i * data_dim]);
+      if (j == 1 && batch->label_bits_) {
+        // The label is packed from a staging row.
+        label_buffer_.resize(data_dim);
+        CopyRow(j, data_permutation_[current_row_], label_buffer_.data());
+        batch->PackLabel(i, label_buffer_.data());
+        continue;
+      }
+      CopyRow(j, data_permutation_[current_row_],
+          &top[j]->mutable_cpu_data()[i * data_dim]);
     }
 
 	//choose number of other views
 	int nviews = distribution_n_views(generator_);
-	//std::cout<<"nviews " <<nviews<<std::endl;
 	int id_blob = 0;
 	//WARNING retrieve id_view (%8 ?) and choose first view (random puis /8 + idv1)
 	int idv1 = data_permutation_[current_row_];
 	int v1 = idv1%8;
 	int id_obj = idv1/8;
-	std::unordered_set<int> views;
-	views.insert(v1);
-	
+
 	int data_dim = top[id_blob]->count() / top[id_blob]->shape(0);
 	Dtype * top_data = &top[id_blob]->mutable_cpu_data()[i * data_dim];
-	shared_ptr<Blob<Dtype> > aggreg_sketches;
-	//LOG(INFO) << "copy initial 3dsketch";
-	caffe_copy(data_dim,
-				&hdf_blobs_[id_blob]->cpu_data()[idv1  * data_dim],
-				top_data);
-		   
+	view_buffer_.resize(nviews * data_dim);
+	views_.resize(nviews);
+	views_[0] = RowData(id_blob, idv1, view_buffer_.data());
+
+	//choose the other views among the 13 update ones, all distinct from v1:
+	//partial Fisher-Yates shuffle of the candidates
+	candidate_views_.clear();
+	for (int v = 0; v < kNumUpdateViews; ++v) {
+		if (v != v1) {
+			candidate_views_.push_back(v);
+		}
+	}
 	for(int n = 1; n < nviews; n++)
 	{
-		//choose other views in the 13 update ones
-		int v2 = distribution_2nd_view(generator_);
-		auto insertion = views.insert(v2);
-		while(!(insertion.second))
-		{
-			v2 = distribution_2nd_view(generator_);
-			insertion = views.insert(v2);
-		}
-		int idv2 = id_obj*13+v2; //id (in dbase) of the first view to use
-		//std::cout<<"obj "<<id_obj<<" v1 : " <<v1<<", v2 : " <<v2<<std::endl;
-		//std::cout<<" idv1 : " <<idv1<<", idv2 : " <<idv2<<std::endl;
-		
-		//WARNING aggreagate values
-		// caffe_add(data_dim,
-		// 		  top_data,
-		// 		  &data_update_->cpu_data()[idv2  * data_dim],
-		// 		  top_data);
-
-		Dtype * new_view_ptr = &data_update_->cpu_data()[idv2  * data_dim];
-		for (int idx = 0; idx < data_dim; ++idx) {
-			top_data[idx] = std::max(new_view_ptr[idx],top_data[idx]);
-		}
-		
+		std::uniform_int_distribution<int> pick(n - 1,
+			candidate_views_.size() - 1);
+		std::swap(candidate_views_[n - 1], candidate_views_[pick(generator_)]);
+		int idv2 = id_obj*13+candidate_views_[n - 1]; //id (in dbase) of the view to use
+		views_[n] = RowData(this->layer_param_.top_size(), idv2,
+			view_buffer_.data() + n * data_dim);
 	}
+	//WARNING aggreagate values: max over all views in one pass
+	caffe_max(data_dim, nviews, views_.data(), top_data);
 	// if(nviews > 1)
 	// 	caffe_scal<Dtype>(data_dim,
 	// 			   1.0/(nviews),
@@ -236,6 +328,8 @@ void HDF5Data3DSketchLayer<Dtype>::Forward_cpu(const vector<Blob<Dtype>*>& botto
 	// 		   aggreg_sketches->cpu_data(),
 	// 		   &top[id_blob]->mutable_cpu_data()[i * data_dim]);
   }
+  batch_timer.Stop();
+  DLOG(INFO) << "Prefetch batch: " << batch_timer.MilliSeconds() << " ms.";
 }
 
 
@@ -1,12 +1,12 @@
 #ifdef USE_HDF5
 /*
 TODO:
-- load file in a separate thread ("prefetch")
 - can be smarter about the memcpy call instead of doing it row-by-row
   :: use util functions caffe_copy, and Blob->offset()
   :: don't forget to update hdf5_daa_layer.cu accordingly
 - add ability to shuffle filenames if flag is set
 */
+#include <boost/bind.hpp>
 #include <fstream>  // NOLINT(readability/streams)
 #include <string>
 #include <vector>
@@ -23,30 +23,45 @@ namespace caffe {
 template <typename Dtype>
 HDF5DataLayer<Dtype>::~HDF5DataLayer<Dtype>() { }
 
-// Load data and label from HDF5 filename into the class property blobs.
+// Read the datasets of HDF5 filename into blobs, one per top.
+// May be called on the file prefetch thread; the caller holds HDF5Lock.
 template <typename Dtype>
-void HDF5DataLayer<Dtype>::LoadHDF5FileData(const char* filename) {
+void HDF5DataLayer<Dtype>::ReadHDF5File(const string& filename,
+    vector<shared_ptr<Blob<Dtype> > >* blobs) {
   DLOG(INFO) << "Loading HDF5 file: " << filename;
-  hid_t file_id = H5Fopen(filename, H5F_ACC_RDONLY, H5P_DEFAULT);
+  hid_t file_id = H5Fopen(filename.c_str(), H5F_ACC_RDONLY, H5P_DEFAULT);
   if (file_id < 0) {
     LOG(FATAL) << "Failed opening HDF5 file: " << filename;
   }
 
   int top_size = this->layer_param_.top_size();
-  hdf_blobs_.resize(top_size);
+  blobs->resize(top_size);
 
   const int MIN_DATA_DIM = 1;
   const int MAX_DATA_DIM = INT_MAX;
 
   for (int i = 0; i < top_size; ++i) {
-    hdf_blobs_[i] = shared_ptr<Blob<Dtype> >(new Blob<Dtype>());
+    (*blobs)[i] = shared_ptr<Blob<Dtype> >(new Blob<Dtype>());
     // Allow reshape here, as we are loading data not params
     hdf5_load_nd_dataset(file_id, this->layer_param_.top(i).c_str(),
-        MIN_DATA_DIM, MAX_DATA_DIM, hdf_blobs_[i].get(), true);
+        MIN_DATA_DIM, MAX_DATA_DIM, (*blobs)[i].get(), true);
   }
 
   herr_t status = H5Fclose(file_id);
   CHECK_GE(status, 0) << "Failed to close HDF5 file: " << filename;
+}
+
+// Load data and label from HDF5 filename into the class property blobs.
+template <typename Dtype>
+void HDF5DataLayer<Dtype>::LoadHDF5FileData(const char* filename) {
+  if (file_prefetcher_) {
+    file_prefetcher_->Take(filename, &hdf_blobs_);
+  } else {
+    // Other layers may read HDF5 files on their threads meanwhile.
+    HDF5Lock lock;
+    ReadHDF5File(filename, &hdf_blobs_);
+  }
+  int top_size = this->layer_param_.top_size();
 
   // MinTopBlobs==1 guarantees at least one top blob
   CHECK_GE(hdf_blobs_[0]->num_axes(), 1) << "Input must have at least 1 axis.";
@@ -68,6 +83,25 @@ void HDF5DataLayer<Dtype>::LoadHDF5FileData(const char* filename) {
   } else {
     DLOG(INFO) << "Successfully loaded " << hdf_blobs_[0]->shape(0) << " rows";
   }
+  PrefetchNextFile();
+}
+
+// Start reading the file that follows the current one.
+template <typename Dtype>
+void HDF5DataLayer<Dtype>::PrefetchNextFile() {
+  if (!file_prefetcher_) {
+    return;
+  }
+  unsigned int next_file = current_file_ + 1;
+  if (next_file == num_files_) {
+    next_file = 0;
+    // The next pass starts with the prefetched file, so its order is drawn
+    // now rather than when looping around.
+    if (this->layer_param_.hdf5_data_param().shuffle()) {
+      std::random_shuffle(file_permutation_.begin(), file_permutation_.end());
+    }
+  }
+  file_prefetcher_->Prefetch(hdf_filenames_[file_permutation_[next_file]]);
 }
 
 template <typename Dtype>
@@ -108,6 +142,12 @@ void HDF5DataLayer<Dtype>::LayerSetUp(const vector<Blob<Dtype>*>& bottom,
     std::random_shuffle(file_permutation_.begin(), file_permutation_.end());
   }
 
+  if (this->layer_param_.hdf5_data_param().prefetch_next_file() &&
+      num_files_ > 1) {
+    file_prefetcher_.reset(new HDF5FilePrefetcher<Dtype>(
+        boost::bind(&HDF5DataLayer<Dtype>::ReadHDF5File, this, _1, _2)));
+  }
+
   // Load the first HDF5 file and initialize the line counter.
   LoadHDF5FileData(hdf_filenames_[file_permutation_[current_file_]].c_str());
   current_row_ = 0;
@@ -143,7 +183,8 @@ void HDF5DataLayer<Dtype>::Next() {
       ++current_file_;
       if (current_file_ == num_files_) {
         current_file_ = 0;
-        if (this->layer_param_.hdf5_data_param().shuffle()) {
+        if (this->layer_param_.hdf5_data_param().shuffle() &&
+            !file_prefetcher_) {
           std::random_shuffle(file_permutation_.begin(),
                               file_permutation_.end());
         }
@@ -1,11 +1,12 @@
 /*
 TODO:
-- load file in a separate thread ("prefetch")
 - can be smarter about the memcpy call instead of doing it row-by-row
   :: use util functions caffe_copy, and Blob->offset()
   :: don't forget to update hdf5_daa_layer.cu accordingly
 - add ability to shuffle filenames if flag is set
 */
+#include <boost/bind.hpp>
+#include <algorithm>
 #include <fstream>  // NOLINT(readability/streams)
 #include <string>
 #include <vector>
@@ -15,7 +16,9 @@ TODO:
 #include "stdint.h"
 
 #include "caffe/layers/hdf5_data_pred_layer.hpp"
+#include "caffe/util/benchmark.hpp"
 #include "caffe/util/hdf5.hpp"
+#include "caffe/util/math_functions.hpp"
 #include "caffe/util/prediction.hpp"
 
 #include <opencv2/core/core.hpp>
@@ -26,76 +29,134 @@ TODO:
 namespace caffe {
 
 template <typename Dtype>
-HDF5DataPredLayer<Dtype>::~HDF5DataPredLayer<Dtype>() { }
+HDF5DataPredLayer<Dtype>::~HDF5DataPredLayer<Dtype>() {
+  this->StopInternalThread();
+}
 
-// Load data and label from HDF5 filename into the class property blobs.
+// Names of the datasets of a file: one per top but the last (the prediction),
+// then the extra datasets in the order of the enum.
 template <typename Dtype>
-void HDF5DataPredLayer<Dtype>::LoadHDF5FileData(const char* filename) {
+vector<string> HDF5DataPredLayer<Dtype>::DatasetNames() const {
+  vector<string> names(this->layer_param_.top().begin(),
+                       this->layer_param_.top().end() - 1);
+  //WARNING load data for rotation, then data single view
+  names.push_back("viewpoint");
+  names.push_back("view_mat");
+  names.push_back("proj_mat");
+  names.push_back("data_single");
+  names.push_back("view_mat_single");
+  return names;
+}
+
+// Read the datasets of HDF5 filename into blobs, in the order of
+// DatasetNames(). May be called on the file prefetch thread; the caller
+// holds HDF5Lock.
+template <typename Dtype>
+void HDF5DataPredLayer<Dtype>::ReadHDF5File(const string& filename,
+    vector<shared_ptr<Blob<Dtype> > >* blobs) {
   DLOG(INFO) << "Loading HDF5 file: " << filename;
-  hid_t file_id = H5Fopen(filename, H5F_ACC_RDONLY, H5P_DEFAULT);
+  hid_t file_id = H5Fopen(filename.c_str(), H5F_ACC_RDONLY, H5P_DEFAULT);
   if (file_id < 0) {
     LOG(FATAL) << "Failed opening HDF5 file: " << filename;
   }
 
-  int top_size = this->layer_param_.top_size()-1; //WARNING change -1 
-  hdf_blobs_.resize(top_size);
+  const vector<string> names = DatasetNames();
+  blobs->clear();
 
   const int MIN_DATA_DIM = 1;
   const int MAX_DATA_DIM = INT_MAX;
 
-  for (int i = 0; i < top_size; ++i) {
-	DLOG(INFO) << "Loading dataset  " << this->layer_param_.top(i).c_str();
-    hdf_blobs_[i] = shared_ptr<Blob<Dtype> >(new Blob<Dtype>());
-    hdf5_load_nd_dataset(file_id, this->layer_param_.top(i).c_str(),
-						 MIN_DATA_DIM, MAX_DATA_DIM, hdf_blobs_[i].get(),true);
+  for (int i = 0; i < names.size(); ++i) {
+	DLOG(INFO) << "Loading dataset  " << names[i];
+    blobs->push_back(shared_ptr<Blob<Dtype> >(new Blob<Dtype>()));
+    hdf5_load_nd_dataset(file_id, names[i].c_str(),
+						 MIN_DATA_DIM, MAX_DATA_DIM, blobs->back().get(),true);
   }
 
-  //WARNING load data for rotation
-  viewpoint_ = shared_ptr<Blob<Dtype> >(new Blob<Dtype>());
-  view_mat_ = shared_ptr<Blob<Dtype> >(new Blob<Dtype>());
-  proj_mat_ = shared_ptr<Blob<Dtype> >(new Blob<Dtype>());
-  hdf5_load_nd_dataset(file_id, "viewpoint",
-        MIN_DATA_DIM, MAX_DATA_DIM, viewpoint_.get(),true);
-  hdf5_load_nd_dataset(file_id, "view_mat",
-        MIN_DATA_DIM, MAX_DATA_DIM, view_mat_.get(),true);
-  hdf5_load_nd_dataset(file_id, "proj_mat",
-        MIN_DATA_DIM, MAX_DATA_DIM, proj_mat_.get(),true);
-  //WARNING load data single view
-  data_single_ = shared_ptr<Blob<Dtype> >(new Blob<Dtype>());
-  view_mat_single_ = shared_ptr<Blob<Dtype> >(new Blob<Dtype>());
-  hdf5_load_nd_dataset(file_id, "data_single",
-        MIN_DATA_DIM, MAX_DATA_DIM, data_single_.get(),true);
-  hdf5_load_nd_dataset(file_id, "view_mat_single",
-        MIN_DATA_DIM, MAX_DATA_DIM, view_mat_single_.get(),true);
-
   herr_t status = H5Fclose(file_id);
   CHECK_GE(status, 0) << "Failed to close HDF5 file: " << filename;
+}
+
+template <typename Dtype>
+vector<int> HDF5DataPredLayer<Dtype>::DatasetShape(int d) const {
+  return row_cache_ ? row_cache_->shape(d) : file_blobs_[d]->shape();
+}
+
+// Copy a row of dataset d of the current file, reading it if streaming.
+template <typename Dtype>
+void HDF5DataPredLayer<Dtype>::CopyRow(int d, int row, Dtype* data) {
+  if (row_cache_) {
+    row_cache_->CopyRow(d, row, data);
+  } else {
+    const int dim = file_blobs_[d]->count(1);
+    caffe_copy(dim, file_blobs_[d]->cpu_data() + row * dim, data);
+  }
+}
+
+// Load data and label from HDF5 filename into the class property blobs.
+template <typename Dtype>
+void HDF5DataPredLayer<Dtype>::LoadHDF5FileData(const char* filename) {
+  const HDF5DataPredParameter& param =
+      this->layer_param_.hdf5_data_pred_param();
+  // Close the previous file before opening the next one.
+  row_cache_.reset();
+  file_blobs_.clear();
+  if (param.stream_cache_mb() > 0) {
+    DLOG(INFO) << "Streaming HDF5 file: " << filename;
+    row_cache_.reset(new HDF5RowCache<Dtype>(filename, DatasetNames(),
+        param.stream_chunk_rows(), size_t(param.stream_cache_mb()) << 20));
+  } else if (file_prefetcher_) {
+    file_prefetcher_->Take(filename, &file_blobs_);
+  } else {
+    // Other layers may read HDF5 files on their threads meanwhile.
+    HDF5Lock lock;
+    ReadHDF5File(filename, &file_blobs_);
+  }
+  int top_size = this->layer_param_.top_size()-1; //WARNING change -1
 
   // MinTopBlobs==1 guarantees at least one top blob
-  CHECK_GE(hdf_blobs_[0]->num_axes(), 1) << "Input must have at least 1 axis.";
-  const int num = hdf_blobs_[0]->shape(0);
+  CHECK_GE(DatasetShape(0).size(), 1) << "Input must have at least 1 axis.";
+  const int num = DatasetShape(0)[0];
   for (int i = 1; i < top_size; ++i) {
-    CHECK_EQ(hdf_blobs_[i]->shape(0), num);
+    CHECK_EQ(DatasetShape(i)[0], num);
   }
   // Default to identity permutation.
   data_permutation_.clear();
-  data_permutation_.resize(hdf_blobs_[0]->shape(0));
-  for (int i = 0; i < hdf_blobs_[0]->shape(0); i++)
+  data_permutation_.resize(num);
+  for (int i = 0; i < num; i++)
     data_permutation_[i] = i;
 
   // Shuffle if needed.
   if (this->layer_param_.hdf5_data_pred_param().shuffle()) {
     std::random_shuffle(data_permutation_.begin(), data_permutation_.end());
-    DLOG(INFO) << "Successully loaded " << hdf_blobs_[0]->shape(0)
-               << " rows (shuffled)";
+    DLOG(INFO) << "Successully loaded " << num << " rows (shuffled)";
   } else {
-    DLOG(INFO) << "Successully loaded " << hdf_blobs_[0]->shape(0) << " rows";
+    DLOG(INFO) << "Successully loaded " << num << " rows";
   }
+  PrefetchNextFile();
 }
 
+// Start reading the file that follows the current one.
 template <typename Dtype>
-void HDF5DataPredLayer<Dtype>::LayerSetUp(const vector<Blob<Dtype>*>& bottom,
-      const vector<Blob<Dtype>*>& top) {
+void HDF5DataPredLayer<Dtype>::PrefetchNextFile() {
+  if (!file_prefetcher_) {
+    return;
+  }
+  unsigned int next_file = current_file_ + 1;
+  if (next_file == num_files_) {
+    next_file = 0;
+    // The next pass starts with the prefetched file, so its order is drawn
+    // now rather than when looping around.
+    if (this->layer_param_.hdf5_data_pred_param().shuffle()) {
+      std::random_shuffle(file_permutation_.begin(), file_permutation_.end());
+    }
+  }
+  file_prefetcher_->Prefetch(hdf_filenames_[file_permutation_[next_file]]);
+}
+
+template <typename Dtype>
+void HDF5DataPredLayer<Dtype>::DataLayerSetUp(
+      const vector<Blob<Dtype>*>& bottom, const vector<Blob<Dtype>*>& top) {
   // Refuse transformation parameters since HDF5 is totally generic.
   CHECK(!this->layer_param_.has_transform_param()) <<
       this->type() << " does not transform data.";
@@ -131,6 +192,13 @@ void HDF5DataPredLayer<Dtype>::LayerSetUp(const vector<Blob<Dtype>*>& bottom,
     std::random_shuffle(file_permutation_.begin(), file_permutation_.end());
   }
 
+  if (this->layer_param_.hdf5_data_pred_param().prefetch_next_file() &&
+      this->layer_param_.hdf5_data_pred_param().stream_cache_mb() == 0 &&
+      num_files_ > 1) {
+    file_prefetcher_.reset(new HDF5FilePrefetcher<Dtype>(
+        boost::bind(&HDF5DataPredLayer<Dtype>::ReadHDF5File, this, _1, _2)));
+  }
+
   // Load the first HDF5 file and initialize the line counter.
   LoadHDF5FileData(hdf_filenames_[file_permutation_[current_file_]].c_str());
   current_row_ = 0;
@@ -140,43 +208,61 @@ void HDF5DataPredLayer<Dtype>::LayerSetUp(const vector<Blob<Dtype>*>& bottom,
   const int top_size = this->layer_param_.top_size()-1; //WARNING -1 to avoid last blob
   vector<int> top_shape;
   for (int i = 0; i < top_size; ++i) {
-	  top_shape.resize(hdf_blobs_[i]->num_axes());
+    top_shape = DatasetShape(i);
     top_shape[0] = batch_size;
-    for (int j = 1; j < top_shape.size(); ++j) {
-      top_shape[j] = hdf_blobs_[i]->shape(j);
-    }
     top[i]->Reshape(top_shape);
+    for (int k = 0; k < this->prefetch_.size(); ++k) {
+      this->prefetch_[k]->blob(i)->Reshape(top_shape);
+    }
   }
   //WARNING set last blob, which is the prediction.
   //Same size as the gt (considered to be in top_size -1 pos)
-  top_shape.resize(hdf_blobs_[top_size-1]->num_axes());
+  top_shape = DatasetShape(top_size-1);
   top_shape[0] = batch_size;
-  for (int j = 1; j < top_shape.size(); ++j) {
-      top_shape[j] = hdf_blobs_[top_size-1]->shape(j);
-  }
   top[top_size]->Reshape(top_shape);
+  for (int k = 0; k < this->prefetch_.size(); ++k) {
+    this->prefetch_[k]->blob(top_size)->Reshape(top_shape);
+  }
+  // Only a label read from the file can be packed, not the prediction.
+  this->packed_label_bits_ =
+      this->layer_param_.data_param().packed_label_bits();
+  CHECK(!this->packed_label_bits_ || top_size > 1)
+      << "The prediction top cannot be packed";
  
   //WARNING init prediction net
   pred_net_.CopyTrainedLayersFrom(this->layer_param_.hdf5_data_pred_param().trained_file());
+  pool_.reset(new ThreadPool(
+      this->layer_param_.hdf5_data_pred_param().num_threads()));
 
 }
 #define mod(a,b) ((a)<0?(a)+(b):(a)%(b))
 
+// This function is called on prefetch thread
 template <typename Dtype>
-void HDF5DataPredLayer<Dtype>::Forward_cpu(const vector<Blob<Dtype>*>& bottom,
-      const vector<Blob<Dtype>*>& top) {
+void HDF5DataPredLayer<Dtype>::load_batch(Batch<Dtype>* batch) {
+  CPUTimer batch_timer;
+  batch_timer.Start();
   const int batch_size = this->layer_param_.hdf5_data_pred_param().batch_size();
+  int last_blob = this->layer_param_.top_size()-1;
+  vector<Blob<Dtype>*> top(last_blob + 1);
+  for (int j = 0; j <= last_blob; ++j) {
+    top[j] = batch->blob(j);
+  }
+  pending_.clear();
   //parcours images du batch
   for (int i = 0; i < batch_size; ++i, ++current_row_) {
-    if (current_row_ == hdf_blobs_[0]->shape(0)) {
+    if (current_row_ == data_permutation_.size()) {
 		//si fin du fichier
       if (num_files_ > 1) {
+        // Pending items index into the current file, predict them first.
+        ForwardPredictions(top[last_blob]);
 		  //prochain fichier
         ++current_file_;
         if (current_file_ == num_files_) {
 			//si dernier fichier, revenir a 0 et shuffle
           current_file_ = 0;
-          if (this->layer_param_.hdf5_data_pred_param().shuffle()) {
+          if (this->layer_param_.hdf5_data_pred_param().shuffle() &&
+              !file_prefetcher_) {
             std::random_shuffle(file_permutation_.begin(),
                                 file_permutation_.end());
           }
@@ -194,22 +280,24 @@ void HDF5DataPredLayer<Dtype>::Forward_cpu(const vector<Blob<Dtype>*>& bottom,
 	//donner donnees
     for (int j = 0; j < this->layer_param_.top_size()-1; ++j) { //WARNING -1 to avoid last blob (pred)
       int data_dim = top[j]->count() / top[j]->shape(0);
-      caffe_copy(data_dim,
-          &hdf_blobs_[j]->cpu_data()[data_permutation_[current_row_]
-            * data_dim], &top[j]->mutable_cpu_data()[i * data_dim]);
+      if (j == 1 && batch->label_bits_) {
+        // The label is packed from a staging row.
+        label_buffer_.resize(data_dim);
+        CopyRow(j, data_permutation_[current_row_], label_buffer_.data());
+        batch->PackLabel(i, label_buffer_.data());
+        continue;
+      }
+      CopyRow(j, data_permutation_[current_row_],
+          &top[j]->mutable_cpu_data()[i * data_dim]);
     }
 
 	//choose gt or pred
-	int last_blob = this->layer_param_.top_size()-1;
 	float choice = distribution_gt(generator_);
 	if(choice<this->layer_param_.hdf5_data_pred_param().gt_prop())
 	{
 		//take GT
-		//WARNING faire prediction
-	  //std::cout<<"taking GT"<<std::endl;
 	  int data_dim = top[last_blob]->count() / top[last_blob]->shape(0);
-	  caffe_copy(data_dim,
-		     &hdf_blobs_[last_blob-1]->cpu_data()[data_permutation_[current_row_]  * data_dim],
+	  CopyRow(last_blob-1, data_permutation_[current_row_],
 		     &top[last_blob]->mutable_cpu_data()[i * data_dim]);
 
 	} else
@@ -222,43 +310,115 @@ void HDF5DataPredLayer<Dtype>::Forward_cpu(const vector<Blob<Dtype>*>& bottom,
 		int v1 = distribution_2nd_view(generator_);
 		while(v1==v2)
 			v1 = distribution_2nd_view(generator_);
-		int idv1 = id_obj*8+v1; //id (in dbase) of the first view to use
-		// std::cout<<"obj "<<id_obj<<" v1 : " <<v1<<", v2 : " <<v2<<std::endl;
-		// std::cout<<" idv1 : " <<idv1<<", idv2 : " <<idv2<<std::endl;
-		
-		Blob<Dtype>* input_layer = pred_net_.input_blobs()[0];
-		int data_dim = top[0]->count() / top[0]->shape(0);
-		caffe_copy(data_dim,
-				   &data_single_->cpu_data()[idv1 * data_dim],
-				   input_layer->mutable_cpu_data());
-		pred_net_.Forward();
-
-		// cv::Mat im1 = cv::Mat(256,256,CV_32FC1,&data_single_->mutable_cpu_data()[idv1 * data_dim]);
-		// cv::namedWindow( "sk1", CV_WINDOW_NORMAL );
-		// cv::imshow("sk1",im1);
-		// cv::Mat im2 = cv::Mat(256,256,CV_32FC1, &hdf_blobs_[0]->mutable_cpu_data()[idv2 * data_dim]);
-		// cv::namedWindow( "sk2", CV_WINDOW_NORMAL );
-		// cv::imshow("sk2",im2);
-		//cv::waitKey();
-
-		//WARNING rotate pred and put it in network
-		data_dim = top[last_blob]->count() / top[last_blob]->shape(0);
-		
-		// caffe_copy(data_dim,
-		// 		   &hdf_blobs_[last_blob-1]->cpu_data()[idv1  * data_dim],
-		// 		   top[last_blob]->mutable_cpu_data());
-		
-		rotate_blobs(pred_net_.output_blobs()[0],
-					 //top[last_blob],
-					 &viewpoint_->cpu_data()[(id_obj*13+v1) * 16],
-					 &view_mat_single_->cpu_data()[idv1 * 16],
-					 &viewpoint_->cpu_data()[idv2 * 16],
-					 &view_mat_->cpu_data()[idv2 * 16],
-					 &proj_mat_->cpu_data()[idv1 * 16],
-					 &top[last_blob]->mutable_cpu_data()[i * data_dim]);
+		PendingItem item;
+		item.batch_index = i;
+		item.idv1 = id_obj*8+v1; //id (in dbase) of the first view to use
+		item.idv2 = idv2;
+		item.model1_row = id_obj*13+v1;
+		pending_.push_back(item);
 	}
 
   }
+  ForwardPredictions(top[last_blob]);
+  batch_timer.Stop();
+  DLOG(INFO) << "Prefetch batch: " << batch_timer.MilliSeconds() << " ms.";
+}
+
+template <typename Dtype>
+void HDF5DataPredLayer<Dtype>::ForwardPredictions(Blob<Dtype>* top) {
+  const int num = pending_.size();
+  if (num == 0) {
+    return;
+  }
+  // Push all first views through the prediction net as one batch.
+  Blob<Dtype>* input_layer = pred_net_.input_blobs()[0];
+  const int data_dim = input_layer->count(1);
+  vector<int> input_shape = input_layer->shape();
+  input_shape[0] = num;
+  input_layer->Reshape(input_shape);
+  Dtype* input_data = input_layer->mutable_cpu_data();
+  for (int k = 0; k < num; ++k) {
+    CopyRow(ExtraDataset(DATA_SINGLE), pending_[k].idv1,
+        input_data + k * data_dim);
+  }
+  pred_net_.Forward();
+
+  // Rotate the predictions into the second views.
+  const Blob<Dtype>* pred = pred_net_.output_blobs()[0];
+  const int size = pred->width();
+  const int pred_dim = top->count(1);
+  const bool trilinear =
+      this->layer_param_.hdf5_data_pred_param().trilinear();
+  const bool on_gpu = Caffe::mode() == Caffe::GPU;
+  Dtype* top_data = on_gpu ? NULL : top->mutable_cpu_data();
+  rotations_.resize(num);
+  rotation_src_.resize(num);
+  rotation_dst_.resize(num);
+  // 4x4 matrices of the first and second views.
+  Dtype model1[16], view_mat1[16], model2[16], view_mat2[16], proj_mat[16];
+  for (int k = 0; k < num; ++k) {
+    const PendingItem& item = pending_[k];
+    CopyRow(ExtraDataset(VIEWPOINT), item.model1_row, model1);
+    CopyRow(ExtraDataset(VIEW_MAT_SINGLE), item.idv1, view_mat1);
+    CopyRow(ExtraDataset(VIEWPOINT), item.idv2, model2);
+    CopyRow(ExtraDataset(VIEW_MAT), item.idv2, view_mat2);
+    CopyRow(ExtraDataset(PROJ_MAT), item.idv1, proj_mat);
+    rotations_[k].reset(new VoxelRotation<Dtype>(size,
+        model1, view_mat1, model2, view_mat2, proj_mat, trilinear));
+    if (!on_gpu) {
+      rotation_src_[k] = prediction_voxels(pred, k);
+      rotation_dst_[k] = top_data + item.batch_index * pred_dim;
+    }
+  }
+  if (on_gpu) {
+    RotateOnGPU(pred, top);
+    pending_.clear();
+    return;
+  }
+  // On CPU, one task per item, or per group of z-slices when there are fewer
+  // items than threads.
+  const int threads = pool_->num_threads();
+  rotation_chunks_ = std::min(size, (threads + num - 1) / num);
+  pool_->Run(num * rotation_chunks_,
+      boost::bind(&HDF5DataPredLayer<Dtype>::RotateTask, this, _1));
+  pending_.clear();
+}
+
+// Rotates all pending items in one kernel, so the predictions stay on the
+// device and only the ground truth rows of the top are uploaded.
+template <typename Dtype>
+void HDF5DataPredLayer<Dtype>::RotateOnGPU(const Blob<Dtype>* pred,
+    Blob<Dtype>* top) {
+#ifndef CPU_ONLY
+  const int num = pending_.size();
+  const int size = pred->width();
+  const int num_params = voxel_rotation_num_params(size);
+  rotation_params_.Reshape(1, 1, num, num_params);
+  rotation_items_.Reshape(1, 1, 1, num);
+  Dtype* params = rotation_params_.mutable_cpu_data();
+  int* items = rotation_items_.mutable_cpu_data();
+  for (int k = 0; k < num; ++k) {
+    std::copy(rotations_[k]->params(), rotations_[k]->params() + num_params,
+              params + k * num_params);
+    items[k] = pending_[k].batch_index;
+  }
+  rotate_blobs_gpu(num, size, rotation_params_.gpu_data(),
+      pred->gpu_data() + prediction_voxels_offset(pred), pred->count(1),
+      rotation_items_.gpu_data(),
+      this->layer_param_.hdf5_data_pred_param().trilinear(),
+      top->mutable_gpu_data(), top->count(1));
+#else
+  NO_GPU;
+#endif
+}
+
+template <typename Dtype>
+void HDF5DataPredLayer<Dtype>::RotateTask(int task) {
+  const int k = task / rotation_chunks_;
+  const int chunk = task % rotation_chunks_;
+  const int size = rotations_[k]->size();
+  rotations_[k]->Apply(rotation_src_[k], rotation_dst_[k],
+      chunk * size / rotation_chunks_, (chunk + 1) * size / rotation_chunks_);
 }
 
 
@@ -2,6 +2,7 @@
 
 #include "caffe/filler.hpp"
 #include "caffe/layers/inner_product_layer.hpp"
+#include "caffe/util/blas_backend.hpp"
 #include "caffe/util/math_functions.hpp"
 
 namespace caffe {
@@ -12,6 +13,8 @@ void InnerProductLayer<Dtype>::LayerSetUp(const vector<Blob<Dtype>*>& bottom,
   const int num_output = this->layer_param_.inner_product_param().num_output();
   bias_term_ = this->layer_param_.inner_product_param().bias_term();
   transpose_ = this->layer_param_.inner_product_param().transpose();
+  activation_ = this->layer_param_.inner_product_param().activation();
+  quantization_ = this->layer_param_.inner_product_param().quantization();
   N_ = num_output;
   const int axis = bottom[0]->CanonicalAxisIndex(
       this->layer_param_.inner_product_param().axis());
@@ -85,21 +88,44 @@ void InnerProductLayer<Dtype>::Forward_cpu(const vector<Blob<Dtype>*>& bottom,
     const vector<Blob<Dtype>*>& top) {
   const Dtype* bottom_data = bottom[0]->cpu_data();
   Dtype* top_data = top[0]->mutable_cpu_data();
-  const Dtype* weight = this->blobs_[0]->cpu_data();
-  caffe_cpu_gemm<Dtype>(CblasNoTrans, transpose_ ? CblasNoTrans : CblasTrans,
-      M_, N_, K_, (Dtype)1.,
-      bottom_data, weight, (Dtype)0., top_data);
+  if (this->phase_ == TEST &&
+      quantization_.precision() == QuantizationParameter_Precision_INT8) {
+    // top^T = W * bottom^T, with the bias of each output in the product.
+    int8_weight_.Quantize(transpose_ ? CblasTrans : CblasNoTrans, N_, K_,
+        *this->blobs_[0]);
+    caffe_cpu_gemm_int8<Dtype>(int8_weight_, CblasTrans, M_,
+        quantization_.input_max(), bottom_data,
+        bias_term_ ? this->blobs_[1]->cpu_data() : NULL, CblasTrans,
+        top_data);
+    caffe_cpu_activation(activation_, M_ * N_, top_data);
+    return;
+  }
+  if (this->phase_ == TEST && caffe_blas_backend() == BLAS_BUILTIN) {
+    // Pack the weights once rather than in every product.
+    packed_weight_.Pack(PackedMatrix<Dtype>::RIGHT,
+        transpose_ ? CblasNoTrans : CblasTrans, K_, N_, *this->blobs_[0]);
+    caffe_cpu_gemm_packed<Dtype>(CblasNoTrans, M_, (Dtype)1., bottom_data,
+        packed_weight_, (Dtype)0., top_data);
+  } else {
+    const Dtype* weight = this->blobs_[0]->cpu_data();
+    caffe_cpu_gemm<Dtype>(CblasNoTrans, transpose_ ? CblasNoTrans : CblasTrans,
+        M_, N_, K_, (Dtype)1.,
+        bottom_data, weight, (Dtype)0., top_data);
+  }
   if (bias_term_) {
     caffe_cpu_gemm<Dtype>(CblasNoTrans, CblasNoTrans, M_, N_, 1, (Dtype)1.,
         bias_multiplier_.cpu_data(),
         this->blobs_[1]->cpu_data(), (Dtype)1., top_data);
   }
+  caffe_cpu_activation(activation_, M_ * N_, top_data);
 }
 
 template <typename Dtype>
 void InnerProductLayer<Dtype>::Backward_cpu(const vector<Blob<Dtype>*>& top,
     const vector<bool>& propagate_down,
     const vector<Blob<Dtype>*>& bottom) {
+  CHECK_EQ(activation_.type(), ActivationParameter_Type_NONE)
+      << "Layers with a fused activation have no backward pass.";
   if (this->param_propagate_down_[0]) {
     const Dtype* top_diff = top[0]->cpu_diff();
     const Dtype* bottom_data = bottom[0]->cpu_data();
@@ -5,6 +5,11 @@
 #include "caffe/layers/pooling_layer.hpp"
 #include "caffe/util/math_functions.hpp"
 
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#define CAFFE_POOLING_X86
+#endif
+
 namespace caffe {
 
 using std::min;
@@ -14,8 +19,18 @@ template <typename Dtype>
 void PoolingLayer<Dtype>::LayerSetUp(const vector<Blob<Dtype>*>& bottom,
       const vector<Blob<Dtype>*>& top) {
   PoolingParameter pool_param = this->layer_param_.pooling_param();
+  num_spatial_axes_ = bottom[0]->num_axes() - 2;
+  CHECK(num_spatial_axes_ == 2 || num_spatial_axes_ == 3)
+      << "Input must have 4 axes, corresponding to (num, channels, height, "
+      << "width), or 5 axes, corresponding to (num, channels, depth, height, "
+      << "width)";
+  const bool pool_3d = num_spatial_axes_ == 3;
+  if (pool_3d) {
+    CHECK(pool_param.pool() != PoolingParameter_PoolMethod_STOCHASTIC)
+        << "3D pooling is implemented only for max and average pooling.";
+  }
   if (pool_param.global_pooling()) {
-    CHECK(!(pool_param.has_kernel_size() ||
+    CHECK(!(pool_param.has_kernel_size() || pool_param.has_kernel_d() ||
       pool_param.has_kernel_h() || pool_param.has_kernel_w()))
       << "With Global_pooling: true Filter size cannot specified";
   } else {
@@ -37,40 +52,52 @@ void PoolingLayer<Dtype>::LayerSetUp(const vector<Blob<Dtype>*>& bottom,
   global_pooling_ = pool_param.global_pooling();
   round_mode_ = pool_param.round_mode();
   if (global_pooling_) {
-    kernel_h_ = bottom[0]->height();
-    kernel_w_ = bottom[0]->width();
+    kernel_d_ = pool_3d ? bottom[0]->shape(2) : 1;
+    kernel_h_ = bottom[0]->shape(-2);
+    kernel_w_ = bottom[0]->shape(-1);
   } else {
     if (pool_param.has_kernel_size()) {
       kernel_h_ = kernel_w_ = pool_param.kernel_size();
+      kernel_d_ = pool_3d ? pool_param.kernel_size() : 1;
     } else {
+      CHECK(!pool_3d || pool_param.has_kernel_d())
+          << "For non-cubic 3D filters kernel_d is required.";
       kernel_h_ = pool_param.kernel_h();
       kernel_w_ = pool_param.kernel_w();
+      kernel_d_ = pool_3d ? pool_param.kernel_d() : 1;
     }
   }
+  CHECK_GT(kernel_d_, 0) << "Filter dimensions cannot be zero.";
   CHECK_GT(kernel_h_, 0) << "Filter dimensions cannot be zero.";
   CHECK_GT(kernel_w_, 0) << "Filter dimensions cannot be zero.";
   if (!pool_param.has_pad_h()) {
     pad_h_ = pad_w_ = pool_param.pad();
+    pad_d_ = pool_3d ? pool_param.pad() : 0;
   } else {
     pad_h_ = pool_param.pad_h();
     pad_w_ = pool_param.pad_w();
+    pad_d_ = pool_3d ? pool_param.pad_d() : 0;
   }
   if (!pool_param.has_stride_h()) {
     stride_h_ = stride_w_ = pool_param.stride();
+    stride_d_ = pool_3d ? pool_param.stride() : 1;
   } else {
     stride_h_ = pool_param.stride_h();
     stride_w_ = pool_param.stride_w();
+    stride_d_ = pool_3d ? pool_param.stride_d() : 1;
   }
   if (global_pooling_) {
-    CHECK(pad_h_ == 0 && pad_w_ == 0 && stride_h_ == 1 && stride_w_ == 1)
+    CHECK(pad_d_ == 0 && pad_h_ == 0 && pad_w_ == 0 && stride_d_ == 1 &&
+        stride_h_ == 1 && stride_w_ == 1)
       << "With Global_pooling: true; only pad = 0 and stride = 1";
   }
-  if (pad_h_ != 0 || pad_w_ != 0) {
+  if (pad_d_ != 0 || pad_h_ != 0 || pad_w_ != 0) {
     CHECK(this->layer_param_.pooling_param().pool()
         == PoolingParameter_PoolMethod_AVE
         || this->layer_param_.pooling_param().pool()
         == PoolingParameter_PoolMethod_MAX)
         << "Padding implemented only for average and max pooling.";
+    CHECK_LT(pad_d_, kernel_d_);
     CHECK_LT(pad_h_, kernel_h_);
     CHECK_LT(pad_w_, kernel_w_);
   }
@@ -79,23 +106,30 @@ void PoolingLayer<Dtype>::LayerSetUp(const vector<Blob<Dtype>*>& bottom,
 template <typename Dtype>
 void PoolingLayer<Dtype>::Reshape(const vector<Blob<Dtype>*>& bottom,
       const vector<Blob<Dtype>*>& top) {
-  CHECK_EQ(4, bottom[0]->num_axes()) << "Input must have 4 axes, "
-      << "corresponding to (num, channels, height, width)";
-  channels_ = bottom[0]->channels();
-  height_ = bottom[0]->height();
-  width_ = bottom[0]->width();
+  CHECK_EQ(num_spatial_axes_ + 2, bottom[0]->num_axes())
+      << "Input must keep the " << num_spatial_axes_ + 2 << " axes it was "
+      << "set up with";
+  channels_ = bottom[0]->shape(1);
+  depth_ = num_spatial_axes_ == 3 ? bottom[0]->shape(2) : 1;
+  height_ = bottom[0]->shape(-2);
+  width_ = bottom[0]->shape(-1);
   if (global_pooling_) {
-    kernel_h_ = bottom[0]->height();
-    kernel_w_ = bottom[0]->width();
+    kernel_d_ = depth_;
+    kernel_h_ = height_;
+    kernel_w_ = width_;
   }
   switch (round_mode_) {
   case PoolingParameter_RoundMode_CEIL:
+    pooled_depth_ = static_cast<int>(ceil(static_cast<float>(
+        depth_ + 2 * pad_d_ - kernel_d_) / stride_d_)) + 1;
     pooled_height_ = static_cast<int>(ceil(static_cast<float>(
         height_ + 2 * pad_h_ - kernel_h_) / stride_h_)) + 1;
     pooled_width_ = static_cast<int>(ceil(static_cast<float>(
         width_ + 2 * pad_w_ - kernel_w_) / stride_w_)) + 1;
     break;
   case PoolingParameter_RoundMode_FLOOR:
+    pooled_depth_ = static_cast<int>(floor(static_cast<float>(
+        depth_ + 2 * pad_d_ - kernel_d_) / stride_d_)) + 1;
     pooled_height_ = static_cast<int>(floor(static_cast<float>(
         height_ + 2 * pad_h_ - kernel_h_) / stride_h_)) + 1;
     pooled_width_ = static_cast<int>(floor(static_cast<float>(
@@ -104,34 +138,41 @@ void PoolingLayer<Dtype>::Reshape(const vector<Blob<Dtype>*>& bottom,
   default:
     LOG(FATAL) << "Unknown rounding mode.";
   }
-  if (pad_h_ || pad_w_) {
+  if (pad_d_ || pad_h_ || pad_w_) {
     // If we have padding, ensure that the last pooling starts strictly
     // inside the image (instead of at the padding); otherwise clip the last.
+    if ((pooled_depth_ - 1) * stride_d_ >= depth_ + pad_d_) {
+      --pooled_depth_;
+    }
     if ((pooled_height_ - 1) * stride_h_ >= height_ + pad_h_) {
       --pooled_height_;
     }
     if ((pooled_width_ - 1) * stride_w_ >= width_ + pad_w_) {
       --pooled_width_;
     }
+    CHECK_LT((pooled_depth_ - 1) * stride_d_, depth_ + pad_d_);
     CHECK_LT((pooled_height_ - 1) * stride_h_, height_ + pad_h_);
     CHECK_LT((pooled_width_ - 1) * stride_w_, width_ + pad_w_);
   }
-  top[0]->Reshape(bottom[0]->num(), channels_, pooled_height_,
-      pooled_width_);
+  vector<int> top_shape = bottom[0]->shape();
+  if (num_spatial_axes_ == 3) {
+    top_shape[2] = pooled_depth_;
+  }
+  top_shape[top_shape.size() - 2] = pooled_height_;
+  top_shape[top_shape.size() - 1] = pooled_width_;
+  top[0]->Reshape(top_shape);
   if (top.size() > 1) {
     top[1]->ReshapeLike(*top[0]);
   }
   // If max pooling, we will initialize the vector index part.
   if (this->layer_param_.pooling_param().pool() ==
       PoolingParameter_PoolMethod_MAX && top.size() == 1) {
-    max_idx_.Reshape(bottom[0]->num(), channels_, pooled_height_,
-        pooled_width_);
+    max_idx_.Reshape(top_shape);
   }
   // If stochastic pooling, we will initialize the random index part.
   if (this->layer_param_.pooling_param().pool() ==
       PoolingParameter_PoolMethod_STOCHASTIC) {
-    rand_idx_.Reshape(bottom[0]->num(), channels_, pooled_height_,
-      pooled_width_);
+    rand_idx_.Reshape(top_shape);
   }
 }
 
@@ -140,6 +181,10 @@ void PoolingLayer<Dtype>::Reshape(const vector<Blob<Dtype>*>& bottom,
 template <typename Dtype>
 void PoolingLayer<Dtype>::Forward_cpu(const vector<Blob<Dtype>*>& bottom,
       const vector<Blob<Dtype>*>& top) {
+  if (num_spatial_axes_ == 3) {
+    Forward_3d_cpu(bottom, top);
+    return;
+  }
   const Dtype* bottom_data = bottom[0]->cpu_data();
   Dtype* top_data = top[0]->mutable_cpu_data();
   const int top_count = top[0]->count();
@@ -245,6 +290,10 @@ void PoolingLayer<Dtype>::Backward_cpu(const vector<Blob<Dtype>*>& top,
   if (!propagate_down[0]) {
     return;
   }
+  if (num_spatial_axes_ == 3) {
+    Backward_3d_cpu(top, bottom);
+    return;
+  }
   const Dtype* top_diff = top[0]->cpu_diff();
   Dtype* bottom_diff = bottom[0]->mutable_cpu_diff();
   // Different pooling methods. We explicitly do the switch outside the for
@@ -319,6 +368,290 @@ void PoolingLayer<Dtype>::Backward_cpu(const vector<Blob<Dtype>*>& top,
   }
 }
 
+// The outputs [*begin, *end) of a row of pooled_width whose input
+// pw * stride + offset falls inside [0, width).
+inline void pool_row_range(const int width, const int pooled_width,
+    const int offset, const int stride, int* begin, int* end) {
+  const int first = offset < 0 ? (stride - 1 - offset) / stride : 0;
+  const int last = width > offset ? (width - offset + stride - 1) / stride : 0;
+  *begin = min(first, pooled_width);
+  *end = max(min(last, pooled_width), *begin);
+}
+
+#ifdef CAFFE_POOLING_X86
+// The inputs pw * stride + offset of the 8 outputs from pw of a row.
+__attribute__((target("avx2")))
+static inline __m256 pool_row_load_avx2(const float* in, const int pw,
+    const int stride, const int offset, const __m256i steps) {
+  const float* first = in + pw * stride + offset;
+  return stride == 1 ? _mm256_loadu_ps(first) :
+      _mm256_i32gather_ps(first, steps, 4);
+}
+
+// The rows below 8 outputs at a time, which are independent of each other,
+// with the comparisons and sums of the scalar loops; each returns the output
+// it stopped at.
+__attribute__((target("avx2")))
+static int max_pool_row_avx2(const float* in, const int index, const int begin,
+    const int end, const int stride, const int offset, float* out,
+    int* mask) {
+  const __m256i steps = _mm256_mullo_epi32(
+      _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7), _mm256_set1_epi32(stride));
+  int pw = begin;
+  for (; pw + 8 <= end; pw += 8) {
+    const __m256 value = pool_row_load_avx2(in, pw, stride, offset, steps);
+    const __m256 old_value = _mm256_loadu_ps(out + pw);
+    const __m256 greater = _mm256_cmp_ps(value, old_value, _CMP_GT_OQ);
+    const __m256i value_index = _mm256_add_epi32(steps,
+        _mm256_set1_epi32(index + pw * stride + offset));
+    const __m256i old_index = _mm256_loadu_si256(
+        reinterpret_cast<const __m256i*>(mask + pw));
+    _mm256_storeu_ps(out + pw, _mm256_blendv_ps(old_value, value, greater));
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(mask + pw),
+        _mm256_blendv_epi8(old_index, value_index,
+            _mm256_castps_si256(greater)));
+  }
+  return pw;
+}
+
+__attribute__((target("avx2")))
+static int max_pool_row_avx2(const float* in, const int index, const int begin,
+    const int end, const int stride, const int offset, float* out,
+    float* mask) {
+  const __m256i steps = _mm256_mullo_epi32(
+      _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7), _mm256_set1_epi32(stride));
+  int pw = begin;
+  for (; pw + 8 <= end; pw += 8) {
+    const __m256 value = pool_row_load_avx2(in, pw, stride, offset, steps);
+    const __m256 old_value = _mm256_loadu_ps(out + pw);
+    const __m256 greater = _mm256_cmp_ps(value, old_value, _CMP_GT_OQ);
+    const __m256 value_index = _mm256_cvtepi32_ps(_mm256_add_epi32(steps,
+        _mm256_set1_epi32(index + pw * stride + offset)));
+    _mm256_storeu_ps(out + pw, _mm256_blendv_ps(old_value, value, greater));
+    _mm256_storeu_ps(mask + pw, _mm256_blendv_ps(_mm256_loadu_ps(mask + pw),
+        value_index, greater));
+  }
+  return pw;
+}
+
+__attribute__((target("avx2")))
+static int ave_pool_row_avx2(const float* in, const int begin, const int end,
+    const int stride, const int offset, float* out) {
+  const __m256i steps = _mm256_mullo_epi32(
+      _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7), _mm256_set1_epi32(stride));
+  int pw = begin;
+  for (; pw + 8 <= end; pw += 8) {
+    _mm256_storeu_ps(out + pw, _mm256_add_ps(_mm256_loadu_ps(out + pw),
+        pool_row_load_avx2(in, pw, stride, offset, steps)));
+  }
+  return pw;
+}
+#endif
+
+// The vectorized part of a row returns the output it stopped at; there are
+// kernels for float only.
+template <typename Dtype, typename Mask>
+inline int max_pool_row_vectorized(const Dtype* in, const int index,
+    const int begin, const int end, const int stride, const int offset,
+    Dtype* out, Mask* mask) {
+  return begin;
+}
+
+template <typename Mask>
+inline int max_pool_row_vectorized(const float* in, const int index,
+    const int begin, const int end, const int stride, const int offset,
+    float* out, Mask* mask) {
+#ifdef CAFFE_POOLING_X86
+  static const bool avx2 = __builtin_cpu_supports("avx2");
+  if (avx2) {
+    return max_pool_row_avx2(in, index, begin, end, stride, offset, out,
+        mask);
+  }
+#endif
+  return begin;
+}
+
+template <typename Dtype>
+inline int ave_pool_row_vectorized(const Dtype* in, const int begin,
+    const int end, const int stride, const int offset, Dtype* out) {
+  return begin;
+}
+
+template <>
+inline int ave_pool_row_vectorized(const float* in, const int begin,
+    const int end, const int stride, const int offset, float* out) {
+#ifdef CAFFE_POOLING_X86
+  static const bool avx2 = __builtin_cpu_supports("avx2");
+  if (avx2) { return ave_pool_row_avx2(in, begin, end, stride, offset, out); }
+#endif
+  return begin;
+}
+
+// Max pools one input row, whose first element is at index of the channel,
+// into the outputs [begin, end) of a row, for one offset in the kernel.
+template <typename Dtype, typename Mask>
+inline void max_pool_row(const Dtype* in, const int index, const int begin,
+    const int end, const int stride, const int offset, Dtype* out,
+    Mask* mask) {
+  for (int pw = max_pool_row_vectorized(in, index, begin, end, stride,
+           offset, out, mask); pw < end; ++pw) {
+    const int w = pw * stride + offset;
+    if (in[w] > out[pw]) {
+      out[pw] = in[w];
+      mask[pw] = static_cast<Mask>(index + w);
+    }
+  }
+}
+
+// Rows of outputs are pooled one kernel column at a time, so that the
+// innermost loops run over contiguous outputs without bounds checks. The
+// inputs of each output are still visited in (d, h, w) order, which keeps the
+// argmax of max pooling the same as the one of the 2D pass.
+template <typename Dtype>
+void PoolingLayer<Dtype>::Forward_3d_cpu(const vector<Blob<Dtype>*>& bottom,
+      const vector<Blob<Dtype>*>& top) {
+  const Dtype* bottom_data = bottom[0]->cpu_data();
+  Dtype* top_data = top[0]->mutable_cpu_data();
+  const int top_count = top[0]->count();
+  const int planes = bottom[0]->count(0, 2);
+  const int bottom_dim = bottom[0]->count(2);
+  const int top_dim = top[0]->count(2);
+  const bool max_pool = this->layer_param_.pooling_param().pool() ==
+      PoolingParameter_PoolMethod_MAX;
+  const bool use_top_mask = top.size() > 1;
+  int* mask = NULL;
+  Dtype* top_mask = NULL;
+  if (max_pool) {
+    if (use_top_mask) {
+      top_mask = top[1]->mutable_cpu_data();
+      caffe_set(top_count, Dtype(-1), top_mask);
+    } else {
+      mask = max_idx_.mutable_cpu_data();
+      caffe_set(top_count, -1, mask);
+    }
+    caffe_set(top_count, Dtype(-FLT_MAX), top_data);
+  } else {
+    caffe_set(top_count, Dtype(0), top_data);
+  }
+  for (int p = 0; p < planes; ++p) {
+    const Dtype* volume = bottom_data + p * bottom_dim;
+    for (int pd = 0; pd < pooled_depth_; ++pd) {
+      int dstart = pd * stride_d_ - pad_d_;
+      int dend = min(dstart + kernel_d_, depth_ + pad_d_);
+      const int pool_depth = dend - dstart;
+      dstart = max(dstart, 0);
+      dend = min(dend, depth_);
+      for (int ph = 0; ph < pooled_height_; ++ph) {
+        int hstart = ph * stride_h_ - pad_h_;
+        int hend = min(hstart + kernel_h_, height_ + pad_h_);
+        const int pool_area = pool_depth * (hend - hstart);
+        hstart = max(hstart, 0);
+        hend = min(hend, height_);
+        const int top_index =
+            p * top_dim + (pd * pooled_height_ + ph) * pooled_width_;
+        Dtype* out = top_data + top_index;
+        for (int d = dstart; d < dend; ++d) {
+          for (int h = hstart; h < hend; ++h) {
+            const int index = (d * height_ + h) * width_;
+            const Dtype* in = volume + index;
+            for (int kw = 0; kw < kernel_w_; ++kw) {
+              const int offset = kw - pad_w_;
+              int begin, end;
+              pool_row_range(width_, pooled_width_, offset, stride_w_,
+                  &begin, &end);
+              if (!max_pool) {
+                for (int pw = ave_pool_row_vectorized(in, begin, end,
+                         stride_w_, offset, out); pw < end; ++pw) {
+                  out[pw] += in[pw * stride_w_ + offset];
+                }
+              } else if (use_top_mask) {
+                max_pool_row(in, index, begin, end, stride_w_, offset, out,
+                    top_mask + top_index);
+              } else {
+                max_pool_row(in, index, begin, end, stride_w_, offset, out,
+                    mask + top_index);
+              }
+            }
+          }
+        }
+        if (!max_pool) {
+          for (int pw = 0; pw < pooled_width_; ++pw) {
+            const int wstart = pw * stride_w_ - pad_w_;
+            const int wend = min(wstart + kernel_w_, width_ + pad_w_);
+            out[pw] /= pool_area * (wend - wstart);
+          }
+        }
+      }
+    }
+  }
+}
+
+template <typename Dtype>
+void PoolingLayer<Dtype>::Backward_3d_cpu(const vector<Blob<Dtype>*>& top,
+      const vector<Blob<Dtype>*>& bottom) {
+  const Dtype* top_diff = top[0]->cpu_diff();
+  Dtype* bottom_diff = bottom[0]->mutable_cpu_diff();
+  caffe_set(bottom[0]->count(), Dtype(0), bottom_diff);
+  const int planes = bottom[0]->count(0, 2);
+  const int bottom_dim = bottom[0]->count(2);
+  const int top_dim = top[0]->count(2);
+  if (this->layer_param_.pooling_param().pool() ==
+      PoolingParameter_PoolMethod_MAX) {
+    const bool use_top_mask = top.size() > 1;
+    const Dtype* top_mask = use_top_mask ? top[1]->cpu_data() : NULL;
+    const int* mask = use_top_mask ? NULL : max_idx_.cpu_data();
+    for (int p = 0; p < planes; ++p) {
+      Dtype* volume_diff = bottom_diff + p * bottom_dim;
+      for (int i = p * top_dim; i < (p + 1) * top_dim; ++i) {
+        const int bottom_index =
+            use_top_mask ? static_cast<int>(top_mask[i]) : mask[i];
+        volume_diff[bottom_index] += top_diff[i];
+      }
+    }
+    return;
+  }
+  // Average pooling: the transpose of Forward_3d_cpu, with the top diffs of
+  // a row divided by their pool sizes first.
+  vector<Dtype> row_diff(pooled_width_);
+  for (int p = 0; p < planes; ++p) {
+    Dtype* volume_diff = bottom_diff + p * bottom_dim;
+    for (int pd = 0; pd < pooled_depth_; ++pd) {
+      int dstart = pd * stride_d_ - pad_d_;
+      int dend = min(dstart + kernel_d_, depth_ + pad_d_);
+      const int pool_depth = dend - dstart;
+      dstart = max(dstart, 0);
+      dend = min(dend, depth_);
+      for (int ph = 0; ph < pooled_height_; ++ph) {
+        int hstart = ph * stride_h_ - pad_h_;
+        int hend = min(hstart + kernel_h_, height_ + pad_h_);
+        const int pool_area = pool_depth * (hend - hstart);
+        hstart = max(hstart, 0);
+        hend = min(hend, height_);
+        const Dtype* out_diff = top_diff + p * top_dim +
+            (pd * pooled_height_ + ph) * pooled_width_;
+        for (int pw = 0; pw < pooled_width_; ++pw) {
+          const int wstart = pw * stride_w_ - pad_w_;
+          const int wend = min(wstart + kernel_w_, width_ + pad_w_);
+          row_diff[pw] = out_diff[pw] / (pool_area * (wend - wstart));
+        }
+        for (int d = dstart; d < dend; ++d) {
+          for (int h = hstart; h < hend; ++h) {
+            Dtype* in_diff = volume_diff + (d * height_ + h) * width_;
+            for (int kw = 0; kw < kernel_w_; ++kw) {
+              const int offset = kw - pad_w_;
+              int begin, end;
+              pool_row_range(width_, pooled_width_, offset, stride_w_,
+                  &begin, &end);
+              for (int pw = begin; pw < end; ++pw) {
+                in_diff[pw * stride_w_ + offset] += row_diff[pw];
+              }
+            }
+          }
+        }
+      }
+    }
+  }
+}
 
 #ifdef CPU_ONLY
 STUB_GPU(PoolingLayer);
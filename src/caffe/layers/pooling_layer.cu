@@ -157,6 +157,10 @@ __global__ void StoPoolForwardTest(const int nthreads,
 template <typename Dtype>
 void PoolingLayer<Dtype>::Forward_gpu(const vector<Blob<Dtype>*>& bottom,
       const vector<Blob<Dtype>*>& top) {
+  if (num_spatial_axes_ == 3) {
+    Forward_3d_gpu(bottom, top);
+    return;
+  }
   const Dtype* bottom_data = bottom[0]->gpu_data();
   Dtype* top_data = top[0]->mutable_gpu_data();
   int count = top[0]->count();
@@ -336,6 +340,10 @@ void PoolingLayer<Dtype>::Backward_gpu(const vector<Blob<Dtype>*>& top,
   if (!propagate_down[0]) {
     return;
   }
+  if (num_spatial_axes_ == 3) {
+    Backward_3d_gpu(top, bottom);
+    return;
+  }
   const Dtype* top_diff = top[0]->gpu_diff();
   Dtype* bottom_diff = bottom[0]->mutable_gpu_diff();
   const int count = bottom[0]->count();
@@ -379,6 +387,241 @@ void PoolingLayer<Dtype>::Backward_gpu(const vector<Blob<Dtype>*>& top,
   CUDA_POST_KERNEL_CHECK;
 }
 
+// The 3D kernels index the (num * channels) volumes of the blobs directly.
+template <typename Dtype>
+__global__ void MaxPool3DForward(const int nthreads,
+    const Dtype* const bottom_data, const int depth, const int height,
+    const int width, const int pooled_depth, const int pooled_height,
+    const int pooled_width, const int kernel_d, const int kernel_h,
+    const int kernel_w, const int stride_d, const int stride_h,
+    const int stride_w, const int pad_d, const int pad_h, const int pad_w,
+    Dtype* const top_data, int* mask, Dtype* top_mask) {
+  CUDA_KERNEL_LOOP(index, nthreads) {
+    const int pw = index % pooled_width;
+    const int ph = (index / pooled_width) % pooled_height;
+    const int pd = (index / pooled_width / pooled_height) % pooled_depth;
+    const int p = index / pooled_width / pooled_height / pooled_depth;
+    int dstart = pd * stride_d - pad_d;
+    int hstart = ph * stride_h - pad_h;
+    int wstart = pw * stride_w - pad_w;
+    const int dend = min(dstart + kernel_d, depth);
+    const int hend = min(hstart + kernel_h, height);
+    const int wend = min(wstart + kernel_w, width);
+    dstart = max(dstart, 0);
+    hstart = max(hstart, 0);
+    wstart = max(wstart, 0);
+    Dtype maxval = -FLT_MAX;
+    int maxidx = -1;
+    const Dtype* const bottom_volume =
+        bottom_data + p * depth * height * width;
+    for (int d = dstart; d < dend; ++d) {
+      for (int h = hstart; h < hend; ++h) {
+        for (int w = wstart; w < wend; ++w) {
+          const int i = (d * height + h) * width + w;
+          if (bottom_volume[i] > maxval) {
+            maxidx = i;
+            maxval = bottom_volume[i];
+          }
+        }
+      }
+    }
+    top_data[index] = maxval;
+    if (mask) {
+      mask[index] = maxidx;
+    } else {
+      top_mask[index] = maxidx;
+    }
+  }
+}
+
+template <typename Dtype>
+__global__ void AvePool3DForward(const int nthreads,
+    const Dtype* const bottom_data, const int depth, const int height,
+    const int width, const int pooled_depth, const int pooled_height,
+    const int pooled_width, const int kernel_d, const int kernel_h,
+    const int kernel_w, const int stride_d, const int stride_h,
+    const int stride_w, const int pad_d, const int pad_h, const int pad_w,
+    Dtype* const top_data) {
+  CUDA_KERNEL_LOOP(index, nthreads) {
+    const int pw = index % pooled_width;
+    const int ph = (index / pooled_width) % pooled_height;
+    const int pd = (index / pooled_width / pooled_height) % pooled_depth;
+    const int p = index / pooled_width / pooled_height / pooled_depth;
+    int dstart = pd * stride_d - pad_d;
+    int hstart = ph * stride_h - pad_h;
+    int wstart = pw * stride_w - pad_w;
+    int dend = min(dstart + kernel_d, depth + pad_d);
+    int hend = min(hstart + kernel_h, height + pad_h);
+    int wend = min(wstart + kernel_w, width + pad_w);
+    const int pool_size = (dend - dstart) * (hend - hstart) * (wend - wstart);
+    dstart = max(dstart, 0);
+    hstart = max(hstart, 0);
+    wstart = max(wstart, 0);
+    dend = min(dend, depth);
+    hend = min(hend, height);
+    wend = min(wend, width);
+    Dtype aveval = 0;
+    const Dtype* const bottom_volume =
+        bottom_data + p * depth * height * width;
+    for (int d = dstart; d < dend; ++d) {
+      for (int h = hstart; h < hend; ++h) {
+        for (int w = wstart; w < wend; ++w) {
+          aveval += bottom_volume[(d * height + h) * width + w];
+        }
+      }
+    }
+    top_data[index] = aveval / pool_size;
+  }
+}
+
+template <typename Dtype>
+void PoolingLayer<Dtype>::Forward_3d_gpu(const vector<Blob<Dtype>*>& bottom,
+      const vector<Blob<Dtype>*>& top) {
+  const Dtype* bottom_data = bottom[0]->gpu_data();
+  Dtype* top_data = top[0]->mutable_gpu_data();
+  int count = top[0]->count();
+  if (this->layer_param_.pooling_param().pool() ==
+      PoolingParameter_PoolMethod_MAX) {
+    int* mask = NULL;
+    Dtype* top_mask = NULL;
+    if (top.size() > 1) {
+      top_mask = top[1]->mutable_gpu_data();
+    } else {
+      mask = max_idx_.mutable_gpu_data();
+    }
+    // NOLINT_NEXT_LINE(whitespace/operators)
+    MaxPool3DForward<Dtype><<<CAFFE_GET_BLOCKS(count),
+                              CAFFE_CUDA_NUM_THREADS>>>(
+        count, bottom_data, depth_, height_, width_, pooled_depth_,
+        pooled_height_, pooled_width_, kernel_d_, kernel_h_, kernel_w_,
+        stride_d_, stride_h_, stride_w_, pad_d_, pad_h_, pad_w_, top_data,
+        mask, top_mask);
+  } else {
+    // NOLINT_NEXT_LINE(whitespace/operators)
+    AvePool3DForward<Dtype><<<CAFFE_GET_BLOCKS(count),
+                              CAFFE_CUDA_NUM_THREADS>>>(
+        count, bottom_data, depth_, height_, width_, pooled_depth_,
+        pooled_height_, pooled_width_, kernel_d_, kernel_h_, kernel_w_,
+        stride_d_, stride_h_, stride_w_, pad_d_, pad_h_, pad_w_, top_data);
+  }
+  CUDA_POST_KERNEL_CHECK;
+}
+
+template <typename Dtype>
+__global__ void MaxPool3DBackward(const int nthreads,
+    const Dtype* const top_diff, const int* const mask,
+    const Dtype* const top_mask, const int depth, const int height,
+    const int width, const int pooled_depth, const int pooled_height,
+    const int pooled_width, const int kernel_d, const int kernel_h,
+    const int kernel_w, const int stride_d, const int stride_h,
+    const int stride_w, const int pad_d, const int pad_h, const int pad_w,
+    Dtype* const bottom_diff) {
+  CUDA_KERNEL_LOOP(index, nthreads) {
+    const int w = index % width;
+    const int h = (index / width) % height;
+    const int d = (index / width / height) % depth;
+    const int p = index / width / height / depth;
+    const int pdstart =
+         (d + pad_d < kernel_d) ? 0 : (d + pad_d - kernel_d) / stride_d + 1;
+    const int pdend = min((d + pad_d) / stride_d + 1, pooled_depth);
+    const int phstart =
+         (h + pad_h < kernel_h) ? 0 : (h + pad_h - kernel_h) / stride_h + 1;
+    const int phend = min((h + pad_h) / stride_h + 1, pooled_height);
+    const int pwstart =
+         (w + pad_w < kernel_w) ? 0 : (w + pad_w - kernel_w) / stride_w + 1;
+    const int pwend = min((w + pad_w) / stride_w + 1, pooled_width);
+    const int bottom_index = (d * height + h) * width + w;
+    const int offset = p * pooled_depth * pooled_height * pooled_width;
+    Dtype gradient = 0;
+    for (int pd = pdstart; pd < pdend; ++pd) {
+      for (int ph = phstart; ph < phend; ++ph) {
+        for (int pw = pwstart; pw < pwend; ++pw) {
+          const int i = offset + (pd * pooled_height + ph) * pooled_width + pw;
+          const int argmax = mask ? mask[i] : static_cast<int>(top_mask[i]);
+          if (argmax == bottom_index) {
+            gradient += top_diff[i];
+          }
+        }
+      }
+    }
+    bottom_diff[index] = gradient;
+  }
+}
+
+template <typename Dtype>
+__global__ void AvePool3DBackward(const int nthreads,
+    const Dtype* const top_diff, const int depth, const int height,
+    const int width, const int pooled_depth, const int pooled_height,
+    const int pooled_width, const int kernel_d, const int kernel_h,
+    const int kernel_w, const int stride_d, const int stride_h,
+    const int stride_w, const int pad_d, const int pad_h, const int pad_w,
+    Dtype* const bottom_diff) {
+  CUDA_KERNEL_LOOP(index, nthreads) {
+    const int w = index % width + pad_w;
+    const int h = (index / width) % height + pad_h;
+    const int d = (index / width / height) % depth + pad_d;
+    const int p = index / width / height / depth;
+    const int pdstart = (d < kernel_d) ? 0 : (d - kernel_d) / stride_d + 1;
+    const int pdend = min(d / stride_d + 1, pooled_depth);
+    const int phstart = (h < kernel_h) ? 0 : (h - kernel_h) / stride_h + 1;
+    const int phend = min(h / stride_h + 1, pooled_height);
+    const int pwstart = (w < kernel_w) ? 0 : (w - kernel_w) / stride_w + 1;
+    const int pwend = min(w / stride_w + 1, pooled_width);
+    Dtype gradient = 0;
+    const Dtype* const top_diff_volume =
+        top_diff + p * pooled_depth * pooled_height * pooled_width;
+    for (int pd = pdstart; pd < pdend; ++pd) {
+      const int dstart = pd * stride_d - pad_d;
+      const int pool_depth = min(dstart + kernel_d, depth + pad_d) - dstart;
+      for (int ph = phstart; ph < phend; ++ph) {
+        const int hstart = ph * stride_h - pad_h;
+        const int pool_height =
+            min(hstart + kernel_h, height + pad_h) - hstart;
+        for (int pw = pwstart; pw < pwend; ++pw) {
+          const int wstart = pw * stride_w - pad_w;
+          const int pool_width = min(wstart + kernel_w, width + pad_w) - wstart;
+          gradient += top_diff_volume[(pd * pooled_height + ph) *
+              pooled_width + pw] / (pool_depth * pool_height * pool_width);
+        }
+      }
+    }
+    bottom_diff[index] = gradient;
+  }
+}
+
+template <typename Dtype>
+void PoolingLayer<Dtype>::Backward_3d_gpu(const vector<Blob<Dtype>*>& top,
+      const vector<Blob<Dtype>*>& bottom) {
+  const Dtype* top_diff = top[0]->gpu_diff();
+  Dtype* bottom_diff = bottom[0]->mutable_gpu_diff();
+  const int count = bottom[0]->count();
+  if (this->layer_param_.pooling_param().pool() ==
+      PoolingParameter_PoolMethod_MAX) {
+    const int* mask = NULL;
+    const Dtype* top_mask = NULL;
+    if (top.size() > 1) {
+      top_mask = top[1]->gpu_data();
+    } else {
+      mask = max_idx_.gpu_data();
+    }
+    // NOLINT_NEXT_LINE(whitespace/operators)
+    MaxPool3DBackward<Dtype><<<CAFFE_GET_BLOCKS(count),
+                               CAFFE_CUDA_NUM_THREADS>>>(
+        count, top_diff, mask, top_mask, depth_, height_, width_,
+        pooled_depth_, pooled_height_, pooled_width_, kernel_d_, kernel_h_,
+        kernel_w_, stride_d_, stride_h_, stride_w_, pad_d_, pad_h_, pad_w_,
+        bottom_diff);
+  } else {
+    // NOLINT_NEXT_LINE(whitespace/operators)
+    AvePool3DBackward<Dtype><<<CAFFE_GET_BLOCKS(count),
+                               CAFFE_CUDA_NUM_THREADS>>>(
+        count, top_diff, depth_, height_, width_, pooled_depth_,
+        pooled_height_, pooled_width_, kernel_d_, kernel_h_, kernel_w_,
+        stride_d_, stride_h_, stride_w_, pad_d_, pad_h_, pad_w_,
+        bottom_diff);
+  }
+  CUDA_POST_KERNEL_CHECK;
+}
 
 INSTANTIATE_LAYER_GPU_FUNCS(PoolingLayer);
 
@@ -19,6 +19,9 @@ void SplitLayer<Dtype>::Reshape(const vector<Blob<Dtype>*>& bottom,
         "allow in-place computation.";
     top[i]->ReshapeLike(*bottom[0]);
     CHECK_EQ(count_, top[i]->count());
+    // Share here as well as in Forward, so that the net sees the tops alias
+    // the bottom from setup on (see Net::PlanMemory).
+    top[i]->ShareData(*bottom[0]);
   }
 }
 
@@ -1,6 +1,9 @@
 #ifdef USE_OPENCV
 #include <opencv2/core/core.hpp>
 
+#include <boost/bind.hpp>
+
+#include <algorithm>
 #include <fstream>  // NOLINT(readability/streams)
 #include <iostream>  // NOLINT(readability/streams)
 #include <string>
@@ -15,6 +18,7 @@
 #include "caffe/util/math_functions.hpp"
 #include "caffe/util/prediction.hpp"
 #include "caffe/util/rng.hpp"
+#include "caffe/util/voxel_datum.hpp"
 
 namespace caffe {
 
@@ -26,28 +30,18 @@ VoxelsDataLayer<Dtype>::~VoxelsDataLayer<Dtype>() {
 template <typename Dtype>
 	void	VoxelsDataLayer<Dtype>::UnpackVoxels(const cv::Mat & cv_img,
 												 cv::Mat & data, Grid<Dtype> &vox) {
-		int size = this->layer_param_.voxels_data_param().img_size();
-		int dim = this->layer_param_.voxels_data_param().voxels_size();
-		CHECK(cv_img.rows == size) << "#rows in image should be the size of input image";
-		cv::Mat data_alpha = cv_img(cv::Rect(0,0,size,size));
-		int from_to[3*2] = {0,0,1,1,2,2};
-		data = cv::Mat(data_alpha.size(),data_alpha.depth()+8*2);
-		cv::mixChannels(&data_alpha,1,&data,1,from_to,3);
-		
-		// LOG(INFO) << "data of size "  << data.rows << "," << data.cols << "," << data.channels() ;
-
-		cv::Mat vox_cv = cv_img(cv::Rect(size,0,cv_img.cols-size,size));
-		int grid_rows = size/dim;
-		int grid_cols=dim/grid_rows/4;
-		vox = unpack_pred_in_image<Dtype>(vox_cv,grid_rows,grid_cols);
-		LOG(INFO) << "grid of size "  << vox.size() << "," << vox[0].rows() << "," << vox[0].cols() ;
+		unpack_voxels_image(cv_img,
+				this->layer_param_.voxels_data_param().img_size(),
+				this->layer_param_.voxels_data_param().voxels_size(), &data, &vox);
+		DLOG(INFO) << "grid of size "  << vox.size() << "," << vox[0].rows() << "," << vox[0].cols() ;
 		
 	}
 
 	
+// Reads the list of voxels images and returns the shape of the sketch of the
+// first one.
 template <typename Dtype>
-void VoxelsDataLayer<Dtype>::DataLayerSetUp(const vector<Blob<Dtype>*>& bottom,
-      const vector<Blob<Dtype>*>& top) {
+vector<int> VoxelsDataLayer<Dtype>::ReadImageListSetUp() {
   const int new_height = this->layer_param_.voxels_data_param().new_height();
   const int new_width  = this->layer_param_.voxels_data_param().new_width();
   const bool is_color  = this->layer_param_.voxels_data_param().is_color();
@@ -90,7 +84,43 @@ void VoxelsDataLayer<Dtype>::DataLayerSetUp(const vector<Blob<Dtype>*>& bottom,
   Grid<Dtype> vox;
   this->UnpackVoxels(cv_img,data,vox);
   // Use data_transformer to infer the expected blob shape from a cv_image.
-  vector<int> top_shape = this->data_transformer_->InferBlobShape(data);
+  return this->data_transformer_->InferBlobShape(data);
+}
+
+template <typename Dtype>
+void VoxelsDataLayer<Dtype>::DataLayerSetUp(const vector<Blob<Dtype>*>& bottom,
+      const vector<Blob<Dtype>*>& top) {
+  const VoxelsDataParameter& voxels_data_param =
+      this->layer_param_.voxels_data_param();
+  vector<int> top_shape;
+  if (voxels_data_param.source_type() ==
+      VoxelsDataParameter_SourceType_VOXEL_DB) {
+    db_.reset(db::GetDB(voxels_data_param.backend()));
+    db_->Open(voxels_data_param.source(), db::READ);
+    cursor_.reset(db_->NewCursor());
+    // Index the keys to read the records at random. In test mode, only rank
+    // 0 runs, so it takes all of them.
+    if (voxels_data_param.shuffle()) {
+      db::ReadOrWriteKeyIndex(voxels_data_param.key_index(), cursor_.get(),
+          Caffe::root_solver(), &keys_);
+      const bool test = this->phase_ == TEST;
+      sampler_.reset(new db::ShardedSampler(keys_.size(),
+          voxels_data_param.shuffle_seed(), test ? 0 : Caffe::solver_rank(),
+          test ? 1 : Caffe::solver_count()));
+      LOG_IF(INFO, Caffe::root_solver())
+          << "Shuffling " << keys_.size() << " keys";
+    }
+    // Read a record, and use it to initialize the top blob.
+    VoxelDatum datum;
+    CHECK(datum.ParseFromString(cursor_->value()))
+        << "Could not parse record " << cursor_->key();
+    CHECK_EQ(datum.voxels_size(), voxels_data_param.voxels_size())
+        << "Voxels size of " << voxels_data_param.source()
+        << " does not match voxels_size";
+    top_shape = this->data_transformer_->InferBlobShape(datum.sketch());
+  } else {
+    top_shape = ReadImageListSetUp();
+  }
   this->transformed_data_.Reshape(top_shape);
   // Reshape prefetch_data and top[0] according to the batch_size.
   const int batch_size = this->layer_param_.voxels_data_param().batch_size();
@@ -101,6 +131,18 @@ void VoxelsDataLayer<Dtype>::DataLayerSetUp(const vector<Blob<Dtype>*>& bottom,
   }
   top[0]->Reshape(top_shape);
 
+  // One transformer per decode task, as their random generators are not
+  // shared between threads.
+  pool_.reset(new ThreadPool(voxels_data_param.num_threads()));
+  transformers_.resize(std::min<int>(pool_->num_threads(), batch_size));
+  transformers_[0] = this->data_transformer_;
+  for (int i = 1; i < transformers_.size(); ++i) {
+    transformers_[i].reset(new DataTransformer<Dtype>(
+        this->transform_param_, this->phase_));
+    transformers_[i]->InitRand();
+  }
+  LOG(INFO) << "Decoding batches with " << transformers_.size() << " threads";
+
   LOG(INFO) << "output data size: " << top[0]->num() << ","
       << top[0]->channels() << "," << top[0]->height() << ","
       << top[0]->width();
@@ -112,6 +154,9 @@ void VoxelsDataLayer<Dtype>::DataLayerSetUp(const vector<Blob<Dtype>*>& bottom,
   for (int i = 0; i < this->prefetch_.size(); ++i) {
     this->prefetch_[i]->label_.Reshape(vox_shape);
   }
+  // Keep the grids packed until forwarded if asked to.
+  this->packed_label_bits_ =
+      this->layer_param_.data_param().packed_label_bits();
   LOG(INFO) << "voxels data size: " << top[1]->num() << ","
       << top[1]->channels() << "," << top[1]->height() << ","
       << top[1]->width();
@@ -124,74 +169,151 @@ void VoxelsDataLayer<Dtype>::ShuffleImages() {
   shuffle(lines_.begin(), lines_.end(), prefetch_rng);
 }
 
+template <typename Dtype>
+void VoxelsDataLayer<Dtype>::SeekBatches(uint64_t batches) {
+  sampler_->set_offset(batches *
+      this->layer_param_.voxels_data_param().batch_size());
+}
+
+template <typename Dtype>
+void VoxelsDataLayer<Dtype>::NextRecord() {
+  cursor_->Next();
+  if (!cursor_->valid()) {
+    DLOG(INFO) << "Restarting data prefetching from start.";
+    cursor_->SeekToFirst();
+  }
+  offset_++;
+}
+
+// Stores the grid of datum as the label of item_id, copying its bytes when
+// the batch packs labels the way the record does. buffer stages the grid
+// otherwise.
+template <typename Dtype>
+void VoxelsDataLayer<Dtype>::StoreVoxels(const VoxelDatum& datum,
+    Batch<Dtype>* batch, int item_id, vector<Dtype>* buffer) {
+  const int record_bits = datum.bit_packed() ? 1 : 8;
+  if (batch->label_bits_ == record_bits) {
+    const string& voxels = datum.voxels();
+    CHECK_EQ(voxels.size(), batch->label_.count(1) * record_bits / 8)
+        << "Incorrect voxels size of record " << batch_keys_[item_id];
+    std::memcpy(batch_packed_label_ + voxels.size() * item_id, voxels.data(),
+                voxels.size());
+  } else if (batch->label_bits_) {
+    buffer->resize(batch->label_.count(1));
+    DecodeVoxels(datum, buffer->data());
+    PackVoxels(batch, item_id, *buffer);
+  } else {
+    DecodeVoxels(datum, batch_label_ + batch->label_.offset(item_id));
+  }
+}
+
+// Stores the grid vox as the label of item_id, staged in buffer when the batch
+// packs labels.
+template <typename Dtype>
+void VoxelsDataLayer<Dtype>::StoreVoxels(const Grid<Dtype>& vox,
+    Batch<Dtype>* batch, int item_id, vector<Dtype>* buffer) {
+  const int vox_size = this->layer_param_.voxels_data_param().voxels_size();
+  CHECK_EQ(vox.size(), vox_size) << "Unexpected grid size in "
+                                 << batch_keys_[item_id];
+  if (batch->label_bits_) {
+    buffer->resize(batch->label_.count(1));
+  }
+  Dtype* label_data = batch->label_bits_ ? buffer->data() :
+      batch_label_ + batch->label_.offset(item_id);
+  for (int c = 0; c < vox_size; ++c) {
+    std::memcpy(label_data, vox[c].data(), vox_size * vox_size * sizeof(Dtype));
+    label_data += vox_size * vox_size;
+  }
+  if (batch->label_bits_) {
+    PackVoxels(batch, item_id, *buffer);
+  }
+}
+
+template <typename Dtype>
+void VoxelsDataLayer<Dtype>::PackVoxels(Batch<Dtype>* batch, int item_id,
+    const vector<Dtype>& voxels) {
+  const int dim = batch->label_.count(1);
+  caffe_pack_occupancy(dim, batch->label_bits_, voxels.data(),
+      batch_packed_label_ + static_cast<size_t>(item_id) * dim *
+      batch->label_bits_ / 8);
+}
+
+// Decodes the items task, task + num_tasks, ... of the batch into their place
+// with the transformer of the task.
+// This function is called on decode threads
+template <typename Dtype>
+void VoxelsDataLayer<Dtype>::DecodeItems(Batch<Dtype>* batch, int task) {
+  const VoxelsDataParameter& voxels_data_param =
+      this->layer_param_.voxels_data_param();
+  DataTransformer<Dtype>* transformer = transformers_[task].get();
+  Blob<Dtype> transformed_data(this->transformed_data_.shape());
+  vector<Dtype> buffer;
+  VoxelDatum datum;
+  cv::Mat data;
+  Grid<Dtype> vox;
+  for (int item_id = task; item_id < batch_keys_.size();
+       item_id += transformers_.size()) {
+    transformed_data.set_cpu_data(batch_data_ + batch->data_.offset(item_id));
+    if (cursor_) {
+      CHECK(datum.ParseFromString(batch_values_[item_id]))
+          << "Could not parse record " << batch_keys_[item_id];
+      CHECK_EQ(datum.voxels_size(), voxels_data_param.voxels_size())
+          << "Voxels size of record " << batch_keys_[item_id]
+          << " does not match voxels_size";
+      transformer->Transform(datum.sketch(), &transformed_data);
+      StoreVoxels(datum, batch, item_id, &buffer);
+    } else {
+      cv::Mat cv_img = ReadImageToCVMat(
+          voxels_data_param.root_folder() + batch_keys_[item_id],
+          voxels_data_param.new_height(), voxels_data_param.new_width(),
+          voxels_data_param.is_color());
+      CHECK(cv_img.data) << "Could not load " << batch_keys_[item_id];
+      UnpackVoxels(cv_img, data, vox);
+      // Apply transformations (mirror, crop...) to the image
+      transformer->Transform(data, &transformed_data);
+      StoreVoxels(vox, batch, item_id, &buffer);
+    }
+  }
+}
+
+// Picks the items of the batch, then decodes them on the pool.
+// The shape of the sketches is fixed by img_size, so it is inferred once at
+// setup instead of from a decoded image of every batch.
 // This function is called on prefetch thread
 template <typename Dtype>
 void VoxelsDataLayer<Dtype>::load_batch(Batch<Dtype>* batch) {
   CPUTimer batch_timer;
   batch_timer.Start();
-  double read_time = 0;
-  double trans_time = 0;
-  CPUTimer timer;
   CHECK(batch->data_.count());
   CHECK(this->transformed_data_.count());
-  VoxelsDataParameter voxels_data_param = this->layer_param_.voxels_data_param();
-  const int batch_size = voxels_data_param.batch_size();
-  const int new_height = voxels_data_param.new_height();
-  const int new_width = voxels_data_param.new_width();
-  const bool is_color = voxels_data_param.is_color();
-  string root_folder = voxels_data_param.root_folder();
-
-  // Reshape according to the first image of each batch
-  // on single input batches allows for inputs of varying dimension.
-  cv::Mat cv_img = ReadImageToCVMat(root_folder + lines_[lines_id_],
-      new_height, new_width, is_color);
-  CHECK(cv_img.data) << "Could not load " << lines_[lines_id_];
-  // Use data_transformer to infer the expected blob shape from a cv_img.
-  cv::Mat  data;
-  Grid<Dtype> vox;
-  this->UnpackVoxels(cv_img,data,vox);
-  
-  vector<int> top_shape = this->data_transformer_->InferBlobShape(data );
-  this->transformed_data_.Reshape(top_shape);
-  // Reshape batch according to the batch_size.
-  top_shape[0] = batch_size;
-  batch->data_.Reshape(top_shape);
-
-  int vox_size = this->layer_param_.voxels_data_param().voxels_size();
-  vector<int> vox_shape(4,vox_size);
-  vox_shape[0] = batch_size;
-  batch->label_.Reshape(vox_shape);
-
-  Dtype* prefetch_data = batch->data_.mutable_cpu_data();
-  Dtype* prefetch_label = batch->label_.mutable_cpu_data();
-
-  // datum scales
+  const int batch_size = this->layer_param_.voxels_data_param().batch_size();
+  batch_keys_.resize(batch_size);
+  if (cursor_) {
+    batch_values_.resize(batch_size);
+  }
   const int lines_size = lines_.size();
   for (int item_id = 0; item_id < batch_size; ++item_id) {
-    // get a blob
-    timer.Start();
+    if (cursor_) {
+      // The records of this solver, in order or by the keys the sampler
+      // draws.
+      if (sampler_) {
+        const string& key = keys_[sampler_->Next()];
+        CHECK(cursor_->Seek(key)) << "Key " << key << " is not in "
+            << this->layer_param_.voxels_data_param().source();
+      } else {
+        while (this->Skip(offset_)) {
+          NextRecord();
+        }
+      }
+      batch_keys_[item_id] = cursor_->key();
+      batch_values_[item_id] = cursor_->value();
+      if (!sampler_) {
+        NextRecord();
+      }
+      continue;
+    }
     CHECK_GT(lines_size, lines_id_);
-    cv::Mat cv_img = ReadImageToCVMat(root_folder + lines_[lines_id_],
-        new_height, new_width, is_color);
-    CHECK(cv_img.data) << "Could not load " << lines_[lines_id_];
-	this->UnpackVoxels(cv_img,data,vox);
-    read_time += timer.MicroSeconds();
-    timer.Start();
-    // Apply transformations (mirror, crop...) to the image
-    int offset = batch->data_.offset(item_id);
-    this->transformed_data_.set_cpu_data(prefetch_data + offset);
-    this->data_transformer_->Transform(data, &(this->transformed_data_));
-    trans_time += timer.MicroSeconds();
-
-	offset = batch->label_.offset(item_id);
-	Dtype * label_data = prefetch_label+offset;
-	for(int c = 0; c < vox_size; c++)
-	{
-		std::memcpy(label_data, vox[c].data() ,vox_size * vox_size * sizeof(Dtype));
-		label_data += vox_size*vox_size;
-	}
-	
-    //prefetch_label[item_id] = lines_[lines_id_].second;
+    batch_keys_[item_id] = lines_[lines_id_];
     // go to the next iter
     lines_id_++;
     if (lines_id_ >= lines_size) {
@@ -203,10 +325,17 @@ void VoxelsDataLayer<Dtype>::load_batch(Batch<Dtype>* batch) {
       }
     }
   }
+  // Take the memory of the batch on this thread, the tasks only write to it.
+  batch_data_ = batch->data_.mutable_cpu_data();
+  if (batch->label_bits_) {
+    batch_packed_label_ = batch->mutable_packed_label();
+  } else {
+    batch_label_ = batch->label_.mutable_cpu_data();
+  }
+  pool_->Run(transformers_.size(),
+      boost::bind(&VoxelsDataLayer<Dtype>::DecodeItems, this, batch, _1));
   batch_timer.Stop();
   DLOG(INFO) << "Prefetch batch: " << batch_timer.MilliSeconds() << " ms.";
-  DLOG(INFO) << "     Read time: " << read_time / 1000 << " ms.";
-  DLOG(INFO) << "Transform time: " << trans_time / 1000 << " ms.";
 }
 
 INSTANTIATE_CLASS(VoxelsDataLayer);
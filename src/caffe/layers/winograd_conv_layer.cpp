@@ -0,0 +1,108 @@
+#include <boost/bind.hpp>
+#include <vector>
+
+#include "caffe/layers/winograd_conv_layer.hpp"
+#include "caffe/util/winograd.hpp"
+
+namespace caffe {
+
+template <typename Dtype>
+void WinogradConvolutionLayer<Dtype>::LayerSetUp(
+    const vector<Blob<Dtype>*>& bottom, const vector<Blob<Dtype>*>& top) {
+  ConvolutionLayer<Dtype>::LayerSetUp(bottom, top);
+  supported_ = this->num_spatial_axes_ == 2;
+  for (int i = 0; i < this->num_spatial_axes_ && supported_; ++i) {
+    supported_ = this->kernel_shape_.cpu_data()[i] == 3 &&
+        this->stride_.cpu_data()[i] == 1 &&
+        this->dilation_.cpu_data()[i] == 1;
+  }
+  if (!supported_) {
+    LOG(INFO) << "Layer " << this->layer_param_.name() << " uses im2col: "
+        << "the Winograd engine needs 2D 3x3 kernels of stride 1.";
+  }
+}
+
+template <typename Dtype>
+void WinogradConvolutionLayer<Dtype>::Reshape(
+    const vector<Blob<Dtype>*>& bottom, const vector<Blob<Dtype>*>& top) {
+  ConvolutionLayer<Dtype>::Reshape(bottom, top);
+  if (!supported_) {
+    return;
+  }
+  const int height_out = this->output_shape_[0];
+  const int width_out = this->output_shape_[1];
+  tile_ = height_out >= 8 && width_out >= 8 ? 4 : 2;
+  const int channels = this->channels_ / this->group_;
+  const int num_output = this->num_output_ / this->group_;
+  vector<int> shape(1, this->group_ * winograd_tile_elements(tile_) *
+      num_output * channels);
+  transformed_weights_.Reshape(shape);
+  buffer_size_ = winograd_buffer_size(tile_, channels, num_output,
+      height_out, width_out);
+}
+
+template <typename Dtype>
+void WinogradConvolutionLayer<Dtype>::winograd_cpu_images(
+    const Dtype* bottom_data, const Dtype* transformed_weights,
+    const Dtype* bias, Dtype* buffer, Dtype* top_data, int thread) {
+  const int channels = this->channels_ / this->group_;
+  const int num_output = this->num_output_ / this->group_;
+  const int height = this->input_shape(1);
+  const int width = this->input_shape(2);
+  const int height_out = this->output_shape_[0];
+  const int width_out = this->output_shape_[1];
+  const int* pad = this->pad_.cpu_data();
+  const int weight_group = winograd_tile_elements(tile_) * num_output *
+      channels;
+  buffer += thread * buffer_size_;
+  int begin, end;
+  this->cpu_batch_range(thread, &begin, &end);
+  for (int n = begin; n < end; ++n) {
+    for (int g = 0; g < this->group_; ++g) {
+      conv_winograd_cpu(tile_, bottom_data + n * this->bottom_dim_ +
+          g * channels * height * width, channels, height, width, pad[0],
+          pad[1], transformed_weights + g * weight_group, num_output,
+          height_out, width_out, buffer, top_data + n * this->top_dim_ +
+          g * num_output * height_out * width_out);
+    }
+    if (bias) {
+      this->forward_cpu_bias(top_data + n * this->top_dim_, bias);
+    }
+    caffe_cpu_activation(this->activation_, this->top_dim_,
+        top_data + n * this->top_dim_);
+  }
+}
+
+template <typename Dtype>
+void WinogradConvolutionLayer<Dtype>::Forward_cpu(
+    const vector<Blob<Dtype>*>& bottom, const vector<Blob<Dtype>*>& top) {
+  if (!supported_) {
+    ConvolutionLayer<Dtype>::Forward_cpu(bottom, top);
+    return;
+  }
+  // The weights may have changed since the last pass.
+  const int channels = this->channels_ / this->group_;
+  const int num_output = this->num_output_ / this->group_;
+  const Dtype* weight = this->blobs_[0]->cpu_data();
+  Dtype* transformed_weights = transformed_weights_.mutable_cpu_data();
+  for (int g = 0; g < this->group_; ++g) {
+    winograd_weight_transform_cpu(tile_, weight + this->weight_offset_ * g,
+        num_output, channels, transformed_weights +
+        g * winograd_tile_elements(tile_) * num_output * channels);
+  }
+  vector<int> buffer_shape(2, this->cpu_batch_threads());
+  buffer_shape[1] = buffer_size_;
+  buffer_.Reshape(buffer_shape);
+  Dtype* buffer = buffer_.mutable_cpu_data();
+  const Dtype* bias = this->bias_term_ ? this->blobs_[1]->cpu_data() : NULL;
+  for (int i = 0; i < bottom.size(); ++i) {
+    this->cpu_batch(boost::bind(
+        &WinogradConvolutionLayer<Dtype>::winograd_cpu_images, this,
+        bottom[i]->cpu_data(), transformed_weights, bias, buffer,
+        top[i]->mutable_cpu_data(), _1), NULL, false);
+  }
+}
+
+INSTANTIATE_CLASS(WinogradConvolutionLayer);
+
+}  // namespace caffe
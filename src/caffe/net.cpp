@@ -1,4 +1,6 @@
+#include <boost/bind.hpp>
 #include <algorithm>
+#include <climits>
 #include <map>
 #include <set>
 #include <string>
@@ -61,6 +63,7 @@ void Net<Dtype>::Init(const NetParameter& in_param) {
   map<string, int> blob_name_to_idx;
   set<string> available_blobs;
   memory_used_ = 0;
+  plannable_blobs_.clear();
   // For each layer, set up its input and output
   bottom_vecs_.resize(param.layer_size());
   top_vecs_.resize(param.layer_size());
@@ -254,6 +257,66 @@ void Net<Dtype>::Init(const NetParameter& in_param) {
   }
   ShareWeights();
   debug_info_ = param.debug_info();
+  plan_memory_ = param.plan_memory();
+  if (plan_memory_ && phase_ != TEST) {
+    LOG(WARNING) << "Backward needs the activations; plan_memory is only "
+        << "applied in the TEST phase.";
+    plan_memory_ = false;
+  }
+  for (int i = 0; i < param.pinned_blob_size(); ++i) {
+    CHECK(has_blob(param.pinned_blob(i))) << "Unknown pinned blob "
+        << param.pinned_blob(i);
+    pinned_blobs_.insert(param.pinned_blob(i));
+  }
+  if (plan_memory_) {
+    PlanMemory();
+  }
+  layer_segment_.clear();
+  layer_recompute_.clear();
+  segment_begin_.clear();
+  if (phase_ == TRAIN && param.checkpoint_layer_size() > 0) {
+    vector<bool> checkpoint(layers_.size(), false);
+    for (int i = 0; i < param.checkpoint_layer_size(); ++i) {
+      CHECK(has_layer(param.checkpoint_layer(i))) << "Unknown checkpoint layer "
+          << param.checkpoint_layer(i);
+      checkpoint[layer_names_index_[param.checkpoint_layer(i)]] = true;
+    }
+    // Each checkpoint layer ends a segment.
+    layer_segment_.resize(layers_.size());
+    segment_begin_.push_back(0);
+    for (int layer_id = 0; layer_id < layers_.size(); ++layer_id) {
+      layer_segment_[layer_id] = segment_begin_.size() - 1;
+      if (checkpoint[layer_id] && layer_id + 1 < layers_.size()) {
+        segment_begin_.push_back(layer_id + 1);
+      }
+    }
+    PlanCheckpoints();
+  }
+  activation_storage_ = param.activation_storage();
+  compress_after_forward_.clear();
+  compress_after_backward_.clear();
+  if (activation_storage_ != NATIVE) {
+    if (plan_memory_ || !layer_segment_.empty()) {
+      LOG(WARNING) << "Planned activations are not owned by their blobs; "
+          << "activation_storage is ignored.";
+      activation_storage_ = NATIVE;
+    } else {
+      PlanActivationStorage();
+    }
+  }
+  layer_pool_.reset();
+  if (param.layer_threads() != 1) {
+    if (plan_memory_ || !layer_segment_.empty()) {
+      LOG(WARNING) << "Planned activations share memory across branches; "
+          << "layers run sequentially.";
+    } else if (activation_storage_ != NATIVE) {
+      LOG(WARNING) << "Activations are compressed in the order of the "
+          << "layers; layers run sequentially.";
+    } else {
+      layer_pool_.reset(new ThreadPool(param.layer_threads()));
+      BuildLayerGraphs();
+    }
+  }
   LOG_IF(INFO, Caffe::root_solver()) << "Network initialization done.";
 }
 
@@ -519,16 +582,31 @@ Dtype Net<Dtype>::ForwardFromTo(int start, int end) {
   CHECK_GE(start, 0);
   CHECK_LT(end, layers_.size());
   Dtype loss = 0;
+  if (LayersInParallel()) {
+    forward_graph_->Run(layer_pool_.get(),
+        boost::bind(&Net<Dtype>::ForwardLayer, this, _1), start, end);
+    // Summed in order, as in sequential mode.
+    for (int i = start; i <= end; ++i) {
+      loss += layer_losses_[i];
+    }
+    return loss;
+  }
   for (int i = start; i <= end; ++i) {
     for (int c = 0; c < before_forward_.size(); ++c) {
       before_forward_[c]->run(i);
     }
     Dtype layer_loss = layers_[i]->Forward(bottom_vecs_[i], top_vecs_[i]);
     loss += layer_loss;
+    if (!layer_recompute_.empty() && layer_recompute_[i]) {
+      resident_layer_ = i;
+    }
     if (debug_info_) { ForwardDebugInfo(i); }
     for (int c = 0; c < after_forward_.size(); ++c) {
       after_forward_[c]->run(i);
     }
+    if (!compress_after_forward_.empty()) {
+      CompressActivations(compress_after_forward_[i]);
+    }
   }
   return loss;
 }
@@ -569,11 +647,17 @@ template <typename Dtype>
 void Net<Dtype>::BackwardFromTo(int start, int end) {
   CHECK_GE(end, 0);
   CHECK_LT(start, layers_.size());
+  if (LayersInParallel()) {
+    backward_graph_->Run(layer_pool_.get(),
+        boost::bind(&Net<Dtype>::BackwardLayer, this, _1), end, start);
+    return;
+  }
   for (int i = start; i >= end; --i) {
     for (int c = 0; c < before_backward_.size(); ++c) {
       before_backward_[c]->run(i);
     }
     if (layer_need_backward_[i]) {
+      if (!layer_segment_.empty()) { RecomputeSegment(i); }
       layers_[i]->Backward(
           top_vecs_[i], bottom_need_backward_[i], bottom_vecs_[i]);
       if (debug_info_) { BackwardDebugInfo(i); }
@@ -581,6 +665,9 @@ void Net<Dtype>::BackwardFromTo(int start, int end) {
     for (int c = 0; c < after_backward_.size(); ++c) {
       after_backward_[c]->run(i);
     }
+    if (!compress_after_backward_.empty()) {
+      CompressActivations(compress_after_backward_[i]);
+    }
   }
 }
 
@@ -729,6 +816,515 @@ void Net<Dtype>::Reshape() {
   for (int i = 0; i < layers_.size(); ++i) {
     layers_[i]->Reshape(bottom_vecs_[i], top_vecs_[i]);
   }
+  if (plan_memory_) {
+    PlanMemory();
+  }
+  if (!layer_segment_.empty()) {
+    PlanCheckpoints();
+  }
+  if (activation_storage_ != NATIVE) {
+    PlanActivationStorage();
+  }
+  if (layer_pool_) {
+    BuildLayerGraphs();
+  }
+}
+
+// A buffer of activation memory, shared by one or more blobs of the net and
+// live from layer begin to layer end.
+struct ActivationBuffer {
+  boost::weak_ptr<SyncedMemory> memory;
+  int references;
+  int holders;
+  int begin;
+  int end;
+  bool pinned;
+  size_t size;
+  size_t offset;
+};
+
+static bool LargerBuffer(const ActivationBuffer* a,
+    const ActivationBuffer* b) {
+  return a->size > b->size;
+}
+
+static bool LowerOffset(const ActivationBuffer* a,
+    const ActivationBuffer* b) {
+  return a->offset < b->offset;
+}
+
+// Offsets are aligned for vectorized and coalesced access.
+static const size_t kActivationAlignment = 256;
+
+// Counts one more holder of memory, grouped in buffers by pointer, and
+// returns the id of its buffer.
+static int AddBufferHolder(const shared_ptr<SyncedMemory>& memory,
+    map<SyncedMemory*, int>* buffer_ids, vector<ActivationBuffer>* buffers) {
+  map<SyncedMemory*, int>::iterator it = buffer_ids->find(memory.get());
+  if (it == buffer_ids->end()) {
+    ActivationBuffer buffer;
+    buffer.memory = memory;
+    buffer.references = memory.use_count();
+    buffer.holders = 0;
+    buffer.begin = INT_MAX;
+    buffer.end = -1;
+    buffer.pinned = false;
+    buffer.size = (memory->size() + kActivationAlignment - 1) /
+        kActivationAlignment * kActivationAlignment;
+    buffer.offset = 0;
+    it = buffer_ids->insert(std::make_pair(memory.get(),
+        static_cast<int>(buffers->size()))).first;
+    buffers->push_back(buffer);
+  }
+  ++(*buffers)[it->second].holders;
+  return it->second;
+}
+
+// Allocates an arena of size bytes and moves the memory of each buffer to its
+// offset. The memory placed in the previous arena, listed in placed, that is
+// not planned anymore, e.g. as it is now also held outside the net, gets
+// memory of its own before that arena is released.
+static shared_ptr<SyncedMemory> AllocateArena(size_t size,
+    const vector<ActivationBuffer*>& buffers,
+    vector<boost::weak_ptr<SyncedMemory> >* placed) {
+  set<SyncedMemory*> moved;
+  for (int i = 0; i < buffers.size(); ++i) {
+    moved.insert(buffers[i]->memory.lock().get());
+  }
+  for (int i = 0; i < placed->size(); ++i) {
+    shared_ptr<SyncedMemory> memory = (*placed)[i].lock();
+    if (memory && !moved.count(memory.get())) {
+      memory->own_data();
+    }
+  }
+  placed->clear();
+  shared_ptr<SyncedMemory> arena(new SyncedMemory(size));
+  if (size > 0) {
+    const bool on_gpu = Caffe::mode() == Caffe::GPU;
+    char* base = static_cast<char*>(on_gpu ? arena->mutable_gpu_data() :
+                                             arena->mutable_cpu_data());
+    for (int i = 0; i < buffers.size(); ++i) {
+      shared_ptr<SyncedMemory> memory = buffers[i]->memory.lock();
+      if (on_gpu) {
+        memory->set_gpu_data(base + buffers[i]->offset);
+      } else {
+        memory->set_cpu_data(base + buffers[i]->offset);
+      }
+      placed->push_back(memory);
+    }
+  }
+  return arena;
+}
+
+template <typename Dtype>
+void Net<Dtype>::PlanMemory() {
+  const bool first_plan = plannable_blobs_.empty();
+  if (first_plan) {
+    plannable_blobs_.resize(blobs_.size(), true);
+  }
+  // Group the blobs by memory.
+  map<SyncedMemory*, int> buffer_ids;
+  vector<ActivationBuffer> buffers;
+  vector<int> blob_buffer(blobs_.size(), -1);
+  for (int blob_id = 0; blob_id < blobs_.size(); ++blob_id) {
+    if (blobs_[blob_id]->count() == 0) {
+      continue;
+    }
+    const shared_ptr<SyncedMemory>& memory = blobs_[blob_id]->data();
+    blob_buffer[blob_id] = AddBufferHolder(memory, &buffer_ids, &buffers);
+    ActivationBuffer& buffer = buffers[blob_buffer[blob_id]];
+    if (first_plan && memory->head() != SyncedMemory::UNINITIALIZED) {
+      plannable_blobs_[blob_id] = false;
+    }
+    if (!plannable_blobs_[blob_id] ||
+        pinned_blobs_.count(blob_names_[blob_id])) {
+      buffer.pinned = true;
+    }
+  }
+  for (int i = 0; i < net_input_blob_indices_.size(); ++i) {
+    const int buffer_id = blob_buffer[net_input_blob_indices_[i]];
+    if (buffer_id >= 0) { buffers[buffer_id].pinned = true; }
+  }
+  for (int i = 0; i < net_output_blob_indices_.size(); ++i) {
+    const int buffer_id = blob_buffer[net_output_blob_indices_[i]];
+    if (buffer_id >= 0) { buffers[buffer_id].pinned = true; }
+  }
+  // Lifetimes, in layers.
+  for (int layer_id = 0; layer_id < layers_.size(); ++layer_id) {
+    for (int i = 0; i < top_id_vecs_[layer_id].size(); ++i) {
+      const int buffer_id = blob_buffer[top_id_vecs_[layer_id][i]];
+      if (buffer_id < 0) { continue; }
+      buffers[buffer_id].begin = std::min(buffers[buffer_id].begin, layer_id);
+      buffers[buffer_id].end = std::max(buffers[buffer_id].end, layer_id);
+    }
+    for (int i = 0; i < bottom_id_vecs_[layer_id].size(); ++i) {
+      const int buffer_id = blob_buffer[bottom_id_vecs_[layer_id][i]];
+      if (buffer_id < 0) { continue; }
+      buffers[buffer_id].end = std::max(buffers[buffer_id].end, layer_id);
+    }
+  }
+  // Place the largest buffers first, each at the lowest offset clear of the
+  // buffers already placed that are live at the same time.
+  vector<ActivationBuffer*> planned;
+  size_t activations = 0;
+  for (int i = 0; i < buffers.size(); ++i) {
+    ActivationBuffer& buffer = buffers[i];
+    // Memory also held outside the net is not ours to move.
+    if (!buffer.pinned && buffer.references == buffer.holders &&
+        buffer.size > 0 && buffer.begin <= buffer.end) {
+      planned.push_back(&buffer);
+      activations += buffer.size;
+    }
+  }
+  std::stable_sort(planned.begin(), planned.end(), LargerBuffer);
+  size_t arena_size = 0;
+  vector<ActivationBuffer*> conflicts;
+  for (int i = 0; i < planned.size(); ++i) {
+    ActivationBuffer* buffer = planned[i];
+    conflicts.clear();
+    for (int j = 0; j < i; ++j) {
+      if (planned[j]->begin <= buffer->end &&
+          buffer->begin <= planned[j]->end) {
+        conflicts.push_back(planned[j]);
+      }
+    }
+    std::sort(conflicts.begin(), conflicts.end(), LowerOffset);
+    size_t offset = 0;
+    for (int j = 0; j < conflicts.size(); ++j) {
+      if (conflicts[j]->offset >= offset + buffer->size) {
+        break;
+      }
+      offset = std::max(offset, conflicts[j]->offset + conflicts[j]->size);
+    }
+    buffer->offset = offset;
+    arena_size = std::max(arena_size, offset + buffer->size);
+  }
+  memory_arena_ = AllocateArena(arena_size, planned, &arena_memory_);
+  LOG_IF(INFO, Caffe::root_solver())
+      << "Planned " << activations << " bytes of activations in "
+      << arena_size << " bytes of memory.";
+}
+
+template <typename Dtype>
+void Net<Dtype>::PlanActivationStorage() {
+  // The first and last layer accessing the memory of each blob, which the
+  // blob first seen holding it represents.
+  map<SyncedMemory*, int> owner;
+  vector<int> first(blobs_.size(), INT_MAX);
+  vector<int> last(blobs_.size(), -1);
+  vector<int> blob_owner(blobs_.size(), -1);
+  for (int blob_id = 0; blob_id < blobs_.size(); ++blob_id) {
+    if (blobs_[blob_id]->count() > 0) {
+      blob_owner[blob_id] = owner.insert(std::make_pair(
+          blobs_[blob_id]->data().get(), blob_id)).first->second;
+    }
+  }
+  for (int layer_id = 0; layer_id < layers_.size(); ++layer_id) {
+    for (int i = 0; i < bottom_id_vecs_[layer_id].size(); ++i) {
+      const int blob_id = blob_owner[bottom_id_vecs_[layer_id][i]];
+      if (blob_id < 0) { continue; }
+      first[blob_id] = std::min(first[blob_id], layer_id);
+      last[blob_id] = std::max(last[blob_id], layer_id);
+    }
+    for (int i = 0; i < top_id_vecs_[layer_id].size(); ++i) {
+      const int blob_id = blob_owner[top_id_vecs_[layer_id][i]];
+      if (blob_id < 0) { continue; }
+      first[blob_id] = std::min(first[blob_id], layer_id);
+      last[blob_id] = std::max(last[blob_id], layer_id);
+    }
+  }
+  // The net inputs and outputs are accessed outside the passes.
+  for (int i = 0; i < net_input_blob_indices_.size(); ++i) {
+    const int blob_id = blob_owner[net_input_blob_indices_[i]];
+    if (blob_id >= 0) { last[blob_id] = -1; }
+  }
+  for (int i = 0; i < net_output_blob_indices_.size(); ++i) {
+    const int blob_id = blob_owner[net_output_blob_indices_[i]];
+    if (blob_id >= 0) { last[blob_id] = -1; }
+  }
+  compress_after_forward_.assign(layers_.size(), vector<int>());
+  compress_after_backward_.assign(layers_.size(), vector<int>());
+  for (int blob_id = 0; blob_id < blobs_.size(); ++blob_id) {
+    if (blob_owner[blob_id] == blob_id && last[blob_id] >= 0) {
+      compress_after_forward_[last[blob_id]].push_back(blob_id);
+      compress_after_backward_[first[blob_id]].push_back(blob_id);
+    }
+  }
+}
+
+template <typename Dtype>
+void Net<Dtype>::CompressActivations(const vector<int>& blob_ids) {
+  if (Caffe::mode() != Caffe::CPU) {
+    return;
+  }
+  for (int i = 0; i < blob_ids.size(); ++i) {
+    blobs_[blob_ids[i]]->data()->template compress<Dtype>(
+        activation_storage_);
+  }
+}
+
+template <typename Dtype>
+void Net<Dtype>::PlanCheckpoints() {
+  const bool first_plan = plannable_diffs_.empty();
+  if (first_plan) {
+    plannable_blobs_.resize(blobs_.size(), true);
+    plannable_diffs_.resize(blobs_.size(), true);
+  }
+  // A blob can be dropped if it is produced and used within one segment.
+  vector<int> blob_segment(blobs_.size(), -1);
+  vector<int> last_producer(blobs_.size(), -1);
+  vector<bool> dropped(blobs_.size(), false);
+  for (int layer_id = 0; layer_id < layers_.size(); ++layer_id) {
+    const int segment = layer_segment_[layer_id];
+    for (int i = 0; i < top_id_vecs_[layer_id].size(); ++i) {
+      const int blob_id = top_id_vecs_[layer_id][i];
+      if (last_producer[blob_id] < 0) {
+        blob_segment[blob_id] = segment;
+        dropped[blob_id] = true;
+      }
+      dropped[blob_id] = dropped[blob_id] && blob_segment[blob_id] == segment;
+      last_producer[blob_id] = layer_id;
+    }
+    for (int i = 0; i < bottom_id_vecs_[layer_id].size(); ++i) {
+      const int blob_id = bottom_id_vecs_[layer_id][i];
+      dropped[blob_id] = dropped[blob_id] && blob_segment[blob_id] == segment;
+    }
+  }
+  for (int i = 0; i < net_output_blob_indices_.size(); ++i) {
+    dropped[net_output_blob_indices_[i]] = false;
+  }
+  // Group the data and the diffs of the blobs by memory, which the segment
+  // of the blobs holding it is recorded in begin and end of.
+  map<SyncedMemory*, int> buffer_ids;
+  vector<ActivationBuffer> buffers;
+  vector<int> data_buffer(blobs_.size(), -1);
+  vector<int> diff_buffer(blobs_.size(), -1);
+  for (int blob_id = 0; blob_id < blobs_.size(); ++blob_id) {
+    if (blobs_[blob_id]->count() == 0) {
+      dropped[blob_id] = false;
+      continue;
+    }
+    const shared_ptr<SyncedMemory>& data = blobs_[blob_id]->data();
+    const shared_ptr<SyncedMemory>& diff = blobs_[blob_id]->diff();
+    if (first_plan) {
+      plannable_blobs_[blob_id] = data->head() == SyncedMemory::UNINITIALIZED;
+      plannable_diffs_[blob_id] = diff->head() == SyncedMemory::UNINITIALIZED;
+    }
+    // Loss tops hold their loss weight in their diff.
+    if (!plannable_blobs_[blob_id] || !plannable_diffs_[blob_id] ||
+        blob_loss_weights_[blob_id] != Dtype(0)) {
+      dropped[blob_id] = false;
+    }
+    data_buffer[blob_id] = AddBufferHolder(data, &buffer_ids, &buffers);
+    diff_buffer[blob_id] = AddBufferHolder(diff, &buffer_ids, &buffers);
+    const int ids[] = {data_buffer[blob_id], diff_buffer[blob_id]};
+    for (int i = 0; i < 2; ++i) {
+      ActivationBuffer& buffer = buffers[ids[i]];
+      buffer.pinned = buffer.pinned || buffer.references != buffer.holders ||
+          (buffer.end >= 0 && buffer.end != blob_segment[blob_id]);
+      buffer.begin = buffer.end = blob_segment[blob_id];
+    }
+  }
+  vector<bool> recompute(layers_.size(), false);
+  for (bool changed = true; changed; ) {
+    changed = false;
+    // A layer rerun by Backward has to be allowed to, drop all its tops, and
+    // only read kept blobs that no later layer overwrites.
+    for (int layer_id = 0; layer_id < layers_.size(); ++layer_id) {
+      const vector<int>& tops = top_id_vecs_[layer_id];
+      const vector<int>& bottoms = bottom_id_vecs_[layer_id];
+      bool allowed = !bottoms.empty() && layers_[layer_id]->AllowRecompute();
+      recompute[layer_id] = false;
+      for (int i = 0; i < tops.size(); ++i) {
+        recompute[layer_id] = recompute[layer_id] || dropped[tops[i]];
+        allowed = allowed && dropped[tops[i]];
+      }
+      for (int i = 0; i < bottoms.size(); ++i) {
+        allowed = allowed &&
+            (dropped[bottoms[i]] || last_producer[bottoms[i]] < layer_id);
+      }
+      if (recompute[layer_id] && !allowed) {
+        for (int i = 0; i < tops.size(); ++i) {
+          dropped[tops[i]] = false;
+        }
+        recompute[layer_id] = false;
+        changed = true;
+      }
+    }
+    // Memory is dropped with all the blobs sharing it.
+    for (int blob_id = 0; blob_id < blobs_.size(); ++blob_id) {
+      if (data_buffer[blob_id] >= 0 && !dropped[blob_id]) {
+        buffers[data_buffer[blob_id]].pinned = true;
+        buffers[diff_buffer[blob_id]].pinned = true;
+      }
+    }
+    for (int blob_id = 0; blob_id < blobs_.size(); ++blob_id) {
+      if (dropped[blob_id] && (buffers[data_buffer[blob_id]].pinned ||
+                               buffers[diff_buffer[blob_id]].pinned)) {
+        dropped[blob_id] = false;
+        changed = true;
+      }
+    }
+  }
+  // The dropped memory of each segment is laid out from the start of the
+  // arena, which the segments take turns to use.
+  vector<size_t> segment_size(segment_begin_.size(), 0);
+  vector<ActivationBuffer*> planned;
+  size_t activations = 0;
+  for (int i = 0; i < buffers.size(); ++i) {
+    ActivationBuffer& buffer = buffers[i];
+    if (!buffer.pinned && buffer.size > 0) {
+      buffer.offset = segment_size[buffer.begin];
+      segment_size[buffer.begin] += buffer.size;
+      activations += buffer.size;
+      planned.push_back(&buffer);
+    }
+  }
+  const size_t arena_size = segment_size.empty() ? 0 :
+      *std::max_element(segment_size.begin(), segment_size.end());
+  memory_arena_ = AllocateArena(arena_size, planned, &arena_memory_);
+  layer_recompute_ = recompute;
+  resident_layer_ = -1;
+  LOG_IF(INFO, Caffe::root_solver())
+      << "Recomputing " << std::count(recompute.begin(), recompute.end(), true)
+      << " layers in " << segment_begin_.size() << " segments: "
+      << activations << " bytes of activations and diffs in " << arena_size
+      << " bytes of memory.";
+}
+
+template <typename Dtype>
+void Net<Dtype>::RecomputeSegment(const int layer_id) {
+  const int segment = layer_segment_[layer_id];
+  // Continue from the tops in memory if they belong to the segment.
+  int begin = segment_begin_[segment];
+  if (resident_layer_ >= 0 && layer_segment_[resident_layer_] == segment) {
+    begin = resident_layer_ + 1;
+  }
+  for (int i = begin; i <= layer_id; ++i) {
+    if (layer_recompute_[i]) {
+      layers_[i]->Forward(bottom_vecs_[i], top_vecs_[i]);
+      resident_layer_ = i;
+    }
+  }
+}
+
+// Makes each layer, taken in order, wait for the last layer writing memory it
+// accesses and for the layers reading memory it writes since.
+static void AddHazards(const vector<int>& order,
+    const vector<set<SyncedMemory*> >& reads,
+    const vector<set<SyncedMemory*> >& writes, TaskGraph* graph) {
+  map<SyncedMemory*, int> last_writer;
+  map<SyncedMemory*, vector<int> > readers;
+  for (int k = 0; k < order.size(); ++k) {
+    const int layer_id = order[k];
+    set<int> before;
+    for (set<SyncedMemory*>::const_iterator it = reads[layer_id].begin();
+         it != reads[layer_id].end(); ++it) {
+      if (last_writer.count(*it)) {
+        before.insert(last_writer[*it]);
+      }
+    }
+    for (set<SyncedMemory*>::const_iterator it = writes[layer_id].begin();
+         it != writes[layer_id].end(); ++it) {
+      if (last_writer.count(*it)) {
+        before.insert(last_writer[*it]);
+      }
+      before.insert(readers[*it].begin(), readers[*it].end());
+      readers[*it].clear();
+      last_writer[*it] = layer_id;
+    }
+    for (set<SyncedMemory*>::const_iterator it = reads[layer_id].begin();
+         it != reads[layer_id].end(); ++it) {
+      if (!writes[layer_id].count(*it)) {
+        readers[*it].push_back(layer_id);
+      }
+    }
+    before.erase(layer_id);
+    for (set<int>::const_iterator it = before.begin(); it != before.end();
+         ++it) {
+      graph->AddDependency(*it, layer_id);
+    }
+  }
+}
+
+template <typename Dtype>
+void Net<Dtype>::BuildLayerGraphs() {
+  const int num_layers = layers_.size();
+  vector<set<SyncedMemory*> > forward_reads(num_layers);
+  vector<set<SyncedMemory*> > forward_writes(num_layers);
+  vector<set<SyncedMemory*> > backward_reads(num_layers);
+  vector<set<SyncedMemory*> > backward_writes(num_layers);
+  for (int layer_id = 0; layer_id < num_layers; ++layer_id) {
+    const vector<Blob<Dtype>*>& bottom = bottom_vecs_[layer_id];
+    const vector<Blob<Dtype>*>& top = top_vecs_[layer_id];
+    for (int i = 0; i < bottom.size(); ++i) {
+      if (bottom[i]->count() == 0) { continue; }
+      forward_reads[layer_id].insert(bottom[i]->data().get());
+      backward_reads[layer_id].insert(bottom[i]->data().get());
+      if (bottom_need_backward_[layer_id][i]) {
+        backward_writes[layer_id].insert(bottom[i]->diff().get());
+      }
+    }
+    for (int i = 0; i < top.size(); ++i) {
+      if (top[i]->count() == 0) { continue; }
+      forward_writes[layer_id].insert(top[i]->data().get());
+      backward_reads[layer_id].insert(top[i]->data().get());
+      backward_reads[layer_id].insert(top[i]->diff().get());
+    }
+    // Shared parameters accumulate their diff.
+    const vector<shared_ptr<Blob<Dtype> > >& params =
+        layers_[layer_id]->blobs();
+    for (int i = 0; i < params.size(); ++i) {
+      if (params[i]->count() == 0) { continue; }
+      forward_reads[layer_id].insert(params[i]->data().get());
+      if (layers_[layer_id]->param_propagate_down(i)) {
+        backward_writes[layer_id].insert(params[i]->diff().get());
+      }
+    }
+  }
+  vector<int> order(num_layers);
+  for (int layer_id = 0; layer_id < num_layers; ++layer_id) {
+    order[layer_id] = layer_id;
+  }
+  forward_graph_.reset(new TaskGraph(num_layers));
+  AddHazards(order, forward_reads, forward_writes, forward_graph_.get());
+  std::reverse(order.begin(), order.end());
+  backward_graph_.reset(new TaskGraph(num_layers));
+  AddHazards(order, backward_reads, backward_writes, backward_graph_.get());
+  int last_on_caller = -1;
+  for (int layer_id = 0; layer_id < num_layers; ++layer_id) {
+    if (bottom_vecs_[layer_id].empty() ||
+        !layers_[layer_id]->AllowRecompute()) {
+      forward_graph_->set_on_caller(layer_id, true);
+      if (last_on_caller >= 0) {
+        forward_graph_->AddDependency(last_on_caller, layer_id);
+      }
+      last_on_caller = layer_id;
+    }
+  }
+  layer_losses_.assign(num_layers, Dtype(0));
+}
+
+template <typename Dtype>
+bool Net<Dtype>::LayersInParallel() const {
+  return layer_pool_ && layer_pool_->num_threads() > 1 &&
+      Caffe::mode() == Caffe::CPU && !debug_info_ &&
+      before_forward_.empty() && after_forward_.empty() &&
+      before_backward_.empty() && after_backward_.empty();
+}
+
+template <typename Dtype>
+void Net<Dtype>::ForwardLayer(int layer_id) {
+  layer_losses_[layer_id] =
+      layers_[layer_id]->Forward(bottom_vecs_[layer_id], top_vecs_[layer_id]);
+}
+
+template <typename Dtype>
+void Net<Dtype>::BackwardLayer(int layer_id) {
+  if (layer_need_backward_[layer_id]) {
+    layers_[layer_id]->Backward(top_vecs_[layer_id],
+        bottom_need_backward_[layer_id], bottom_vecs_[layer_id]);
+  }
 }
 
 template <typename Dtype>
@@ -842,14 +1438,15 @@ void Net<Dtype>::CopyTrainedLayersFromHDF5(const string& trained_filename) {
 }
 
 template <typename Dtype>
-void Net<Dtype>::ToProto(NetParameter* param, bool write_diff) const {
+void Net<Dtype>::ToProto(NetParameter* param, bool write_diff,
+    BlobStorage storage) const {
   param->Clear();
   param->set_name(name_);
   // Add bottom and top
   DLOG(INFO) << "Serializing " << layers_.size() << " layers";
   for (int i = 0; i < layers_.size(); ++i) {
     LayerParameter* layer_param = param->add_layer();
-    layers_[i]->ToProto(layer_param, write_diff);
+    layers_[i]->ToProto(layer_param, write_diff, storage);
   }
 }
 
@@ -4,6 +4,7 @@
 #include <vector>
 
 #include "boost/algorithm/string.hpp"
+#include "caffe/layers/base_data_layer.hpp"
 #include "caffe/solver.hpp"
 #include "caffe/util/format.hpp"
 #include "caffe/util/hdf5.hpp"
@@ -46,6 +47,9 @@ void Solver<Dtype>::Init(const SolverParameter& param) {
     << std::endl << param.DebugString();
   param_ = param;
   CHECK_GE(param_.average_loss(), 1) << "average_loss should be non-negative.";
+  CHECK(param_.snapshot_storage() == NATIVE ||
+      param_.snapshot_format() == SolverParameter_SnapshotFormat_BINARYPROTO)
+      << "snapshot_storage is only supported by BINARYPROTO snapshots.";
   CheckSnapshotWritePermissions();
   if (param_.random_seed() >= 0) {
     Caffe::set_random_seed(param_.random_seed() + Caffe::solver_rank());
@@ -463,7 +467,7 @@ string Solver<Dtype>::SnapshotToBinaryProto() {
   string model_filename = SnapshotFilename(".caffemodel");
   LOG(INFO) << "Snapshotting to binary proto file " << model_filename;
   NetParameter net_param;
-  net_->ToProto(&net_param, param_.snapshot_diff());
+  net_->ToProto(&net_param, param_.snapshot_diff(), param_.snapshot_storage());
   WriteProtoToBinaryFile(net_param, model_filename);
   return model_filename;
 }
@@ -485,6 +489,16 @@ void Solver<Dtype>::Restore(const char* state_file) {
   } else {
     RestoreSolverStateFromBinaryProto(state_filename);
   }
+  // Data layers read at random resume at the item after the last one trained
+  // on, iter_size batches per iteration.
+  const vector<shared_ptr<Layer<Dtype> > >& layers = net_->layers();
+  for (int i = 0; i < layers.size(); ++i) {
+    BasePrefetchingDataLayer<Dtype>* data_layer =
+        dynamic_cast<BasePrefetchingDataLayer<Dtype>*>(layers[i].get());
+    if (data_layer && data_layer->resumable()) {
+      data_layer->Resume(static_cast<uint64_t>(iter_) * param_.iter_size());
+    }
+  }
 }
 
 template <typename Dtype>
@@ -1,11 +1,16 @@
+#include <climits>
+#include <cstring>
+
 #include "caffe/common.hpp"
 #include "caffe/syncedmem.hpp"
+#include "caffe/util/half.hpp"
 #include "caffe/util/math_functions.hpp"
 
 namespace caffe {
 SyncedMemory::SyncedMemory()
   : cpu_ptr_(NULL), gpu_ptr_(NULL), size_(0), head_(UNINITIALIZED),
-    own_cpu_data_(false), cpu_malloc_use_cuda_(false), own_gpu_data_(false) {
+    own_cpu_data_(false), cpu_malloc_use_cuda_(false), own_gpu_data_(false),
+    version_(0), half_ptr_(NULL), half_storage_(NATIVE), half_double_(false) {
 #ifndef CPU_ONLY
 #ifdef DEBUG
   CUDA_CHECK(cudaGetDevice(&device_));
@@ -15,7 +20,8 @@ SyncedMemory::SyncedMemory()
 
 SyncedMemory::SyncedMemory(size_t size)
   : cpu_ptr_(NULL), gpu_ptr_(NULL), size_(size), head_(UNINITIALIZED),
-    own_cpu_data_(false), cpu_malloc_use_cuda_(false), own_gpu_data_(false) {
+    own_cpu_data_(false), cpu_malloc_use_cuda_(false), own_gpu_data_(false),
+    version_(0), half_ptr_(NULL), half_storage_(NATIVE), half_double_(false) {
 #ifndef CPU_ONLY
 #ifdef DEBUG
   CUDA_CHECK(cudaGetDevice(&device_));
@@ -28,6 +34,7 @@ SyncedMemory::~SyncedMemory() {
   if (cpu_ptr_ && own_cpu_data_) {
     CaffeFreeHost(cpu_ptr_, cpu_malloc_use_cuda_);
   }
+  release_half();
 
 #ifndef CPU_ONLY
   if (gpu_ptr_ && own_gpu_data_) {
@@ -58,6 +65,10 @@ inline void SyncedMemory::to_cpu() {
 #endif
     break;
   case HEAD_AT_CPU:
+    if (cpu_ptr_ == NULL) {
+      expand();
+    }
+    break;
   case SYNCED:
     break;
   }
@@ -74,6 +85,9 @@ inline void SyncedMemory::to_gpu() {
     own_gpu_data_ = true;
     break;
   case HEAD_AT_CPU:
+    if (cpu_ptr_ == NULL) {
+      expand();
+    }
     if (gpu_ptr_ == NULL) {
       CUDA_CHECK(cudaMalloc(&gpu_ptr_, size_));
       own_gpu_data_ = true;
@@ -105,6 +119,8 @@ void SyncedMemory::set_cpu_data(void* data) {
   cpu_ptr_ = data;
   head_ = HEAD_AT_CPU;
   own_cpu_data_ = false;
+  release_half();
+  ++version_;
 }
 
 const void* SyncedMemory::gpu_data() {
@@ -128,15 +144,39 @@ void SyncedMemory::set_gpu_data(void* data) {
   gpu_ptr_ = data;
   head_ = HEAD_AT_GPU;
   own_gpu_data_ = false;
+  release_half();
+  ++version_;
 #else
   NO_GPU;
 #endif
 }
 
+void SyncedMemory::own_data() {
+  check_device();
+  if (cpu_ptr_ && !own_cpu_data_) {
+    void* ptr;
+    CaffeMallocHost(&ptr, size_, &cpu_malloc_use_cuda_);
+    memcpy(ptr, cpu_ptr_, size_);
+    cpu_ptr_ = ptr;
+    own_cpu_data_ = true;
+  }
+#ifndef CPU_ONLY
+  if (gpu_ptr_ && !own_gpu_data_) {
+    void* ptr;
+    CUDA_CHECK(cudaMalloc(&ptr, size_));
+    caffe_gpu_memcpy(size_, gpu_ptr_, ptr);
+    gpu_ptr_ = ptr;
+    own_gpu_data_ = true;
+  }
+#endif
+}
+
 void* SyncedMemory::mutable_cpu_data() {
   check_device();
   to_cpu();
   head_ = HEAD_AT_CPU;
+  release_half();
+  ++version_;
   return cpu_ptr_;
 }
 
@@ -145,6 +185,8 @@ void* SyncedMemory::mutable_gpu_data() {
 #ifndef CPU_ONLY
   to_gpu();
   head_ = HEAD_AT_GPU;
+  release_half();
+  ++version_;
   return gpu_ptr_;
 #else
   NO_GPU;
@@ -156,6 +198,9 @@ void* SyncedMemory::mutable_gpu_data() {
 void SyncedMemory::async_gpu_push(const cudaStream_t& stream) {
   check_device();
   CHECK(head_ == HEAD_AT_CPU);
+  if (cpu_ptr_ == NULL) {
+    expand();
+  }
   if (gpu_ptr_ == NULL) {
     CUDA_CHECK(cudaMalloc(&gpu_ptr_, size_));
     own_gpu_data_ = true;
@@ -167,6 +212,57 @@ void SyncedMemory::async_gpu_push(const cudaStream_t& stream) {
 }
 #endif
 
+template <typename Dtype>
+void SyncedMemory::compress(const BlobStorage storage) {
+  check_device();
+  if (storage == NATIVE || head_ != HEAD_AT_CPU || !own_cpu_data_ ||
+      size_ == 0) {
+    return;
+  }
+  if (half_ptr_ && half_storage_ != storage) {
+    release_half();
+  }
+  if (!half_ptr_) {
+    const size_t count = size_ / sizeof(Dtype);
+    CHECK_LE(count, INT_MAX) << "Cannot compress " << count << " values.";
+    half_ptr_ = static_cast<uint16_t*>(malloc(count * sizeof(uint16_t)));
+    CHECK(half_ptr_) << "host allocation of size " << count * sizeof(uint16_t)
+        << " failed";
+    caffe_cpu_to_half(storage, count, static_cast<const Dtype*>(cpu_ptr_),
+        half_ptr_);
+    half_storage_ = storage;
+    half_double_ = sizeof(Dtype) == sizeof(double);
+    // The data is rounded.
+    ++version_;
+  }
+  CaffeFreeHost(cpu_ptr_, cpu_malloc_use_cuda_);
+  cpu_ptr_ = NULL;
+  own_cpu_data_ = false;
+}
+
+template void SyncedMemory::compress<float>(const BlobStorage storage);
+template void SyncedMemory::compress<double>(const BlobStorage storage);
+
+void SyncedMemory::expand() {
+  CHECK(half_ptr_);
+  CaffeMallocHost(&cpu_ptr_, size_, &cpu_malloc_use_cuda_);
+  own_cpu_data_ = true;
+  if (half_double_) {
+    caffe_cpu_from_half(half_storage_, size_ / sizeof(double), half_ptr_,
+        static_cast<double*>(cpu_ptr_));
+  } else {
+    caffe_cpu_from_half(half_storage_, size_ / sizeof(float), half_ptr_,
+        static_cast<float*>(cpu_ptr_));
+  }
+}
+
+void SyncedMemory::release_half() {
+  if (half_ptr_) {
+    free(half_ptr_);
+    half_ptr_ = NULL;
+  }
+}
+
 void SyncedMemory::check_device() {
 #ifndef CPU_ONLY
 #ifdef DEBUG
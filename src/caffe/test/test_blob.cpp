@@ -5,6 +5,8 @@
 #include "caffe/blob.hpp"
 #include "caffe/common.hpp"
 #include "caffe/filler.hpp"
+#include "caffe/util/half.hpp"
+#include "caffe/util/math_functions.hpp"
 
 #include "caffe/test/test_caffe_main.hpp"
 
@@ -112,6 +114,35 @@ TYPED_TEST(BlobSimpleTest, TestLegacyBlobProtoShapeEquals) {
   EXPECT_FALSE(this->blob_->ShapeEquals(blob_proto));
 }
 
+TYPED_TEST(BlobSimpleTest, TestProtoHalfStorage) {
+  FillerParameter filler_param;
+  GaussianFiller<TypeParam> filler(filler_param);
+  filler.Fill(this->blob_preshaped_);
+  caffe_copy(this->blob_preshaped_->count(), this->blob_preshaped_->cpu_data(),
+      this->blob_preshaped_->mutable_cpu_diff());
+  const int count = this->blob_preshaped_->count();
+  const BlobStorage storages[] = {FLOAT16, BFLOAT16};
+  for (int s = 0; s < 2; ++s) {
+    BlobProto proto;
+    this->blob_preshaped_->ToProto(&proto, true, storages[s]);
+    EXPECT_EQ(storages[s], proto.storage());
+    EXPECT_EQ(0, proto.data_size() + proto.double_data_size());
+    EXPECT_EQ(count * sizeof(uint16_t), proto.half_data().size());
+    EXPECT_EQ(count * sizeof(uint16_t), proto.half_diff().size());
+    this->blob_->FromProto(proto);
+    EXPECT_TRUE(this->blob_->ShapeEquals(proto));
+    vector<uint16_t> half(count);
+    vector<TypeParam> expected(count);
+    caffe_cpu_to_half(storages[s], count, this->blob_preshaped_->cpu_data(),
+        &half[0]);
+    caffe_cpu_from_half(storages[s], count, &half[0], &expected[0]);
+    for (int i = 0; i < count; ++i) {
+      EXPECT_EQ(expected[i], this->blob_->cpu_data()[i]);
+      EXPECT_EQ(expected[i], this->blob_->cpu_diff()[i]);
+    }
+  }
+}
+
 template <typename TypeParam>
 class BlobMathTest : public MultiDeviceTest<TypeParam> {
   typedef typename TypeParam::Dtype Dtype;
@@ -1,3 +1,5 @@
+#include <algorithm>
+#include <cmath>
 #include <vector>
 
 #include "gtest/gtest.h"
@@ -6,6 +8,9 @@
 #include "caffe/common.hpp"
 #include "caffe/filler.hpp"
 #include "caffe/layers/conv_layer.hpp"
+#include "caffe/layers/direct_conv_layer.hpp"
+#include "caffe/layers/winograd_conv_layer.hpp"
+#include "caffe/util/blas_backend.hpp"
 
 #ifdef USE_CUDNN
 #include "caffe/layers/cudnn_conv_layer.hpp"
@@ -190,6 +195,35 @@ class ConvolutionLayerTest : public MultiDeviceTest<TypeParam> {
   vector<Blob<Dtype>*> blob_top_vec_;
 };
 
+// Checks that layer, of another engine, computes the same top as the CAFFE
+// engine with the same weights.
+template <typename Dtype>
+void CheckAgainstCaffeEngine(Layer<Dtype>* layer,
+    const LayerParameter& layer_param, const vector<Blob<Dtype>*>& bottom,
+    const vector<Blob<Dtype>*>& top) {
+  layer->SetUp(bottom, top);
+  layer->Forward(bottom, top);
+  vector<shared_ptr<Blob<Dtype> > > results;
+  for (int i = 0; i < top.size(); ++i) {
+    results.push_back(shared_ptr<Blob<Dtype> >(new Blob<Dtype>()));
+    results.back()->CopyFrom(*top[i], false, true);
+  }
+  ConvolutionLayer<Dtype> reference(layer_param);
+  reference.SetUp(bottom, top);
+  for (int i = 0; i < layer->blobs().size(); ++i) {
+    reference.blobs()[i]->CopyFrom(*layer->blobs()[i]);
+  }
+  reference.Forward(bottom, top);
+  for (int i = 0; i < top.size(); ++i) {
+    ASSERT_EQ(top[i]->count(), results[i]->count());
+    for (int j = 0; j < top[i]->count(); ++j) {
+      const Dtype expected = top[i]->cpu_data()[j];
+      EXPECT_NEAR(expected, results[i]->cpu_data()[j],
+          1e-4 * std::max(Dtype(1), std::fabs(expected)));
+    }
+  }
+}
+
 TYPED_TEST_CASE(ConvolutionLayerTest, TestDtypesAndDevices);
 
 TYPED_TEST(ConvolutionLayerTest, TestSetup) {
@@ -811,6 +845,323 @@ TYPED_TEST(ConvolutionLayerTest, TestGradientGroup) {
       this->blob_top_vec_);
 }
 
+TYPED_TEST(ConvolutionLayerTest, TestCPUThreads) {
+  typedef typename TypeParam::Dtype Dtype;
+  // Five images do not split evenly over the threads.
+  vector<int> bottom_shape(4);
+  bottom_shape[0] = 5;
+  bottom_shape[1] = 3;
+  bottom_shape[2] = 6;
+  bottom_shape[3] = 4;
+  FillerParameter filler_param;
+  GaussianFiller<Dtype> filler(filler_param);
+  this->blob_bottom_vec_.push_back(this->blob_bottom_2_);
+  this->blob_top_vec_.push_back(this->blob_top_2_);
+  for (int i = 0; i < this->blob_bottom_vec_.size(); ++i) {
+    this->blob_bottom_vec_[i]->Reshape(bottom_shape);
+    filler.Fill(this->blob_bottom_vec_[i]);
+  }
+  LayerParameter layer_param;
+  ConvolutionParameter* convolution_param =
+      layer_param.mutable_convolution_param();
+  convolution_param->add_kernel_size(3);
+  convolution_param->add_stride(2);
+  convolution_param->set_num_output(4);
+  convolution_param->mutable_weight_filler()->set_type("gaussian");
+  convolution_param->mutable_bias_filler()->set_type("gaussian");
+  vector<bool> propagate_down(2, true);
+  vector<shared_ptr<Blob<Dtype> > > results;
+  for (int threads = 1; threads <= 3; threads += 2) {
+    Caffe::set_random_seed(1701);
+    Caffe::set_cpu_threads(threads);
+    ConvolutionLayer<Dtype> layer(layer_param);
+    layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+    layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+    for (int i = 0; i < this->blob_top_vec_.size(); ++i) {
+      caffe_copy(this->blob_top_vec_[i]->count(),
+          this->blob_top_vec_[i]->cpu_data(),
+          this->blob_top_vec_[i]->mutable_cpu_diff());
+    }
+    for (int i = 0; i < layer.blobs().size(); ++i) {
+      caffe_set(layer.blobs()[i]->count(), Dtype(0),
+          layer.blobs()[i]->mutable_cpu_diff());
+    }
+    layer.Backward(this->blob_top_vec_, propagate_down,
+        this->blob_bottom_vec_);
+    vector<Blob<Dtype>*> blobs(this->blob_top_vec_);
+    blobs.insert(blobs.end(), this->blob_bottom_vec_.begin(),
+        this->blob_bottom_vec_.end());
+    blobs.push_back(layer.blobs()[0].get());
+    blobs.push_back(layer.blobs()[1].get());
+    for (int i = 0; i < blobs.size(); ++i) {
+      results.push_back(shared_ptr<Blob<Dtype> >(new Blob<Dtype>()));
+      results.back()->CopyFrom(*blobs[i], false, true);
+      results.back()->CopyFrom(*blobs[i], true);
+    }
+  }
+  Caffe::set_cpu_threads(1);
+  const int num_results = results.size() / 2;
+  for (int i = 0; i < num_results; ++i) {
+    const Blob<Dtype>& serial = *results[i];
+    const Blob<Dtype>& parallel = *results[num_results + i];
+    ASSERT_EQ(serial.count(), parallel.count());
+    for (int j = 0; j < serial.count(); ++j) {
+      EXPECT_EQ(serial.cpu_data()[j], parallel.cpu_data()[j]);
+      EXPECT_NEAR(serial.cpu_diff()[j], parallel.cpu_diff()[j],
+          1e-4 * std::max(Dtype(1), std::fabs(serial.cpu_diff()[j])));
+    }
+  }
+}
+
+TYPED_TEST(ConvolutionLayerTest, TestPackedWeights) {
+  typedef typename TypeParam::Dtype Dtype;
+  this->blob_bottom_vec_.push_back(this->blob_bottom_2_);
+  this->blob_top_vec_.push_back(this->blob_top_2_);
+  LayerParameter layer_param;
+  layer_param.set_phase(TEST);
+  ConvolutionParameter* convolution_param =
+      layer_param.mutable_convolution_param();
+  convolution_param->add_kernel_size(3);
+  convolution_param->add_pad(1);
+  convolution_param->set_num_output(6);
+  convolution_param->set_group(3);
+  convolution_param->set_bias_term(false);
+  convolution_param->mutable_weight_filler()->set_type("gaussian");
+  ConvolutionLayer<Dtype> layer(layer_param);
+  layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+  vector<shared_ptr<Blob<Dtype> > > expected;
+  for (int i = 0; i < this->blob_top_vec_.size(); ++i) {
+    expected.push_back(shared_ptr<Blob<Dtype> >(new Blob<Dtype>()));
+    expected.back()->CopyFrom(*this->blob_top_vec_[i], false, true);
+  }
+  // The weights are packed once for both bottoms and both threads, and
+  // packed again when they change.
+  caffe_set_blas_backend("builtin");
+  Caffe::set_cpu_threads(2);
+  for (int pass = 0; pass < 3; ++pass) {
+    const Dtype scale = pass == 2 ? 2 : 1;
+    if (pass == 2) {
+      caffe_scal(layer.blobs()[0]->count(), scale,
+          layer.blobs()[0]->mutable_cpu_data());
+    }
+    layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+    for (int i = 0; i < this->blob_top_vec_.size(); ++i) {
+      for (int j = 0; j < expected[i]->count(); ++j) {
+        const Dtype value = scale * expected[i]->cpu_data()[j];
+        EXPECT_NEAR(value, this->blob_top_vec_[i]->cpu_data()[j],
+            1e-4 * std::max(Dtype(1), std::fabs(value)));
+      }
+    }
+  }
+  Caffe::set_cpu_threads(1);
+  caffe_set_blas_backend("linked");
+}
+
+TYPED_TEST(ConvolutionLayerTest, TestWinogradEngine) {
+  typedef typename TypeParam::Dtype Dtype;
+  FillerParameter filler_param;
+  GaussianFiller<Dtype> filler(filler_param);
+  this->blob_bottom_vec_.push_back(this->blob_bottom_2_);
+  this->blob_top_vec_.push_back(this->blob_top_2_);
+  LayerParameter layer_param;
+  ConvolutionParameter* convolution_param =
+      layer_param.mutable_convolution_param();
+  convolution_param->set_engine(ConvolutionParameter_Engine_WINOGRAD);
+  convolution_param->add_kernel_size(3);
+  convolution_param->set_num_output(4);
+  convolution_param->mutable_weight_filler()->set_type("gaussian");
+  convolution_param->mutable_bias_filler()->set_type("gaussian");
+  // F(2x2, 3x3) on the 4 x 2 output of the default bottoms.
+  {
+    WinogradConvolutionLayer<Dtype> layer(layer_param);
+    CheckAgainstCaffeEngine<Dtype>(&layer, layer_param,
+        this->blob_bottom_vec_, this->blob_top_vec_);
+    EXPECT_EQ(2, layer.tile());
+  }
+  // F(4x4, 3x3) with padding, groups and outputs not a multiple of the tile,
+  // on two threads.
+  for (int i = 0; i < this->blob_bottom_vec_.size(); ++i) {
+    this->blob_bottom_vec_[i]->Reshape(3, 4, 13, 10);
+    filler.Fill(this->blob_bottom_vec_[i]);
+  }
+  convolution_param->add_pad(1);
+  convolution_param->set_group(2);
+  Caffe::set_cpu_threads(2);
+  {
+    WinogradConvolutionLayer<Dtype> layer(layer_param);
+    CheckAgainstCaffeEngine<Dtype>(&layer, layer_param,
+        this->blob_bottom_vec_, this->blob_top_vec_);
+    EXPECT_EQ(4, layer.tile());
+  }
+  Caffe::set_cpu_threads(1);
+  // Strided convolution falls back to im2col.
+  convolution_param->add_stride(2);
+  {
+    WinogradConvolutionLayer<Dtype> layer(layer_param);
+    CheckAgainstCaffeEngine<Dtype>(&layer, layer_param,
+        this->blob_bottom_vec_, this->blob_top_vec_);
+    EXPECT_EQ(0, layer.tile());
+  }
+}
+
+TYPED_TEST(ConvolutionLayerTest, TestDirectEngine) {
+  typedef typename TypeParam::Dtype Dtype;
+  FillerParameter filler_param;
+  GaussianFiller<Dtype> filler(filler_param);
+  for (int i = 0; i < this->blob_bottom_vec_.size(); ++i) {
+    this->blob_bottom_vec_[i]->Reshape(2, 6, 11, 21);
+    filler.Fill(this->blob_bottom_vec_[i]);
+  }
+  LayerParameter layer_param;
+  ConvolutionParameter* convolution_param =
+      layer_param.mutable_convolution_param();
+  convolution_param->set_engine(ConvolutionParameter_Engine_DIRECT);
+  convolution_param->set_kernel_h(3);
+  convolution_param->set_kernel_w(2);
+  convolution_param->set_num_output(6);
+  convolution_param->mutable_weight_filler()->set_type("gaussian");
+  convolution_param->mutable_bias_filler()->set_type("gaussian");
+  // Rows of 20 outputs, whose last tile overlaps the previous one.
+  {
+    DirectConvolutionLayer<Dtype> layer(layer_param);
+    CheckAgainstCaffeEngine<Dtype>(&layer, layer_param,
+        this->blob_bottom_vec_, this->blob_top_vec_);
+  }
+  // Padding, strides, dilation, rows shorter than a tile and groups of less
+  // than a block of outputs.
+  convolution_param->set_pad_h(2);
+  convolution_param->set_pad_w(1);
+  convolution_param->set_stride_h(2);
+  convolution_param->set_stride_w(3);
+  convolution_param->add_dilation(2);
+  convolution_param->set_group(2);
+  {
+    DirectConvolutionLayer<Dtype> layer(layer_param);
+    CheckAgainstCaffeEngine<Dtype>(&layer, layer_param,
+        this->blob_bottom_vec_, this->blob_top_vec_);
+  }
+}
+
+TYPED_TEST(ConvolutionLayerTest, Test3DAgainstND) {
+  typedef typename TypeParam::Dtype Dtype;
+  vector<int> bottom_shape(5, 2);
+  bottom_shape[1] = 3;
+  bottom_shape[2] = 5;
+  bottom_shape[3] = 6;
+  bottom_shape[4] = 7;
+  FillerParameter filler_param;
+  GaussianFiller<Dtype> filler(filler_param);
+  this->blob_bottom_->Reshape(bottom_shape);
+  filler.Fill(this->blob_bottom_);
+  LayerParameter layer_param;
+  ConvolutionParameter* convolution_param =
+      layer_param.mutable_convolution_param();
+  convolution_param->add_kernel_size(2);
+  convolution_param->add_kernel_size(3);
+  convolution_param->add_kernel_size(3);
+  convolution_param->add_pad(1);
+  convolution_param->add_pad(0);
+  convolution_param->add_pad(2);
+  convolution_param->add_stride(1);
+  convolution_param->add_stride(2);
+  convolution_param->add_stride(3);
+  convolution_param->add_dilation(2);
+  convolution_param->add_dilation(1);
+  convolution_param->add_dilation(1);
+  convolution_param->set_num_output(4);
+  convolution_param->mutable_weight_filler()->set_type("gaussian");
+  convolution_param->mutable_bias_filler()->set_type("gaussian");
+  // Forward and backward through the 3D im2col, then through the N-D one.
+  vector<shared_ptr<Blob<Dtype> > > results;
+  vector<shared_ptr<Blob<Dtype> > > weights;
+  for (int force_nd = 0; force_nd <= 1; ++force_nd) {
+    convolution_param->set_force_nd_im2col(force_nd);
+    ConvolutionLayer<Dtype> layer(layer_param);
+    layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+    for (int i = 0; i < layer.blobs().size(); ++i) {
+      if (force_nd) {
+        layer.blobs()[i]->CopyFrom(*weights[i]);
+      } else {
+        weights.push_back(layer.blobs()[i]);
+      }
+    }
+    layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+    caffe_copy(this->blob_top_->count(), this->blob_top_->cpu_data(),
+        this->blob_top_->mutable_cpu_diff());
+    for (int i = 0; i < layer.blobs().size(); ++i) {
+      caffe_set(layer.blobs()[i]->count(), Dtype(0),
+          layer.blobs()[i]->mutable_cpu_diff());
+    }
+    layer.Backward(this->blob_top_vec_, vector<bool>(1, true),
+        this->blob_bottom_vec_);
+    const Blob<Dtype>* blobs[3] = {this->blob_top_, this->blob_bottom_,
+        layer.blobs()[0].get()};
+    for (int i = 0; i < 3; ++i) {
+      Blob<Dtype>* result = new Blob<Dtype>();
+      result->CopyFrom(*blobs[i], i > 0, true);
+      results.push_back(shared_ptr<Blob<Dtype> >(result));
+    }
+  }
+  for (int i = 0; i < 3; ++i) {
+    const Blob<Dtype>& expected = *results[i + 3];
+    const Blob<Dtype>& actual = *results[i];
+    const Dtype* expected_data = i ? expected.cpu_diff() : expected.cpu_data();
+    const Dtype* actual_data = i ? actual.cpu_diff() : actual.cpu_data();
+    for (int j = 0; j < expected.count(); ++j) {
+      EXPECT_NEAR(expected_data[j], actual_data[j],
+          1e-4 * std::max(Dtype(1), std::fabs(expected_data[j])));
+    }
+  }
+}
+
+TYPED_TEST(ConvolutionLayerTest, TestDirectEngine3D) {
+  typedef typename TypeParam::Dtype Dtype;
+  vector<int> bottom_shape(5, 2);
+  bottom_shape[1] = 4;
+  bottom_shape[2] = 5;
+  bottom_shape[3] = 6;
+  bottom_shape[4] = 13;
+  FillerParameter filler_param;
+  GaussianFiller<Dtype> filler(filler_param);
+  for (int i = 0; i < this->blob_bottom_vec_.size(); ++i) {
+    this->blob_bottom_vec_[i]->Reshape(bottom_shape);
+    filler.Fill(this->blob_bottom_vec_[i]);
+  }
+  LayerParameter layer_param;
+  ConvolutionParameter* convolution_param =
+      layer_param.mutable_convolution_param();
+  convolution_param->set_engine(ConvolutionParameter_Engine_DIRECT);
+  // Compare with the N-D im2col, not with the 3D one.
+  convolution_param->set_force_nd_im2col(true);
+  convolution_param->add_kernel_size(3);
+  convolution_param->set_num_output(6);
+  convolution_param->mutable_weight_filler()->set_type("gaussian");
+  convolution_param->mutable_bias_filler()->set_type("gaussian");
+  {
+    DirectConvolutionLayer<Dtype> layer(layer_param);
+    CheckAgainstCaffeEngine<Dtype>(&layer, layer_param,
+        this->blob_bottom_vec_, this->blob_top_vec_);
+  }
+  convolution_param->add_kernel_size(2);
+  convolution_param->add_kernel_size(3);
+  convolution_param->add_pad(1);
+  convolution_param->add_pad(0);
+  convolution_param->add_pad(1);
+  convolution_param->add_stride(2);
+  convolution_param->add_stride(1);
+  convolution_param->add_stride(2);
+  convolution_param->add_dilation(1);
+  convolution_param->add_dilation(2);
+  convolution_param->add_dilation(1);
+  convolution_param->set_group(2);
+  {
+    DirectConvolutionLayer<Dtype> layer(layer_param);
+    CheckAgainstCaffeEngine<Dtype>(&layer, layer_param,
+        this->blob_bottom_vec_, this->blob_top_vec_);
+  }
+}
+
 #ifdef USE_CUDNN
 
 template <typename Dtype>
@@ -1,4 +1,5 @@
 #ifdef USE_OPENCV
+#include <algorithm>
 #include <string>
 #include <vector>
 
@@ -12,6 +13,7 @@
 #include "caffe/proto/caffe.pb.h"
 #include "caffe/util/db.hpp"
 #include "caffe/util/io.hpp"
+#include "caffe/util/tensor_record.hpp"
 
 #include "caffe/test/test_caffe_main.hpp"
 
@@ -28,7 +30,7 @@ class DataLayerTest : public MultiDeviceTest<TypeParam> {
       : backend_(DataParameter_DB_LEVELDB),
         blob_top_data_(new Blob<Dtype>()),
         blob_top_label_(new Blob<Dtype>()),
-        seed_(1701) {}
+        seed_(1701), decode_threads_(1), tensor_records_(false) {}
   virtual void SetUp() {
     filename_.reset(new string());
     MakeTempDir(filename_.get());
@@ -37,6 +39,18 @@ class DataLayerTest : public MultiDeviceTest<TypeParam> {
     blob_top_vec_.push_back(blob_top_label_);
   }
 
+  // The value stored for datum: a tensor record if tensor_records_, else
+  // the serialized datum.
+  string Value(const Datum& datum) {
+    string out;
+    if (tensor_records_) {
+      DatumToTensorRecord(datum, &out);
+    } else {
+      CHECK(datum.SerializeToString(&out));
+    }
+    return out;
+  }
+
   // Fill the DB with data: if unique_pixels, each pixel is unique but
   // all images are the same; else each image is unique but all pixels within
   // an image are the same.
@@ -59,9 +73,7 @@ class DataLayerTest : public MultiDeviceTest<TypeParam> {
       }
       stringstream ss;
       ss << i;
-      string out;
-      CHECK(datum.SerializeToString(&out));
-      txn->Put(ss.str(), out);
+      txn->Put(ss.str(), Value(datum));
     }
     txn->Commit();
     db->Close();
@@ -75,6 +87,7 @@ class DataLayerTest : public MultiDeviceTest<TypeParam> {
     data_param->set_batch_size(5);
     data_param->set_source(filename_->c_str());
     data_param->set_backend(backend_);
+    data_param->set_decode_threads(decode_threads_);
 
     TransformationParameter* transform_param =
         param.mutable_transform_param();
@@ -113,6 +126,7 @@ class DataLayerTest : public MultiDeviceTest<TypeParam> {
     data_param->set_batch_size(batch_size);
     data_param->set_source(filename_->c_str());
     data_param->set_backend(backend_);
+    data_param->set_decode_threads(decode_threads_);
     Caffe::set_solver_count(8);
     for (int dev = 0; dev < Caffe::solver_count(); ++dev) {
       Caffe::set_solver_rank(dev);
@@ -131,6 +145,72 @@ class DataLayerTest : public MultiDeviceTest<TypeParam> {
     Caffe::set_solver_rank(0);
   }
 
+  // Checks that shuffled layers take every item once an epoch between the
+  // solvers, and resume where they were after some batches.
+  void TestShuffle() {
+    LayerParameter param;
+    param.set_phase(TRAIN);
+    DataParameter* data_param = param.mutable_data_param();
+    const int batch_size = 3;
+    data_param->set_batch_size(batch_size);
+    data_param->set_source(filename_->c_str());
+    data_param->set_backend(backend_);
+    data_param->set_decode_threads(decode_threads_);
+    data_param->set_shuffle(true);
+    // The first solver writes the key index and the second reads it.
+    data_param->set_key_index(*filename_ + ".keys");
+    const int num_solvers = 2;
+    const int batches = 5;
+    // Sample k of solver rank is sample k * num_solvers + rank of all.
+    vector<int> labels(num_solvers * batches * batch_size);
+    Caffe::set_solver_count(num_solvers);
+    for (int rank = 0; rank < num_solvers; ++rank) {
+      Caffe::set_solver_rank(rank);
+      vector<int> solver_labels;
+      {
+        DataLayer<Dtype> layer(param);
+        layer.SetUp(blob_bottom_vec_, blob_top_vec_);
+        for (int iter = 0; iter < batches; ++iter) {
+          layer.Forward(blob_bottom_vec_, blob_top_vec_);
+          for (int i = 0; i < batch_size; ++i) {
+            const int label = blob_top_label_->cpu_data()[i];
+            EXPECT_EQ(label, blob_top_data_->cpu_data()[i * 24]);
+            labels[solver_labels.size() * num_solvers + rank] = label;
+            solver_labels.push_back(label);
+          }
+        }
+      }
+      DataLayer<Dtype> layer(param);
+      layer.SetUp(blob_bottom_vec_, blob_top_vec_);
+      layer.Resume(2);
+      for (int iter = 2; iter < batches; ++iter) {
+        layer.Forward(blob_bottom_vec_, blob_top_vec_);
+        for (int i = 0; i < batch_size; ++i) {
+          EXPECT_EQ(solver_labels[iter * batch_size + i],
+              blob_top_label_->cpu_data()[i])
+              << "debug: rank " << rank << " iter " << iter << " i " << i;
+        }
+      }
+    }
+    Caffe::set_solver_count(1);
+    Caffe::set_solver_rank(0);
+    // Every epoch of 5 samples is a permutation of the items, not always in
+    // their order.
+    bool shuffled = false;
+    for (int epoch = 0; epoch < labels.size() / 5; ++epoch) {
+      vector<int> epoch_labels(labels.begin() + epoch * 5,
+          labels.begin() + (epoch + 1) * 5);
+      for (int i = 0; i < 5; ++i) {
+        shuffled |= epoch_labels[i] != i;
+      }
+      std::sort(epoch_labels.begin(), epoch_labels.end());
+      for (int i = 0; i < 5; ++i) {
+        EXPECT_EQ(i, epoch_labels[i]) << "debug: epoch " << epoch;
+      }
+    }
+    EXPECT_TRUE(shuffled);
+  }
+
   void TestReshape(DataParameter_DB backend) {
     const int num_inputs = 5;
     // Save data of varying shapes.
@@ -151,9 +231,7 @@ class DataLayerTest : public MultiDeviceTest<TypeParam> {
       }
       stringstream ss;
       ss << i;
-      string out;
-      CHECK(datum.SerializeToString(&out));
-      txn->Put(ss.str(), out);
+      txn->Put(ss.str(), Value(datum));
     }
     txn->Commit();
     db->Close();
@@ -250,6 +328,58 @@ class DataLayerTest : public MultiDeviceTest<TypeParam> {
     }
   }
 
+  // Checks that batches transformed when forwarded, with defer_transform,
+  // hold what the prefetch thread would have transformed from the same seed.
+  void TestDeferTransform() {
+    LayerParameter param;
+    param.set_phase(TRAIN);
+    DataParameter* data_param = param.mutable_data_param();
+    data_param->set_batch_size(5);
+    data_param->set_source(filename_->c_str());
+    data_param->set_backend(backend_);
+    data_param->set_decode_threads(decode_threads_);
+
+    TransformationParameter* transform_param =
+        param.mutable_transform_param();
+    transform_param->set_crop_size(2);
+    transform_param->set_mirror(true);
+    transform_param->set_scale(0.5);
+    transform_param->add_mean_value(3);
+    transform_param->add_mean_value(11);
+
+    vector<vector<Dtype> > expected;
+    for (int defer = 0; defer < 2; ++defer) {
+      // Fresh tops: those of a layer point into its batches once forwarded.
+      Blob<Dtype> top_data, top_label;
+      vector<Blob<Dtype>*> top_vec;
+      top_vec.push_back(&top_data);
+      top_vec.push_back(&top_label);
+      data_param->set_defer_transform(defer);
+      Caffe::set_random_seed(seed_);
+      DataLayer<Dtype> layer(param);
+      layer.SetUp(blob_bottom_vec_, top_vec);
+      EXPECT_EQ(5, top_data.num());
+      EXPECT_EQ(2, top_data.channels());
+      EXPECT_EQ(2, top_data.height());
+      EXPECT_EQ(2, top_data.width());
+      for (int iter = 0; iter < 3; ++iter) {
+        layer.Forward(blob_bottom_vec_, top_vec);
+        for (int i = 0; i < 5; ++i) {
+          EXPECT_EQ(i, top_label.cpu_data()[i]);
+        }
+        const Dtype* data = top_data.cpu_data();
+        if (!defer) {
+          expected.push_back(vector<Dtype>(data, data + top_data.count()));
+          continue;
+        }
+        for (int j = 0; j < top_data.count(); ++j) {
+          EXPECT_EQ(expected[iter][j], data[j])
+              << "debug: iter " << iter << " j " << j;
+        }
+      }
+    }
+  }
+
   void TestReadCropTrainSequenceSeeded() {
     LayerParameter param;
     param.set_phase(TRAIN);
@@ -257,6 +387,7 @@ class DataLayerTest : public MultiDeviceTest<TypeParam> {
     data_param->set_batch_size(5);
     data_param->set_source(filename_->c_str());
     data_param->set_backend(backend_);
+    data_param->set_decode_threads(decode_threads_);
 
     TransformationParameter* transform_param =
         param.mutable_transform_param();
@@ -371,6 +502,8 @@ class DataLayerTest : public MultiDeviceTest<TypeParam> {
   vector<Blob<Dtype>*> blob_bottom_vec_;
   vector<Blob<Dtype>*> blob_top_vec_;
   int seed_;
+  int decode_threads_;
+  bool tensor_records_;
 };
 
 TYPED_TEST_CASE(DataLayerTest, TestDtypesAndDevices);
@@ -387,6 +520,19 @@ TYPED_TEST(DataLayerTest, TestSkipLevelDB) {
   this->TestSkip();
 }
 
+TYPED_TEST(DataLayerTest, TestShuffleLevelDB) {
+  const bool unique_pixels = false;  // all pixels the same; images different
+  this->Fill(unique_pixels, DataParameter_DB_LEVELDB);
+  this->TestShuffle();
+}
+
+TYPED_TEST(DataLayerTest, TestShuffleParallelLevelDB) {
+  const bool unique_pixels = false;  // all pixels the same; images different
+  this->Fill(unique_pixels, DataParameter_DB_LEVELDB);
+  this->decode_threads_ = 3;
+  this->TestShuffle();
+}
+
 TYPED_TEST(DataLayerTest, TestReshapeLevelDB) {
   this->TestReshape(DataParameter_DB_LEVELDB);
 }
@@ -418,6 +564,69 @@ TYPED_TEST(DataLayerTest, TestReadCropTestLevelDB) {
   this->Fill(unique_pixels, DataParameter_DB_LEVELDB);
   this->TestReadCrop(TEST);
 }
+
+// Test that decode workers fill the batches as the prefetch thread alone.
+TYPED_TEST(DataLayerTest, TestReadParallelLevelDB) {
+  const bool unique_pixels = false;  // all pixels the same; images different
+  this->Fill(unique_pixels, DataParameter_DB_LEVELDB);
+  this->decode_threads_ = 3;
+  this->TestRead();
+}
+
+TYPED_TEST(DataLayerTest, TestSkipParallelLevelDB) {
+  this->Fill(false, DataParameter_DB_LEVELDB);
+  this->decode_threads_ = 3;
+  this->TestSkip();
+}
+
+TYPED_TEST(DataLayerTest, TestReadCropTrainSequenceSeededParallelLevelDB) {
+  const bool unique_pixels = true;  // all images the same; pixels different
+  this->Fill(unique_pixels, DataParameter_DB_LEVELDB);
+  this->decode_threads_ = 3;
+  this->TestReadCropTrainSequenceSeeded();
+}
+
+// Test that tensor records read as the Datum they were made from.
+TYPED_TEST(DataLayerTest, TestReadTensorRecordsLevelDB) {
+  const bool unique_pixels = false;  // all pixels the same; images different
+  this->tensor_records_ = true;
+  this->Fill(unique_pixels, DataParameter_DB_LEVELDB);
+  this->TestRead();
+}
+
+TYPED_TEST(DataLayerTest, TestReshapeTensorRecordsLevelDB) {
+  this->tensor_records_ = true;
+  this->TestReshape(DataParameter_DB_LEVELDB);
+}
+
+TYPED_TEST(DataLayerTest, TestReadCropTestTensorRecordsLevelDB) {
+  const bool unique_pixels = true;  // all images the same; pixels different
+  this->tensor_records_ = true;
+  this->Fill(unique_pixels, DataParameter_DB_LEVELDB);
+  this->TestReadCrop(TEST);
+}
+
+TYPED_TEST(DataLayerTest, TestReadParallelTensorRecordsLevelDB) {
+  const bool unique_pixels = false;  // all pixels the same; images different
+  this->tensor_records_ = true;
+  this->Fill(unique_pixels, DataParameter_DB_LEVELDB);
+  this->decode_threads_ = 3;
+  this->TestRead();
+}
+
+TYPED_TEST(DataLayerTest, TestDeferTransformLevelDB) {
+  const bool unique_pixels = true;  // all images the same; pixels different
+  this->Fill(unique_pixels, DataParameter_DB_LEVELDB);
+  this->TestDeferTransform();
+}
+
+TYPED_TEST(DataLayerTest, TestDeferTransformTensorRecordsLevelDB) {
+  const bool unique_pixels = true;  // all images the same; pixels different
+  this->tensor_records_ = true;
+  this->Fill(unique_pixels, DataParameter_DB_LEVELDB);
+  this->decode_threads_ = 3;
+  this->TestDeferTransform();
+}
 #endif  // USE_LEVELDB
 
 #ifdef USE_LMDB
@@ -432,6 +641,19 @@ TYPED_TEST(DataLayerTest, TestSkipLMDB) {
   this->TestSkip();
 }
 
+TYPED_TEST(DataLayerTest, TestShuffleLMDB) {
+  const bool unique_pixels = false;  // all pixels the same; images different
+  this->Fill(unique_pixels, DataParameter_DB_LMDB);
+  this->TestShuffle();
+}
+
+TYPED_TEST(DataLayerTest, TestShuffleParallelLMDB) {
+  const bool unique_pixels = false;  // all pixels the same; images different
+  this->Fill(unique_pixels, DataParameter_DB_LMDB);
+  this->decode_threads_ = 3;
+  this->TestShuffle();
+}
+
 TYPED_TEST(DataLayerTest, TestReshapeLMDB) {
   this->TestReshape(DataParameter_DB_LMDB);
 }
@@ -464,6 +686,69 @@ TYPED_TEST(DataLayerTest, TestReadCropTestLMDB) {
   this->TestReadCrop(TEST);
 }
 
+// Test that decode workers fill the batches as the prefetch thread alone.
+TYPED_TEST(DataLayerTest, TestReadParallelLMDB) {
+  const bool unique_pixels = false;  // all pixels the same; images different
+  this->Fill(unique_pixels, DataParameter_DB_LMDB);
+  this->decode_threads_ = 3;
+  this->TestRead();
+}
+
+TYPED_TEST(DataLayerTest, TestSkipParallelLMDB) {
+  this->Fill(false, DataParameter_DB_LMDB);
+  this->decode_threads_ = 3;
+  this->TestSkip();
+}
+
+TYPED_TEST(DataLayerTest, TestReadCropTrainSequenceSeededParallelLMDB) {
+  const bool unique_pixels = true;  // all images the same; pixels different
+  this->Fill(unique_pixels, DataParameter_DB_LMDB);
+  this->decode_threads_ = 3;
+  this->TestReadCropTrainSequenceSeeded();
+}
+
+// Test that tensor records read as the Datum they were made from.
+TYPED_TEST(DataLayerTest, TestReadTensorRecordsLMDB) {
+  const bool unique_pixels = false;  // all pixels the same; images different
+  this->tensor_records_ = true;
+  this->Fill(unique_pixels, DataParameter_DB_LMDB);
+  this->TestRead();
+}
+
+TYPED_TEST(DataLayerTest, TestReshapeTensorRecordsLMDB) {
+  this->tensor_records_ = true;
+  this->TestReshape(DataParameter_DB_LMDB);
+}
+
+TYPED_TEST(DataLayerTest, TestReadCropTestTensorRecordsLMDB) {
+  const bool unique_pixels = true;  // all images the same; pixels different
+  this->tensor_records_ = true;
+  this->Fill(unique_pixels, DataParameter_DB_LMDB);
+  this->TestReadCrop(TEST);
+}
+
+TYPED_TEST(DataLayerTest, TestReadParallelTensorRecordsLMDB) {
+  const bool unique_pixels = false;  // all pixels the same; images different
+  this->tensor_records_ = true;
+  this->Fill(unique_pixels, DataParameter_DB_LMDB);
+  this->decode_threads_ = 3;
+  this->TestRead();
+}
+
+TYPED_TEST(DataLayerTest, TestDeferTransformLMDB) {
+  const bool unique_pixels = true;  // all images the same; pixels different
+  this->Fill(unique_pixels, DataParameter_DB_LMDB);
+  this->TestDeferTransform();
+}
+
+TYPED_TEST(DataLayerTest, TestDeferTransformTensorRecordsLMDB) {
+  const bool unique_pixels = true;  // all images the same; pixels different
+  this->tensor_records_ = true;
+  this->Fill(unique_pixels, DataParameter_DB_LMDB);
+  this->decode_threads_ = 3;
+  this->TestDeferTransform();
+}
+
 #endif  // USE_LMDB
 }  // namespace caffe
 #endif  // USE_OPENCV
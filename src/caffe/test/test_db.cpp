@@ -117,6 +117,45 @@ TYPED_TEST(DBTest, TestKeyValue) {
   EXPECT_FALSE(cursor->valid());
 }
 
+TYPED_TEST(DBTest, TestValueView) {
+  scoped_ptr<db::DB> db(db::GetDB(TypeParam::backend));
+  db->Open(this->source_, db::READ);
+  scoped_ptr<db::Cursor> cursor(db->NewCursor());
+  const char* data;
+  size_t size;
+  cursor->value_view(&data, &size);
+  const string first = cursor->value();
+  EXPECT_EQ(first, string(data, size));
+  cursor->Next();
+  const char* next_data;
+  size_t next_size;
+  cursor->value_view(&next_data, &next_size);
+  EXPECT_EQ(cursor->value(), string(next_data, next_size));
+  // Stable views outlive the cursor position they were taken at.
+  if (cursor->stable_values()) {
+    EXPECT_EQ(first, string(data, size));
+  }
+}
+
+TYPED_TEST(DBTest, TestSeek) {
+  scoped_ptr<db::DB> db(db::GetDB(TypeParam::backend));
+  db->Open(this->source_, db::READ);
+  scoped_ptr<db::Cursor> cursor(db->NewCursor());
+  cursor->Next();
+  const string key = cursor->key();
+  const string value = cursor->value();
+  cursor->SeekToFirst();
+  EXPECT_TRUE(cursor->Seek(key));
+  EXPECT_TRUE(cursor->valid());
+  EXPECT_EQ(key, cursor->key());
+  EXPECT_EQ(value, cursor->value());
+  EXPECT_TRUE(cursor->Seek("cat.jpg"));
+  EXPECT_EQ("cat.jpg", cursor->key());
+  cursor->Next();
+  EXPECT_EQ("fish-bike.jpg", cursor->key());
+  EXPECT_FALSE(cursor->Seek("dog.jpg"));
+}
+
 TYPED_TEST(DBTest, TestWrite) {
   scoped_ptr<db::DB> db(db::GetDB(TypeParam::backend));
   db->Open(this->source_, db::WRITE);
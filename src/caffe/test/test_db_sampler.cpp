@@ -0,0 +1,83 @@
+#include <algorithm>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "caffe/common.hpp"
+#include "caffe/util/db_sampler.hpp"
+
+#include "caffe/test/test_caffe_main.hpp"
+
+namespace caffe {
+
+class ShardedSamplerTest : public ::testing::Test {
+ protected:
+  ShardedSamplerTest() : num_keys_(7), seed_(1701) {}
+
+  // The samples of num_shards shards for epochs epochs, in global order.
+  vector<int> Draw(int num_shards, int epochs) {
+    vector<int> samples(num_keys_ * epochs);
+    for (int shard = 0; shard < num_shards; ++shard) {
+      db::ShardedSampler sampler(num_keys_, seed_, shard, num_shards);
+      for (int i = shard; i < samples.size(); i += num_shards) {
+        samples[i] = sampler.Next();
+      }
+    }
+    return samples;
+  }
+
+  const int num_keys_;
+  const uint32_t seed_;
+};
+
+TEST_F(ShardedSamplerTest, TestEpochs) {
+  const int epochs = 6;
+  vector<int> samples = Draw(1, epochs);
+  // Every epoch is a permutation of the keys, and they are not all the same.
+  bool changed = false;
+  for (int epoch = 0; epoch < epochs; ++epoch) {
+    vector<int> sorted(samples.begin() + epoch * num_keys_,
+        samples.begin() + (epoch + 1) * num_keys_);
+    if (epoch > 0) {
+      changed |= !std::equal(sorted.begin(), sorted.end(),
+          samples.begin() + (epoch - 1) * num_keys_);
+    }
+    std::sort(sorted.begin(), sorted.end());
+    for (int i = 0; i < num_keys_; ++i) {
+      EXPECT_EQ(i, sorted[i]) << "epoch " << epoch;
+    }
+  }
+  EXPECT_TRUE(changed);
+}
+
+TEST_F(ShardedSamplerTest, TestShards) {
+  // The shards together take the samples one shard would, whether or not
+  // the epochs divide between them.
+  const vector<int> samples = Draw(1, 6);
+  for (int num_shards = 2; num_shards <= 4; ++num_shards) {
+    const vector<int> shard_samples = Draw(num_shards, 6);
+    for (int i = 0; i < samples.size(); ++i) {
+      EXPECT_EQ(samples[i], shard_samples[i])
+          << "num_shards " << num_shards << " at " << i;
+    }
+  }
+}
+
+TEST_F(ShardedSamplerTest, TestSetOffset) {
+  db::ShardedSampler sampler(num_keys_, seed_, 1, 3);
+  vector<int> samples;
+  for (int i = 0; i < 4 * num_keys_; ++i) {
+    samples.push_back(sampler.Next());
+  }
+  EXPECT_EQ(4 * num_keys_, sampler.offset());
+  // A sampler set back to an offset draws the same samples from there.
+  for (int offset = 4 * num_keys_ - 1; offset >= 0; offset -= 5) {
+    db::ShardedSampler resumed(num_keys_, seed_, 1, 3);
+    resumed.set_offset(offset);
+    for (int i = offset; i < samples.size(); ++i) {
+      EXPECT_EQ(samples[i], resumed.Next()) << "offset " << offset;
+    }
+  }
+}
+
+}  // namespace caffe
@@ -0,0 +1,178 @@
+#include <string>
+#include <vector>
+
+#include "google/protobuf/text_format.h"
+
+#include "gtest/gtest.h"
+
+#include "caffe/common.hpp"
+#include "caffe/filler.hpp"
+#include "caffe/net.hpp"
+#include "caffe/util/fusion.hpp"
+
+#include "caffe/test/test_caffe_main.hpp"
+
+namespace caffe {
+
+template <typename TypeParam>
+class FusionTest : public MultiDeviceTest<TypeParam> {
+  typedef typename TypeParam::Dtype Dtype;
+
+ protected:
+  // Sets the weights of the layers of net that no filler initializes.
+  void FillStatistics(Net<Dtype>* net) {
+    FillerParameter filler_param;
+    filler_param.set_min(0.5);
+    filler_param.set_max(2);
+    UniformFiller<Dtype> uniform(filler_param);
+    GaussianFiller<Dtype> gaussian(filler_param);
+    for (int i = 0; i < net->layers().size(); ++i) {
+      const vector<shared_ptr<Blob<Dtype> > >& blobs =
+          net->layers()[i]->blobs();
+      const string type = net->layers()[i]->type();
+      if (type == "BatchNorm") {
+        // Statistics summed with a weight of 2.
+        gaussian.Fill(blobs[0].get());
+        uniform.Fill(blobs[1].get());
+        blobs[2]->mutable_cpu_data()[0] = 2;
+      } else if (type == "Scale") {
+        uniform.Fill(blobs[0].get());
+        if (blobs.size() > 1) {
+          gaussian.Fill(blobs[1].get());
+        }
+      }
+    }
+  }
+
+  // The layers of param with the weights of net.
+  void AddWeights(const Net<Dtype>& net, NetParameter* param) {
+    for (int i = 0; i < param->layer_size(); ++i) {
+      LayerParameter* layer_param = param->mutable_layer(i);
+      const vector<shared_ptr<Blob<Dtype> > >& blobs =
+          net.layer_by_name(layer_param->name())->blobs();
+      for (int j = 0; j < blobs.size(); ++j) {
+        blobs[j]->ToProto(layer_param->add_blobs());
+      }
+    }
+  }
+};
+
+TYPED_TEST_CASE(FusionTest, TestDtypesAndDevices);
+
+TYPED_TEST(FusionTest, TestFusedNetMatches) {
+  typedef typename TypeParam::Dtype Dtype;
+  const string proto =
+      "state { phase: TEST } "
+      "layer { name: 'data' type: 'Input' top: 'data' "
+      "  input_param { shape { dim: 2 dim: 3 dim: 6 dim: 5 } } } "
+      // Conv -> BatchNorm -> Scale -> ReLU, in place.
+      "layer { name: 'conv1' type: 'Convolution' bottom: 'data' top: 'conv1' "
+      "  convolution_param { num_output: 4 kernel_size: 3 pad: 1 "
+      "    weight_filler { type: 'gaussian' std: 0.5 } "
+      "    bias_filler { type: 'gaussian' std: 0.5 } } } "
+      "layer { name: 'bn1' type: 'BatchNorm' bottom: 'conv1' top: 'conv1' } "
+      "layer { name: 'scale1' type: 'Scale' bottom: 'conv1' top: 'conv1' "
+      "  scale_param { bias_term: true } } "
+      "layer { name: 'relu1' type: 'ReLU' bottom: 'conv1' top: 'conv1' "
+      "  relu_param { negative_slope: 0.1 } } "
+      // Conv without bias -> BatchNorm -> Swish, out of place.
+      "layer { name: 'conv2' type: 'Convolution' bottom: 'conv1' top: 'conv2' "
+      "  convolution_param { num_output: 4 kernel_size: 1 bias_term: false "
+      "    weight_filler { type: 'gaussian' std: 0.5 } } } "
+      "layer { name: 'bn2' type: 'BatchNorm' bottom: 'conv2' top: 'bn2' } "
+      "layer { name: 'swish2' type: 'Swish' bottom: 'bn2' top: 'swish2' } "
+      // InnerProduct -> Scale -> Clip.
+      "layer { name: 'ip' type: 'InnerProduct' bottom: 'swish2' top: 'ip' "
+      "  inner_product_param { num_output: 5 "
+      "    weight_filler { type: 'gaussian' std: 0.2 } } } "
+      "layer { name: 'scale3' type: 'Scale' bottom: 'ip' top: 'ip' } "
+      "layer { name: 'clip3' type: 'Clip' bottom: 'ip' top: 'ip' "
+      "  clip_param { min: -0.5 max: 0.5 } } "
+      // A BatchNorm whose bottom is also read later, which stays.
+      "layer { name: 'conv4' type: 'Convolution' bottom: 'data' top: 'conv4' "
+      "  convolution_param { num_output: 2 kernel_size: 1 "
+      "    weight_filler { type: 'gaussian' std: 0.5 } } } "
+      "layer { name: 'bn4' type: 'BatchNorm' bottom: 'conv4' top: 'bn4' } "
+      "layer { name: 'sum' type: 'Eltwise' bottom: 'conv4' bottom: 'bn4' "
+      "  top: 'sum' } ";
+  NetParameter param;
+  CHECK(google::protobuf::TextFormat::ParseFromString(proto, &param));
+  Net<Dtype> net(param);
+  this->FillStatistics(&net);
+  FillerParameter filler_param;
+  GaussianFiller<Dtype> filler(filler_param);
+  filler.Fill(net.input_blobs()[0]);
+  net.Forward();
+
+  this->AddWeights(net, &param);
+  NetParameter fused_param;
+  EXPECT_EQ(7, FuseNet(param, &fused_param));
+  ASSERT_EQ(param.layer_size() - 7, fused_param.layer_size());
+  EXPECT_EQ("conv1", fused_param.layer(1).name());
+  EXPECT_EQ(ActivationParameter_Type_RELU,
+      fused_param.layer(1).convolution_param().activation().type());
+  EXPECT_EQ("swish2", fused_param.layer(2).top(0));
+  EXPECT_TRUE(fused_param.layer(2).convolution_param().bias_term());
+  EXPECT_EQ(ActivationParameter_Type_CLIP,
+      fused_param.layer(3).inner_product_param().activation().type());
+  EXPECT_EQ("bn4", fused_param.layer(5).name());
+
+  Net<Dtype> fused_net(fused_param);
+  fused_net.input_blobs()[0]->CopyFrom(*net.input_blobs()[0]);
+  fused_net.Forward();
+  const char* outputs[] = {"ip", "sum"};
+  for (int i = 0; i < 2; ++i) {
+    const Blob<Dtype>& expected = *net.blob_by_name(outputs[i]);
+    const Blob<Dtype>& result = *fused_net.blob_by_name(outputs[i]);
+    ASSERT_EQ(expected.count(), result.count());
+    for (int j = 0; j < expected.count(); ++j) {
+      EXPECT_NEAR(expected.cpu_data()[j], result.cpu_data()[j], 1e-4);
+    }
+  }
+}
+
+TYPED_TEST(FusionTest, TestTrainingStatisticsAreNotFolded) {
+  const string proto =
+      "layer { name: 'data' type: 'Input' top: 'data' "
+      "  input_param { shape { dim: 2 dim: 3 } } } "
+      "layer { name: 'ip' type: 'InnerProduct' bottom: 'data' top: 'ip' "
+      "  inner_product_param { num_output: 3 } "
+      "  blobs { shape { dim: 3 dim: 3 } } blobs { shape { dim: 3 } } } "
+      "layer { name: 'bn' type: 'BatchNorm' bottom: 'ip' top: 'ip' "
+      "  batch_norm_param { use_global_stats: false } "
+      "  blobs { shape { dim: 3 } } blobs { shape { dim: 3 } } "
+      "  blobs { shape { dim: 1 } } } "
+      "layer { name: 'relu' type: 'ReLU' bottom: 'ip' top: 'ip' } ";
+  NetParameter param;
+  CHECK(google::protobuf::TextFormat::ParseFromString(proto, &param));
+  NetParameter fused_param;
+  EXPECT_EQ(0, FuseNet(param, &fused_param));
+  EXPECT_EQ(param.layer_size(), fused_param.layer_size());
+}
+
+TYPED_TEST(FusionTest, TestSharedWeightsAreNotFolded) {
+  const string proto =
+      "layer { name: 'data' type: 'Input' top: 'data' "
+      "  input_param { shape { dim: 2 dim: 3 } } } "
+      "layer { name: 'ip1' type: 'InnerProduct' bottom: 'data' top: 'ip1' "
+      "  param { name: 'w' } inner_product_param { num_output: 3 } "
+      "  blobs { shape { dim: 3 dim: 3 } } blobs { shape { dim: 3 } } } "
+      "layer { name: 'scale' type: 'Scale' bottom: 'ip1' top: 'ip1' "
+      "  blobs { shape { dim: 3 } data: 1 data: 2 data: 3 } } "
+      "layer { name: 'ip2' type: 'InnerProduct' bottom: 'data' top: 'ip2' "
+      "  param { name: 'w' } inner_product_param { num_output: 3 } "
+      "  blobs { shape { dim: 3 dim: 3 } } blobs { shape { dim: 3 } } } "
+      "layer { name: 'relu' type: 'ReLU' bottom: 'ip2' top: 'ip2' } ";
+  NetParameter param;
+  CHECK(google::protobuf::TextFormat::ParseFromString(proto, &param));
+  NetParameter fused_param;
+  // Only the activation, which leaves the weights as they are, is fused.
+  EXPECT_EQ(1, FuseNet(param, &fused_param));
+  ASSERT_EQ(4, fused_param.layer_size());
+  EXPECT_EQ("scale", fused_param.layer(2).name());
+  EXPECT_EQ(param.layer(1).DebugString(), fused_param.layer(1).DebugString());
+  EXPECT_EQ(ActivationParameter_Type_RELU,
+      fused_param.layer(3).inner_product_param().activation().type());
+}
+
+}  // namespace caffe
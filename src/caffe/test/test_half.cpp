@@ -0,0 +1,135 @@
+#include <stdint.h>
+#include <string.h>
+
+#include <cmath>
+#include <limits>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "caffe/common.hpp"
+#include "caffe/util/half.hpp"
+#include "caffe/util/rng.hpp"
+
+#include "caffe/test/test_caffe_main.hpp"
+
+namespace caffe {
+
+static float BitsFloat(uint32_t bits) {
+  float x;
+  memcpy(&x, &bits, sizeof(x));
+  return x;
+}
+
+static uint32_t FloatBits(float x) {
+  uint32_t bits;
+  memcpy(&bits, &x, sizeof(bits));
+  return bits;
+}
+
+class HalfTest : public ::testing::Test {};
+
+TEST_F(HalfTest, TestFloatToHalf) {
+  EXPECT_EQ(0x3c00, caffe_float_to_half(1));
+  EXPECT_EQ(0xc000, caffe_float_to_half(-2));
+  EXPECT_EQ(0x8000, caffe_float_to_half(-0.f));
+  EXPECT_EQ(0x3555, caffe_float_to_half(1.f / 3));
+  // The largest half, and the first value rounding to infinity.
+  EXPECT_EQ(0x7bff, caffe_float_to_half(65504));
+  EXPECT_EQ(0x7bff, caffe_float_to_half(65519.99f));
+  EXPECT_EQ(0x7c00, caffe_float_to_half(65520));
+  EXPECT_EQ(0xfc00, caffe_float_to_half(-1e30f));
+  EXPECT_EQ(0x7c00, caffe_float_to_half(
+      std::numeric_limits<float>::infinity()));
+  // Ties go to the even neighbour, in normals and denormals.
+  EXPECT_EQ(0x3c00, caffe_float_to_half(1 + std::ldexp(1.f, -11)));
+  EXPECT_EQ(0x3c02, caffe_float_to_half(1 + 3 * std::ldexp(1.f, -11)));
+  EXPECT_EQ(0x0001, caffe_float_to_half(std::ldexp(1.f, -24)));
+  EXPECT_EQ(0x0000, caffe_float_to_half(std::ldexp(1.f, -25)));
+  EXPECT_EQ(0x0002, caffe_float_to_half(3 * std::ldexp(1.f, -25)));
+  // The largest denormal rounds up to the smallest normal.
+  EXPECT_EQ(0x0400, caffe_float_to_half(std::ldexp(1.f, -14) -
+      std::ldexp(1.f, -26)));
+  const uint16_t nan =
+      caffe_float_to_half(std::numeric_limits<float>::quiet_NaN());
+  EXPECT_EQ(0x7c00, nan & 0x7c00);
+  EXPECT_NE(0, nan & 0x3ff);
+}
+
+TEST_F(HalfTest, TestHalfRoundTrip) {
+  for (uint32_t h = 0; h < 0x10000; ++h) {
+    const float x = caffe_half_to_float(h);
+    if ((h & 0x7c00) == 0x7c00 && (h & 0x3ff)) {
+      EXPECT_TRUE(std::isnan(x));
+    } else {
+      EXPECT_EQ(h, caffe_float_to_half(x));
+    }
+  }
+  EXPECT_EQ(std::ldexp(1.f, -24), caffe_half_to_float(0x0001));
+  EXPECT_EQ(65504, caffe_half_to_float(0x7bff));
+}
+
+TEST_F(HalfTest, TestFloatToBfloat16) {
+  EXPECT_EQ(0x3f80, caffe_float_to_bfloat16(1));
+  EXPECT_EQ(0x8000, caffe_float_to_bfloat16(-0.f));
+  EXPECT_EQ(0x3f80, caffe_float_to_bfloat16(1 + std::ldexp(1.f, -8)));
+  EXPECT_EQ(0x3f82, caffe_float_to_bfloat16(1 + 3 * std::ldexp(1.f, -8)));
+  EXPECT_EQ(0x3f81, caffe_float_to_bfloat16(1 + std::ldexp(1.f, -7)));
+  EXPECT_EQ(0x7f80, caffe_float_to_bfloat16(
+      std::numeric_limits<float>::max()));
+  EXPECT_TRUE(std::isnan(caffe_bfloat16_to_float(caffe_float_to_bfloat16(
+      std::numeric_limits<float>::quiet_NaN()))));
+  for (uint32_t h = 0; h < 0x10000; ++h) {
+    const float x = caffe_bfloat16_to_float(h);
+    EXPECT_EQ(h << 16, FloatBits(x));
+    if (!std::isnan(x)) {
+      EXPECT_EQ(h, caffe_float_to_bfloat16(x));
+    }
+  }
+}
+
+TEST_F(HalfTest, TestArraysMatchScalars) {
+  // Random bits, NaNs and denormals included, over lengths around the
+  // vector widths.
+  Caffe::set_random_seed(1701);
+  const int n = 1000;
+  vector<float> x(n);
+  for (int i = 0; i < n; ++i) {
+    x[i] = BitsFloat((*caffe_rng())());
+  }
+  const BlobStorage storages[] = {FLOAT16, BFLOAT16};
+  for (int s = 0; s < 2; ++s) {
+    for (int length = n - 20; length <= n; ++length) {
+      vector<uint16_t> h(length);
+      vector<float> y(length);
+      caffe_cpu_to_half(storages[s], length, &x[0], &h[0]);
+      caffe_cpu_from_half(storages[s], length, &h[0], &y[0]);
+      for (int i = 0; i < length; ++i) {
+        const uint16_t expected = storages[s] == FLOAT16 ?
+            caffe_float_to_half(x[i]) : caffe_float_to_bfloat16(x[i]);
+        const float expected_float = storages[s] == FLOAT16 ?
+            caffe_half_to_float(h[i]) : caffe_bfloat16_to_float(h[i]);
+        EXPECT_EQ(expected, h[i]) << "at " << i;
+        EXPECT_EQ(FloatBits(expected_float), FloatBits(y[i])) << "at " << i;
+      }
+    }
+  }
+}
+
+TEST_F(HalfTest, TestDoubles) {
+  const int n = 3000;
+  vector<double> x(n), y(n);
+  for (int i = 0; i < n; ++i) {
+    x[i] = (i - n / 2) / 7.;
+  }
+  vector<uint16_t> h(n);
+  caffe_cpu_to_half(FLOAT16, n, &x[0], &h[0]);
+  caffe_cpu_from_half(FLOAT16, n, &h[0], &y[0]);
+  for (int i = 0; i < n; ++i) {
+    EXPECT_EQ(caffe_float_to_half(x[i]), h[i]);
+    EXPECT_EQ(caffe_half_to_float(h[i]), y[i]);
+    EXPECT_NEAR(x[i], y[i], std::fabs(x[i]) * std::ldexp(1., -11));
+  }
+}
+
+}  // namespace caffe
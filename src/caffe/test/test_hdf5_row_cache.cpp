@@ -0,0 +1,92 @@
+#ifdef USE_HDF5
+#include <string>
+#include <vector>
+
+#include "hdf5.h"
+
+#include "gtest/gtest.h"
+
+#include "caffe/blob.hpp"
+#include "caffe/common.hpp"
+#include "caffe/util/hdf5.hpp"
+#include "caffe/util/hdf5_row_cache.hpp"
+
+#include "caffe/test/test_caffe_main.hpp"
+
+namespace caffe {
+
+template <typename Dtype>
+class HDF5RowCacheTest : public ::testing::Test {
+ protected:
+  HDF5RowCacheTest()
+      : filename_(ABS_TEST_DATA_DIR "/sample_data.h5") {}
+
+  virtual void SetUp() {
+    datasets_.push_back("data");
+    datasets_.push_back("label");
+    hid_t file_id = H5Fopen(filename_.c_str(), H5F_ACC_RDONLY, H5P_DEFAULT);
+    ASSERT_GE(file_id, 0) << "Failed to open HDF5 file " << filename_;
+    for (int d = 0; d < datasets_.size(); ++d) {
+      blobs_.push_back(shared_ptr<Blob<Dtype> >(new Blob<Dtype>()));
+      hdf5_load_nd_dataset(file_id, datasets_[d].c_str(), 1, 4,
+                           blobs_[d].get(), true);
+    }
+    H5Fclose(file_id);
+  }
+
+  // Checks that row of dataset d matches the whole dataset load.
+  void CheckRow(HDF5RowCache<Dtype>* cache, int d, int row) {
+    const int dim = blobs_[d]->count(1);
+    vector<Dtype> data(dim);
+    cache->CopyRow(d, row, data.data());
+    for (int i = 0; i < dim; ++i) {
+      EXPECT_EQ(blobs_[d]->cpu_data()[row * dim + i], data[i])
+          << "dataset " << d << " row " << row;
+    }
+  }
+
+  string filename_;
+  vector<string> datasets_;
+  vector<shared_ptr<Blob<Dtype> > > blobs_;
+};
+
+TYPED_TEST_CASE(HDF5RowCacheTest, TestDtypes);
+
+TYPED_TEST(HDF5RowCacheTest, TestShapes) {
+  HDF5RowCache<TypeParam> cache(this->filename_, this->datasets_, 4, 1 << 20);
+  ASSERT_EQ(2, cache.num_datasets());
+  for (int d = 0; d < 2; ++d) {
+    EXPECT_EQ(this->blobs_[d]->shape(), cache.shape(d));
+    EXPECT_EQ(this->blobs_[d]->count(1), cache.row_dim(d));
+  }
+  EXPECT_EQ(0, cache.hits() + cache.misses());
+}
+
+TYPED_TEST(HDF5RowCacheTest, TestReadAllRows) {
+  // Chunks of 3 rows do not divide the 10 rows of the file.
+  HDF5RowCache<TypeParam> cache(this->filename_, this->datasets_, 3, 1 << 20);
+  for (int d = 0; d < 2; ++d) {
+    for (int row = cache.num_rows(d) - 1; row >= 0; --row) {
+      this->CheckRow(&cache, d, row);
+    }
+  }
+  EXPECT_EQ(8, cache.misses());
+  EXPECT_EQ(12, cache.hits());
+}
+
+TYPED_TEST(HDF5RowCacheTest, TestEviction) {
+  // Room for a single chunk of data rows.
+  const size_t chunk_bytes = 2 * sizeof(TypeParam) * this->blobs_[0]->count(1);
+  HDF5RowCache<TypeParam> cache(this->filename_, this->datasets_, 2,
+                                chunk_bytes);
+  this->CheckRow(&cache, 0, 0);
+  this->CheckRow(&cache, 0, 1);
+  EXPECT_EQ(1, cache.misses());
+  this->CheckRow(&cache, 0, 9);
+  this->CheckRow(&cache, 0, 0);
+  EXPECT_EQ(3, cache.misses());
+  EXPECT_EQ(1, cache.hits());
+}
+
+}  // namespace caffe
+#endif  // USE_HDF5
@@ -49,5 +49,26 @@ TEST_F(InternalThreadTest, TestRandomSeed) {
   t3.StopInternalThread();
 }
 
+class TestThreadCpuThreads : public InternalThread {
+ public:
+  TestThreadCpuThreads() : cpu_threads_(0) {}
+  int cpu_threads_;
+
+ protected:
+  void InternalThreadEntry() {
+    cpu_threads_ = Caffe::cpu_threads();
+  }
+};
+
+TEST_F(InternalThreadTest, TestCpuThreads) {
+  const int cpu_threads = Caffe::cpu_threads();
+  Caffe::set_cpu_threads(3);
+  TestThreadCpuThreads t;
+  t.StartInternalThread();
+  t.StopInternalThread();
+  EXPECT_EQ(3, t.cpu_threads_);
+  Caffe::set_cpu_threads(cpu_threads);
+}
+
 }  // namespace caffe
 
@@ -1,6 +1,9 @@
 #include <stdint.h>  // for uint32_t & uint64_t
 #include <time.h>
+#include <algorithm>
 #include <cmath>  // for std::fabs
+#include <limits>
+#include <vector>
 
 #include "gtest/gtest.h"
 
@@ -119,6 +122,115 @@ TYPED_TEST(CPUMathFunctionsTest, TestCopy) {
   }
 }
 
+TYPED_TEST(CPUMathFunctionsTest, TestMax) {
+  const int n = this->blob_bottom_->count();
+  const TypeParam* a = this->blob_bottom_->cpu_data();
+  const TypeParam* b = this->blob_top_->cpu_data();
+  caffe_max<TypeParam>(n, a, b, this->blob_bottom_->mutable_cpu_diff());
+  const TypeParam* y = this->blob_bottom_->cpu_diff();
+  for (int i = 0; i < n; ++i) {
+    EXPECT_EQ(y[i], std::max(a[i], b[i]));
+  }
+}
+
+TYPED_TEST(CPUMathFunctionsTest, TestMaxN) {
+  // Inputs are the 11 slices of the bottom and top blobs, and the output
+  // overwrites one of them.
+  const int num = this->blob_bottom_->num();
+  const int n = this->blob_bottom_->count(1);
+  vector<const TypeParam*> x;
+  for (int k = 0; k < num; ++k) {
+    x.push_back(this->blob_bottom_->cpu_data() + this->blob_bottom_->offset(k));
+    x.push_back(this->blob_top_->cpu_data() + this->blob_top_->offset(k));
+  }
+  vector<TypeParam> expected(x[0], x[0] + n);
+  for (int j = 1; j < x.size(); ++j) {
+    for (int i = 0; i < n; ++i) {
+      expected[i] = std::max(expected[i], x[j][i]);
+    }
+  }
+  TypeParam* y = this->blob_top_->mutable_cpu_data();
+  caffe_max<TypeParam>(n, x.size(), x.data(), y);
+  for (int i = 0; i < n; ++i) {
+    EXPECT_EQ(expected[i], y[i]);
+  }
+  caffe_max<TypeParam>(n, 1, x.data() + 2, y);
+  for (int i = 0; i < n; ++i) {
+    EXPECT_EQ(x[2][i], y[i]);
+  }
+}
+
+TYPED_TEST(CPUMathFunctionsTest, TestMaxSpecialValues) {
+  // The vector kernels and the scalar tails agree that the first input is
+  // taken only where it is greater, for NaNs and signed zeros too.
+  const TypeParam values[] = {std::numeric_limits<TypeParam>::quiet_NaN(),
+      TypeParam(0), -TypeParam(0), TypeParam(1), TypeParam(-1)};
+  const int n = 75;
+  vector<TypeParam> a(n), b(n), y(n), y_n(n);
+  for (int i = 0; i < n; ++i) {
+    a[i] = values[i % 5];
+    b[i] = values[i / 5 % 5];
+  }
+  caffe_max<TypeParam>(n, a.data(), b.data(), y.data());
+  const TypeParam* x[] = {a.data(), b.data(), a.data()};
+  caffe_max<TypeParam>(n, 3, x, y_n.data());
+  for (int i = 0; i < n; ++i) {
+    const TypeParam expected = a[i] > b[i] ? a[i] : b[i];
+    const TypeParam expected_n = expected > a[i] ? expected : a[i];
+    EXPECT_EQ(std::isnan(expected), std::isnan(y[i])) << "at " << i;
+    EXPECT_EQ(std::isnan(expected_n), std::isnan(y_n[i])) << "at " << i;
+    if (!std::isnan(expected)) {
+      EXPECT_EQ(expected, y[i]);
+      EXPECT_EQ(std::signbit(expected), std::signbit(y[i])) << "at " << i;
+    }
+    if (!std::isnan(expected_n)) {
+      EXPECT_EQ(expected_n, y_n[i]);
+      EXPECT_EQ(std::signbit(expected_n), std::signbit(y_n[i]))
+          << "at " << i;
+    }
+  }
+}
+
+TYPED_TEST(CPUMathFunctionsTest, TestPackOccupancy) {
+  // The count is not a multiple of 8, so the last byte is partial.
+  const int n = this->blob_bottom_->count();
+  TypeParam* x = this->blob_bottom_->mutable_cpu_data();
+  caffe_rng_uniform<TypeParam>(n, 0, 1, x);
+  TypeParam* y = this->blob_top_->mutable_cpu_data();
+  vector<uint8_t> packed(n);
+  caffe_pack_occupancy<TypeParam>(n, 1, x, packed.data());
+  caffe_unpack_occupancy<TypeParam>(n, 1, packed.data(), y);
+  for (int i = 0; i < n; ++i) {
+    EXPECT_EQ(x[i] >= 0.5 ? 1 : 0, y[i]);
+  }
+  caffe_pack_occupancy<TypeParam>(n, 8, x, packed.data());
+  caffe_unpack_occupancy<TypeParam>(n, 8, packed.data(), y);
+  for (int i = 0; i < n; ++i) {
+    EXPECT_NEAR(x[i], y[i], 0.5 / 255 + 1e-6);
+  }
+}
+
+TYPED_TEST(CPUMathFunctionsTest, TestUnpackOccupancyBytes) {
+  // Every byte, and a partial vector at the end, against the scalar
+  // definitions exactly.
+  const int bytes = 261;
+  vector<uint8_t> x(bytes);
+  for (int b = 0; b < bytes; ++b) {
+    x[b] = b % 256;
+  }
+  vector<TypeParam> y(8 * bytes);
+  const int n = 8 * bytes - 3;
+  caffe_unpack_occupancy<TypeParam>(n, 1, x.data(), y.data());
+  for (int i = 0; i < n; ++i) {
+    EXPECT_EQ((x[i / 8] >> (i % 8)) & 1, y[i]) << "at " << i;
+  }
+  caffe_unpack_occupancy<TypeParam>(bytes, 8, x.data(), y.data());
+  const TypeParam scale = TypeParam(1) / 255;
+  for (int b = 0; b < bytes; ++b) {
+    EXPECT_EQ(x[b] * scale, y[b]) << "at " << b;
+  }
+}
+
 #ifndef CPU_ONLY
 
 template <typename Dtype>
@@ -172,6 +284,71 @@ TYPED_TEST(GPUMathFunctionsTest, TestFabs) {
   }
 }
 
+TYPED_TEST(GPUMathFunctionsTest, TestMax) {
+  int n = this->blob_bottom_->count();
+  caffe_gpu_max<TypeParam>(n, this->blob_bottom_->gpu_data(),
+                           this->blob_top_->gpu_data(),
+                           this->blob_bottom_->mutable_gpu_diff());
+  const TypeParam* y = this->blob_bottom_->cpu_diff();
+  const TypeParam* a = this->blob_bottom_->cpu_data();
+  const TypeParam* b = this->blob_top_->cpu_data();
+  for (int i = 0; i < n; ++i) {
+    EXPECT_EQ(y[i], std::max(a[i], b[i]));
+  }
+}
+
+TYPED_TEST(GPUMathFunctionsTest, TestMaxN) {
+  // The 22 inputs take two passes, and the output overwrites the last one,
+  // which a pass after the first would read.
+  const int num = this->blob_bottom_->num();
+  const int n = this->blob_bottom_->count(1);
+  vector<const TypeParam*> x;
+  for (int k = 0; k < num; ++k) {
+    x.push_back(this->blob_bottom_->gpu_data() + this->blob_bottom_->offset(k));
+    x.push_back(this->blob_top_->gpu_data() + this->blob_top_->offset(k));
+  }
+  const TypeParam* bottom_data = this->blob_bottom_->cpu_data();
+  const TypeParam* top_data = this->blob_top_->cpu_data();
+  vector<TypeParam> expected(bottom_data, bottom_data + n);
+  for (int k = 0; k < num; ++k) {
+    for (int i = 0; i < n; ++i) {
+      expected[i] = std::max(expected[i],
+          bottom_data[this->blob_bottom_->offset(k) + i]);
+      expected[i] = std::max(expected[i],
+          top_data[this->blob_top_->offset(k) + i]);
+    }
+  }
+  const int last = this->blob_top_->offset(num - 1);
+  caffe_gpu_max<TypeParam>(n, x.size(), x.data(),
+      this->blob_top_->mutable_gpu_data() + last);
+  const TypeParam* y = this->blob_top_->cpu_data() + last;
+  for (int i = 0; i < n; ++i) {
+    EXPECT_EQ(expected[i], y[i]);
+  }
+}
+
+TYPED_TEST(GPUMathFunctionsTest, TestUnpackOccupancy) {
+  const int n = this->blob_bottom_->count();
+  TypeParam* x = this->blob_bottom_->mutable_cpu_data();
+  caffe_rng_uniform<TypeParam>(n, 0, 1, x);
+  SyncedMemory packed(n);
+  for (int bits = 1; bits <= 8; bits += 7) {
+    caffe_pack_occupancy<TypeParam>(n, bits, x,
+        static_cast<uint8_t*>(packed.mutable_cpu_data()));
+    caffe_unpack_occupancy<TypeParam>(n, bits,
+        static_cast<const uint8_t*>(packed.cpu_data()),
+        this->blob_bottom_->mutable_cpu_diff());
+    caffe_gpu_unpack_occupancy<TypeParam>(n, bits,
+        static_cast<const uint8_t*>(packed.gpu_data()),
+        this->blob_top_->mutable_gpu_data());
+    const TypeParam* expected = this->blob_bottom_->cpu_diff();
+    const TypeParam* y = this->blob_top_->cpu_data();
+    for (int i = 0; i < n; ++i) {
+      EXPECT_EQ(expected[i], y[i]);
+    }
+  }
+}
+
 TYPED_TEST(GPUMathFunctionsTest, TestScale) {
   int n = this->blob_bottom_->count();
   TypeParam alpha = this->blob_bottom_->cpu_diff()[caffe_rng_rand() %
@@ -839,6 +839,355 @@ class NetTest : public MultiDeviceTest<TypeParam> {
     InitNetFromProtoFileWithState(proto, phase, level, stages);
   }
 
+  virtual void InitPlannedNet(const string& plan) {
+    // ip1 stays live until 'sum' while ip2, ip3 and ip4 are computed in turn.
+    const string& proto =
+        "name: 'PlannedNetwork' "
+        "state { phase: TEST } " + plan +
+        "layer { "
+        "  name: 'data' "
+        "  type: 'Input' "
+        "  top: 'data' "
+        "  input_param { "
+        "    shape: { dim: 2 dim: 10 } "
+        "  } "
+        "} "
+        "layer { "
+        "  name: 'ip1' "
+        "  type: 'InnerProduct' "
+        "  bottom: 'data' "
+        "  top: 'ip1' "
+        "  inner_product_param { "
+        "    num_output: 10 "
+        "    weight_filler { "
+        "      type: 'gaussian' "
+        "      std: 0.1 "
+        "    } "
+        "  } "
+        "} "
+        "layer { "
+        "  name: 'relu1' "
+        "  type: 'ReLU' "
+        "  bottom: 'ip1' "
+        "  top: 'ip1' "
+        "} "
+        "layer { "
+        "  name: 'ip2' "
+        "  type: 'InnerProduct' "
+        "  bottom: 'ip1' "
+        "  top: 'ip2' "
+        "  inner_product_param { "
+        "    num_output: 10 "
+        "    weight_filler { "
+        "      type: 'gaussian' "
+        "      std: 0.1 "
+        "    } "
+        "  } "
+        "} "
+        "layer { "
+        "  name: 'ip3' "
+        "  type: 'InnerProduct' "
+        "  bottom: 'ip2' "
+        "  top: 'ip3' "
+        "  inner_product_param { "
+        "    num_output: 10 "
+        "    weight_filler { "
+        "      type: 'gaussian' "
+        "      std: 0.1 "
+        "    } "
+        "  } "
+        "} "
+        "layer { "
+        "  name: 'ip4' "
+        "  type: 'InnerProduct' "
+        "  bottom: 'ip3' "
+        "  top: 'ip4' "
+        "  inner_product_param { "
+        "    num_output: 10 "
+        "    weight_filler { "
+        "      type: 'gaussian' "
+        "      std: 0.1 "
+        "    } "
+        "  } "
+        "} "
+        "layer { "
+        "  name: 'sum' "
+        "  type: 'Eltwise' "
+        "  bottom: 'ip1' "
+        "  bottom: 'ip4' "
+        "  top: 'sum' "
+        "} ";
+    InitNetFromProtoString(proto);
+  }
+
+  virtual void InitCheckpointNet(const string& checkpoints) {
+    // With checkpoints at relu1 and ip4, the second segment recomputes ip2,
+    // sig2 and ip3 but not the Dropout, and the third one ip5 and sig5.
+    const string& proto =
+        "name: 'CheckpointNetwork' "
+        "state { phase: TRAIN } " + checkpoints +
+        "layer { "
+        "  name: 'data' "
+        "  type: 'DummyData' "
+        "  top: 'data' "
+        "  top: 'target' "
+        "  dummy_data_param { "
+        "    shape { dim: 2 dim: 10 } "
+        "    shape { dim: 2 dim: 4 } "
+        "    data_filler { "
+        "      type: 'gaussian' "
+        "    } "
+        "  } "
+        "} "
+        "layer { "
+        "  name: 'ip1' "
+        "  type: 'InnerProduct' "
+        "  bottom: 'data' "
+        "  top: 'ip1' "
+        "  inner_product_param { "
+        "    num_output: 8 "
+        "    weight_filler { "
+        "      type: 'gaussian' "
+        "      std: 0.1 "
+        "    } "
+        "  } "
+        "} "
+        "layer { "
+        "  name: 'relu1' "
+        "  type: 'ReLU' "
+        "  bottom: 'ip1' "
+        "  top: 'ip1' "
+        "} "
+        "layer { "
+        "  name: 'ip2' "
+        "  type: 'InnerProduct' "
+        "  bottom: 'ip1' "
+        "  top: 'ip2' "
+        "  inner_product_param { "
+        "    num_output: 8 "
+        "    weight_filler { "
+        "      type: 'gaussian' "
+        "      std: 0.1 "
+        "    } "
+        "  } "
+        "} "
+        "layer { "
+        "  name: 'sig2' "
+        "  type: 'Sigmoid' "
+        "  bottom: 'ip2' "
+        "  top: 'sig2' "
+        "} "
+        "layer { "
+        "  name: 'ip3' "
+        "  type: 'InnerProduct' "
+        "  bottom: 'sig2' "
+        "  top: 'ip3' "
+        "  inner_product_param { "
+        "    num_output: 8 "
+        "    weight_filler { "
+        "      type: 'gaussian' "
+        "      std: 0.1 "
+        "    } "
+        "  } "
+        "} "
+        "layer { "
+        "  name: 'drop3' "
+        "  type: 'Dropout' "
+        "  bottom: 'ip3' "
+        "  top: 'drop3' "
+        "} "
+        "layer { "
+        "  name: 'ip4' "
+        "  type: 'InnerProduct' "
+        "  bottom: 'drop3' "
+        "  top: 'ip4' "
+        "  inner_product_param { "
+        "    num_output: 8 "
+        "    weight_filler { "
+        "      type: 'gaussian' "
+        "      std: 0.1 "
+        "    } "
+        "  } "
+        "} "
+        "layer { "
+        "  name: 'ip5' "
+        "  type: 'InnerProduct' "
+        "  bottom: 'ip4' "
+        "  top: 'ip5' "
+        "  inner_product_param { "
+        "    num_output: 4 "
+        "    weight_filler { "
+        "      type: 'gaussian' "
+        "      std: 0.1 "
+        "    } "
+        "  } "
+        "} "
+        "layer { "
+        "  name: 'sig5' "
+        "  type: 'Sigmoid' "
+        "  bottom: 'ip5' "
+        "  top: 'sig5' "
+        "} "
+        "layer { "
+        "  name: 'loss' "
+        "  type: 'EuclideanLoss' "
+        "  bottom: 'sig5' "
+        "  bottom: 'target' "
+        "  top: 'loss' "
+        "} ";
+    InitNetFromProtoString(proto);
+  }
+
+  virtual void InitMultiBranchNet(const string& threads) {
+    // Three branches from the data, two of them sharing their parameters and
+    // one with Dropout, summed before the loss.
+    const string& proto =
+        "name: 'MultiBranchNetwork' "
+        "state { phase: TRAIN } " + threads +
+        "layer { "
+        "  name: 'data' "
+        "  type: 'DummyData' "
+        "  top: 'data' "
+        "  top: 'target' "
+        "  dummy_data_param { "
+        "    shape { dim: 2 dim: 10 } "
+        "    shape { dim: 2 dim: 6 } "
+        "    data_filler { "
+        "      type: 'gaussian' "
+        "    } "
+        "  } "
+        "} "
+        "layer { "
+        "  name: 'a' "
+        "  type: 'InnerProduct' "
+        "  bottom: 'data' "
+        "  top: 'a' "
+        "  param { name: 'shared_weights' } "
+        "  param { name: 'shared_bias' } "
+        "  inner_product_param { "
+        "    num_output: 6 "
+        "    weight_filler { "
+        "      type: 'gaussian' "
+        "      std: 0.1 "
+        "    } "
+        "    bias_filler { "
+        "      type: 'gaussian' "
+        "      std: 0.1 "
+        "    } "
+        "  } "
+        "} "
+        "layer { "
+        "  name: 'relu_a' "
+        "  type: 'ReLU' "
+        "  bottom: 'a' "
+        "  top: 'a' "
+        "} "
+        "layer { "
+        "  name: 'b' "
+        "  type: 'InnerProduct' "
+        "  bottom: 'data' "
+        "  top: 'b' "
+        "  inner_product_param { "
+        "    num_output: 6 "
+        "    weight_filler { "
+        "      type: 'gaussian' "
+        "      std: 0.1 "
+        "    } "
+        "    bias_filler { "
+        "      type: 'gaussian' "
+        "      std: 0.1 "
+        "    } "
+        "  } "
+        "} "
+        "layer { "
+        "  name: 'drop_b' "
+        "  type: 'Dropout' "
+        "  bottom: 'b' "
+        "  top: 'drop_b' "
+        "} "
+        "layer { "
+        "  name: 'c' "
+        "  type: 'InnerProduct' "
+        "  bottom: 'data' "
+        "  top: 'c' "
+        "  param { name: 'shared_weights' } "
+        "  param { name: 'shared_bias' } "
+        "  inner_product_param { "
+        "    num_output: 6 "
+        "    weight_filler { "
+        "      type: 'gaussian' "
+        "      std: 0.1 "
+        "    } "
+        "    bias_filler { "
+        "      type: 'gaussian' "
+        "      std: 0.1 "
+        "    } "
+        "  } "
+        "} "
+        "layer { "
+        "  name: 'sig_c' "
+        "  type: 'Sigmoid' "
+        "  bottom: 'c' "
+        "  top: 'c' "
+        "} "
+        "layer { "
+        "  name: 'sum' "
+        "  type: 'Eltwise' "
+        "  bottom: 'a' "
+        "  bottom: 'drop_b' "
+        "  bottom: 'c' "
+        "  top: 'sum' "
+        "} "
+        "layer { "
+        "  name: 'out' "
+        "  type: 'InnerProduct' "
+        "  bottom: 'sum' "
+        "  top: 'out' "
+        "  inner_product_param { "
+        "    num_output: 6 "
+        "    weight_filler { "
+        "      type: 'gaussian' "
+        "      std: 0.1 "
+        "    } "
+        "    bias_filler { "
+        "      type: 'gaussian' "
+        "      std: 0.1 "
+        "    } "
+        "  } "
+        "} "
+        "layer { "
+        "  name: 'loss' "
+        "  type: 'EuclideanLoss' "
+        "  bottom: 'out' "
+        "  bottom: 'target' "
+        "  top: 'loss' "
+        "} ";
+    InitNetFromProtoString(proto);
+  }
+
+  // Runs pass iter of ForwardBackward on reference and on net_, with the same
+  // seed so that they see the same data and Dropout masks, and expects the
+  // same loss and learnable parameter diffs, within tolerance relative to the
+  // loss and to the mean absolute diff of each parameter (0: exactly).
+  virtual void ExpectSameForwardBackward(Net<Dtype>* reference,
+      const int iter, const Dtype tolerance) {
+    Caffe::set_random_seed(seed_ + iter);
+    const Dtype loss = reference->ForwardBackward();
+    Caffe::set_random_seed(seed_ + iter);
+    EXPECT_NEAR(loss, net_->ForwardBackward(), tolerance * loss);
+    const vector<Blob<Dtype>*>& params = reference->learnable_params();
+    const vector<Blob<Dtype>*>& net_params = net_->learnable_params();
+    ASSERT_EQ(params.size(), net_params.size());
+    for (int i = 0; i < params.size(); ++i) {
+      const Dtype param_tolerance = tolerance == 0 ? 0 :
+          tolerance * params[i]->asum_diff() / params[i]->count() + 1e-6;
+      for (int j = 0; j < params[i]->count(); ++j) {
+        EXPECT_NEAR(params[i]->cpu_diff()[j], net_params[i]->cpu_diff()[j],
+                    param_tolerance) << "param " << i << " at " << j;
+      }
+    }
+  }
+
   int seed_;
   shared_ptr<Net<Dtype> > net_;
 };
@@ -2601,4 +2950,149 @@ TYPED_TEST(NetTest, TestAllInOneNetDeploy) {
   ASSERT_TRUE(found_data);
 }
 
+// The memory activations are computed in, on the device in GPU mode.
+template <typename Dtype>
+static const void* ActivationMemory(const Net<Dtype>& net,
+    const string& blob_name) {
+  const Blob<Dtype>& blob = *net.blob_by_name(blob_name);
+  return Caffe::mode() == Caffe::GPU ? static_cast<const void*>(
+      blob.gpu_data()) : static_cast<const void*>(blob.cpu_data());
+}
+
+TYPED_TEST(NetTest, TestPlanMemory) {
+  typedef typename TypeParam::Dtype Dtype;
+  FillerParameter filler_param;
+  filler_param.set_std(1);
+  GaussianFiller<Dtype> filler(filler_param);
+  vector<int> shape(2);
+  shape[0] = 2;
+  shape[1] = 10;
+  Blob<Dtype> data(shape);
+  filler.Fill(&data);
+  Blob<Dtype> expected;
+  for (int planned = 0; planned < 2; ++planned) {
+    Caffe::set_random_seed(this->seed_);
+    this->InitPlannedNet(planned ? "plan_memory: true " : "");
+    this->net_->input_blobs()[0]->CopyFrom(data);
+    const Blob<Dtype>* sum = this->net_->Forward()[0];
+    if (!planned) {
+      EXPECT_EQ(0, this->net_->planned_memory());
+      expected.CopyFrom(*sum, false, true);
+      continue;
+    }
+    for (int i = 0; i < sum->count(); ++i) {
+      EXPECT_EQ(expected.cpu_data()[i], sum->cpu_data()[i]);
+    }
+  }
+  // ip2 and ip4 are never live at the same time, the other activations are.
+  const Net<Dtype>& net = *this->net_;
+  EXPECT_EQ(ActivationMemory(net, "ip2"), ActivationMemory(net, "ip4"));
+  EXPECT_NE(ActivationMemory(net, "ip1"), ActivationMemory(net, "ip2"));
+  EXPECT_NE(ActivationMemory(net, "ip1"), ActivationMemory(net, "ip3"));
+  EXPECT_NE(ActivationMemory(net, "ip3"), ActivationMemory(net, "ip4"));
+  // Each activation takes one aligned 256 byte slot: ip4 reuses the slot of
+  // ip2.
+  EXPECT_EQ(3 * 256, net.planned_memory());
+}
+
+TYPED_TEST(NetTest, TestPlanMemoryPinnedBlob) {
+  typedef typename TypeParam::Dtype Dtype;
+  this->InitPlannedNet("plan_memory: true pinned_blob: 'ip2' ");
+  this->net_->Forward();
+  const Net<Dtype>& net = *this->net_;
+  // The pinned blob, the input and the output keep their own memory.
+  const char* kActivations[] = {"ip1", "ip3", "ip4"};
+  const char* kPinned[] = {"ip2", "data", "sum"};
+  for (int i = 0; i < 3; ++i) {
+    for (int j = 0; j < 3; ++j) {
+      EXPECT_NE(ActivationMemory(net, kPinned[i]),
+                ActivationMemory(net, kActivations[j]));
+    }
+  }
+}
+
+TYPED_TEST(NetTest, TestPlanMemoryReshapeKeepsHeldMemory) {
+  typedef typename TypeParam::Dtype Dtype;
+  this->InitPlannedNet("plan_memory: true ");
+  FillerParameter filler_param;
+  filler_param.set_std(1);
+  GaussianFiller<Dtype> filler(filler_param);
+  filler.Fill(this->net_->input_blobs()[0]);
+  this->net_->Forward();
+  Blob<Dtype> expected;
+  expected.CopyFrom(*this->net_->blob_by_name("ip3"), false, true);
+  shared_ptr<SyncedMemory> held = this->net_->blob_by_name("ip3")->data();
+  const void* planned = ActivationMemory(*this->net_, "ip3");
+  // A larger batch gives ip3 new memory, and the arena the held memory was
+  // placed in is released by the new plan: it must have moved out of it.
+  vector<int> shape(2);
+  shape[0] = 4;
+  shape[1] = 10;
+  this->net_->input_blobs()[0]->Reshape(shape);
+  this->net_->Reshape();
+  const void* kept = Caffe::mode() == Caffe::GPU ? held->gpu_data() :
+      held->cpu_data();
+  EXPECT_NE(planned, kept);
+  filler.Fill(this->net_->input_blobs()[0]);
+  this->net_->Forward();
+  const Dtype* data = static_cast<const Dtype*>(held->cpu_data());
+  for (int i = 0; i < expected.count(); ++i) {
+    EXPECT_EQ(expected.cpu_data()[i], data[i]);
+  }
+}
+
+TYPED_TEST(NetTest, TestCheckpoint) {
+  typedef typename TypeParam::Dtype Dtype;
+  Caffe::set_random_seed(this->seed_);
+  this->InitCheckpointNet("");
+  shared_ptr<Net<Dtype> > net = this->net_;
+  EXPECT_EQ(0, net->planned_memory());
+  Caffe::set_random_seed(this->seed_);
+  this->InitCheckpointNet(
+      "checkpoint_layer: 'relu1' checkpoint_layer: 'ip4' ");
+  // ip2, sig2 and ip3, data and diff, take one aligned 256 byte slot each;
+  // ip5 and sig5 then reuse the slots of ip2 and sig2.
+  EXPECT_EQ(6 * 256, this->net_->planned_memory());
+  for (int iter = 0; iter < 2; ++iter) {
+    this->ExpectSameForwardBackward(net.get(), iter, 0);
+  }
+}
+
+TYPED_TEST(NetTest, TestParallelLayers) {
+  typedef typename TypeParam::Dtype Dtype;
+  Caffe::set_random_seed(this->seed_);
+  this->InitMultiBranchNet("");
+  shared_ptr<Net<Dtype> > net = this->net_;
+  Caffe::set_random_seed(this->seed_);
+  this->InitMultiBranchNet("layer_threads: 4 ");
+  for (int iter = 0; iter < 3; ++iter) {
+    this->ExpectSameForwardBackward(net.get(), iter, 0);
+    const Blob<Dtype>& sum = *net->blob_by_name("sum");
+    const Blob<Dtype>& parallel_sum = *this->net_->blob_by_name("sum");
+    for (int i = 0; i < sum.count(); ++i) {
+      EXPECT_EQ(sum.cpu_data()[i], parallel_sum.cpu_data()[i]);
+    }
+  }
+}
+
+TYPED_TEST(NetTest, TestActivationStorage) {
+  typedef typename TypeParam::Dtype Dtype;
+  Caffe::set_random_seed(this->seed_);
+  this->InitCheckpointNet("");
+  shared_ptr<Net<Dtype> > net = this->net_;
+  Caffe::set_random_seed(this->seed_);
+  this->InitCheckpointNet("activation_storage: FLOAT16 ");
+  for (int iter = 0; iter < 2; ++iter) {
+    // Activations read after they are idle are rounded to 11 bits.
+    this->ExpectSameForwardBackward(net.get(), iter, 1e-2);
+    // Between passes, in CPU mode, the activations are held in 16 bits,
+    // but not the outputs.
+    EXPECT_EQ(Caffe::mode() == Caffe::CPU,
+              this->net_->blob_by_name("ip2")->data()->compressed());
+    EXPECT_EQ(Caffe::mode() == Caffe::CPU,
+              this->net_->blob_by_name("target")->data()->compressed());
+    EXPECT_FALSE(this->net_->blob_by_name("loss")->data()->compressed());
+  }
+}
+
 }  // namespace caffe
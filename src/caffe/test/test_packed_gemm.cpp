@@ -0,0 +1,162 @@
+#include <algorithm>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "caffe/blob.hpp"
+#include "caffe/filler.hpp"
+#include "caffe/util/blas_backend.hpp"
+#include "caffe/util/math_functions.hpp"
+#include "caffe/util/packed_gemm.hpp"
+
+#include "caffe/test/test_caffe_main.hpp"
+
+namespace caffe {
+
+template <typename Dtype>
+class PackedGemmTest : public ::testing::Test {
+ protected:
+  virtual ~PackedGemmTest() {
+    caffe_set_blas_backend("linked");
+  }
+
+  void Fill(Blob<Dtype>* blob, int count) {
+    vector<int> shape(1, count);
+    blob->Reshape(shape);
+    FillerParameter filler_param;
+    filler_param.set_min(-1);
+    filler_param.set_max(1);
+    UniformFiller<Dtype> filler(filler_param);
+    filler.Fill(blob);
+  }
+
+  // C = 1.5 * op(A) * op(B) + beta * C of the linked cblas, into expected.
+  void Reference(CBLAS_TRANSPOSE trans_a, CBLAS_TRANSPOSE trans_b, int M,
+      int N, int K, Dtype beta) {
+    Fill(&a_, M * K);
+    Fill(&b_, K * N);
+    Fill(&c_, M * N);
+    expected_.ReshapeLike(c_);
+    caffe_copy(c_.count(), c_.cpu_data(), expected_.mutable_cpu_data());
+    caffe_set_blas_backend("linked");
+    caffe_cpu_gemm<Dtype>(trans_a, trans_b, M, N, K, Dtype(1.5),
+        a_.cpu_data(), b_.cpu_data(), beta, expected_.mutable_cpu_data());
+  }
+
+  void Check(int K) {
+    const Dtype tolerance = (sizeof(Dtype) == 4 ? 1e-5 : 1e-12) * (K + 1);
+    for (int i = 0; i < c_.count(); ++i) {
+      EXPECT_NEAR(expected_.cpu_data()[i], c_.cpu_data()[i], tolerance)
+          << "at " << i;
+    }
+  }
+
+  Blob<Dtype> a_, b_, c_, expected_;
+};
+
+TYPED_TEST_CASE(PackedGemmTest, TestDtypes);
+
+// Sizes around the register tiles and past the K and N blocks.
+static const int kGemmShapes[][3] = {
+  {1, 1, 1}, {3, 5, 7}, {4, 16, 8}, {9, 33, 300}, {17, 1030, 20}, {64, 2, 513}
+};
+
+TYPED_TEST(PackedGemmTest, TestBuiltinGemm) {
+  const CBLAS_TRANSPOSE trans[] = {CblasNoTrans, CblasTrans};
+  for (int s = 0; s < sizeof(kGemmShapes) / sizeof(kGemmShapes[0]); ++s) {
+    const int M = kGemmShapes[s][0];
+    const int N = kGemmShapes[s][1];
+    const int K = kGemmShapes[s][2];
+    for (int t = 0; t < 4; ++t) {
+      const TypeParam beta = t == 1 ? 0.5 : 0;
+      this->Reference(trans[t / 2], trans[t % 2], M, N, K, beta);
+      caffe_set_blas_backend("builtin");
+      caffe_cpu_gemm<TypeParam>(trans[t / 2], trans[t % 2], M, N, K,
+          TypeParam(1.5), this->a_.cpu_data(), this->b_.cpu_data(), beta,
+          this->c_.mutable_cpu_data());
+      this->Check(K);
+    }
+  }
+}
+
+TYPED_TEST(PackedGemmTest, TestBuiltinGemv) {
+  const int M = 7, N = 37;
+  for (int t = 0; t < 2; ++t) {
+    const CBLAS_TRANSPOSE trans = t ? CblasTrans : CblasNoTrans;
+    const int x_size = t ? M : N, y_size = t ? N : M;
+    Blob<TypeParam> x;
+    this->Fill(&this->a_, M * N);
+    this->Fill(&x, x_size);
+    this->Fill(&this->c_, y_size);
+    this->expected_.ReshapeLike(this->c_);
+    caffe_copy(y_size, this->c_.cpu_data(),
+        this->expected_.mutable_cpu_data());
+    caffe_cpu_gemv<TypeParam>(trans, M, N, TypeParam(2), this->a_.cpu_data(),
+        x.cpu_data(), TypeParam(0.5), this->expected_.mutable_cpu_data());
+    caffe_set_blas_backend("builtin");
+    caffe_cpu_gemv<TypeParam>(trans, M, N, TypeParam(2), this->a_.cpu_data(),
+        x.cpu_data(), TypeParam(0.5), this->c_.mutable_cpu_data());
+    caffe_set_blas_backend("linked");
+    this->Check(N);
+  }
+}
+
+TYPED_TEST(PackedGemmTest, TestPackedLeftAndRight) {
+  const CBLAS_TRANSPOSE trans[] = {CblasNoTrans, CblasTrans};
+  for (int s = 0; s < sizeof(kGemmShapes) / sizeof(kGemmShapes[0]); ++s) {
+    const int M = kGemmShapes[s][0];
+    const int N = kGemmShapes[s][1];
+    const int K = kGemmShapes[s][2];
+    for (int t = 0; t < 4; ++t) {
+      const TypeParam beta = t == 2 ? 0.5 : 0;
+      this->Reference(trans[t / 2], trans[t % 2], M, N, K, beta);
+      Blob<TypeParam> c_copy;
+      c_copy.CopyFrom(this->c_, false, true);
+      PackedMatrix<TypeParam> a;
+      a.Pack(PackedMatrix<TypeParam>::LEFT, trans[t / 2], M, K, this->a_);
+      EXPECT_EQ(M, a.rows());
+      EXPECT_EQ(K, a.cols());
+      caffe_cpu_gemm_packed<TypeParam>(a, trans[t % 2], N, TypeParam(1.5),
+          this->b_.cpu_data(), beta, this->c_.mutable_cpu_data());
+      this->Check(K);
+      this->c_.CopyFrom(c_copy);
+      PackedMatrix<TypeParam> b;
+      b.Pack(PackedMatrix<TypeParam>::RIGHT, trans[t % 2], K, N, this->b_);
+      caffe_cpu_gemm_packed<TypeParam>(trans[t / 2], M, TypeParam(1.5),
+          this->a_.cpu_data(), b, beta, this->c_.mutable_cpu_data());
+      this->Check(K);
+    }
+  }
+}
+
+TYPED_TEST(PackedGemmTest, TestRepackOnlyWhenChanged) {
+  const int M = 5, N = 6, K = 7;
+  this->Reference(CblasNoTrans, CblasNoTrans, M, N, K, 0);
+  PackedMatrix<TypeParam> b;
+  b.Pack(PackedMatrix<TypeParam>::RIGHT, CblasNoTrans, K, N, this->b_);
+  // A write that bypasses mutable_cpu_data is not seen...
+  TypeParam* stale = this->b_.mutable_cpu_data();
+  b.Pack(PackedMatrix<TypeParam>::RIGHT, CblasNoTrans, K, N, this->b_);
+  caffe_scal(K * N, TypeParam(2), stale);
+  b.Pack(PackedMatrix<TypeParam>::RIGHT, CblasNoTrans, K, N, this->b_);
+  caffe_cpu_gemm_packed<TypeParam>(CblasNoTrans, M, TypeParam(1.5),
+      this->a_.cpu_data(), b, TypeParam(0), this->c_.mutable_cpu_data());
+  this->Check(K);
+  // ...but one through it is.
+  caffe_scal(K * N, TypeParam(0.5), this->b_.mutable_cpu_data());
+  b.Pack(PackedMatrix<TypeParam>::RIGHT, CblasNoTrans, K, N, this->b_);
+  caffe_cpu_gemm_packed<TypeParam>(CblasNoTrans, M, TypeParam(1.5),
+      this->a_.cpu_data(), b, TypeParam(0), this->c_.mutable_cpu_data());
+  this->Check(K);
+  // So is packing another part of the blob.
+  b.Pack(PackedMatrix<TypeParam>::RIGHT, CblasNoTrans, K - 1, N, this->b_,
+      N);
+  caffe_cpu_gemm_packed<TypeParam>(CblasNoTrans, M, TypeParam(1.5),
+      this->a_.cpu_data(), b, TypeParam(0), this->c_.mutable_cpu_data());
+  caffe_cpu_gemm<TypeParam>(CblasNoTrans, CblasNoTrans, M, N, K - 1,
+      TypeParam(1.5), this->a_.cpu_data(), this->b_.cpu_data() + N,
+      TypeParam(0), this->expected_.mutable_cpu_data());
+  this->Check(K);
+}
+
+}  // namespace caffe
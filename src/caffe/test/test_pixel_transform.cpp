@@ -0,0 +1,187 @@
+#include <stdint.h>
+#include <string.h>
+
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "caffe/blob.hpp"
+#include "caffe/common.hpp"
+#include "caffe/syncedmem.hpp"
+#include "caffe/util/pixel_transform.hpp"
+#include "caffe/util/rng.hpp"
+
+#include "caffe/test/test_caffe_main.hpp"
+
+namespace caffe {
+
+template <typename Dtype>
+class PixelTransformTest : public ::testing::Test {
+ protected:
+  PixelTransformTest() : max_length_(40), max_stride_(4) {}
+
+  virtual void SetUp() {
+    Caffe::set_random_seed(1701);
+    const int size = max_length_ * max_stride_;
+    bytes_.resize(size);
+    floats_.resize(size);
+    mean_.resize(max_length_);
+    for (int i = 0; i < size; ++i) {
+      bytes_[i] = (*caffe_rng())() % 256;
+      floats_[i] = static_cast<float>((*caffe_rng())() % 100000) / 77;
+    }
+    for (int i = 0; i < max_length_; ++i) {
+      mean_[i] = static_cast<Dtype>((*caffe_rng())() % 25600) / 100;
+    }
+  }
+
+  // Checks the rows of every length, stride, mirror and mean against the
+  // per-pixel loop DataTransformer had, value for value.
+  template <typename T>
+  void CheckRows(const vector<T>& x) {
+    const Dtype scale = 0.00390625 * 3;
+    vector<Dtype> y(max_length_ + 1);
+    for (int n = 0; n <= max_length_; ++n) {
+      for (int stride = 1; stride <= max_stride_; ++stride) {
+        for (int options = 0; options < 4; ++options) {
+          const bool mirror = options & 1;
+          const Dtype* mean_row = (options & 2) ? &mean_[0] : NULL;
+          const Dtype mean_value = (options & 2) ? 0 : 127.5;
+          // The value after the row stays as it is.
+          y[n] = -1;
+          caffe_cpu_transform_row(n, &x[0], stride, mean_row, mean_value,
+              scale, mirror, &y[0]);
+          for (int w = 0; w < n; ++w) {
+            const Dtype element = static_cast<Dtype>(x[w * stride]);
+            const Dtype expected = mean_row ?
+                (element - mean_row[w]) * scale :
+                (element - mean_value) * scale;
+            EXPECT_EQ(expected, y[mirror ? n - 1 - w : w])
+                << "n " << n << " stride " << stride << " options "
+                << options << " at " << w;
+          }
+          EXPECT_EQ(-1, y[n]);
+        }
+      }
+    }
+  }
+
+  // Fills a batch of 3 images of 2 x 5 x 11 bytes, with crops of 3 x 9 at
+  // random offsets and mirrored at random.
+  void FillBatch(vector<uint8_t>* x, vector<int>* augmentation) {
+    x->resize(num_ * channels_ * height_ * width_);
+    augmentation->resize(3 * num_);
+    for (int i = 0; i < x->size(); ++i) {
+      (*x)[i] = (*caffe_rng())() % 256;
+    }
+    for (int n = 0; n < num_; ++n) {
+      (*augmentation)[3 * n] = (*caffe_rng())() % (height_ - crop_height_ + 1);
+      (*augmentation)[3 * n + 1] =
+          (*caffe_rng())() % (width_ - crop_width_ + 1);
+      (*augmentation)[3 * n + 2] = (*caffe_rng())() % 2;
+    }
+  }
+
+  static const int num_ = 3;
+  static const int channels_ = 2;
+  static const int height_ = 5;
+  static const int width_ = 11;
+  static const int crop_height_ = 3;
+  static const int crop_width_ = 9;
+  int max_length_;
+  int max_stride_;
+  vector<uint8_t> bytes_;
+  vector<float> floats_;
+  vector<Dtype> mean_;
+};
+
+TYPED_TEST_CASE(PixelTransformTest, TestDtypes);
+
+TYPED_TEST(PixelTransformTest, TestBytes) {
+  this->CheckRows(this->bytes_);
+}
+
+TYPED_TEST(PixelTransformTest, TestFloats) {
+  this->CheckRows(this->floats_);
+}
+
+TYPED_TEST(PixelTransformTest, TestNoMean) {
+  // Without a mean, the values are only scaled.
+  vector<TypeParam> y(this->bytes_.size());
+  caffe_cpu_transform_row(this->bytes_.size(), &this->bytes_[0], 1,
+      static_cast<const TypeParam*>(NULL), TypeParam(0), TypeParam(0.5), false,
+      &y[0]);
+  for (int i = 0; i < y.size(); ++i) {
+    EXPECT_EQ(this->bytes_[i] * TypeParam(0.5), y[i]);
+  }
+}
+
+TYPED_TEST(PixelTransformTest, TestTransformBatch) {
+  typedef TypeParam Dtype;
+  vector<uint8_t> x;
+  vector<int> augmentation;
+  this->FillBatch(&x, &augmentation);
+  const int C = this->channels_, H = this->height_, W = this->width_;
+  const int crop_h = this->crop_height_, crop_w = this->crop_width_;
+  vector<Dtype> mean(C * H * W);
+  for (int i = 0; i < mean.size(); ++i) {
+    mean[i] = static_cast<Dtype>((*caffe_rng())() % 25600) / 100;
+  }
+  const Dtype mean_values[] = {104, 117};
+  const Dtype scale = 0.5;
+  vector<Dtype> y(this->num_ * C * crop_h * crop_w);
+  for (int with_mean = 0; with_mean < 2; ++with_mean) {
+    caffe_cpu_transform_batch(this->num_, C, H, W, &x[0], &augmentation[0],
+        crop_h, crop_w, with_mean ? &mean[0] : NULL,
+        with_mean ? NULL : mean_values, scale, &y[0]);
+    for (int n = 0; n < this->num_; ++n) {
+      const int* item = &augmentation[3 * n];
+      for (int c = 0; c < C; ++c) {
+        for (int h = 0; h < crop_h; ++h) {
+          for (int w = 0; w < crop_w; ++w) {
+            const int out_w = item[2] ? crop_w - 1 - w : w;
+            const int index = (c * H + item[0] + h) * W + item[1] + w;
+            const Dtype m = with_mean ? mean[index] : mean_values[c];
+            EXPECT_EQ((static_cast<Dtype>(x[n * C * H * W + index]) - m) *
+                scale, y[((n * C + c) * crop_h + h) * crop_w + out_w]);
+          }
+        }
+      }
+    }
+  }
+}
+
+#ifndef CPU_ONLY
+TYPED_TEST(PixelTransformTest, TestTransformBatchGPU) {
+  typedef TypeParam Dtype;
+  vector<uint8_t> x;
+  vector<int> augmentation;
+  this->FillBatch(&x, &augmentation);
+  const int C = this->channels_, H = this->height_, W = this->width_;
+  const int crop_h = this->crop_height_, crop_w = this->crop_width_;
+  SyncedMemory x_gpu(x.size());
+  memcpy(x_gpu.mutable_cpu_data(), &x[0], x.size());
+  SyncedMemory augmentation_gpu(augmentation.size() * sizeof(int));
+  memcpy(augmentation_gpu.mutable_cpu_data(), &augmentation[0],
+      augmentation.size() * sizeof(int));
+  Blob<Dtype> mean_values(1, C, 1, 1);
+  mean_values.mutable_cpu_data()[0] = 104;
+  mean_values.mutable_cpu_data()[1] = 117;
+  const Dtype scale = 0.25;
+  vector<Dtype> expected(this->num_ * C * crop_h * crop_w);
+  caffe_cpu_transform_batch(this->num_, C, H, W, &x[0], &augmentation[0],
+      crop_h, crop_w, static_cast<const Dtype*>(NULL),
+      mean_values.cpu_data(), scale, &expected[0]);
+  Blob<Dtype> y(this->num_, C, crop_h, crop_w);
+  caffe_gpu_transform_batch(this->num_, C, H, W,
+      static_cast<const uint8_t*>(x_gpu.gpu_data()),
+      static_cast<const int*>(augmentation_gpu.gpu_data()), crop_h, crop_w,
+      static_cast<const Dtype*>(NULL), mean_values.gpu_data(), scale,
+      y.mutable_gpu_data());
+  for (int i = 0; i < expected.size(); ++i) {
+    EXPECT_EQ(expected[i], y.cpu_data()[i]);
+  }
+}
+#endif
+
+}  // namespace caffe
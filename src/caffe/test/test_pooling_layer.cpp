@@ -1,3 +1,5 @@
+#include <algorithm>
+#include <cfloat>
 #include <vector>
 
 #include "gtest/gtest.h"
@@ -609,6 +611,266 @@ TYPED_TEST(PoolingLayerTest, TestGradientAvePadded) {
   }
 }
 
+// Reference 3D pooling of a (num, channels, depth, height, width) blob,
+// visiting the windows in the same order as the 2D loops of PoolingLayer.
+template <typename Dtype>
+void ReferencePool3D(const Blob<Dtype>& bottom, const bool max_pool,
+    const int* kernel, const int* stride, const int* pad, Blob<Dtype>* top,
+    Blob<Dtype>* top_mask) {
+  const int* shape = &bottom.shape()[2];
+  const int* pooled = &top->shape()[2];
+  const Dtype* bottom_data = bottom.cpu_data();
+  Dtype* top_data = top->mutable_cpu_data();
+  Dtype* mask = top_mask->mutable_cpu_data();
+  const int planes = bottom.count(0, 2);
+  for (int p = 0; p < planes; ++p) {
+    const Dtype* in = bottom_data + p * bottom.count(2);
+    for (int pd = 0; pd < pooled[0]; ++pd) {
+      for (int ph = 0; ph < pooled[1]; ++ph) {
+        for (int pw = 0; pw < pooled[2]; ++pw) {
+          int start[3] = {pd * stride[0] - pad[0], ph * stride[1] - pad[1],
+              pw * stride[2] - pad[2]};
+          int end[3];
+          int pool_size = 1;
+          for (int i = 0; i < 3; ++i) {
+            end[i] = std::min(start[i] + kernel[i], shape[i] + pad[i]);
+            pool_size *= end[i] - start[i];
+            start[i] = std::max(start[i], 0);
+            end[i] = std::min(end[i], shape[i]);
+          }
+          Dtype value = max_pool ? -FLT_MAX : 0;
+          int argmax = -1;
+          for (int d = start[0]; d < end[0]; ++d) {
+            for (int h = start[1]; h < end[1]; ++h) {
+              for (int w = start[2]; w < end[2]; ++w) {
+                const int index = (d * shape[1] + h) * shape[2] + w;
+                if (!max_pool) {
+                  value += in[index];
+                } else if (in[index] > value) {
+                  value = in[index];
+                  argmax = index;
+                }
+              }
+            }
+          }
+          *top_data++ = max_pool ? value : value / pool_size;
+          *mask++ = argmax;
+        }
+      }
+    }
+  }
+}
+
+TYPED_TEST(PoolingLayerTest, TestSetup3D) {
+  typedef typename TypeParam::Dtype Dtype;
+  vector<int> shape(5, 2);
+  shape[2] = 5;
+  shape[3] = 6;
+  shape[4] = 7;
+  this->blob_bottom_->Reshape(shape);
+  LayerParameter layer_param;
+  PoolingParameter* pooling_param = layer_param.mutable_pooling_param();
+  pooling_param->set_kernel_size(3);
+  pooling_param->set_stride(2);
+  {
+    PoolingLayer<Dtype> layer(layer_param);
+    layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+    ASSERT_EQ(5, this->blob_top_->num_axes());
+    EXPECT_EQ(2, this->blob_top_->shape(0));
+    EXPECT_EQ(2, this->blob_top_->shape(1));
+    EXPECT_EQ(2, this->blob_top_->shape(2));
+    EXPECT_EQ(3, this->blob_top_->shape(3));
+    EXPECT_EQ(3, this->blob_top_->shape(4));
+  }
+  pooling_param->clear_kernel_size();
+  pooling_param->set_kernel_d(2);
+  pooling_param->set_kernel_h(3);
+  pooling_param->set_kernel_w(4);
+  pooling_param->set_pad_d(1);
+  pooling_param->set_pad_h(0);
+  pooling_param->set_pad_w(0);
+  {
+    PoolingLayer<Dtype> layer(layer_param);
+    layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+    // The last of ceil((5 + 2 - 2) / 2) + 1 windows would start in the pad.
+    EXPECT_EQ(3, this->blob_top_->shape(2));
+    EXPECT_EQ(3, this->blob_top_->shape(3));
+    EXPECT_EQ(3, this->blob_top_->shape(4));
+  }
+}
+
+TYPED_TEST(PoolingLayerTest, TestForward3D) {
+  typedef typename TypeParam::Dtype Dtype;
+  vector<int> shape(5, 2);
+  shape[1] = 3;
+  shape[2] = 5;
+  shape[3] = 7;
+  shape[4] = 19;
+  this->blob_bottom_->Reshape(shape);
+  FillerParameter filler_param;
+  GaussianFiller<Dtype> filler(filler_param);
+  filler.Fill(this->blob_bottom_);
+  this->blob_top_vec_.push_back(this->blob_top_mask_);
+  const int kernel[3] = {2, 3, 3};
+  const int stride[3] = {1, 2, 1};
+  const int pad[3] = {1, 1, 2};
+  for (int max_pool = 0; max_pool <= 1; ++max_pool) {
+    LayerParameter layer_param;
+    PoolingParameter* pooling_param = layer_param.mutable_pooling_param();
+    pooling_param->set_pool(max_pool ? PoolingParameter_PoolMethod_MAX :
+        PoolingParameter_PoolMethod_AVE);
+    pooling_param->set_kernel_d(kernel[0]);
+    pooling_param->set_kernel_h(kernel[1]);
+    pooling_param->set_kernel_w(kernel[2]);
+    pooling_param->set_stride_d(stride[0]);
+    pooling_param->set_stride_h(stride[1]);
+    pooling_param->set_stride_w(stride[2]);
+    pooling_param->set_pad_d(pad[0]);
+    pooling_param->set_pad_h(pad[1]);
+    pooling_param->set_pad_w(pad[2]);
+    PoolingLayer<Dtype> layer(layer_param);
+    vector<Blob<Dtype>*> top_vec(this->blob_top_vec_.begin(),
+        this->blob_top_vec_.begin() + 1 + max_pool);
+    layer.SetUp(this->blob_bottom_vec_, top_vec);
+    layer.Forward(this->blob_bottom_vec_, top_vec);
+    Blob<Dtype> top, mask;
+    top.ReshapeLike(*this->blob_top_);
+    mask.ReshapeLike(*this->blob_top_);
+    ReferencePool3D(*this->blob_bottom_, max_pool, kernel, stride, pad, &top,
+        &mask);
+    for (int i = 0; i < top.count(); ++i) {
+      EXPECT_NEAR(top.cpu_data()[i], this->blob_top_->cpu_data()[i], 1e-5);
+      if (max_pool) {
+        EXPECT_EQ(mask.cpu_data()[i], this->blob_top_mask_->cpu_data()[i]);
+      }
+    }
+  }
+}
+
+TYPED_TEST(PoolingLayerTest, TestForward3DRows) {
+  // Rows long enough for vectors of outputs at several strides, with and
+  // without the top mask, the argmaxes of the latter checked by Backward.
+  typedef typename TypeParam::Dtype Dtype;
+  vector<int> shape(5, 2);
+  shape[2] = 3;
+  shape[3] = 4;
+  shape[4] = 45;
+  this->blob_bottom_->Reshape(shape);
+  FillerParameter filler_param;
+  GaussianFiller<Dtype> filler(filler_param);
+  filler.Fill(this->blob_bottom_);
+  for (int stride_w = 1; stride_w <= 3; ++stride_w) {
+    const int kernel[3] = {2, 2, 3};
+    const int stride[3] = {1, 1, stride_w};
+    const int pad[3] = {0, 1, 1};
+    for (int pool = 0; pool < 3; ++pool) {
+      const bool max_pool = pool > 0;
+      const bool use_top_mask = pool == 2;
+      LayerParameter layer_param;
+      PoolingParameter* pooling_param = layer_param.mutable_pooling_param();
+      pooling_param->set_pool(max_pool ? PoolingParameter_PoolMethod_MAX :
+          PoolingParameter_PoolMethod_AVE);
+      pooling_param->set_kernel_d(kernel[0]);
+      pooling_param->set_kernel_h(kernel[1]);
+      pooling_param->set_kernel_w(kernel[2]);
+      pooling_param->set_stride_d(stride[0]);
+      pooling_param->set_stride_h(stride[1]);
+      pooling_param->set_stride_w(stride[2]);
+      pooling_param->set_pad_d(pad[0]);
+      pooling_param->set_pad_h(pad[1]);
+      pooling_param->set_pad_w(pad[2]);
+      PoolingLayer<Dtype> layer(layer_param);
+      vector<Blob<Dtype>*> top_vec(1, this->blob_top_);
+      if (use_top_mask) {
+        top_vec.push_back(this->blob_top_mask_);
+      }
+      layer.SetUp(this->blob_bottom_vec_, top_vec);
+      layer.Forward(this->blob_bottom_vec_, top_vec);
+      Blob<Dtype> top, mask;
+      top.ReshapeLike(*this->blob_top_);
+      mask.ReshapeLike(*this->blob_top_);
+      ReferencePool3D(*this->blob_bottom_, max_pool, kernel, stride, pad,
+          &top, &mask);
+      for (int i = 0; i < top.count(); ++i) {
+        EXPECT_NEAR(top.cpu_data()[i], this->blob_top_->cpu_data()[i], 1e-5)
+            << "stride_w " << stride_w << " pool " << pool;
+        if (use_top_mask) {
+          EXPECT_EQ(mask.cpu_data()[i], this->blob_top_mask_->cpu_data()[i]);
+        }
+      }
+      if (max_pool && !use_top_mask) {
+        caffe_set(this->blob_top_->count(), Dtype(1),
+            this->blob_top_->mutable_cpu_diff());
+        layer.Backward(top_vec, vector<bool>(1, true),
+            this->blob_bottom_vec_);
+        vector<Dtype> expected(this->blob_bottom_->count());
+        const int top_dim = top.count(2);
+        for (int i = 0; i < top.count(); ++i) {
+          const int plane = i / top_dim;
+          expected[plane * this->blob_bottom_->count(2) +
+              static_cast<int>(mask.cpu_data()[i])] += 1;
+        }
+        for (int i = 0; i < expected.size(); ++i) {
+          EXPECT_EQ(expected[i], this->blob_bottom_->cpu_diff()[i])
+              << "stride_w " << stride_w;
+        }
+      }
+    }
+  }
+}
+
+TYPED_TEST(PoolingLayerTest, TestGradientMax3D) {
+  typedef typename TypeParam::Dtype Dtype;
+  vector<int> shape(5, 1);
+  shape[1] = 2;
+  shape[2] = 4;
+  shape[3] = 5;
+  shape[4] = 4;
+  this->blob_bottom_->Reshape(shape);
+  FillerParameter filler_param;
+  GaussianFiller<Dtype> filler(filler_param);
+  filler.Fill(this->blob_bottom_);
+  LayerParameter layer_param;
+  PoolingParameter* pooling_param = layer_param.mutable_pooling_param();
+  pooling_param->set_kernel_size(3);
+  pooling_param->set_stride(2);
+  pooling_param->set_pad(1);
+  pooling_param->set_pool(PoolingParameter_PoolMethod_MAX);
+  PoolingLayer<Dtype> layer(layer_param);
+  GradientChecker<Dtype> checker(1e-4, 1e-2);
+  checker.CheckGradientExhaustive(&layer, this->blob_bottom_vec_,
+      this->blob_top_vec_);
+}
+
+TYPED_TEST(PoolingLayerTest, TestGradientAve3D) {
+  typedef typename TypeParam::Dtype Dtype;
+  vector<int> shape(5, 1);
+  shape[1] = 2;
+  shape[2] = 4;
+  shape[3] = 5;
+  shape[4] = 4;
+  this->blob_bottom_->Reshape(shape);
+  FillerParameter filler_param;
+  GaussianFiller<Dtype> filler(filler_param);
+  filler.Fill(this->blob_bottom_);
+  LayerParameter layer_param;
+  PoolingParameter* pooling_param = layer_param.mutable_pooling_param();
+  pooling_param->set_kernel_d(2);
+  pooling_param->set_kernel_h(3);
+  pooling_param->set_kernel_w(3);
+  pooling_param->set_stride_d(1);
+  pooling_param->set_stride_h(2);
+  pooling_param->set_stride_w(2);
+  pooling_param->set_pad_d(1);
+  pooling_param->set_pad_h(2);
+  pooling_param->set_pad_w(1);
+  pooling_param->set_pool(PoolingParameter_PoolMethod_AVE);
+  PoolingLayer<Dtype> layer(layer_param);
+  GradientChecker<Dtype> checker(1e-2, 1e-2);
+  checker.CheckGradientExhaustive(&layer, this->blob_bottom_vec_,
+      this->blob_top_vec_);
+}
+
 #ifdef USE_CUDNN
 template <typename Dtype>
 class CuDNNPoolingLayerTest : public GPUDeviceTest<Dtype> {
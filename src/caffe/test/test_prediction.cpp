@@ -0,0 +1,232 @@
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "caffe/blob.hpp"
+#include "caffe/common.hpp"
+#include "caffe/filler.hpp"
+#include "caffe/util/math_functions.hpp"
+#include "caffe/util/prediction.hpp"
+
+#include "caffe/test/test_caffe_main.hpp"
+
+namespace caffe {
+
+template <typename Dtype>
+class VoxelRotationTest : public ::testing::Test {
+ protected:
+  typedef Eigen::Matrix<Dtype, 4, 4> Mat4;
+
+  VoxelRotationTest() : size_(16), blob_vox_(new Blob<Dtype>()) {}
+
+  virtual void SetUp() {
+    Caffe::set_random_seed(1701);
+    blob_vox_->Reshape(1, size_, size_, size_);
+    FillerParameter filler_param;
+    UniformFiller<Dtype> filler(filler_param);
+    filler.Fill(blob_vox_);
+    // Perspective projection (near 1, far 10) and a camera at z = 5.
+    const Dtype n = 1, f = 10, t = 1 / std::tan(Dtype(0.3));
+    proj_.setZero();
+    proj_(0, 0) = t;
+    proj_(1, 1) = t;
+    proj_(2, 2) = -(f + n) / (f - n);
+    proj_(2, 3) = -2 * f * n / (f - n);
+    proj_(3, 2) = -1;
+    view_.setIdentity();
+    view_(2, 3) = -5;
+  }
+
+  virtual ~VoxelRotationTest() { delete blob_vox_; }
+
+  Mat4 RotationY(Dtype angle) {
+    Mat4 m = Mat4::Identity();
+    m(0, 0) = std::cos(angle);
+    m(0, 2) = std::sin(angle);
+    m(2, 0) = -std::sin(angle);
+    m(2, 2) = std::cos(angle);
+    return m;
+  }
+
+  int size_;
+  Blob<Dtype>* const blob_vox_;
+  Mat4 proj_;
+  Mat4 view_;
+};
+
+TYPED_TEST_CASE(VoxelRotationTest, TestDtypes);
+
+TYPED_TEST(VoxelRotationTest, TestSameViewpointIsIdentity) {
+  const int size = this->size_;
+  typename TestFixture::Mat4 model = this->RotationY(0.7);
+  VoxelRotation<TypeParam> rotation(size, model.data(), this->view_.data(),
+      model.data(), this->view_.data(), this->proj_.data());
+  std::vector<TypeParam> output(size * size * size);
+  rotation.Apply(this->blob_vox_->cpu_data(), output.data());
+  const TypeParam* vox = this->blob_vox_->cpu_data();
+  for (int i = 0; i < output.size(); ++i) {
+    EXPECT_EQ(vox[i], output[i]);
+  }
+}
+
+TYPED_TEST(VoxelRotationTest, TestMatchesPerVoxelReference) {
+  const int size = this->size_;
+  typename TestFixture::Mat4 model1 = this->RotationY(0.4);
+  typename TestFixture::Mat4 model2 = this->RotationY(-1.1);
+  Grid<TypeParam> grid(size);
+  const TypeParam* vox = this->blob_vox_->cpu_data();
+  for (int c = 0; c < size; ++c) {
+    grid[c] = Slice<TypeParam>(size, size);
+    std::memcpy(grid[c].data(), vox + c * size * size,
+        size * size * sizeof(TypeParam));
+  }
+  Grid<TypeParam> reference = rotate_voxels_prediction<TypeParam>(grid,
+      model1, this->view_, model2, this->view_, this->proj_);
+  std::vector<TypeParam> output(size * size * size);
+  rotate_blobs(this->blob_vox_, model1.data(), this->view_.data(),
+      model2.data(), this->view_.data(), this->proj_.data(), output.data());
+  // The combined transform is built once, so round-off may move a sample
+  // across a cell boundary; allow a handful of such cells.
+  int mismatches = 0;
+  for (int c = 0; c < size; ++c) {
+    for (int i = 0; i < size; ++i) {
+      for (int j = 0; j < size; ++j) {
+        if (reference[c](i, j) != output[(c * size + i) * size + j]) {
+          ++mismatches;
+        }
+      }
+    }
+  }
+  EXPECT_LE(mismatches, size * size * size / 1000 + 1);
+}
+
+TYPED_TEST(VoxelRotationTest, TestSliceRangesCompose) {
+  const int size = this->size_;
+  typename TestFixture::Mat4 model1 = this->RotationY(0.4);
+  typename TestFixture::Mat4 model2 = this->RotationY(2.3);
+  VoxelRotation<TypeParam> rotation(size, model1.data(), this->view_.data(),
+      model2.data(), this->view_.data(), this->proj_.data());
+  std::vector<TypeParam> whole(size * size * size);
+  std::vector<TypeParam> parts(size * size * size);
+  rotation.Apply(this->blob_vox_->cpu_data(), whole.data());
+  rotation.Apply(this->blob_vox_->cpu_data(), parts.data(), 0, size / 3);
+  rotation.Apply(this->blob_vox_->cpu_data(), parts.data(), size / 3, size);
+  for (int i = 0; i < whole.size(); ++i) {
+    EXPECT_EQ(whole[i], parts[i]);
+  }
+}
+
+TYPED_TEST(VoxelRotationTest, TestBatchedMatchesApply) {
+  const int size = this->size_;
+  const int grid_count = size * size * size;
+  const int num = 3;
+  const int num_params = voxel_rotation_num_params(size);
+  // Items are written in reverse order, into a batch with room for a fourth.
+  const int items[num] = {3, 1, 0};
+  std::vector<TypeParam> grids(num * grid_count);
+  std::vector<TypeParam> params(num * num_params);
+  std::vector<TypeParam> expected(4 * grid_count, -1);
+  for (int n = 0; n < num; ++n) {
+    caffe_rng_uniform<TypeParam>(grid_count, 0, 1, &grids[n * grid_count]);
+    typename TestFixture::Mat4 model1 = this->RotationY(0.3 * n);
+    typename TestFixture::Mat4 model2 = this->RotationY(1.7 - n);
+    VoxelRotation<TypeParam> rotation(size, model1.data(), this->view_.data(),
+        model2.data(), this->view_.data(), this->proj_.data());
+    std::copy(rotation.params(), rotation.params() + num_params,
+              &params[n * num_params]);
+    rotation.Apply(&grids[n * grid_count], &expected[items[n] * grid_count]);
+  }
+  std::vector<TypeParam> output(4 * grid_count, -1);
+  rotate_blobs_cpu(num, size, params.data(), grids.data(), grid_count, items,
+                   false, output.data(), grid_count);
+  for (int i = 0; i < output.size(); ++i) {
+    EXPECT_EQ(expected[i], output[i]);
+  }
+}
+
+TYPED_TEST(VoxelRotationTest, TestNearestMatchesSourceFunctions) {
+  // Rows of any length, vectorized or not, sample the voxels the per-column
+  // functions select.
+  for (int size = 5; size <= 21; size += 8) {
+    std::vector<TypeParam> vox(size * size * size);
+    caffe_rng_uniform<TypeParam>(vox.size(), 0, 1, vox.data());
+    typename TestFixture::Mat4 model1 = this->RotationY(0.4);
+    typename TestFixture::Mat4 model2 = this->RotationY(-1.1);
+    VoxelRotation<TypeParam> rotation(size, model1.data(), this->view_.data(),
+        model2.data(), this->view_.data(), this->proj_.data());
+    std::vector<TypeParam> output(vox.size());
+    rotation.Apply(vox.data(), output.data());
+    TypeParam base[4];
+    for (int c = 0; c < size; ++c) {
+      for (int i = 0; i < size; ++i) {
+        voxel_rotation_row(rotation.params(), size, c, i, base);
+        for (int j = 0; j < size; ++j) {
+          TypeParam uz, ui, uj;
+          voxel_rotation_source(rotation.params(), size, base, j, &uz, &ui,
+              &uj);
+          EXPECT_EQ(vox[voxel_rotation_nearest(size, uz, ui, uj)],
+              output[(c * size + i) * size + j])
+              << "size " << size << " at " << c << ", " << i << ", " << j;
+        }
+      }
+    }
+  }
+}
+
+TYPED_TEST(VoxelRotationTest, TestTrilinearSameViewpoint) {
+  const int size = this->size_;
+  typename TestFixture::Mat4 model = this->RotationY(0.7);
+  VoxelRotation<TypeParam> rotation(size, model.data(), this->view_.data(),
+      model.data(), this->view_.data(), this->proj_.data(), true);
+  std::vector<TypeParam> output(size * size * size);
+  rotation.Apply(this->blob_vox_->cpu_data(), output.data());
+  // Samples fall on the voxel centers, up to round-off.
+  const TypeParam* vox = this->blob_vox_->cpu_data();
+  for (int i = 0; i < output.size(); ++i) {
+    EXPECT_NEAR(vox[i], output[i], 1e-3);
+  }
+}
+
+#ifndef CPU_ONLY
+TYPED_TEST(VoxelRotationTest, TestGPUMatchesCPU) {
+  const int size = this->size_;
+  const int grid_count = size * size * size;
+  const int num = 2;
+  const int num_params = voxel_rotation_num_params(size);
+  Blob<TypeParam> grids(num, size, size, size);
+  Blob<TypeParam> params(1, 1, num, num_params);
+  Blob<int> items(1, 1, 1, num);
+  FillerParameter filler_param;
+  UniformFiller<TypeParam> filler(filler_param);
+  filler.Fill(&grids);
+  for (int n = 0; n < num; ++n) {
+    typename TestFixture::Mat4 model1 = this->RotationY(0.4 + n);
+    typename TestFixture::Mat4 model2 = this->RotationY(-1.1 * n);
+    VoxelRotation<TypeParam> rotation(size, model1.data(), this->view_.data(),
+        model2.data(), this->view_.data(), this->proj_.data());
+    std::copy(rotation.params(), rotation.params() + num_params,
+              params.mutable_cpu_data() + n * num_params);
+    items.mutable_cpu_data()[n] = num - 1 - n;
+  }
+  Blob<TypeParam> cpu_output(num, size, size, size);
+  Blob<TypeParam> gpu_output(num, size, size, size);
+  for (int trilinear = 0; trilinear < 2; ++trilinear) {
+    rotate_blobs_cpu(num, size, params.cpu_data(), grids.cpu_data(),
+        grid_count, items.cpu_data(), trilinear, cpu_output.mutable_cpu_data(),
+        grid_count);
+    rotate_blobs_gpu(num, size, params.gpu_data(), grids.gpu_data(),
+        grid_count, items.gpu_data(), trilinear, gpu_output.mutable_gpu_data(),
+        grid_count);
+    const TypeParam* expected = cpu_output.cpu_data();
+    const TypeParam* output = gpu_output.cpu_data();
+    for (int i = 0; i < num * grid_count; ++i) {
+      EXPECT_EQ(expected[i], output[i]) << "trilinear " << trilinear;
+    }
+  }
+}
+#endif  // CPU_ONLY
+
+}  // namespace caffe
@@ -0,0 +1,243 @@
+#include <algorithm>
+#include <cmath>
+#include <string>
+#include <vector>
+
+#include "google/protobuf/text_format.h"
+
+#include "gtest/gtest.h"
+
+#include "caffe/blob.hpp"
+#include "caffe/common.hpp"
+#include "caffe/filler.hpp"
+#include "caffe/layers/conv_layer.hpp"
+#include "caffe/layers/inner_product_layer.hpp"
+#include "caffe/net.hpp"
+#include "caffe/util/int8_gemm.hpp"
+#include "caffe/util/quantization.hpp"
+
+#include "caffe/test/test_caffe_main.hpp"
+
+namespace caffe {
+
+template <typename Dtype>
+static void FillUniform(Blob<Dtype>* blob, Dtype min, Dtype max) {
+  FillerParameter filler_param;
+  filler_param.set_min(min);
+  filler_param.set_max(max);
+  UniformFiller<Dtype> filler(filler_param);
+  filler.Fill(blob);
+}
+
+template <typename Dtype>
+static Dtype MaxAbs(const Blob<Dtype>& blob) {
+  Dtype max_abs = 0;
+  for (int i = 0; i < blob.count(); ++i) {
+    max_abs = std::max(max_abs, std::fabs(blob.cpu_data()[i]));
+  }
+  return max_abs;
+}
+
+template <typename Dtype>
+class Int8GemmTest : public ::testing::Test {};
+
+TYPED_TEST_CASE(Int8GemmTest, TestDtypes);
+
+TYPED_TEST(Int8GemmTest, TestGemmWithinRoundingError) {
+  // Sizes around the register tiles, and a K larger than the row block.
+  const int shapes[][3] = {
+    {1, 1, 1}, {3, 5, 7}, {4, 16, 8}, {9, 33, 300}, {6, 20, 70000}
+  };
+  for (int s = 0; s < sizeof(shapes) / sizeof(shapes[0]); ++s) {
+    const int M = shapes[s][0], N = shapes[s][1], K = shapes[s][2];
+    for (int t = 0; t < 8; ++t) {
+      const bool trans_a = t & 1, trans_b = t & 2, trans_c = t & 4;
+      Blob<TypeParam> a(vector<int>(1, M * K)), b(vector<int>(1, K * N));
+      Blob<TypeParam> bias(vector<int>(1, M)), c(vector<int>(1, M * N));
+      FillUniform<TypeParam>(&a, -1, 1);
+      FillUniform<TypeParam>(&b, -2, 2);
+      FillUniform<TypeParam>(&bias, -1, 1);
+      // Inputs beyond input_max saturate.
+      const TypeParam input_max = 1.5;
+      Int8Matrix<TypeParam> quantized;
+      quantized.Quantize(trans_a ? CblasTrans : CblasNoTrans, M, K, a);
+      caffe_cpu_gemm_int8<TypeParam>(quantized,
+          trans_b ? CblasTrans : CblasNoTrans, N, input_max, b.cpu_data(),
+          bias.cpu_data(), trans_c ? CblasTrans : CblasNoTrans,
+          c.mutable_cpu_data());
+      for (int i = 0; i < M; ++i) {
+        TypeParam row_max = 0;
+        for (int k = 0; k < K; ++k) {
+          row_max = std::max(row_max, std::fabs(
+              a.cpu_data()[trans_a ? k * M + i : i * K + k]));
+        }
+        EXPECT_NEAR(row_max / 127, quantized.scales()[i], 1e-6);
+        const TypeParam a_error = row_max / 127 / 2;
+        const TypeParam b_error = input_max / 127 / 2;
+        for (int j = 0; j < N; ++j) {
+          // The exact product with the inputs saturated, and a bound on
+          // the error of rounding both operands.
+          TypeParam expected = bias.cpu_data()[i], bound = 0;
+          for (int k = 0; k < K; ++k) {
+            const TypeParam a_value =
+                a.cpu_data()[trans_a ? k * M + i : i * K + k];
+            const TypeParam b_value = std::max(-input_max, std::min(input_max,
+                b.cpu_data()[trans_b ? j * K + k : k * N + j]));
+            expected += a_value * b_value;
+            bound += std::fabs(a_value) * b_error + input_max * a_error +
+                a_error * b_error;
+          }
+          EXPECT_NEAR(expected, c.cpu_data()[trans_c ? j * M + i : i * N + j],
+              bound * 1.001 + 1e-4) << "at " << i << ", " << j;
+        }
+      }
+    }
+  }
+}
+
+template <typename TypeParam>
+class QuantizationTest : public MultiDeviceTest<TypeParam> {
+  typedef typename TypeParam::Dtype Dtype;
+
+ protected:
+  QuantizationTest() : blob_bottom_(new Blob<Dtype>(2, 4, 7, 6)),
+      blob_top_(new Blob<Dtype>()) {
+    FillUniform<Dtype>(blob_bottom_, -1, 1);
+    blob_bottom_vec_.push_back(blob_bottom_);
+    blob_top_vec_.push_back(blob_top_);
+  }
+  virtual ~QuantizationTest() {
+    delete blob_bottom_;
+    delete blob_top_;
+  }
+
+  // Checks that layer, at TEST with INT8 set in quantization, computes what
+  // it does in FLOAT within 5% of the range of the output.
+  void CheckInt8Forward(LayerParameter* layer_param,
+      QuantizationParameter* quantization) {
+    layer_param->set_phase(TEST);
+    shared_ptr<Layer<Dtype> > layer(
+        LayerRegistry<Dtype>::CreateLayer(*layer_param));
+    layer->SetUp(blob_bottom_vec_, blob_top_vec_);
+    layer->Forward(blob_bottom_vec_, blob_top_vec_);
+    Blob<Dtype> expected;
+    expected.CopyFrom(*blob_top_, false, true);
+    quantization->set_precision(QuantizationParameter_Precision_INT8);
+    quantization->set_input_max(MaxAbs(*blob_bottom_));
+    shared_ptr<Layer<Dtype> > int8_layer(
+        LayerRegistry<Dtype>::CreateLayer(*layer_param));
+    int8_layer->SetUp(blob_bottom_vec_, blob_top_vec_);
+    for (int i = 0; i < layer->blobs().size(); ++i) {
+      int8_layer->blobs()[i]->CopyFrom(*layer->blobs()[i]);
+    }
+    int8_layer->Forward(blob_bottom_vec_, blob_top_vec_);
+    const Dtype tolerance = Dtype(0.05) * MaxAbs(expected);
+    for (int i = 0; i < expected.count(); ++i) {
+      EXPECT_NEAR(expected.cpu_data()[i], blob_top_->cpu_data()[i],
+          tolerance);
+    }
+  }
+
+  Blob<Dtype>* const blob_bottom_;
+  Blob<Dtype>* const blob_top_;
+  vector<Blob<Dtype>*> blob_bottom_vec_;
+  vector<Blob<Dtype>*> blob_top_vec_;
+};
+
+TYPED_TEST_CASE(QuantizationTest, TestDtypesAndDevices);
+
+TYPED_TEST(QuantizationTest, TestConvolutionInt8) {
+  LayerParameter layer_param;
+  layer_param.set_type("Convolution");
+  ConvolutionParameter* convolution_param =
+      layer_param.mutable_convolution_param();
+  convolution_param->add_kernel_size(3);
+  convolution_param->add_pad(1);
+  convolution_param->set_num_output(6);
+  convolution_param->set_group(2);
+  convolution_param->mutable_weight_filler()->set_type("gaussian");
+  convolution_param->mutable_bias_filler()->set_type("gaussian");
+  convolution_param->mutable_activation()->set_type(
+      ActivationParameter_Type_RELU);
+  this->CheckInt8Forward(&layer_param,
+      convolution_param->mutable_quantization());
+}
+
+TYPED_TEST(QuantizationTest, TestConvolution1x1Int8) {
+  LayerParameter layer_param;
+  layer_param.set_type("Convolution");
+  ConvolutionParameter* convolution_param =
+      layer_param.mutable_convolution_param();
+  convolution_param->add_kernel_size(1);
+  convolution_param->set_num_output(5);
+  convolution_param->set_bias_term(false);
+  convolution_param->mutable_weight_filler()->set_type("gaussian");
+  this->CheckInt8Forward(&layer_param,
+      convolution_param->mutable_quantization());
+}
+
+TYPED_TEST(QuantizationTest, TestInnerProductInt8) {
+  for (int transpose = 0; transpose < 2; ++transpose) {
+    LayerParameter layer_param;
+    layer_param.set_type("InnerProduct");
+    InnerProductParameter* inner_product_param =
+        layer_param.mutable_inner_product_param();
+    inner_product_param->set_num_output(7);
+    inner_product_param->set_transpose(transpose);
+    inner_product_param->mutable_weight_filler()->set_type("gaussian");
+    inner_product_param->mutable_bias_filler()->set_type("gaussian");
+    this->CheckInt8Forward(&layer_param,
+        inner_product_param->mutable_quantization());
+  }
+}
+
+TYPED_TEST(QuantizationTest, TestCalibrateNet) {
+  typedef typename TypeParam::Dtype Dtype;
+  const string proto =
+      "layer { name: 'data' type: 'Input' top: 'data' "
+      "  input_param { shape { dim: 2 dim: 3 dim: 5 dim: 5 } } } "
+      "layer { name: 'conv' type: 'Convolution' bottom: 'data' top: 'conv' "
+      "  convolution_param { num_output: 4 kernel_size: 3 "
+      "    weight_filler { type: 'gaussian' std: 0.5 } } } "
+      "layer { name: 'relu' type: 'ReLU' bottom: 'conv' top: 'conv' } "
+      "layer { name: 'ip' type: 'InnerProduct' bottom: 'conv' top: 'ip' "
+      "  inner_product_param { num_output: 3 "
+      "    weight_filler { type: 'gaussian' std: 0.5 } } } "
+      "layer { name: 'deconv' type: 'Deconvolution' bottom: 'data' "
+      "  top: 'deconv' convolution_param { num_output: 2 kernel_size: 1 } } ";
+  NetParameter param;
+  CHECK(google::protobuf::TextFormat::ParseFromString(proto, &param));
+  param.mutable_state()->set_phase(TEST);
+  Net<Dtype> net(param);
+  FillUniform<Dtype>(net.input_blobs()[0], -2, 2);
+  NetParameter int8_param(param);
+  EXPECT_EQ(2, CalibrateNet(&net, 1, &int8_param));
+  const QuantizationParameter& conv =
+      int8_param.layer(1).convolution_param().quantization();
+  EXPECT_EQ(QuantizationParameter_Precision_INT8, conv.precision());
+  EXPECT_FLOAT_EQ(MaxAbs(*net.blob_by_name("data")), conv.input_max());
+  const QuantizationParameter& ip =
+      int8_param.layer(3).inner_product_param().quantization();
+  EXPECT_EQ(QuantizationParameter_Precision_INT8, ip.precision());
+  EXPECT_FLOAT_EQ(MaxAbs(*net.blob_by_name("conv")), ip.input_max());
+  EXPECT_FALSE(int8_param.layer(4).convolution_param().has_quantization());
+
+  Net<Dtype> int8_net(int8_param);
+  for (int i = 0; i < net.layers().size(); ++i) {
+    for (int j = 0; j < net.layers()[i]->blobs().size(); ++j) {
+      int8_net.layers()[i]->blobs()[j]->CopyFrom(
+          *net.layers()[i]->blobs()[j]);
+    }
+  }
+  int8_net.input_blobs()[0]->CopyFrom(*net.input_blobs()[0]);
+  int8_net.Forward();
+  const Blob<Dtype>& expected = *net.blob_by_name("ip");
+  const Blob<Dtype>& result = *int8_net.blob_by_name("ip");
+  // The rounding errors of both layers add up.
+  for (int i = 0; i < expected.count(); ++i) {
+    EXPECT_NEAR(expected.cpu_data()[i], result.cpu_data()[i],
+        Dtype(0.1) * MaxAbs(expected));
+  }
+}
+
+}  // namespace caffe
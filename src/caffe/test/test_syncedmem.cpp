@@ -5,6 +5,7 @@
 #include "caffe/common.hpp"
 #include "caffe/syncedmem.hpp"
 #include "caffe/util/device_alternate.hpp"
+#include "caffe/util/half.hpp"
 #include "caffe/util/math_functions.hpp"
 
 #include "caffe/test/test_caffe_main.hpp"
@@ -67,6 +68,68 @@ TEST_F(SyncedMemoryTest, TestCPUWrite) {
   }
 }
 
+TEST_F(SyncedMemoryTest, TestCompress) {
+  SyncedMemory mem(10 * sizeof(float));
+  float* cpu_data = static_cast<float*>(mem.mutable_cpu_data());
+  for (int i = 0; i < 10; ++i) {
+    cpu_data[i] = i + 1.f / 3;
+  }
+  const uint64_t version = mem.version();
+  mem.compress<float>(BFLOAT16);
+  EXPECT_TRUE(mem.compressed());
+  EXPECT_EQ(mem.head(), SyncedMemory::HEAD_AT_CPU);
+  // The data is rounded.
+  EXPECT_GT(mem.version(), version);
+  const float* rounded = static_cast<const float*>(mem.cpu_data());
+  EXPECT_FALSE(mem.compressed());
+  for (int i = 0; i < 10; ++i) {
+    EXPECT_EQ(caffe_bfloat16_to_float(caffe_float_to_bfloat16(i + 1.f / 3)),
+              rounded[i]);
+  }
+  // Data only read since is compressed again as is.
+  const uint64_t read_version = mem.version();
+  mem.compress<float>(BFLOAT16);
+  EXPECT_TRUE(mem.compressed());
+  EXPECT_EQ(mem.version(), read_version);
+  // Written data is converted again.
+  cpu_data = static_cast<float*>(mem.mutable_cpu_data());
+  cpu_data[0] = 1.f / 3;
+  mem.compress<float>(FLOAT16);
+  EXPECT_EQ(caffe_half_to_float(caffe_float_to_half(1.f / 3)),
+            static_cast<const float*>(mem.cpu_data())[0]);
+}
+
+TEST_F(SyncedMemoryTest, TestCompressSkipsMemoryNotOwned) {
+  double data[4] = {1. / 3, 2. / 3, 1, 4. / 3};
+  SyncedMemory mem(sizeof(data));
+  mem.set_cpu_data(data);
+  mem.compress<double>(FLOAT16);
+  EXPECT_FALSE(mem.compressed());
+  EXPECT_EQ(data, mem.cpu_data());
+  EXPECT_EQ(1. / 3, data[0]);
+}
+
+#ifndef CPU_ONLY  // GPU test
+
+TEST_F(SyncedMemoryTest, TestCompressGPURead) {
+  SyncedMemory mem(10 * sizeof(float));
+  float* cpu_data = static_cast<float*>(mem.mutable_cpu_data());
+  for (int i = 0; i < 10; ++i) {
+    cpu_data[i] = i + 1.f / 3;
+  }
+  mem.compress<float>(FLOAT16);
+  const void* gpu_data = mem.gpu_data();
+  EXPECT_EQ(mem.head(), SyncedMemory::SYNCED);
+  float recovered_value[10];
+  caffe_gpu_memcpy(sizeof(recovered_value), gpu_data, recovered_value);
+  for (int i = 0; i < 10; ++i) {
+    EXPECT_EQ(caffe_half_to_float(caffe_float_to_half(i + 1.f / 3)),
+              recovered_value[i]);
+  }
+}
+
+#endif
+
 #ifndef CPU_ONLY  // GPU test
 
 TEST_F(SyncedMemoryTest, TestGPURead) {
@@ -0,0 +1,106 @@
+#include <boost/bind.hpp>
+#include <boost/thread.hpp>
+#include <utility>
+#include <vector>
+
+#include "glog/logging.h"
+#include "gtest/gtest.h"
+
+#include "caffe/util/task_graph.hpp"
+#include "caffe/util/thread_pool.hpp"
+
+#include "caffe/test/test_caffe_main.hpp"
+
+namespace caffe {
+
+static const int kNumTasks = 40;
+
+class TaskGraphTest : public ::testing::Test {
+ public:
+  void Record(int task) {
+    boost::mutex::scoped_lock lock(mutex_);
+    order_[task] = next_++;
+    threads_[task] = boost::this_thread::get_id();
+  }
+
+ protected:
+  TaskGraphTest() : graph_(kNumTasks) {}
+
+  virtual void SetUp() {
+    // A layered graph: each task depends on up to three tasks of the
+    // previous layer of four.
+    for (int task = 4; task < kNumTasks; ++task) {
+      const int layer = task / 4 * 4;
+      for (int i = 0; i < 4; ++i) {
+        if ((task * 7 + i * 3) % 4 != 0) {
+          graph_.AddDependency(layer - 4 + i, task);
+          edges_.push_back(std::make_pair(layer - 4 + i, task));
+        }
+      }
+    }
+  }
+
+  void Reset() {
+    order_.assign(kNumTasks, -1);
+    threads_.assign(kNumTasks, boost::thread::id());
+    next_ = 0;
+  }
+
+  TaskGraph graph_;
+  vector<std::pair<int, int> > edges_;
+  boost::mutex mutex_;
+  vector<int> order_;
+  vector<boost::thread::id> threads_;
+  int next_;
+};
+
+TEST_F(TaskGraphTest, TestRunsAfterDependencies) {
+  ThreadPool pool(4);
+  for (int run = 0; run < 20; ++run) {
+    Reset();
+    graph_.Run(&pool, boost::bind(&TaskGraphTest::Record, this, _1));
+    for (int task = 0; task < kNumTasks; ++task) {
+      EXPECT_GE(order_[task], 0);
+    }
+    for (int i = 0; i < edges_.size(); ++i) {
+      EXPECT_LT(order_[edges_[i].first], order_[edges_[i].second]);
+    }
+  }
+}
+
+TEST_F(TaskGraphTest, TestRange) {
+  ThreadPool pool(3);
+  Reset();
+  graph_.Run(&pool, boost::bind(&TaskGraphTest::Record, this, _1), 8, 19);
+  for (int task = 0; task < kNumTasks; ++task) {
+    EXPECT_EQ(task >= 8 && task <= 19, order_[task] >= 0);
+  }
+  EXPECT_EQ(12, next_);
+}
+
+TEST_F(TaskGraphTest, TestOnCaller) {
+  ThreadPool pool(4);
+  for (int task = 0; task < kNumTasks; task += 3) {
+    graph_.set_on_caller(task, true);
+  }
+  Reset();
+  graph_.Run(&pool, boost::bind(&TaskGraphTest::Record, this, _1));
+  for (int task = 0; task < kNumTasks; task += 3) {
+    EXPECT_EQ(boost::this_thread::get_id(), threads_[task]);
+  }
+  for (int i = 0; i < edges_.size(); ++i) {
+    EXPECT_LT(order_[edges_[i].first], order_[edges_[i].second]);
+  }
+}
+
+TEST_F(TaskGraphTest, TestSingleThread) {
+  ThreadPool pool(1);
+  Reset();
+  graph_.Run(&pool, boost::bind(&TaskGraphTest::Record, this, _1));
+  for (int i = 0; i < edges_.size(); ++i) {
+    EXPECT_LT(order_[edges_[i].first], order_[edges_[i].second]);
+  }
+  EXPECT_EQ(kNumTasks, next_);
+}
+
+}  // namespace caffe
@@ -0,0 +1,90 @@
+#include <string>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "caffe/blob.hpp"
+#include "caffe/common.hpp"
+#include "caffe/data_transformer.hpp"
+#include "caffe/proto/caffe.pb.h"
+#include "caffe/util/tensor_record.hpp"
+
+#include "caffe/test/test_caffe_main.hpp"
+
+namespace caffe {
+
+class TensorRecordTest : public ::testing::Test {
+ protected:
+  virtual void SetUp() {
+    datum_.set_label(7);
+    datum_.set_channels(3);
+    datum_.set_height(5);
+    datum_.set_width(6);
+    for (int i = 0; i < 3 * 5 * 6; ++i) {
+      datum_.mutable_data()->push_back(static_cast<char>(i * 37 % 256));
+    }
+  }
+
+  Datum datum_;
+};
+
+TEST_F(TensorRecordTest, TestRoundTrip) {
+  string value;
+  DatumToTensorRecord(datum_, &value);
+  EXPECT_EQ(kTensorRecordHeaderSize + datum_.data().size(), value.size());
+  ASSERT_TRUE(IsTensorRecord(value.data(), value.size()));
+  TensorRecord record;
+  ReadTensorRecord(value.data(), value.size(), &record);
+  EXPECT_EQ(7, record.label);
+  EXPECT_EQ(3, record.channels);
+  EXPECT_EQ(5, record.height);
+  EXPECT_EQ(6, record.width);
+  // The pixels are read in place.
+  EXPECT_EQ(reinterpret_cast<const uint8_t*>(value.data()) +
+      kTensorRecordHeaderSize, record.data);
+  for (int i = 0; i < datum_.data().size(); ++i) {
+    EXPECT_EQ(static_cast<uint8_t>(datum_.data()[i]), record.data[i]);
+  }
+}
+
+TEST_F(TensorRecordTest, TestDatumIsNotRecord) {
+  string value;
+  CHECK(datum_.SerializeToString(&value));
+  EXPECT_FALSE(IsTensorRecord(value.data(), value.size()));
+  Datum empty;
+  CHECK(empty.SerializeToString(&value));
+  EXPECT_FALSE(IsTensorRecord(value.data(), value.size()));
+}
+
+TEST_F(TensorRecordTest, TestTransformAsDatum) {
+  string value;
+  DatumToTensorRecord(datum_, &value);
+  TensorRecord record;
+  ReadTensorRecord(value.data(), value.size(), &record);
+  TransformationParameter transform_param;
+  transform_param.set_crop_size(4);
+  transform_param.set_mirror(true);
+  transform_param.set_scale(0.5);
+  transform_param.add_mean_value(10);
+  transform_param.add_mean_value(20);
+  transform_param.add_mean_value(30);
+  DataTransformer<float> transformer(transform_param, TRAIN);
+  EXPECT_EQ(transformer.InferBlobShape(datum_),
+      transformer.InferBlobShape(record));
+  Blob<float> expected(transformer.InferBlobShape(datum_));
+  Blob<float> blob(transformer.InferBlobShape(record));
+  // The same random crops and mirrors, from the same seed.
+  for (int iter = 0; iter < 10; ++iter) {
+    Caffe::set_random_seed(1701 + iter);
+    transformer.InitRand();
+    transformer.Transform(datum_, &expected);
+    Caffe::set_random_seed(1701 + iter);
+    transformer.InitRand();
+    transformer.Transform(record, &blob);
+    for (int i = 0; i < blob.count(); ++i) {
+      EXPECT_EQ(expected.cpu_data()[i], blob.cpu_data()[i]);
+    }
+  }
+}
+
+}  // namespace caffe
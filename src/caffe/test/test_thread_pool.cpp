@@ -0,0 +1,114 @@
+#include <boost/bind.hpp>
+#include <boost/thread.hpp>
+#include <vector>
+
+#include "glog/logging.h"
+#include "gtest/gtest.h"
+
+#include "caffe/util/thread_pool.hpp"
+
+#include "caffe/test/test_caffe_main.hpp"
+
+namespace caffe {
+
+class ThreadPoolTest : public ::testing::Test {
+ public:
+  void Fill(int i) { values_[i] += i + 1; }
+  // Spins so that the workers take part in the run.
+  void FillCpuThreads(int i) {
+    boost::posix_time::ptime end = boost::posix_time::microsec_clock::
+        universal_time() + boost::posix_time::milliseconds(10);
+    while (boost::posix_time::microsec_clock::universal_time() < end) {}
+    values_[i] = Caffe::cpu_threads();
+  }
+
+ protected:
+  std::vector<int> values_;
+};
+
+TEST_F(ThreadPoolTest, TestRunVisitsEveryIndexOnce) {
+  ThreadPool pool(4);
+  EXPECT_EQ(4, pool.num_threads());
+  const int n = 1000;
+  values_.assign(n, 0);
+  pool.Run(n, boost::bind(&ThreadPoolTest::Fill, this, _1));
+  for (int i = 0; i < n; ++i) {
+    EXPECT_EQ(i + 1, values_[i]);
+  }
+}
+
+TEST_F(ThreadPoolTest, TestRepeatedRuns) {
+  ThreadPool pool(3);
+  const int n = 17;
+  values_.assign(n, 0);
+  for (int run = 0; run < 50; ++run) {
+    pool.Run(n, boost::bind(&ThreadPoolTest::Fill, this, _1));
+  }
+  for (int i = 0; i < n; ++i) {
+    EXPECT_EQ(50 * (i + 1), values_[i]);
+  }
+}
+
+TEST_F(ThreadPoolTest, TestSingleThreadAndEmptyRun) {
+  ThreadPool pool(1);
+  values_.assign(5, 0);
+  pool.Run(0, boost::bind(&ThreadPoolTest::Fill, this, _1));
+  pool.Run(5, boost::bind(&ThreadPoolTest::Fill, this, _1));
+  for (int i = 0; i < 5; ++i) {
+    EXPECT_EQ(i + 1, values_[i]);
+  }
+}
+
+class ThreadPoolInterruptTest : public ::testing::Test {
+ public:
+  ThreadPoolInterruptTest() : pool_(4), values_(4, 0) {}
+
+  // Spins instead of sleeping so that the tasks have no interruption point.
+  void SlowFill(int i) {
+    boost::posix_time::ptime end = boost::posix_time::microsec_clock::
+        universal_time() + boost::posix_time::milliseconds(50 * (i + 1));
+    while (boost::posix_time::microsec_clock::universal_time() < end) {}
+    values_[i] = i + 1;
+  }
+  void Run() {
+    pool_.Run(values_.size(),
+        boost::bind(&ThreadPoolInterruptTest::SlowFill, this, _1));
+  }
+
+ protected:
+  ThreadPool pool_;
+  std::vector<int> values_;
+};
+
+TEST_F(ThreadPoolInterruptTest, TestInterruptedRunWaitsForWorkers) {
+  // A prefetch thread may be stopped while it waits for the workers of its
+  // pool, which still use the task it passed.
+  boost::thread caller(&ThreadPoolInterruptTest::Run, this);
+  boost::this_thread::sleep(boost::posix_time::milliseconds(10));
+  caller.interrupt();
+  caller.join();
+  for (int i = 0; i < values_.size(); ++i) {
+    EXPECT_EQ(i + 1, values_[i]);
+  }
+}
+
+TEST_F(ThreadPoolTest, TestWorkersInheritCpuThreads) {
+  const int cpu_threads = Caffe::cpu_threads();
+  Caffe::set_cpu_threads(3);
+  {
+    ThreadPool pool(4);
+    values_.assign(8, 0);
+    pool.Run(8, boost::bind(&ThreadPoolTest::FillCpuThreads, this, _1));
+  }
+  Caffe::set_cpu_threads(cpu_threads);
+  for (int i = 0; i < 8; ++i) {
+    EXPECT_EQ(3, values_[i]);
+  }
+}
+
+TEST_F(ThreadPoolTest, TestDefaultSize) {
+  ThreadPool pool(0);
+  EXPECT_GE(pool.num_threads(), 1);
+}
+
+}  // namespace caffe
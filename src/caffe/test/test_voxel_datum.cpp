@@ -0,0 +1,73 @@
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "caffe/common.hpp"
+#include "caffe/proto/caffe.pb.h"
+#include "caffe/util/voxel_datum.hpp"
+
+#include "caffe/test/test_caffe_main.hpp"
+
+namespace caffe {
+
+template <typename Dtype>
+class VoxelDatumTest : public ::testing::Test {
+ protected:
+  VoxelDatumTest() : size_(3), voxels_(size_ * size_ * size_) {}
+
+  virtual void SetUp() {
+    // Values as decoded from an 8-bit voxels image.
+    for (int i = 0; i < voxels_.size(); ++i) {
+      voxels_[i] = Dtype((i * 37) % 256) / 255;
+    }
+  }
+
+  int size_;
+  vector<Dtype> voxels_;
+};
+
+TYPED_TEST_CASE(VoxelDatumTest, TestDtypes);
+
+TYPED_TEST(VoxelDatumTest, TestBytesRoundTrip) {
+  VoxelDatum datum;
+  EncodeVoxels(this->size_, this->voxels_.data(), false, &datum);
+  EXPECT_EQ(this->size_, datum.voxels_size());
+  EXPECT_FALSE(datum.bit_packed());
+  EXPECT_EQ(this->voxels_.size(), datum.voxels().size());
+  vector<TypeParam> decoded(this->voxels_.size());
+  DecodeVoxels(datum, decoded.data());
+  for (int i = 0; i < decoded.size(); ++i) {
+    EXPECT_NEAR(this->voxels_[i], decoded[i], 1e-6);
+  }
+}
+
+TYPED_TEST(VoxelDatumTest, TestBitPacked) {
+  VoxelDatum datum;
+  EncodeVoxels(this->size_, this->voxels_.data(), true, &datum);
+  EXPECT_TRUE(datum.bit_packed());
+  // 27 voxels fit in 4 bytes.
+  EXPECT_EQ(4, datum.voxels().size());
+  vector<TypeParam> decoded(this->voxels_.size());
+  DecodeVoxels(datum, decoded.data());
+  for (int i = 0; i < decoded.size(); ++i) {
+    EXPECT_EQ(this->voxels_[i] >= 0.5 ? 1 : 0, decoded[i]);
+  }
+}
+
+TYPED_TEST(VoxelDatumTest, TestSerialized) {
+  VoxelDatum datum;
+  datum.mutable_sketch()->set_channels(3);
+  EncodeVoxels(this->size_, this->voxels_.data(), true, &datum);
+  string out;
+  ASSERT_TRUE(datum.SerializeToString(&out));
+  VoxelDatum parsed;
+  ASSERT_TRUE(parsed.ParseFromString(out));
+  EXPECT_EQ(3, parsed.sketch().channels());
+  vector<TypeParam> expected(this->voxels_.size());
+  vector<TypeParam> decoded(this->voxels_.size());
+  DecodeVoxels(datum, expected.data());
+  DecodeVoxels(parsed, decoded.data());
+  EXPECT_EQ(expected, decoded);
+}
+
+}  // namespace caffe
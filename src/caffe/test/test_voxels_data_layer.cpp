@@ -0,0 +1,198 @@
+#if defined(USE_OPENCV) && defined(USE_LMDB)
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include "boost/scoped_ptr.hpp"
+#include "gtest/gtest.h"
+
+#include "caffe/blob.hpp"
+#include "caffe/common.hpp"
+#include "caffe/layers/voxels_data_layer.hpp"
+#include "caffe/proto/caffe.pb.h"
+#include "caffe/util/db.hpp"
+#include "caffe/util/format.hpp"
+#include "caffe/util/io.hpp"
+
+#include "caffe/test/test_caffe_main.hpp"
+
+namespace caffe {
+
+using boost::scoped_ptr;
+
+template <typename TypeParam>
+class VoxelsDataLayerTest : public MultiDeviceTest<TypeParam> {
+  typedef typename TypeParam::Dtype Dtype;
+
+ protected:
+  VoxelsDataLayerTest()
+      : blob_top_data_(new Blob<Dtype>()),
+        blob_top_voxels_(new Blob<Dtype>()),
+        num_records_(6), batch_size_(3) {}
+  virtual void SetUp() {
+    filename_.reset(new string());
+    MakeTempDir(filename_.get());
+    *filename_ += "/db";
+    blob_top_vec_.push_back(blob_top_data_);
+    blob_top_vec_.push_back(blob_top_voxels_);
+    Fill();
+  }
+  virtual ~VoxelsDataLayerTest() {
+    delete blob_top_data_;
+    delete blob_top_voxels_;
+  }
+
+  // Record i has a 1x2x2 sketch of pixels i, and a 2x2x2 grid that is full
+  // if i is odd and else empty.
+  void Fill() {
+    LOG(INFO) << "Using temporary dataset " << *filename_;
+    scoped_ptr<db::DB> db(db::GetDB(DataParameter_DB_LMDB));
+    db->Open(*filename_, db::NEW);
+    scoped_ptr<db::Transaction> txn(db->NewTransaction());
+    for (int i = 0; i < num_records_; ++i) {
+      VoxelDatum datum;
+      Datum* sketch = datum.mutable_sketch();
+      sketch->set_channels(1);
+      sketch->set_height(2);
+      sketch->set_width(2);
+      sketch->set_data(string(4, static_cast<char>(i)));
+      datum.set_voxels_size(2);
+      datum.set_voxels(string(8, static_cast<char>(i % 2 ? 255 : 0)));
+      string value;
+      CHECK(datum.SerializeToString(&value));
+      txn->Put(format_int(i, 8), value);
+    }
+    txn->Commit();
+    db->Close();
+  }
+
+  LayerParameter Param(Phase phase, bool shuffle) {
+    LayerParameter param;
+    param.set_phase(phase);
+    VoxelsDataParameter* voxels_data_param =
+        param.mutable_voxels_data_param();
+    voxels_data_param->set_batch_size(batch_size_);
+    voxels_data_param->set_source(*filename_);
+    voxels_data_param->set_source_type(
+        VoxelsDataParameter_SourceType_VOXEL_DB);
+    voxels_data_param->set_backend(DataParameter_DB_LMDB);
+    voxels_data_param->set_voxels_size(2);
+    voxels_data_param->set_shuffle(shuffle);
+    // The first solver writes the key index and the others read it.
+    voxels_data_param->set_key_index(*filename_ + ".keys");
+    return param;
+  }
+
+  // Forwards num_batches batches of layer, appending the record of each item
+  // to records.
+  void Read(VoxelsDataLayer<Dtype>* layer, int num_batches,
+      vector<int>* records) {
+    for (int iter = 0; iter < num_batches; ++iter) {
+      layer->Forward(blob_bottom_vec_, blob_top_vec_);
+      for (int i = 0; i < batch_size_; ++i) {
+        const int record = blob_top_data_->cpu_data()[i * 4];
+        EXPECT_EQ(record % 2, blob_top_voxels_->cpu_data()[i * 8]);
+        records->push_back(record);
+      }
+    }
+  }
+
+  // Checks that every epoch of records goes through all the records once.
+  void ExpectPermutations(const vector<int>& records) {
+    for (int epoch = 0; epoch < records.size() / num_records_; ++epoch) {
+      vector<int> epoch_records(records.begin() + epoch * num_records_,
+          records.begin() + (epoch + 1) * num_records_);
+      std::sort(epoch_records.begin(), epoch_records.end());
+      for (int i = 0; i < num_records_; ++i) {
+        EXPECT_EQ(i, epoch_records[i]) << "debug: epoch " << epoch;
+      }
+    }
+  }
+
+  shared_ptr<string> filename_;
+  Blob<Dtype>* const blob_top_data_;
+  Blob<Dtype>* const blob_top_voxels_;
+  vector<Blob<Dtype>*> blob_bottom_vec_;
+  vector<Blob<Dtype>*> blob_top_vec_;
+  const int num_records_;
+  const int batch_size_;
+};
+
+TYPED_TEST_CASE(VoxelsDataLayerTest, TestDtypesAndDevices);
+
+TYPED_TEST(VoxelsDataLayerTest, TestShardsInOrder) {
+  typedef typename TypeParam::Dtype Dtype;
+  const int num_solvers = 2;
+  Caffe::set_solver_count(num_solvers);
+  for (int rank = 0; rank < num_solvers; ++rank) {
+    Caffe::set_solver_rank(rank);
+    VoxelsDataLayer<Dtype> layer(this->Param(TRAIN, false));
+    layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+    vector<int> records;
+    this->Read(&layer, 2, &records);
+    for (int i = 0; i < records.size(); ++i) {
+      EXPECT_EQ((rank + i * num_solvers) % this->num_records_, records[i])
+          << "debug: rank " << rank << " i " << i;
+    }
+  }
+  Caffe::set_solver_count(1);
+  Caffe::set_solver_rank(0);
+}
+
+TYPED_TEST(VoxelsDataLayerTest, TestShuffledShards) {
+  typedef typename TypeParam::Dtype Dtype;
+  const int num_solvers = 2;
+  const int batches = 4;
+  // Sample k of solver rank is sample k * num_solvers + rank of all.
+  vector<int> records(num_solvers * batches * this->batch_size_);
+  Caffe::set_solver_count(num_solvers);
+  for (int rank = 0; rank < num_solvers; ++rank) {
+    Caffe::set_solver_rank(rank);
+    vector<int> solver_records;
+    {
+      VoxelsDataLayer<Dtype> layer(this->Param(TRAIN, true));
+      layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+      EXPECT_TRUE(layer.resumable());
+      this->Read(&layer, batches, &solver_records);
+    }
+    for (int k = 0; k < solver_records.size(); ++k) {
+      records[k * num_solvers + rank] = solver_records[k];
+    }
+    // A layer resumed after 2 batches goes on as this one did.
+    VoxelsDataLayer<Dtype> layer(this->Param(TRAIN, true));
+    layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+    layer.Resume(2);
+    vector<int> resumed;
+    this->Read(&layer, batches - 2, &resumed);
+    for (int k = 0; k < resumed.size(); ++k) {
+      EXPECT_EQ(solver_records[2 * this->batch_size_ + k], resumed[k])
+          << "debug: rank " << rank << " k " << k;
+    }
+  }
+  Caffe::set_solver_count(1);
+  Caffe::set_solver_rank(0);
+  // The shards of an epoch are disjoint and cover every record.
+  this->ExpectPermutations(records);
+}
+
+TYPED_TEST(VoxelsDataLayerTest, TestTestPhaseReadsEveryRecord) {
+  typedef typename TypeParam::Dtype Dtype;
+  // Only the first solver tests, so it reads all the records.
+  Caffe::set_solver_count(2);
+  for (int shuffle = 0; shuffle < 2; ++shuffle) {
+    VoxelsDataLayer<Dtype> layer(this->Param(TEST, shuffle));
+    layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+    vector<int> records;
+    this->Read(&layer, 4, &records);
+    if (!shuffle) {
+      for (int i = 0; i < records.size(); ++i) {
+        EXPECT_EQ(i % this->num_records_, records[i]);
+      }
+    }
+    this->ExpectPermutations(records);
+  }
+  Caffe::set_solver_count(1);
+}
+
+}  // namespace caffe
+#endif  // USE_OPENCV && USE_LMDB
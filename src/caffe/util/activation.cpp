@@ -0,0 +1,57 @@
+#include <algorithm>
+#include <cmath>
+
+#include "caffe/common.hpp"
+#include "caffe/util/activation.hpp"
+
+namespace caffe {
+
+template <typename Dtype>
+void caffe_cpu_activation(const ActivationParameter& param, const int count,
+    Dtype* data) {
+  switch (param.type()) {
+  case ActivationParameter_Type_NONE:
+    break;
+  case ActivationParameter_Type_RELU: {
+    const Dtype negative_slope = param.relu_param().negative_slope();
+    for (int i = 0; i < count; ++i) {
+      data[i] = std::max(data[i], Dtype(0)) +
+          negative_slope * std::min(data[i], Dtype(0));
+    }
+    break;
+  }
+  case ActivationParameter_Type_SWISH: {
+    // x * sigmoid(beta * x), with the sigmoid of SigmoidLayer.
+    const Dtype beta = param.swish_param().beta();
+    for (int i = 0; i < count; ++i) {
+      data[i] *= 0.5 * tanh(0.5 * beta * data[i]) + 0.5;
+    }
+    break;
+  }
+  case ActivationParameter_Type_CLIP: {
+    const Dtype min = param.clip_param().min();
+    const Dtype max = param.clip_param().max();
+    for (int i = 0; i < count; ++i) {
+      data[i] = std::max(min, std::min(data[i], max));
+    }
+    break;
+  }
+  case ActivationParameter_Type_ELU: {
+    const Dtype alpha = param.elu_param().alpha();
+    for (int i = 0; i < count; ++i) {
+      data[i] = std::max(data[i], Dtype(0))
+          + alpha * (exp(std::min(data[i], Dtype(0))) - Dtype(1));
+    }
+    break;
+  }
+  default:
+    LOG(FATAL) << "Unknown activation " << param.type();
+  }
+}
+
+template void caffe_cpu_activation<float>(const ActivationParameter& param,
+    const int count, float* data);
+template void caffe_cpu_activation<double>(const ActivationParameter& param,
+    const int count, double* data);
+
+}  // namespace caffe
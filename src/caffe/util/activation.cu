@@ -0,0 +1,81 @@
+#include "caffe/common.hpp"
+#include "caffe/util/activation.hpp"
+
+namespace caffe {
+
+template <typename Dtype>
+__global__ void relu_activation_kernel(const int n, const Dtype slope,
+    Dtype* data) {
+  CUDA_KERNEL_LOOP(index, n) {
+    data[index] = data[index] > 0 ? data[index] : data[index] * slope;
+  }
+}
+
+template <typename Dtype>
+__global__ void swish_activation_kernel(const int n, const Dtype beta,
+    Dtype* data) {
+  CUDA_KERNEL_LOOP(index, n) {
+    data[index] *= 0.5 * tanh(0.5 * beta * data[index]) + 0.5;
+  }
+}
+
+template <typename Dtype>
+__global__ void clip_activation_kernel(const int n, const Dtype min,
+    const Dtype max, Dtype* data) {
+  CUDA_KERNEL_LOOP(index, n) {
+    data[index] = data[index] < min ? min :
+        (data[index] > max ? max : data[index]);
+  }
+}
+
+template <typename Dtype>
+__global__ void elu_activation_kernel(const int n, const Dtype alpha,
+    Dtype* data) {
+  CUDA_KERNEL_LOOP(index, n) {
+    data[index] = data[index] > 0 ? data[index] :
+        alpha * (exp(data[index]) - 1);
+  }
+}
+
+template <typename Dtype>
+void caffe_gpu_activation(const ActivationParameter& param, const int count,
+    Dtype* data) {
+  switch (param.type()) {
+  case ActivationParameter_Type_NONE:
+    return;
+  case ActivationParameter_Type_RELU:
+    // NOLINT_NEXT_LINE(whitespace/operators)
+    relu_activation_kernel<Dtype><<<CAFFE_GET_BLOCKS(count),
+        CAFFE_CUDA_NUM_THREADS>>>(count,
+        Dtype(param.relu_param().negative_slope()), data);
+    break;
+  case ActivationParameter_Type_SWISH:
+    // NOLINT_NEXT_LINE(whitespace/operators)
+    swish_activation_kernel<Dtype><<<CAFFE_GET_BLOCKS(count),
+        CAFFE_CUDA_NUM_THREADS>>>(count, Dtype(param.swish_param().beta()),
+        data);
+    break;
+  case ActivationParameter_Type_CLIP:
+    // NOLINT_NEXT_LINE(whitespace/operators)
+    clip_activation_kernel<Dtype><<<CAFFE_GET_BLOCKS(count),
+        CAFFE_CUDA_NUM_THREADS>>>(count, Dtype(param.clip_param().min()),
+        Dtype(param.clip_param().max()), data);
+    break;
+  case ActivationParameter_Type_ELU:
+    // NOLINT_NEXT_LINE(whitespace/operators)
+    elu_activation_kernel<Dtype><<<CAFFE_GET_BLOCKS(count),
+        CAFFE_CUDA_NUM_THREADS>>>(count, Dtype(param.elu_param().alpha()),
+        data);
+    break;
+  default:
+    LOG(FATAL) << "Unknown activation " << param.type();
+  }
+  CUDA_POST_KERNEL_CHECK;
+}
+
+template void caffe_gpu_activation<float>(const ActivationParameter& param,
+    const int count, float* data);
+template void caffe_gpu_activation<double>(const ActivationParameter& param,
+    const int count, double* data);
+
+}  // namespace caffe
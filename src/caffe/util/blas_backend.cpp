@@ -0,0 +1,95 @@
+#include <dlfcn.h>
+
+#include <string>
+#include <vector>
+
+#include "caffe/common.hpp"
+#include "caffe/util/blas_backend.hpp"
+
+namespace caffe {
+
+static BlasBackend blas_backend_ = BLAS_LINKED;
+static std::string blas_backend_name_ = "linked";
+static BlasLibrary blas_library_ = {};
+static void* blas_handle_ = NULL;
+
+// The sonames tried for the libraries selected by name, newest first.
+static std::vector<std::string> blas_library_names(const std::string& name) {
+  std::vector<std::string> names;
+  if (name == "openblas") {
+    names.push_back("libopenblas.so.0");
+    names.push_back("libopenblas.so");
+    names.push_back("libopenblas.dylib");
+  } else if (name == "mkl") {
+    names.push_back("libmkl_rt.so.2");
+    names.push_back("libmkl_rt.so");
+    names.push_back("libmkl_rt.dylib");
+  } else if (name == "blis") {
+    names.push_back("libblis.so.4");
+    names.push_back("libblis.so.3");
+    names.push_back("libblis.so");
+    names.push_back("libblis.dylib");
+  } else {
+    names.push_back(name);
+  }
+  return names;
+}
+
+template <typename Function>
+static void load_blas_symbol(void* handle, const std::string& library,
+    const char* symbol, Function* function) {
+  void* address = dlsym(handle, symbol);
+  CHECK(address) << "No " << symbol << " in " << library << ": "
+      << dlerror();
+  *reinterpret_cast<void**>(function) = address;
+}
+
+void caffe_set_blas_backend(const std::string& name) {
+  if (name == blas_backend_name_) {
+    return;
+  }
+  void* handle = NULL;
+  BlasBackend backend = BLAS_LIBRARY;
+  BlasLibrary library = {};
+  if (name == "linked") {
+    backend = BLAS_LINKED;
+  } else if (name == "builtin") {
+    backend = BLAS_BUILTIN;
+  } else {
+    const std::vector<std::string> names = blas_library_names(name);
+    std::string error;
+    for (int i = 0; i < names.size() && !handle; ++i) {
+      handle = dlopen(names[i].c_str(), RTLD_NOW | RTLD_LOCAL);
+      if (!handle) {
+        error += std::string("\n  ") + dlerror();
+      }
+    }
+    CHECK(handle) << "Cannot load the BLAS library " << name << ":" << error;
+    load_blas_symbol(handle, name, "cblas_sgemm", &library.sgemm);
+    load_blas_symbol(handle, name, "cblas_dgemm", &library.dgemm);
+    load_blas_symbol(handle, name, "cblas_sgemv", &library.sgemv);
+    load_blas_symbol(handle, name, "cblas_dgemv", &library.dgemv);
+  }
+  if (blas_handle_) {
+    dlclose(blas_handle_);
+  }
+  blas_handle_ = handle;
+  blas_library_ = library;
+  blas_backend_ = backend;
+  blas_backend_name_ = name;
+  LOG(INFO) << "Using the " << name << " BLAS backend.";
+}
+
+BlasBackend caffe_blas_backend() {
+  return blas_backend_;
+}
+
+const std::string& caffe_blas_backend_name() {
+  return blas_backend_name_;
+}
+
+const BlasLibrary& caffe_blas_library() {
+  return blas_library_;
+}
+
+}  // namespace caffe
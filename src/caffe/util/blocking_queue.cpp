@@ -4,6 +4,7 @@
 #include "caffe/layers/base_data_layer.hpp"
 #include "caffe/parallel.hpp"
 #include "caffe/util/blocking_queue.hpp"
+#include "caffe/util/hdf5_prefetcher.hpp"
 
 namespace caffe {
 
@@ -87,5 +88,8 @@ size_t BlockingQueue<T>::size() const {
 
 template class BlockingQueue<Batch<float>*>;
 template class BlockingQueue<Batch<double>*>;
+template class BlockingQueue<HDF5FileData<float>*>;
+template class BlockingQueue<HDF5FileData<double>*>;
+template class BlockingQueue<string>;
 
 }  // namespace caffe
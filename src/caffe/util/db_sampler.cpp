@@ -0,0 +1,74 @@
+#include <boost/filesystem.hpp>
+
+#include <string>
+#include <vector>
+
+#include "caffe/proto/caffe.pb.h"
+#include "caffe/util/db_sampler.hpp"
+#include "caffe/util/io.hpp"
+#include "caffe/util/rng.hpp"
+
+namespace caffe { namespace db {
+
+void ReadKeys(Cursor* cursor, vector<string>* keys) {
+  keys->clear();
+  for (cursor->SeekToFirst(); cursor->valid(); cursor->Next()) {
+    keys->push_back(cursor->key());
+  }
+  cursor->SeekToFirst();
+}
+
+void ReadOrWriteKeyIndex(const string& filename, Cursor* cursor,
+    bool write_index, vector<string>* keys) {
+  if (!filename.empty() && boost::filesystem::exists(filename)) {
+    KeyIndex index;
+    CHECK(ReadProtoFromBinaryFile(filename, &index))
+        << "Failed to read key index " << filename;
+    keys->assign(index.key().begin(), index.key().end());
+    return;
+  }
+  ReadKeys(cursor, keys);
+  if (!filename.empty() && write_index) {
+    KeyIndex index;
+    for (int i = 0; i < keys->size(); ++i) {
+      index.add_key((*keys)[i]);
+    }
+    // Readers see the whole index or none of it.
+    const string temp_filename = filename + ".tmp";
+    WriteProtoToBinaryFile(index, temp_filename);
+    boost::filesystem::rename(temp_filename, filename);
+    LOG(INFO) << "Wrote the index of " << keys->size() << " keys to "
+        << filename;
+  }
+}
+
+ShardedSampler::ShardedSampler(int num_keys, uint32_t seed, int shard,
+    int num_shards)
+    : num_keys_(num_keys), seed_(seed), shard_(shard),
+      num_shards_(num_shards), offset_(0), epoch_(0) {
+  CHECK_GT(num_keys_, 0) << "There are no keys to sample";
+  CHECK_GE(shard_, 0);
+  CHECK_LT(shard_, num_shards_);
+}
+
+int ShardedSampler::Next() {
+  const uint64_t position = offset_++ * num_shards_ + shard_;
+  const uint64_t epoch = position / num_keys_;
+  if (permutation_.empty() || epoch != epoch_) {
+    Shuffle(epoch);
+  }
+  return permutation_[position % num_keys_];
+}
+
+void ShardedSampler::Shuffle(uint64_t epoch) {
+  permutation_.resize(num_keys_);
+  for (int i = 0; i < num_keys_; ++i) {
+    permutation_[i] = i;
+  }
+  rng_t rng(static_cast<uint32_t>(seed_ + epoch));
+  shuffle(permutation_.begin(), permutation_.end(), &rng);
+  epoch_ = epoch;
+}
+
+}  // namespace db
+}  // namespace caffe
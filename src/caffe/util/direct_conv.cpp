@@ -0,0 +1,224 @@
+#include <algorithm>
+
+#include "caffe/util/direct_conv.hpp"
+#include "caffe/util/math_functions.hpp"
+
+namespace caffe {
+
+// Outputs are computed in register tiles of kDirectConvBlock channels by
+// kDirectConvWidth columns of a row, accumulated over the input channels and
+// the kernel.
+static const int kDirectConvBlock = 4;
+static const int kDirectConvWidth = 8;
+
+// One tile, data pointing at the first input of its first output in the
+// padded volume, whose channels are channel_size apart and whose slices and
+// rows are slice_size and width apart. kStride is the column stride when
+// known at compile time, 0 otherwise.
+template <typename Dtype, int kStride>
+static void conv_direct_tile(const Dtype* data, const int channels,
+    const int channel_size, const int slice_size, const int width,
+    const Dtype* weights, const int block, const int kernel_d,
+    const int kernel_h, const int kernel_w, const int stride_w,
+    const int dilation_d, const int dilation_h, const int dilation_w,
+    Dtype* output, const int output_size) {
+  const int stride = kStride ? kStride : stride_w;
+  const int kernel_size = kernel_d * kernel_h * kernel_w;
+  const int weight_stride = channels * kernel_size;
+  // One accumulator row per output channel of the block, so that they can
+  // stay in registers. Blocks of less than kDirectConvBlock channels compute
+  // their last one several times.
+  Dtype acc0[kDirectConvWidth] = {}, acc1[kDirectConvWidth] = {};
+  Dtype acc2[kDirectConvWidth] = {}, acc3[kDirectConvWidth] = {};
+  const Dtype* weights1 = weights + std::min(1, block - 1) * weight_stride;
+  const Dtype* weights2 = weights + std::min(2, block - 1) * weight_stride;
+  const Dtype* weights3 = weights + std::min(3, block - 1) * weight_stride;
+  for (int c = 0; c < channels; ++c) {
+    for (int kd = 0; kd < kernel_d; ++kd) {
+      for (int kh = 0; kh < kernel_h; ++kh) {
+        const Dtype* in_row = data + c * channel_size +
+            kd * dilation_d * slice_size + kh * dilation_h * width;
+        const int w_offset = c * kernel_size + (kd * kernel_h + kh) * kernel_w;
+        for (int kw = 0; kw < kernel_w; ++kw) {
+          const Dtype w0 = weights[w_offset + kw];
+          const Dtype w1 = weights1[w_offset + kw];
+          const Dtype w2 = weights2[w_offset + kw];
+          const Dtype w3 = weights3[w_offset + kw];
+          const Dtype* in = in_row + kw * dilation_w;
+          for (int x = 0; x < kDirectConvWidth; ++x) {
+            const Dtype value = in[x * stride];
+            acc0[x] += w0 * value;
+            acc1[x] += w1 * value;
+            acc2[x] += w2 * value;
+            acc3[x] += w3 * value;
+          }
+        }
+      }
+    }
+  }
+  Dtype* acc[kDirectConvBlock] = {acc0, acc1, acc2, acc3};
+  for (int b = 0; b < block; ++b) {
+    for (int x = 0; x < kDirectConvWidth; ++x) {
+      output[b * output_size + x] = acc[b][x];
+    }
+  }
+}
+
+// Rows narrower than a tile, one output at a time.
+template <typename Dtype>
+static void conv_direct_row(const Dtype* data, const int channels,
+    const int channel_size, const int slice_size, const int width,
+    const Dtype* weights, const int block, const int kernel_d,
+    const int kernel_h, const int kernel_w, const int stride_w,
+    const int dilation_d, const int dilation_h, const int dilation_w,
+    const int columns, Dtype* output, const int output_size) {
+  const int kernel_size = kernel_d * kernel_h * kernel_w;
+  for (int b = 0; b < block; ++b) {
+    const Dtype* filter = weights + b * channels * kernel_size;
+    for (int x = 0; x < columns; ++x) {
+      Dtype sum = 0;
+      for (int c = 0; c < channels; ++c) {
+        for (int kd = 0; kd < kernel_d; ++kd) {
+          for (int kh = 0; kh < kernel_h; ++kh) {
+            const Dtype* in = data + c * channel_size +
+                kd * dilation_d * slice_size + kh * dilation_h * width +
+                x * stride_w;
+            const Dtype* f = filter + c * kernel_size +
+                (kd * kernel_h + kh) * kernel_w;
+            for (int kw = 0; kw < kernel_w; ++kw) {
+              sum += f[kw] * in[kw * dilation_w];
+            }
+          }
+        }
+      }
+      output[b * output_size + x] = sum;
+    }
+  }
+}
+
+// conv_direct_3d_cpu, which conv_direct_cpu calls with a depth of 1.
+template <typename Dtype>
+static void conv_direct_core_cpu(const Dtype* data, const int channels,
+    const int depth, const int height, const int width,
+    const Dtype* weights, const int num_output, const int kernel_d,
+    const int kernel_h, const int kernel_w, const int pad_d, const int pad_h,
+    const int pad_w, const int stride_d, const int stride_h,
+    const int stride_w, const int dilation_d, const int dilation_h,
+    const int dilation_w, const int depth_out, const int height_out,
+    const int width_out, Dtype* buffer, Dtype* output) {
+  // Pad the volume once so that the tiles need no bounds checks.
+  const int padded_depth = depth + 2 * pad_d;
+  const int padded_height = height + 2 * pad_h;
+  const int padded_width = width + 2 * pad_w;
+  const int slice_size = padded_height * padded_width;
+  const int channel_size = padded_depth * slice_size;
+  if (pad_d || pad_h || pad_w) {
+    caffe_set(channels * channel_size, Dtype(0), buffer);
+    for (int c = 0; c < channels; ++c) {
+      for (int d = 0; d < depth; ++d) {
+        for (int h = 0; h < height; ++h) {
+          caffe_copy(width, data + ((c * depth + d) * height + h) * width,
+              buffer + c * channel_size + (d + pad_d) * slice_size +
+              (h + pad_h) * padded_width + pad_w);
+        }
+      }
+    }
+    data = buffer;
+  }
+  const int kernel_size = kernel_d * kernel_h * kernel_w;
+  const int output_size = depth_out * height_out * width_out;
+  for (int k0 = 0; k0 < num_output; k0 += kDirectConvBlock) {
+    const int block = std::min(kDirectConvBlock, num_output - k0);
+    const Dtype* block_weights = weights + k0 * channels * kernel_size;
+    for (int d = 0; d < depth_out; ++d) {
+      for (int h = 0; h < height_out; ++h) {
+        const Dtype* in = data + d * stride_d * slice_size +
+            h * stride_h * padded_width;
+        Dtype* out = output + k0 * output_size +
+            (d * height_out + h) * width_out;
+        if (width_out < kDirectConvWidth) {
+          conv_direct_row(in, channels, channel_size, slice_size,
+              padded_width, block_weights, block, kernel_d, kernel_h,
+              kernel_w, stride_w, dilation_d, dilation_h, dilation_w,
+              width_out, out, output_size);
+          continue;
+        }
+        for (int x0 = 0; x0 < width_out; x0 += kDirectConvWidth) {
+          // The last tile of a row overlaps the previous one rather than
+          // being partial.
+          const int x = std::min(x0, width_out - kDirectConvWidth);
+          if (stride_w == 1) {
+            conv_direct_tile<Dtype, 1>(in + x, channels, channel_size,
+                slice_size, padded_width, block_weights, block, kernel_d,
+                kernel_h, kernel_w, 1, dilation_d, dilation_h, dilation_w,
+                out + x, output_size);
+          } else {
+            conv_direct_tile<Dtype, 0>(in + x * stride_w, channels,
+                channel_size, slice_size, padded_width, block_weights, block,
+                kernel_d, kernel_h, kernel_w, stride_w, dilation_d,
+                dilation_h, dilation_w, out + x, output_size);
+          }
+        }
+      }
+    }
+  }
+}
+
+template <typename Dtype>
+void conv_direct_cpu(const Dtype* data, const int channels,
+    const int height, const int width, const Dtype* weights,
+    const int num_output, const int kernel_h, const int kernel_w,
+    const int pad_h, const int pad_w, const int stride_h, const int stride_w,
+    const int dilation_h, const int dilation_w, const int height_out,
+    const int width_out, Dtype* buffer, Dtype* output) {
+  conv_direct_core_cpu(data, channels, 1, height, width, weights, num_output,
+      1, kernel_h, kernel_w, 0, pad_h, pad_w, 1, stride_h, stride_w, 1,
+      dilation_h, dilation_w, 1, height_out, width_out, buffer, output);
+}
+
+template void conv_direct_cpu<float>(const float* data, const int channels,
+    const int height, const int width, const float* weights,
+    const int num_output, const int kernel_h, const int kernel_w,
+    const int pad_h, const int pad_w, const int stride_h, const int stride_w,
+    const int dilation_h, const int dilation_w, const int height_out,
+    const int width_out, float* buffer, float* output);
+template void conv_direct_cpu<double>(const double* data, const int channels,
+    const int height, const int width, const double* weights,
+    const int num_output, const int kernel_h, const int kernel_w,
+    const int pad_h, const int pad_w, const int stride_h, const int stride_w,
+    const int dilation_h, const int dilation_w, const int height_out,
+    const int width_out, double* buffer, double* output);
+
+template <typename Dtype>
+void conv_direct_3d_cpu(const Dtype* data, const int channels,
+    const int depth, const int height, const int width, const Dtype* weights,
+    const int num_output, const int kernel_d, const int kernel_h,
+    const int kernel_w, const int pad_d, const int pad_h, const int pad_w,
+    const int stride_d, const int stride_h, const int stride_w,
+    const int dilation_d, const int dilation_h, const int dilation_w,
+    const int depth_out, const int height_out, const int width_out,
+    Dtype* buffer, Dtype* output) {
+  conv_direct_core_cpu(data, channels, depth, height, width, weights,
+      num_output, kernel_d, kernel_h, kernel_w, pad_d, pad_h, pad_w, stride_d,
+      stride_h, stride_w, dilation_d, dilation_h, dilation_w, depth_out,
+      height_out, width_out, buffer, output);
+}
+
+template void conv_direct_3d_cpu<float>(const float* data,
+    const int channels, const int depth, const int height, const int width,
+    const float* weights, const int num_output, const int kernel_d,
+    const int kernel_h, const int kernel_w, const int pad_d, const int pad_h,
+    const int pad_w, const int stride_d, const int stride_h,
+    const int stride_w, const int dilation_d, const int dilation_h,
+    const int dilation_w, const int depth_out, const int height_out,
+    const int width_out, float* buffer, float* output);
+template void conv_direct_3d_cpu<double>(const double* data,
+    const int channels, const int depth, const int height, const int width,
+    const double* weights, const int num_output, const int kernel_d,
+    const int kernel_h, const int kernel_w, const int pad_d, const int pad_h,
+    const int pad_w, const int stride_d, const int stride_h,
+    const int stride_w, const int dilation_d, const int dilation_h,
+    const int dilation_w, const int depth_out, const int height_out,
+    const int width_out, double* buffer, double* output);
+
+}  // namespace caffe
@@ -0,0 +1,211 @@
+#include <cmath>
+#include <string>
+#include <vector>
+
+#include "caffe/blob.hpp"
+#include "caffe/common.hpp"
+#include "caffe/util/fusion.hpp"
+
+namespace caffe {
+
+// Writes blob into proto, in double precision only if like is, and in the
+// storage of like.
+static void WriteBlob(const Blob<double>& blob, const BlobProto& like,
+    BlobProto* proto) {
+  if (like.double_data_size() > 0 || like.storage() != NATIVE) {
+    blob.ToProto(proto, false, like.storage());
+    return;
+  }
+  Blob<float> single(blob.shape());
+  float* data = single.mutable_cpu_data();
+  for (int i = 0; i < blob.count(); ++i) {
+    data[i] = blob.cpu_data()[i];
+  }
+  single.ToProto(proto);
+}
+
+// The per channel y = scale * x + shift that a BatchNorm layer with global
+// statistics or a Scale layer of one axis computes, false for other layers.
+static bool ChannelAffine(const LayerParameter& layer,
+    vector<double>* scale, vector<double>* shift) {
+  if (layer.type() == "BatchNorm") {
+    const BatchNormParameter& param = layer.batch_norm_param();
+    if ((param.has_use_global_stats() && !param.use_global_stats()) ||
+        layer.blobs_size() != 3) {
+      return false;
+    }
+    Blob<double> mean, variance, factor;
+    mean.FromProto(layer.blobs(0));
+    variance.FromProto(layer.blobs(1));
+    factor.FromProto(layer.blobs(2));
+    // The statistics are stored summed, factor being the sum of weights.
+    const double normalizer = factor.cpu_data()[0] == 0 ?
+        0 : 1 / factor.cpu_data()[0];
+    scale->resize(mean.count());
+    shift->resize(mean.count());
+    for (int c = 0; c < mean.count(); ++c) {
+      (*scale)[c] = 1 / sqrt(variance.cpu_data()[c] * normalizer +
+          param.eps());
+      (*shift)[c] = -mean.cpu_data()[c] * normalizer * (*scale)[c];
+    }
+    return true;
+  }
+  if (layer.type() == "Scale") {
+    const ScaleParameter& param = layer.scale_param();
+    if (param.axis() != 1 || param.num_axes() != 1 ||
+        layer.blobs_size() != 1 + param.bias_term()) {
+      return false;
+    }
+    Blob<double> gamma, beta;
+    gamma.FromProto(layer.blobs(0));
+    scale->assign(gamma.cpu_data(), gamma.cpu_data() + gamma.count());
+    shift->assign(gamma.count(), 0);
+    if (param.bias_term()) {
+      beta.FromProto(layer.blobs(1));
+      shift->assign(beta.cpu_data(), beta.cpu_data() + beta.count());
+    }
+    return true;
+  }
+  return false;
+}
+
+// The activation that layer computes, NONE if it is not one that can be fused.
+static ActivationParameter LayerActivation(const LayerParameter& layer) {
+  ActivationParameter activation;
+  if (layer.type() == "ReLU") {
+    activation.set_type(ActivationParameter_Type_RELU);
+    activation.mutable_relu_param()->CopyFrom(layer.relu_param());
+  } else if (layer.type() == "Swish") {
+    activation.set_type(ActivationParameter_Type_SWISH);
+    activation.mutable_swish_param()->CopyFrom(layer.swish_param());
+  } else if (layer.type() == "Clip") {
+    activation.set_type(ActivationParameter_Type_CLIP);
+    activation.mutable_clip_param()->CopyFrom(layer.clip_param());
+  } else if (layer.type() == "ELU") {
+    activation.set_type(ActivationParameter_Type_ELU);
+    activation.mutable_elu_param()->CopyFrom(layer.elu_param());
+  }
+  return activation;
+}
+
+// Folds y = scale * x + shift, per output channel, into the weights and bias
+// of producer, adding the bias if it has none. Weights shared by name with
+// other layers are left alone, as those layers would see the folded values.
+static bool FoldAffine(const vector<double>& scale,
+    const vector<double>& shift, LayerParameter* producer) {
+  for (int i = 0; i < producer->param_size(); ++i) {
+    if (producer->param(i).name() != "") {
+      return false;
+    }
+  }
+  const bool conv = producer->type() == "Convolution";
+  const int num_output = conv ? producer->convolution_param().num_output() :
+      producer->inner_product_param().num_output();
+  const bool bias_term = conv ? producer->convolution_param().bias_term() :
+      producer->inner_product_param().bias_term();
+  if (scale.size() != num_output || producer->blobs_size() != 1 + bias_term) {
+    return false;
+  }
+  Blob<double> weights;
+  weights.FromProto(producer->blobs(0));
+  // Inner products with transposed weights keep an output per column.
+  const bool transpose = !conv && producer->inner_product_param().transpose();
+  const int inner = weights.count() / num_output;
+  double* weight = weights.mutable_cpu_data();
+  for (int o = 0; o < num_output; ++o) {
+    for (int i = 0; i < inner; ++i) {
+      weight[transpose ? i * num_output + o : o * inner + i] *= scale[o];
+    }
+  }
+  Blob<double> bias(vector<int>(1, num_output));
+  if (bias_term) {
+    bias.FromProto(producer->blobs(1));
+  }
+  double* bias_data = bias.mutable_cpu_data();
+  for (int o = 0; o < num_output; ++o) {
+    bias_data[o] = bias_data[o] * scale[o] + shift[o];
+  }
+  const BlobProto like = producer->blobs(0);
+  WriteBlob(weights, like, producer->mutable_blobs(0));
+  if (!bias_term) {
+    producer->add_blobs();
+    if (conv) {
+      producer->mutable_convolution_param()->set_bias_term(true);
+    } else {
+      producer->mutable_inner_product_param()->set_bias_term(true);
+    }
+  }
+  WriteBlob(bias, like, producer->mutable_blobs(1));
+  return true;
+}
+
+// Whether a layer after index reads blob.
+static bool ReadAfter(const NetParameter& param, int index,
+    const string& blob) {
+  for (int i = index + 1; i < param.layer_size(); ++i) {
+    for (int j = 0; j < param.layer(i).bottom_size(); ++j) {
+      if (param.layer(i).bottom(j) == blob) {
+        return true;
+      }
+    }
+  }
+  return false;
+}
+
+int FuseNet(const NetParameter& param, NetParameter* fused) {
+  fused->CopyFrom(param);
+  fused->clear_layer();
+  int num_fused = 0;
+  for (int i = 0; i < param.layer_size(); ++i) {
+    LayerParameter* producer = fused->add_layer();
+    producer->CopyFrom(param.layer(i));
+    const bool conv = producer->type() == "Convolution";
+    if ((!conv && producer->type() != "InnerProduct") ||
+        producer->top_size() != 1 ||
+        (conv ? producer->convolution_param().axis() :
+         producer->inner_product_param().axis()) != 1) {
+      continue;
+    }
+    ActivationParameter activation = conv ?
+        producer->convolution_param().activation() :
+        producer->inner_product_param().activation();
+    for (; i + 1 < param.layer_size(); ++i) {
+      const LayerParameter& next = param.layer(i + 1);
+      if (next.bottom_size() != 1 || next.top_size() != 1 ||
+          next.bottom(0) != producer->top(0) ||
+          (next.top(0) != next.bottom(0) &&
+           ReadAfter(param, i + 1, next.bottom(0)))) {
+        break;
+      }
+      // Affine layers fold into the weights only before the activation.
+      vector<double> scale, shift;
+      const ActivationParameter next_activation = LayerActivation(next);
+      if (activation.type() != ActivationParameter_Type_NONE) {
+        break;
+      } else if (ChannelAffine(next, &scale, &shift)) {
+        if (!FoldAffine(scale, shift, producer)) {
+          break;
+        }
+      } else if (next_activation.type() != ActivationParameter_Type_NONE) {
+        activation = next_activation;
+      } else {
+        break;
+      }
+      LOG(INFO) << "Fusing " << next.name() << " into " << producer->name();
+      producer->set_top(0, next.top(0));
+      ++num_fused;
+    }
+    if (activation.type() != ActivationParameter_Type_NONE) {
+      if (conv) {
+        producer->mutable_convolution_param()->mutable_activation()->CopyFrom(
+            activation);
+      } else {
+        producer->mutable_inner_product_param()->mutable_activation()->
+            CopyFrom(activation);
+      }
+    }
+  }
+  return num_fused;
+}
+
+}  // namespace caffe
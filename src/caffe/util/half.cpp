@@ -0,0 +1,237 @@
+#include <string.h>
+
+#include <algorithm>
+
+#include "caffe/common.hpp"
+#include "caffe/util/half.hpp"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#define CAFFE_HALF_X86
+#endif
+
+namespace caffe {
+
+static inline uint32_t float_bits(float x) {
+  uint32_t bits;
+  memcpy(&bits, &x, sizeof(bits));
+  return bits;
+}
+
+static inline float bits_float(uint32_t bits) {
+  float x;
+  memcpy(&x, &bits, sizeof(x));
+  return x;
+}
+
+// The rounding is done on the bits: adding half of the dropped part, less one
+// unless the kept part is odd, carries into the kept part exactly when round
+// to nearest even does, and into the exponent when the mantissa overflows.
+uint16_t caffe_float_to_half(float x) {
+  const uint32_t bits = float_bits(x);
+  const uint32_t sign = (bits >> 16) & 0x8000;
+  const uint32_t abs = bits & 0x7fffffff;
+  if (abs > 0x7f800000) {
+    // A quiet NaN with the top of the payload, as F16C converts it.
+    return sign | 0x7e00 | ((abs >> 13) & 0x3ff);
+  }
+  if (abs >= 0x477ff000) {
+    // From 65520 up, including infinity.
+    return sign | 0x7c00;
+  }
+  if (abs < 0x38800000) {
+    // Below the smallest normal half, 2^-14: adding 0.5 aligns the binary
+    // point of the half denormal with the last bit of the float mantissa,
+    // which the float addition rounds to nearest even.
+    const float aligned = bits_float(abs) + 0.5f;
+    return sign | (float_bits(aligned) - float_bits(0.5f));
+  }
+  // Rebias the exponent from 127 to 15 and round the 13 dropped bits.
+  const uint32_t odd = (abs >> 13) & 1;
+  return sign | ((abs - ((127 - 15) << 23) + 0xfff + odd) >> 13);
+}
+
+float caffe_half_to_float(uint16_t h) {
+  const uint32_t sign = static_cast<uint32_t>(h & 0x8000) << 16;
+  const uint32_t exponent = h & 0x7c00;
+  const uint32_t mantissa = h & 0x3ff;
+  if (exponent == 0x7c00) {
+    // Infinity, or NaN made quiet.
+    return bits_float(sign | 0x7f800000 | (mantissa << 13) |
+        (mantissa ? 0x400000 : 0));
+  }
+  if (exponent == 0) {
+    // Zero or denormal: mantissa * 2^-24, exact in float.
+    return bits_float(sign | float_bits(mantissa * (1.f / (1 << 24))));
+  }
+  return bits_float(sign | ((static_cast<uint32_t>(h & 0x7fff) << 13) +
+      ((127 - 15) << 23)));
+}
+
+uint16_t caffe_float_to_bfloat16(float x) {
+  const uint32_t bits = float_bits(x);
+  if ((bits & 0x7fffffff) > 0x7f800000) {
+    return (bits >> 16) | 0x40;
+  }
+  return (bits + 0x7fff + ((bits >> 16) & 1)) >> 16;
+}
+
+float caffe_bfloat16_to_float(uint16_t h) {
+  return bits_float(static_cast<uint32_t>(h) << 16);
+}
+
+#ifdef CAFFE_HALF_X86
+// 8 values at a time with F16C, which rounds to nearest even as
+// caffe_float_to_half does.
+__attribute__((target("avx,f16c")))
+static int float_to_half_f16c(const int n, const float* x, uint16_t* y) {
+  int i = 0;
+  for (; i + 8 <= n; i += 8) {
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(y + i),
+        _mm256_cvtps_ph(_mm256_loadu_ps(x + i), _MM_FROUND_TO_NEAREST_INT));
+  }
+  return i;
+}
+
+__attribute__((target("avx,f16c")))
+static int half_to_float_f16c(const int n, const uint16_t* x, float* y) {
+  int i = 0;
+  for (; i + 8 <= n; i += 8) {
+    _mm256_storeu_ps(y + i, _mm256_cvtph_ps(
+        _mm_loadu_si128(reinterpret_cast<const __m128i*>(x + i))));
+  }
+  return i;
+}
+
+// caffe_float_to_bfloat16 16 values at a time. The shifted results fit in 16
+// bits, so the saturating pack keeps them; it interleaves the 128-bit lanes
+// of its operands, which the permutation puts back in order.
+__attribute__((target("avx2")))
+static int float_to_bfloat16_avx2(const int n, const float* x, uint16_t* y) {
+  const __m256i abs_mask = _mm256_set1_epi32(0x7fffffff);
+  const __m256i infinity = _mm256_set1_epi32(0x7f800000);
+  const __m256i quiet = _mm256_set1_epi32(0x40);
+  const __m256i round = _mm256_set1_epi32(0x7fff);
+  const __m256i one = _mm256_set1_epi32(1);
+  __m256i halves[2];
+  int i = 0;
+  for (; i + 16 <= n; i += 16) {
+    for (int h = 0; h < 2; ++h) {
+      const __m256i bits = _mm256_loadu_si256(
+          reinterpret_cast<const __m256i*>(x + i + 8 * h));
+      const __m256i nan = _mm256_cmpgt_epi32(
+          _mm256_and_si256(bits, abs_mask), infinity);
+      const __m256i odd = _mm256_and_si256(_mm256_srli_epi32(bits, 16), one);
+      const __m256i rounded = _mm256_srli_epi32(_mm256_add_epi32(bits,
+          _mm256_add_epi32(round, odd)), 16);
+      const __m256i quieted = _mm256_or_si256(_mm256_srli_epi32(bits, 16),
+          quiet);
+      halves[h] = _mm256_blendv_epi8(rounded, quieted, nan);
+    }
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(y + i),
+        _mm256_permute4x64_epi64(_mm256_packus_epi32(halves[0], halves[1]),
+            0xd8));
+  }
+  return i;
+}
+
+__attribute__((target("avx2")))
+static int bfloat16_to_float_avx2(const int n, const uint16_t* x, float* y) {
+  int i = 0;
+  for (; i + 8 <= n; i += 8) {
+    const __m256i wide = _mm256_cvtepu16_epi32(
+        _mm_loadu_si128(reinterpret_cast<const __m128i*>(x + i)));
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(y + i),
+        _mm256_slli_epi32(wide, 16));
+  }
+  return i;
+}
+#endif
+
+// The vectorized part of a conversion returns the number of values it did.
+static void float_to_half(const BlobStorage storage, const int n,
+    const float* x, uint16_t* y) {
+  int i = 0;
+  if (storage == FLOAT16) {
+#ifdef CAFFE_HALF_X86
+    static const bool f16c = __builtin_cpu_supports("f16c") &&
+        __builtin_cpu_supports("avx");
+    if (f16c) { i = float_to_half_f16c(n, x, y); }
+#endif
+    for (; i < n; ++i) {
+      y[i] = caffe_float_to_half(x[i]);
+    }
+  } else {
+    CHECK_EQ(storage, BFLOAT16) << "Unknown 16-bit storage " << storage;
+#ifdef CAFFE_HALF_X86
+    static const bool avx2 = __builtin_cpu_supports("avx2");
+    if (avx2) { i = float_to_bfloat16_avx2(n, x, y); }
+#endif
+    for (; i < n; ++i) {
+      y[i] = caffe_float_to_bfloat16(x[i]);
+    }
+  }
+}
+
+static void half_to_float(const BlobStorage storage, const int n,
+    const uint16_t* x, float* y) {
+  int i = 0;
+  if (storage == FLOAT16) {
+#ifdef CAFFE_HALF_X86
+    static const bool f16c = __builtin_cpu_supports("f16c") &&
+        __builtin_cpu_supports("avx");
+    if (f16c) { i = half_to_float_f16c(n, x, y); }
+#endif
+    for (; i < n; ++i) {
+      y[i] = caffe_half_to_float(x[i]);
+    }
+  } else {
+    CHECK_EQ(storage, BFLOAT16) << "Unknown 16-bit storage " << storage;
+#ifdef CAFFE_HALF_X86
+    static const bool avx2 = __builtin_cpu_supports("avx2");
+    if (avx2) { i = bfloat16_to_float_avx2(n, x, y); }
+#endif
+    for (; i < n; ++i) {
+      y[i] = caffe_bfloat16_to_float(x[i]);
+    }
+  }
+}
+
+// Doubles go through floats, a block at a time.
+static const int kDoubleBlock = 1024;
+
+template <>
+void caffe_cpu_to_half<float>(const BlobStorage storage, const int n,
+    const float* x, uint16_t* y) {
+  float_to_half(storage, n, x, y);
+}
+
+template <>
+void caffe_cpu_to_half<double>(const BlobStorage storage, const int n,
+    const double* x, uint16_t* y) {
+  float block[kDoubleBlock];
+  for (int i = 0; i < n; i += kDoubleBlock) {
+    const int size = std::min(kDoubleBlock, n - i);
+    std::copy(x + i, x + i + size, block);
+    float_to_half(storage, size, block, y + i);
+  }
+}
+
+template <>
+void caffe_cpu_from_half<float>(const BlobStorage storage, const int n,
+    const uint16_t* x, float* y) {
+  half_to_float(storage, n, x, y);
+}
+
+template <>
+void caffe_cpu_from_half<double>(const BlobStorage storage, const int n,
+    const uint16_t* x, double* y) {
+  float block[kDoubleBlock];
+  for (int i = 0; i < n; i += kDoubleBlock) {
+    const int size = std::min(kDoubleBlock, n - i);
+    half_to_float(storage, size, x + i, block);
+    std::copy(block, block + size, y + i);
+  }
+}
+
+}  // namespace caffe
@@ -0,0 +1,97 @@
+#ifdef USE_HDF5
+#include <boost/thread.hpp>
+#include <string>
+#include <vector>
+
+#include "caffe/util/benchmark.hpp"
+#include "caffe/util/hdf5.hpp"
+#include "caffe/util/hdf5_prefetcher.hpp"
+
+namespace caffe {
+
+template <typename Dtype>
+HDF5FilePrefetcher<Dtype>::HDF5FilePrefetcher(const Reader& reader)
+    : reader_(reader), pending_() {
+}
+
+template <typename Dtype>
+HDF5FilePrefetcher<Dtype>::~HDF5FilePrefetcher() {
+  this->StopInternalThread();
+  HDF5FileData<Dtype>* data;
+  while (results_.try_pop(&data)) {
+    delete data;
+  }
+}
+
+template <typename Dtype>
+void HDF5FilePrefetcher<Dtype>::Read(HDF5FileData<Dtype>* data) {
+  CPUTimer timer;
+  timer.Start();
+  {
+    HDF5Lock lock;
+    reader_(data->filename, &data->blobs);
+  }
+  data->read_ms = timer.MilliSeconds();
+}
+
+template <typename Dtype>
+void HDF5FilePrefetcher<Dtype>::InternalThreadEntry() {
+  try {
+    while (!must_stop()) {
+      // Wait for a request before allocating: interruption at shutdown
+      // happens while waiting.
+      const string filename = requests_.pop();
+      HDF5FileData<Dtype>* data = new HDF5FileData<Dtype>();
+      data->filename = filename;
+      Read(data);
+      results_.push(data);
+    }
+  } catch (boost::thread_interrupted&) {
+    // Interrupted exception is expected on shutdown
+  }
+}
+
+template <typename Dtype>
+void HDF5FilePrefetcher<Dtype>::Prefetch(const string& filename) {
+  CHECK(pending_.empty()) << "Only one HDF5 file can be prefetched at a time";
+  if (!is_started()) {
+    StartInternalThread();
+  }
+  pending_ = filename;
+  requests_.push(filename);
+}
+
+template <typename Dtype>
+void HDF5FilePrefetcher<Dtype>::Take(const string& filename,
+    vector<shared_ptr<Blob<Dtype> > >* blobs) {
+  HDF5FileData<Dtype>* data = NULL;
+  if (!pending_.empty()) {
+    CPUTimer timer;
+    timer.Start();
+    data = results_.pop("Waiting for HDF5 file " + pending_);
+    const float wait_ms = timer.MilliSeconds();
+    pending_.clear();
+    if (data->filename == filename) {
+      DLOG(INFO) << "HDF5 file switch: waited " << wait_ms << " ms, read took "
+                 << data->read_ms << " ms, stall saved "
+                 << std::max(0.f, data->read_ms - wait_ms) << " ms.";
+    } else {
+      delete data;
+      data = NULL;
+    }
+  }
+  if (!data) {
+    data = new HDF5FileData<Dtype>();
+    data->filename = filename;
+    Read(data);
+    DLOG(INFO) << "HDF5 file read synchronously in " << data->read_ms
+               << " ms.";
+  }
+  blobs->swap(data->blobs);
+  delete data;
+}
+
+INSTANTIATE_CLASS(HDF5FilePrefetcher);
+
+}  // namespace caffe
+#endif  // USE_HDF5
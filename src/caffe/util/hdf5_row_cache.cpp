@@ -0,0 +1,92 @@
+#ifdef USE_HDF5
+#include <algorithm>
+#include <climits>
+#include <string>
+#include <vector>
+
+#include "caffe/util/hdf5.hpp"
+#include "caffe/util/hdf5_row_cache.hpp"
+#include "caffe/util/math_functions.hpp"
+
+namespace caffe {
+
+template <typename Dtype>
+HDF5RowCache<Dtype>::HDF5RowCache(const string& filename,
+    const vector<string>& datasets, int chunk_rows, size_t cache_bytes)
+    : filename_(filename), datasets_(datasets), chunk_rows_(chunk_rows),
+      cache_bytes_(cache_bytes), cached_bytes_(0), hits_(0), misses_(0) {
+  CHECK_GT(chunk_rows_, 0) << "HDF5 row cache chunks must hold rows";
+  HDF5Lock lock;
+  file_id_ = H5Fopen(filename.c_str(), H5F_ACC_RDONLY, H5P_DEFAULT);
+  if (file_id_ < 0) {
+    LOG(FATAL) << "Failed opening HDF5 file: " << filename;
+  }
+  for (int d = 0; d < datasets_.size(); ++d) {
+    shapes_.push_back(hdf5_get_dataset_shape(file_id_, datasets_[d].c_str(),
+                                             1, INT_MAX));
+    int row_dim = 1;
+    for (int i = 1; i < shapes_[d].size(); ++i) {
+      row_dim *= shapes_[d][i];
+    }
+    row_dims_.push_back(row_dim);
+  }
+}
+
+template <typename Dtype>
+HDF5RowCache<Dtype>::~HDF5RowCache() {
+  DLOG(INFO) << "HDF5 row cache of " << filename_ << ": " << hits_
+             << " hits, " << misses_ << " misses.";
+  HDF5Lock lock;
+  herr_t status = H5Fclose(file_id_);
+  CHECK_GE(status, 0) << "Failed to close HDF5 file: " << filename_;
+}
+
+template <typename Dtype>
+const typename HDF5RowCache<Dtype>::Chunk& HDF5RowCache<Dtype>::Fetch(
+    const Key& key) {
+  typename std::map<Key, typename std::list<Chunk>::iterator>::iterator it =
+      index_.find(key);
+  if (it != index_.end()) {
+    ++hits_;
+    chunks_.splice(chunks_.begin(), chunks_, it->second);
+    return chunks_.front();
+  }
+  ++misses_;
+  const int d = key.first;
+  const int row_begin = key.second * chunk_rows_;
+  const int rows = std::min(chunk_rows_, num_rows(d) - row_begin);
+  const size_t bytes = sizeof(Dtype) * rows * row_dims_[d];
+  // Make room, always keeping at least the chunk being read.
+  while (!chunks_.empty() && cached_bytes_ + bytes > cache_bytes_) {
+    cached_bytes_ -= sizeof(Dtype) * chunks_.back().data.size();
+    index_.erase(chunks_.back().key);
+    chunks_.pop_back();
+  }
+  chunks_.push_front(Chunk());
+  Chunk& chunk = chunks_.front();
+  chunk.key = key;
+  chunk.data.resize(rows * row_dims_[d]);
+  {
+    HDF5Lock lock;
+    hdf5_load_nd_dataset_rows(file_id_, datasets_[d].c_str(), row_begin,
+                              rows, chunk.data.data());
+  }
+  cached_bytes_ += bytes;
+  index_[key] = chunks_.begin();
+  return chunk;
+}
+
+template <typename Dtype>
+void HDF5RowCache<Dtype>::CopyRow(int d, int row, Dtype* data) {
+  CHECK_GE(row, 0);
+  CHECK_LT(row, num_rows(d)) << "Row out of range for dataset "
+                             << datasets_[d];
+  const Chunk& chunk = Fetch(Key(d, row / chunk_rows_));
+  caffe_copy(row_dims_[d],
+             chunk.data.data() + (row % chunk_rows_) * row_dims_[d], data);
+}
+
+INSTANTIATE_CLASS(HDF5RowCache);
+
+}  // namespace caffe
+#endif  // USE_HDF5
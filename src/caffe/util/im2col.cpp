@@ -1,3 +1,4 @@
+#include <algorithm>
 #include <vector>
 
 #include "caffe/util/im2col.hpp"
@@ -230,5 +231,160 @@ template void col2im_nd_cpu<double>(const double* data_col,
     const int* kernel_shape, const int* pad, const int* stride,
     const int* dilation, double* data_im);
 
+// The outputs [*begin, *end) of one axis, among output, whose input
+// offset + output * stride falls inside [0, size).
+inline void im2col_3d_range(const int size, const int output,
+    const int offset, const int stride, int* begin, int* end) {
+  const int first = offset < 0 ? (stride - 1 - offset) / stride : 0;
+  const int last = size > offset ? (size - offset + stride - 1) / stride : 0;
+  *begin = std::min(first, output);
+  *end = std::max(std::min(last, output), *begin);
+}
+
+// im2col_3d_cpu, or col2im_3d_cpu without the zeroing of data_im when
+// im2col is false. The bounds are computed once per kernel offset, so that
+// the rows are plain (strided) copies between zero borders.
+template <typename Dtype>
+inline void im2col_3d_core_cpu(const bool im2col, const Dtype* data_input,
+    const int channels, const int depth, const int height, const int width,
+    const int kernel_d, const int kernel_h, const int kernel_w,
+    const int pad_d, const int pad_h, const int pad_w,
+    const int stride_d, const int stride_h, const int stride_w,
+    const int dilation_d, const int dilation_h, const int dilation_w,
+    Dtype* data_output) {
+  const int output_d = (depth + 2 * pad_d -
+    (dilation_d * (kernel_d - 1) + 1)) / stride_d + 1;
+  const int output_h = (height + 2 * pad_h -
+    (dilation_h * (kernel_h - 1) + 1)) / stride_h + 1;
+  const int output_w = (width + 2 * pad_w -
+    (dilation_w * (kernel_w - 1) + 1)) / stride_w + 1;
+  const int slice_size = height * width;
+  const int channel_size = depth * slice_size;
+  const Dtype* data_col = im2col ? NULL : data_input;
+  Dtype* col = im2col ? data_output : NULL;
+  for (int c = 0; c < channels; ++c) {
+    const Dtype* im = im2col ? data_input + c * channel_size : NULL;
+    Dtype* im_diff = im2col ? NULL : data_output + c * channel_size;
+    for (int kd = 0; kd < kernel_d; ++kd) {
+      const int d_offset = kd * dilation_d - pad_d;
+      int d_begin, d_end;
+      im2col_3d_range(depth, output_d, d_offset, stride_d, &d_begin, &d_end);
+      for (int kh = 0; kh < kernel_h; ++kh) {
+        const int h_offset = kh * dilation_h - pad_h;
+        int h_begin, h_end;
+        im2col_3d_range(height, output_h, h_offset, stride_h, &h_begin,
+            &h_end);
+        for (int kw = 0; kw < kernel_w; ++kw) {
+          const int w_offset = kw * dilation_w - pad_w;
+          int w_begin, w_end;
+          im2col_3d_range(width, output_w, w_offset, stride_w, &w_begin,
+              &w_end);
+          for (int od = 0; od < output_d; ++od) {
+            const bool d_inside = od >= d_begin && od < d_end;
+            for (int oh = 0; oh < output_h; ++oh) {
+              if (!d_inside || oh < h_begin || oh >= h_end) {
+                if (im2col) {
+                  caffe_set(output_w, Dtype(0), col);
+                  col += output_w;
+                } else {
+                  data_col += output_w;
+                }
+                continue;
+              }
+              const int row = (d_offset + od * stride_d) * slice_size +
+                  (h_offset + oh * stride_h) * width + w_offset;
+              if (im2col) {
+                const Dtype* in = im + row;
+                for (int ow = 0; ow < w_begin; ++ow) {
+                  col[ow] = 0;
+                }
+                if (stride_w == 1) {
+                  for (int ow = w_begin; ow < w_end; ++ow) {
+                    col[ow] = in[ow];
+                  }
+                } else {
+                  for (int ow = w_begin; ow < w_end; ++ow) {
+                    col[ow] = in[ow * stride_w];
+                  }
+                }
+                for (int ow = w_end; ow < output_w; ++ow) {
+                  col[ow] = 0;
+                }
+                col += output_w;
+              } else {
+                Dtype* out = im_diff + row;
+                if (stride_w == 1) {
+                  for (int ow = w_begin; ow < w_end; ++ow) {
+                    out[ow] += data_col[ow];
+                  }
+                } else {
+                  for (int ow = w_begin; ow < w_end; ++ow) {
+                    out[ow * stride_w] += data_col[ow];
+                  }
+                }
+                data_col += output_w;
+              }
+            }
+          }
+        }
+      }
+    }
+  }
+}
+
+template <typename Dtype>
+void im2col_3d_cpu(const Dtype* data_im, const int channels,
+    const int depth, const int height, const int width, const int kernel_d,
+    const int kernel_h, const int kernel_w, const int pad_d, const int pad_h,
+    const int pad_w, const int stride_d, const int stride_h,
+    const int stride_w, const int dilation_d, const int dilation_h,
+    const int dilation_w, Dtype* data_col) {
+  const bool kIm2Col = true;
+  im2col_3d_core_cpu(kIm2Col, data_im, channels, depth, height, width,
+      kernel_d, kernel_h, kernel_w, pad_d, pad_h, pad_w, stride_d, stride_h,
+      stride_w, dilation_d, dilation_h, dilation_w, data_col);
+}
+
+// Explicit instantiation
+template void im2col_3d_cpu<float>(const float* data_im, const int channels,
+    const int depth, const int height, const int width, const int kernel_d,
+    const int kernel_h, const int kernel_w, const int pad_d, const int pad_h,
+    const int pad_w, const int stride_d, const int stride_h,
+    const int stride_w, const int dilation_d, const int dilation_h,
+    const int dilation_w, float* data_col);
+template void im2col_3d_cpu<double>(const double* data_im,
+    const int channels, const int depth, const int height, const int width,
+    const int kernel_d, const int kernel_h, const int kernel_w,
+    const int pad_d, const int pad_h, const int pad_w, const int stride_d,
+    const int stride_h, const int stride_w, const int dilation_d,
+    const int dilation_h, const int dilation_w, double* data_col);
+
+template <typename Dtype>
+void col2im_3d_cpu(const Dtype* data_col, const int channels,
+    const int depth, const int height, const int width, const int kernel_d,
+    const int kernel_h, const int kernel_w, const int pad_d, const int pad_h,
+    const int pad_w, const int stride_d, const int stride_h,
+    const int stride_w, const int dilation_d, const int dilation_h,
+    const int dilation_w, Dtype* data_im) {
+  caffe_set(channels * depth * height * width, Dtype(0), data_im);
+  const bool kIm2Col = false;
+  im2col_3d_core_cpu(kIm2Col, data_col, channels, depth, height, width,
+      kernel_d, kernel_h, kernel_w, pad_d, pad_h, pad_w, stride_d, stride_h,
+      stride_w, dilation_d, dilation_h, dilation_w, data_im);
+}
+
+// Explicit instantiation
+template void col2im_3d_cpu<float>(const float* data_col, const int channels,
+    const int depth, const int height, const int width, const int kernel_d,
+    const int kernel_h, const int kernel_w, const int pad_d, const int pad_h,
+    const int pad_w, const int stride_d, const int stride_h,
+    const int stride_w, const int dilation_d, const int dilation_h,
+    const int dilation_w, float* data_im);
+template void col2im_3d_cpu<double>(const double* data_col,
+    const int channels, const int depth, const int height, const int width,
+    const int kernel_d, const int kernel_h, const int kernel_w,
+    const int pad_d, const int pad_h, const int pad_w, const int stride_d,
+    const int stride_h, const int stride_w, const int dilation_d,
+    const int dilation_h, const int dilation_w, double* data_im);
 
 }  // namespace caffe
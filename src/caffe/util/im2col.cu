@@ -509,4 +509,176 @@ template void col2im_nd_gpu<double>(const double* data_col,
     const int* kernel_shape, const int* pad, const int* stride,
     const int* dilation, double* data_im);
 
+template <typename Dtype>
+__global__ void im2col_3d_gpu_kernel(const int n, const Dtype* data_im,
+    const int depth, const int height, const int width,
+    const int kernel_d, const int kernel_h, const int kernel_w,
+    const int pad_d, const int pad_h, const int pad_w,
+    const int stride_d, const int stride_h, const int stride_w,
+    const int dilation_d, const int dilation_h, const int dilation_w,
+    const int depth_col, const int height_col, const int width_col,
+    Dtype* data_col) {
+  CUDA_KERNEL_LOOP(index, n) {
+    const int w_col = index % width_col;
+    const int h_col = (index / width_col) % height_col;
+    const int d_index = index / (width_col * height_col);
+    const int d_col = d_index % depth_col;
+    const int c_im = d_index / depth_col;
+    const int c_col = c_im * kernel_d * kernel_h * kernel_w;
+    const int d_offset = d_col * stride_d - pad_d;
+    const int h_offset = h_col * stride_h - pad_h;
+    const int w_offset = w_col * stride_w - pad_w;
+    const int col_size = depth_col * height_col * width_col;
+    Dtype* data_col_ptr = data_col + c_col * col_size +
+        (d_col * height_col + h_col) * width_col + w_col;
+    const Dtype* data_im_ptr = data_im + c_im * depth * height * width;
+    for (int i = 0; i < kernel_d; ++i) {
+      const int d_im = d_offset + i * dilation_d;
+      for (int j = 0; j < kernel_h; ++j) {
+        const int h_im = h_offset + j * dilation_h;
+        for (int k = 0; k < kernel_w; ++k) {
+          const int w_im = w_offset + k * dilation_w;
+          *data_col_ptr = (d_im >= 0 && h_im >= 0 && w_im >= 0 &&
+              d_im < depth && h_im < height && w_im < width) ?
+              data_im_ptr[(d_im * height + h_im) * width + w_im] : 0;
+          data_col_ptr += col_size;
+        }
+      }
+    }
+  }
+}
+
+template <typename Dtype>
+void im2col_3d_gpu(const Dtype* data_im, const int channels,
+    const int depth, const int height, const int width, const int kernel_d,
+    const int kernel_h, const int kernel_w, const int pad_d, const int pad_h,
+    const int pad_w, const int stride_d, const int stride_h,
+    const int stride_w, const int dilation_d, const int dilation_h,
+    const int dilation_w, Dtype* data_col) {
+  int depth_col = (depth + 2 * pad_d -
+      (dilation_d * (kernel_d - 1) + 1)) / stride_d + 1;
+  int height_col = (height + 2 * pad_h -
+      (dilation_h * (kernel_h - 1) + 1)) / stride_h + 1;
+  int width_col = (width + 2 * pad_w -
+      (dilation_w * (kernel_w - 1) + 1)) / stride_w + 1;
+  int num_kernels = channels * depth_col * height_col * width_col;
+  // NOLINT_NEXT_LINE(whitespace/operators)
+  im2col_3d_gpu_kernel<Dtype><<<CAFFE_GET_BLOCKS(num_kernels),
+                                CAFFE_CUDA_NUM_THREADS>>>(
+      num_kernels, data_im, depth, height, width, kernel_d, kernel_h,
+      kernel_w, pad_d, pad_h, pad_w, stride_d, stride_h, stride_w,
+      dilation_d, dilation_h, dilation_w, depth_col, height_col, width_col,
+      data_col);
+  CUDA_POST_KERNEL_CHECK;
+}
+
+// Explicit instantiation
+template void im2col_3d_gpu<float>(const float* data_im, const int channels,
+    const int depth, const int height, const int width, const int kernel_d,
+    const int kernel_h, const int kernel_w, const int pad_d, const int pad_h,
+    const int pad_w, const int stride_d, const int stride_h,
+    const int stride_w, const int dilation_d, const int dilation_h,
+    const int dilation_w, float* data_col);
+template void im2col_3d_gpu<double>(const double* data_im,
+    const int channels, const int depth, const int height, const int width,
+    const int kernel_d, const int kernel_h, const int kernel_w,
+    const int pad_d, const int pad_h, const int pad_w, const int stride_d,
+    const int stride_h, const int stride_w, const int dilation_d,
+    const int dilation_h, const int dilation_w, double* data_col);
+
+template <typename Dtype>
+__global__ void col2im_3d_gpu_kernel(const int n, const Dtype* data_col,
+    const int depth, const int height, const int width,
+    const int kernel_d, const int kernel_h, const int kernel_w,
+    const int pad_d, const int pad_h, const int pad_w,
+    const int stride_d, const int stride_h, const int stride_w,
+    const int dilation_d, const int dilation_h, const int dilation_w,
+    const int depth_col, const int height_col, const int width_col,
+    Dtype* data_im) {
+  CUDA_KERNEL_LOOP(index, n) {
+    Dtype val = 0;
+    const int w_im = index % width + pad_w;
+    const int h_im = (index / width) % height + pad_h;
+    const int d_im = (index / (width * height)) % depth + pad_d;
+    const int c_im = index / (width * height * depth);
+    const int kernel_extent_d = (kernel_d - 1) * dilation_d + 1;
+    const int kernel_extent_h = (kernel_h - 1) * dilation_h + 1;
+    const int kernel_extent_w = (kernel_w - 1) * dilation_w + 1;
+    // compute the start and end of the output
+    const int d_col_start =
+        (d_im < kernel_extent_d) ? 0 : (d_im - kernel_extent_d) / stride_d + 1;
+    const int d_col_end = min(d_im / stride_d + 1, depth_col);
+    const int h_col_start =
+        (h_im < kernel_extent_h) ? 0 : (h_im - kernel_extent_h) / stride_h + 1;
+    const int h_col_end = min(h_im / stride_h + 1, height_col);
+    const int w_col_start =
+        (w_im < kernel_extent_w) ? 0 : (w_im - kernel_extent_w) / stride_w + 1;
+    const int w_col_end = min(w_im / stride_w + 1, width_col);
+    for (int d_col = d_col_start; d_col < d_col_end; ++d_col) {
+      int d_k = d_im - d_col * stride_d;
+      if (d_k % dilation_d != 0) {
+        continue;
+      }
+      d_k /= dilation_d;
+      for (int h_col = h_col_start; h_col < h_col_end; ++h_col) {
+        int h_k = h_im - h_col * stride_h;
+        if (h_k % dilation_h != 0) {
+          continue;
+        }
+        h_k /= dilation_h;
+        for (int w_col = w_col_start; w_col < w_col_end; ++w_col) {
+          int w_k = w_im - w_col * stride_w;
+          if (w_k % dilation_w == 0) {
+            w_k /= dilation_w;
+            const int data_col_index = ((((c_im * kernel_d + d_k) * kernel_h
+                + h_k) * kernel_w + w_k) * depth_col + d_col) * height_col *
+                width_col + h_col * width_col + w_col;
+            val += data_col[data_col_index];
+          }
+        }
+      }
+    }
+    data_im[index] = val;
+  }
+}
+
+template <typename Dtype>
+void col2im_3d_gpu(const Dtype* data_col, const int channels,
+    const int depth, const int height, const int width, const int kernel_d,
+    const int kernel_h, const int kernel_w, const int pad_d, const int pad_h,
+    const int pad_w, const int stride_d, const int stride_h,
+    const int stride_w, const int dilation_d, const int dilation_h,
+    const int dilation_w, Dtype* data_im) {
+  int depth_col = (depth + 2 * pad_d -
+      (dilation_d * (kernel_d - 1) + 1)) / stride_d + 1;
+  int height_col = (height + 2 * pad_h -
+      (dilation_h * (kernel_h - 1) + 1)) / stride_h + 1;
+  int width_col = (width + 2 * pad_w -
+      (dilation_w * (kernel_w - 1) + 1)) / stride_w + 1;
+  int num_kernels = channels * depth * height * width;
+  // One kernel per bottom element, which adds up its top elements.
+  // NOLINT_NEXT_LINE(whitespace/operators)
+  col2im_3d_gpu_kernel<Dtype><<<CAFFE_GET_BLOCKS(num_kernels),
+                                CAFFE_CUDA_NUM_THREADS>>>(
+      num_kernels, data_col, depth, height, width, kernel_d, kernel_h,
+      kernel_w, pad_d, pad_h, pad_w, stride_d, stride_h, stride_w,
+      dilation_d, dilation_h, dilation_w, depth_col, height_col, width_col,
+      data_im);
+  CUDA_POST_KERNEL_CHECK;
+}
+
+// Explicit instantiation
+template void col2im_3d_gpu<float>(const float* data_col, const int channels,
+    const int depth, const int height, const int width, const int kernel_d,
+    const int kernel_h, const int kernel_w, const int pad_d, const int pad_h,
+    const int pad_w, const int stride_d, const int stride_h,
+    const int stride_w, const int dilation_d, const int dilation_h,
+    const int dilation_w, float* data_im);
+template void col2im_3d_gpu<double>(const double* data_col,
+    const int channels, const int depth, const int height, const int width,
+    const int kernel_d, const int kernel_h, const int kernel_w,
+    const int pad_d, const int pad_h, const int pad_w, const int stride_d,
+    const int stride_h, const int stride_w, const int dilation_d,
+    const int dilation_h, const int dilation_w, double* data_im);
+
 }  // namespace caffe
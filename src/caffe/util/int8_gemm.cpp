@@ -0,0 +1,271 @@
+#include <boost/thread/tss.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+#include "caffe/util/int8_gemm.hpp"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#define CAFFE_INT8_AVX2
+#endif
+
+namespace caffe {
+
+// As in the builtin GEMM, outputs are computed in register tiles of kMR rows
+// by kNR columns, from panels of kMR rows of A and kNR columns of B laid out
+// along K. The panels interleave pairs of consecutive k, [k / 2][width][2],
+// so that the kernel multiplies two 16-bit pairs and adds the products into
+// one 32-bit sum in one step (pmaddwd). A is kept in 8 bits and B packed in
+// 16, a quarter and a half of the size of float panels, so K is not blocked:
+// every tile is summed over all of K in registers and finished at once. Rows
+// of A are blocked so that a block stays in kCacheBytes while the panels of B
+// go past it.
+static const int kMR = 4;
+static const int kNR = 16;
+static const int kCacheBytes = 256 * 1024;
+// The 32-bit sums cannot overflow for K up to 2^31 / 127^2.
+static const int kMaxK = 1 << 17;
+
+// The nearest integer to value in [-127, 127].
+template <typename Dtype>
+inline int8_t round_int8(Dtype value) {
+  value = std::max(Dtype(-127), std::min(Dtype(127), value));
+  return static_cast<int8_t>(value < 0 ? value - Dtype(0.5) :
+      value + Dtype(0.5));
+}
+
+inline int round_up_int8(int value, int multiple) {
+  return (value + multiple - 1) / multiple * multiple;
+}
+
+// The index of element (k, w) in a panel of width elements.
+inline int pair_index(int k, int w, int width) {
+  return (k / 2 * width + w) * 2 + k % 2;
+}
+
+template <typename Dtype>
+void Int8Matrix<Dtype>::Quantize(CBLAS_TRANSPOSE trans, int rows, int cols,
+    const Dtype* data) {
+  trans_ = trans;
+  rows_ = rows;
+  cols_ = cols;
+  source_.reset();
+  const int row_stride = trans == CblasNoTrans ? cols : 1;
+  const int col_stride = trans == CblasNoTrans ? 1 : rows;
+  // Panels of kMR rows by an even number of columns, zero padded.
+  const int depth = round_up_int8(cols, 2);
+  data_.assign(round_up_int8(rows, kMR) * depth, 0);
+  scales_.resize(rows);
+  for (int r = 0; r < rows; ++r) {
+    const Dtype* row = data + r * row_stride;
+    Dtype max_abs = 0;
+    for (int c = 0; c < cols; ++c) {
+      max_abs = std::max(max_abs, std::fabs(row[c * col_stride]));
+    }
+    scales_[r] = max_abs / 127;
+    const Dtype inverse = max_abs > 0 ? 127 / max_abs : 0;
+    int8_t* panel = &data_[r / kMR * depth * kMR];
+    for (int c = 0; c < cols; ++c) {
+      panel[pair_index(c, r % kMR, kMR)] =
+          round_int8(row[c * col_stride] * inverse);
+    }
+  }
+}
+
+template <typename Dtype>
+void Int8Matrix<Dtype>::Quantize(CBLAS_TRANSPOSE trans, int rows, int cols,
+    const Blob<Dtype>& blob, int offset) {
+  const shared_ptr<SyncedMemory>& memory = blob.data();
+  if (source_ == memory && version_ == memory->version() &&
+      offset_ == offset && trans_ == trans && rows_ == rows &&
+      cols_ == cols) {
+    return;
+  }
+  CHECK_LE(offset + rows * cols, blob.count());
+  Quantize(trans, rows, cols, blob.cpu_data() + offset);
+  source_ = memory;
+  version_ = memory->version();
+  offset_ = offset;
+}
+
+INSTANTIATE_CLASS(Int8Matrix);
+
+// Quantizes the K x N matrix whose element (k, j) is data[k * k_stride +
+// j * j_stride] into panels of kNR columns by depth >= K, zero padded.
+template <typename Dtype>
+static void int8_pack(const Dtype* data, const int k_stride,
+    const int j_stride, const int K, const int N, const int depth,
+    const Dtype inverse, int16_t* packed) {
+  for (int j0 = 0; j0 < N; j0 += kNR) {
+    const int valid = std::min(kNR, N - j0);
+    const Dtype* panel = data + j0 * j_stride;
+    if (valid < kNR || depth > K) {
+      std::fill(packed, packed + depth * kNR, 0);
+    }
+    if (j_stride == 1) {
+      for (int k = 0; k < K; ++k) {
+        const Dtype* in = panel + k * k_stride;
+        for (int w = 0; w < valid; ++w) {
+          packed[pair_index(k, w, kNR)] = round_int8(in[w] * inverse);
+        }
+      }
+    } else {
+      // Columns are contiguous along K: read them one at a time.
+      for (int w = 0; w < valid; ++w) {
+        const Dtype* in = panel + w * j_stride;
+        for (int k = 0; k < K; ++k) {
+          packed[pair_index(k, w, kNR)] =
+              round_int8(in[k * k_stride] * inverse);
+        }
+      }
+    }
+    packed += depth * kNR;
+  }
+}
+
+// The kMR x kNR sums of a panel of A and one of B over depth, even.
+static void int8_kernel(const int depth, const int8_t* a, const int16_t* b,
+    int32_t acc[kMR][kNR]) {
+  for (int r = 0; r < kMR; ++r) {
+    std::fill(acc[r], acc[r] + kNR, 0);
+  }
+  for (int k = 0; k < depth; k += 2) {
+    for (int r = 0; r < kMR; ++r) {
+      const int32_t a0 = a[2 * r], a1 = a[2 * r + 1];
+      for (int j = 0; j < kNR; ++j) {
+        acc[r][j] += a0 * b[2 * j] + a1 * b[2 * j + 1];
+      }
+    }
+    a += 2 * kMR;
+    b += 2 * kNR;
+  }
+}
+
+#ifdef CAFFE_INT8_AVX2
+// int8_kernel with AVX2, whose vpmaddwd compilers do not emit for it: each
+// pair of A, widened to 16 bits, is broadcast and multiplied with the pairs
+// of the 16 columns of B, in two registers.
+__attribute__((target("avx2")))
+static void int8_kernel_avx2(const int depth, const int8_t* a,
+    const int16_t* b, int32_t acc[kMR][kNR]) {
+  __m256i acc00 = _mm256_setzero_si256(), acc01 = _mm256_setzero_si256();
+  __m256i acc10 = _mm256_setzero_si256(), acc11 = _mm256_setzero_si256();
+  __m256i acc20 = _mm256_setzero_si256(), acc21 = _mm256_setzero_si256();
+  __m256i acc30 = _mm256_setzero_si256(), acc31 = _mm256_setzero_si256();
+  for (int k = 0; k < depth; k += 2) {
+    const __m256i b0 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(b));
+    const __m256i b1 =
+        _mm256_loadu_si256(reinterpret_cast<const __m256i*>(b + 16));
+    // The 4 pairs of A in both halves, then one pair in all 8 lanes.
+    const __m128i pairs = _mm_cvtepi8_epi16(
+        _mm_loadl_epi64(reinterpret_cast<const __m128i*>(a)));
+    const __m256i a_pairs = _mm256_broadcastsi128_si256(pairs);
+    __m256i a_pair = _mm256_shuffle_epi32(a_pairs, 0x00);
+    acc00 = _mm256_add_epi32(acc00, _mm256_madd_epi16(a_pair, b0));
+    acc01 = _mm256_add_epi32(acc01, _mm256_madd_epi16(a_pair, b1));
+    a_pair = _mm256_shuffle_epi32(a_pairs, 0x55);
+    acc10 = _mm256_add_epi32(acc10, _mm256_madd_epi16(a_pair, b0));
+    acc11 = _mm256_add_epi32(acc11, _mm256_madd_epi16(a_pair, b1));
+    a_pair = _mm256_shuffle_epi32(a_pairs, 0xaa);
+    acc20 = _mm256_add_epi32(acc20, _mm256_madd_epi16(a_pair, b0));
+    acc21 = _mm256_add_epi32(acc21, _mm256_madd_epi16(a_pair, b1));
+    a_pair = _mm256_shuffle_epi32(a_pairs, 0xff);
+    acc30 = _mm256_add_epi32(acc30, _mm256_madd_epi16(a_pair, b0));
+    acc31 = _mm256_add_epi32(acc31, _mm256_madd_epi16(a_pair, b1));
+    a += 2 * kMR;
+    b += 2 * kNR;
+  }
+  const __m256i sums[kMR][2] = {
+    {acc00, acc01}, {acc10, acc11}, {acc20, acc21}, {acc30, acc31}
+  };
+  for (int r = 0; r < kMR; ++r) {
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(acc[r]), sums[r][0]);
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(acc[r] + 8), sums[r][1]);
+  }
+}
+#endif
+
+// Stores rows x cols of a tile of sums, scaled back by row_scales[r] *
+// b_scale with bias[r] added, element (r, j) at c[r * row_stride +
+// j * col_stride].
+template <typename Dtype>
+static void int8_store(const int32_t acc[kMR][kNR], const Dtype* row_scales,
+    const Dtype b_scale, const Dtype* bias, Dtype* c, const int row_stride,
+    const int col_stride, const int rows, const int cols) {
+  for (int r = 0; r < rows; ++r) {
+    const Dtype scale = row_scales[r] * b_scale;
+    const Dtype offset = bias ? bias[r] : Dtype(0);
+    Dtype* out = c + r * row_stride;
+    for (int j = 0; j < cols; ++j) {
+      out[j * col_stride] = scale * acc[r][j] + offset;
+    }
+  }
+}
+
+template <typename Dtype>
+void caffe_cpu_gemm_int8(const Int8Matrix<Dtype>& A,
+    const CBLAS_TRANSPOSE TransB, const int N, const Dtype input_max,
+    const Dtype* B, const Dtype* bias, const CBLAS_TRANSPOSE TransC,
+    Dtype* C) {
+  static boost::thread_specific_ptr<std::vector<int16_t> > buffer;
+  const int M = A.rows();
+  const int K = A.cols();
+  CHECK_GT(input_max, 0) << "The input range of an 8-bit product is unset.";
+  CHECK_LE(K, kMaxK) << "Products of more than " << kMaxK
+      << " 8-bit terms overflow.";
+  if (M == 0 || N == 0) {
+    return;
+  }
+  if (!buffer.get()) {
+    buffer.reset(new std::vector<int16_t>());
+  }
+#ifdef CAFFE_INT8_AVX2
+  static const bool avx2 = __builtin_cpu_supports("avx2");
+#endif
+  const int depth = round_up_int8(K, 2);
+  std::vector<int16_t>& b_buffer = *buffer;
+  b_buffer.resize(std::max<size_t>(b_buffer.size(),
+      round_up_int8(N, kNR) * depth));
+  int8_pack(B, TransB == CblasNoTrans ? N : 1,
+      TransB == CblasNoTrans ? 1 : K, K, N, depth, Dtype(127) / input_max,
+      &b_buffer[0]);
+  const Dtype b_scale = input_max / 127;
+  const int row_stride = TransC == CblasNoTrans ? N : 1;
+  const int col_stride = TransC == CblasNoTrans ? 1 : M;
+  const int mc = std::max(kMR, kCacheBytes / depth / kMR * kMR);
+  int32_t acc[kMR][kNR];
+  for (int i0 = 0; i0 < M; i0 += mc) {
+    const int i_end = std::min(M, i0 + mc);
+    for (int j = 0; j < N; j += kNR) {
+      const int16_t* b_panel = &b_buffer[0] + j / kNR * depth * kNR;
+      for (int i = i0; i < i_end; i += kMR) {
+        const int8_t* a_panel = A.data() + i / kMR * depth * kMR;
+#ifdef CAFFE_INT8_AVX2
+        if (avx2) {
+          int8_kernel_avx2(depth, a_panel, b_panel, acc);
+        } else {
+          int8_kernel(depth, a_panel, b_panel, acc);
+        }
+#else
+        int8_kernel(depth, a_panel, b_panel, acc);
+#endif
+        int8_store(acc, A.scales() + i, b_scale, bias ? bias + i : NULL,
+            C + i * row_stride + j * col_stride, row_stride, col_stride,
+            std::min(kMR, M - i), std::min(kNR, N - j));
+      }
+    }
+  }
+}
+
+template void caffe_cpu_gemm_int8<float>(const Int8Matrix<float>& A,
+    const CBLAS_TRANSPOSE TransB, const int N, const float input_max,
+    const float* B, const float* bias, const CBLAS_TRANSPOSE TransC,
+    float* C);
+template void caffe_cpu_gemm_int8<double>(const Int8Matrix<double>& A,
+    const CBLAS_TRANSPOSE TransB, const int N, const double input_max,
+    const double* B, const double* bias, const CBLAS_TRANSPOSE TransC,
+    double* C);
+
+}  // namespace caffe
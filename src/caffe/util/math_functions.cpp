@@ -1,12 +1,22 @@
+#include <string.h>
+
 #include <boost/math/special_functions/next.hpp>
 #include <boost/random.hpp>
 
+#include <algorithm>
 #include <limits>
 
 #include "caffe/common.hpp"
+#include "caffe/util/blas_backend.hpp"
 #include "caffe/util/math_functions.hpp"
+#include "caffe/util/packed_gemm.hpp"
 #include "caffe/util/rng.hpp"
 
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#define CAFFE_MATH_X86
+#endif
+
 namespace caffe {
 
 template<>
@@ -16,8 +26,19 @@ void caffe_cpu_gemm<float>(const CBLAS_TRANSPOSE TransA,
     float* C) {
   int lda = (TransA == CblasNoTrans) ? K : M;
   int ldb = (TransB == CblasNoTrans) ? N : K;
-  cblas_sgemm(CblasRowMajor, TransA, TransB, M, N, K, alpha, A, lda, B,
-      ldb, beta, C, N);
+  switch (caffe_blas_backend()) {
+  case BLAS_LINKED:
+    cblas_sgemm(CblasRowMajor, TransA, TransB, M, N, K, alpha, A, lda, B,
+        ldb, beta, C, N);
+    break;
+  case BLAS_LIBRARY:
+    caffe_blas_library().sgemm(CblasRowMajor, TransA, TransB, M, N, K, alpha,
+        A, lda, B, ldb, beta, C, N);
+    break;
+  case BLAS_BUILTIN:
+    caffe_cpu_gemm_builtin(TransA, TransB, M, N, K, alpha, A, B, beta, C);
+    break;
+  }
 }
 
 template<>
@@ -27,22 +48,55 @@ void caffe_cpu_gemm<double>(const CBLAS_TRANSPOSE TransA,
     double* C) {
   int lda = (TransA == CblasNoTrans) ? K : M;
   int ldb = (TransB == CblasNoTrans) ? N : K;
-  cblas_dgemm(CblasRowMajor, TransA, TransB, M, N, K, alpha, A, lda, B,
-      ldb, beta, C, N);
+  switch (caffe_blas_backend()) {
+  case BLAS_LINKED:
+    cblas_dgemm(CblasRowMajor, TransA, TransB, M, N, K, alpha, A, lda, B,
+        ldb, beta, C, N);
+    break;
+  case BLAS_LIBRARY:
+    caffe_blas_library().dgemm(CblasRowMajor, TransA, TransB, M, N, K, alpha,
+        A, lda, B, ldb, beta, C, N);
+    break;
+  case BLAS_BUILTIN:
+    caffe_cpu_gemm_builtin(TransA, TransB, M, N, K, alpha, A, B, beta, C);
+    break;
+  }
 }
 
 template <>
 void caffe_cpu_gemv<float>(const CBLAS_TRANSPOSE TransA, const int M,
     const int N, const float alpha, const float* A, const float* x,
     const float beta, float* y) {
-  cblas_sgemv(CblasRowMajor, TransA, M, N, alpha, A, N, x, 1, beta, y, 1);
+  switch (caffe_blas_backend()) {
+  case BLAS_LINKED:
+    cblas_sgemv(CblasRowMajor, TransA, M, N, alpha, A, N, x, 1, beta, y, 1);
+    break;
+  case BLAS_LIBRARY:
+    caffe_blas_library().sgemv(CblasRowMajor, TransA, M, N, alpha, A, N, x, 1,
+        beta, y, 1);
+    break;
+  case BLAS_BUILTIN:
+    caffe_cpu_gemv_builtin(TransA, M, N, alpha, A, x, beta, y);
+    break;
+  }
 }
 
 template <>
 void caffe_cpu_gemv<double>(const CBLAS_TRANSPOSE TransA, const int M,
     const int N, const double alpha, const double* A, const double* x,
     const double beta, double* y) {
-  cblas_dgemv(CblasRowMajor, TransA, M, N, alpha, A, N, x, 1, beta, y, 1);
+  switch (caffe_blas_backend()) {
+  case BLAS_LINKED:
+    cblas_dgemv(CblasRowMajor, TransA, M, N, alpha, A, N, x, 1, beta, y, 1);
+    break;
+  case BLAS_LIBRARY:
+    caffe_blas_library().dgemv(CblasRowMajor, TransA, M, N, alpha, A, N, x, 1,
+        beta, y, 1);
+    break;
+  case BLAS_BUILTIN:
+    caffe_cpu_gemv_builtin(TransA, M, N, alpha, A, x, beta, y);
+    break;
+  }
 }
 
 template <>
@@ -186,6 +240,314 @@ void caffe_powx<double>(const int n, const double* a, const double b,
   vdPowx(n, a, b, y);
 }
 
+#ifdef CAFFE_MATH_X86
+// _mm512_max_ps and _mm512_max_pd merge into an undefined vector, which
+// -Wall takes for an uninitialized one; with every lane set in the mask, the
+// masked max only merges into its first operand.
+__attribute__((target("avx512f")))
+static inline __m512 max512(const __m512 a, const __m512 b) {
+  return _mm512_mask_max_ps(a, 0xffff, a, b);
+}
+
+__attribute__((target("avx512f")))
+static inline __m512d max512(const __m512d a, const __m512d b) {
+  return _mm512_mask_max_pd(a, 0xff, a, b);
+}
+
+// Element-wise max of x[0], ..., x[num - 1], 4 vectors at a time held in
+// registers across the inputs and then one at a time. The max instructions
+// return their second operand unless the first is greater, as the scalar
+// loops do, so the results are the same, NaNs and signed zeros included.
+__attribute__((target("avx512f")))
+static int max_avx512(const int n, const int num, const float* const* x,
+    float* y) {
+  int i = 0;
+  for (; i + 64 <= n; i += 64) {
+    __m512 y0 = _mm512_loadu_ps(x[0] + i);
+    __m512 y1 = _mm512_loadu_ps(x[0] + i + 16);
+    __m512 y2 = _mm512_loadu_ps(x[0] + i + 32);
+    __m512 y3 = _mm512_loadu_ps(x[0] + i + 48);
+    for (int j = 1; j < num; ++j) {
+      y0 = max512(y0, _mm512_loadu_ps(x[j] + i));
+      y1 = max512(y1, _mm512_loadu_ps(x[j] + i + 16));
+      y2 = max512(y2, _mm512_loadu_ps(x[j] + i + 32));
+      y3 = max512(y3, _mm512_loadu_ps(x[j] + i + 48));
+    }
+    _mm512_storeu_ps(y + i, y0);
+    _mm512_storeu_ps(y + i + 16, y1);
+    _mm512_storeu_ps(y + i + 32, y2);
+    _mm512_storeu_ps(y + i + 48, y3);
+  }
+  for (; i + 16 <= n; i += 16) {
+    __m512 y0 = _mm512_loadu_ps(x[0] + i);
+    for (int j = 1; j < num; ++j) {
+      y0 = max512(y0, _mm512_loadu_ps(x[j] + i));
+    }
+    _mm512_storeu_ps(y + i, y0);
+  }
+  return i;
+}
+
+__attribute__((target("avx512f")))
+static int max_avx512(const int n, const int num, const double* const* x,
+    double* y) {
+  int i = 0;
+  for (; i + 32 <= n; i += 32) {
+    __m512d y0 = _mm512_loadu_pd(x[0] + i);
+    __m512d y1 = _mm512_loadu_pd(x[0] + i + 8);
+    __m512d y2 = _mm512_loadu_pd(x[0] + i + 16);
+    __m512d y3 = _mm512_loadu_pd(x[0] + i + 24);
+    for (int j = 1; j < num; ++j) {
+      y0 = max512(y0, _mm512_loadu_pd(x[j] + i));
+      y1 = max512(y1, _mm512_loadu_pd(x[j] + i + 8));
+      y2 = max512(y2, _mm512_loadu_pd(x[j] + i + 16));
+      y3 = max512(y3, _mm512_loadu_pd(x[j] + i + 24));
+    }
+    _mm512_storeu_pd(y + i, y0);
+    _mm512_storeu_pd(y + i + 8, y1);
+    _mm512_storeu_pd(y + i + 16, y2);
+    _mm512_storeu_pd(y + i + 24, y3);
+  }
+  for (; i + 8 <= n; i += 8) {
+    __m512d y0 = _mm512_loadu_pd(x[0] + i);
+    for (int j = 1; j < num; ++j) {
+      y0 = max512(y0, _mm512_loadu_pd(x[j] + i));
+    }
+    _mm512_storeu_pd(y + i, y0);
+  }
+  return i;
+}
+
+__attribute__((target("avx2")))
+static int max_avx2(const int n, const int num, const float* const* x,
+    float* y) {
+  int i = 0;
+  for (; i + 32 <= n; i += 32) {
+    __m256 y0 = _mm256_loadu_ps(x[0] + i);
+    __m256 y1 = _mm256_loadu_ps(x[0] + i + 8);
+    __m256 y2 = _mm256_loadu_ps(x[0] + i + 16);
+    __m256 y3 = _mm256_loadu_ps(x[0] + i + 24);
+    for (int j = 1; j < num; ++j) {
+      y0 = _mm256_max_ps(y0, _mm256_loadu_ps(x[j] + i));
+      y1 = _mm256_max_ps(y1, _mm256_loadu_ps(x[j] + i + 8));
+      y2 = _mm256_max_ps(y2, _mm256_loadu_ps(x[j] + i + 16));
+      y3 = _mm256_max_ps(y3, _mm256_loadu_ps(x[j] + i + 24));
+    }
+    _mm256_storeu_ps(y + i, y0);
+    _mm256_storeu_ps(y + i + 8, y1);
+    _mm256_storeu_ps(y + i + 16, y2);
+    _mm256_storeu_ps(y + i + 24, y3);
+  }
+  for (; i + 8 <= n; i += 8) {
+    __m256 y0 = _mm256_loadu_ps(x[0] + i);
+    for (int j = 1; j < num; ++j) {
+      y0 = _mm256_max_ps(y0, _mm256_loadu_ps(x[j] + i));
+    }
+    _mm256_storeu_ps(y + i, y0);
+  }
+  return i;
+}
+
+__attribute__((target("avx2")))
+static int max_avx2(const int n, const int num, const double* const* x,
+    double* y) {
+  int i = 0;
+  for (; i + 16 <= n; i += 16) {
+    __m256d y0 = _mm256_loadu_pd(x[0] + i);
+    __m256d y1 = _mm256_loadu_pd(x[0] + i + 4);
+    __m256d y2 = _mm256_loadu_pd(x[0] + i + 8);
+    __m256d y3 = _mm256_loadu_pd(x[0] + i + 12);
+    for (int j = 1; j < num; ++j) {
+      y0 = _mm256_max_pd(y0, _mm256_loadu_pd(x[j] + i));
+      y1 = _mm256_max_pd(y1, _mm256_loadu_pd(x[j] + i + 4));
+      y2 = _mm256_max_pd(y2, _mm256_loadu_pd(x[j] + i + 8));
+      y3 = _mm256_max_pd(y3, _mm256_loadu_pd(x[j] + i + 12));
+    }
+    _mm256_storeu_pd(y + i, y0);
+    _mm256_storeu_pd(y + i + 4, y1);
+    _mm256_storeu_pd(y + i + 8, y2);
+    _mm256_storeu_pd(y + i + 12, y3);
+  }
+  for (; i + 4 <= n; i += 4) {
+    __m256d y0 = _mm256_loadu_pd(x[0] + i);
+    for (int j = 1; j < num; ++j) {
+      y0 = _mm256_max_pd(y0, _mm256_loadu_pd(x[j] + i));
+    }
+    _mm256_storeu_pd(y + i, y0);
+  }
+  return i;
+}
+#endif
+
+// The vectorized part of a max returns the number of values it did.
+template <typename Dtype>
+static int max_vectorized(const int n, const int num, const Dtype* const* x,
+    Dtype* y) {
+#ifdef CAFFE_MATH_X86
+  static const bool avx512 = __builtin_cpu_supports("avx512f");
+  static const bool avx2 = __builtin_cpu_supports("avx2");
+  if (avx512) { return max_avx512(n, num, x, y); }
+  if (avx2) { return max_avx2(n, num, x, y); }
+#endif
+  return 0;
+}
+
+template <typename Dtype>
+void caffe_max(const int n, const Dtype* a, const Dtype* b, Dtype* y) {
+  const Dtype* x[] = {a, b};
+  for (int i = max_vectorized(n, 2, x, y); i < n; ++i) {
+    y[i] = a[i] > b[i] ? a[i] : b[i];
+  }
+}
+
+template void caffe_max<float>(const int n, const float* a, const float* b,
+    float* y);
+template void caffe_max<double>(const int n, const double* a, const double* b,
+    double* y);
+
+template <typename Dtype>
+void caffe_max(const int n, const int num, const Dtype* const* x, Dtype* y) {
+  CHECK_GE(num, 1);
+  // Without vector kernels, reduce block by block in a buffer that stays in
+  // L1, so that y is written once and every input read once whatever num is.
+  const int kBlock = 1024;
+  Dtype buffer[kBlock];
+  for (int begin = max_vectorized(n, num, x, y); begin < n;
+       begin += kBlock) {
+    const int size = std::min(kBlock, n - begin);
+    if (num == 1) {
+      std::copy(x[0] + begin, x[0] + begin + size, buffer);
+    } else {
+      caffe_max(size, x[0] + begin, x[1] + begin, buffer);
+    }
+    for (int j = 2; j < num; ++j) {
+      caffe_max<Dtype>(size, buffer, x[j] + begin, buffer);
+    }
+    std::copy(buffer, buffer + size, y + begin);
+  }
+}
+
+template void caffe_max<float>(const int n, const int num,
+    const float* const* x, float* y);
+template void caffe_max<double>(const int n, const int num,
+    const double* const* x, double* y);
+
+template <typename Dtype>
+void caffe_pack_occupancy(const int n, const int bits, const Dtype* x,
+    uint8_t* y) {
+  if (bits == 8) {
+    for (int i = 0; i < n; ++i) {
+      const Dtype value = x[i] * 255 + Dtype(0.5);
+      y[i] = static_cast<uint8_t>(value < 0 ? 0 : (value > 255 ? 255 : value));
+    }
+  } else {
+    CHECK_EQ(bits, 1) << "Occupancies are packed with 1 or 8 bits";
+    for (int b = 0; b < (n + 7) / 8; ++b) {
+      const int end = std::min(8, n - 8 * b);
+      uint8_t byte = 0;
+      for (int k = 0; k < end; ++k) {
+        byte |= (x[8 * b + k] >= Dtype(0.5)) << k;
+      }
+      y[b] = byte;
+    }
+  }
+}
+
+template void caffe_pack_occupancy<float>(const int n, const int bits,
+    const float* x, uint8_t* y);
+template void caffe_pack_occupancy<double>(const int n, const int bits,
+    const double* x, uint8_t* y);
+
+#ifdef CAFFE_MATH_X86
+// Occupancies 8 at a time, bit k of a byte in lane k, or 4 at a time for
+// doubles, which the masks select; the bytes convert to Dtype exactly before
+// the same product as in the scalar loop.
+__attribute__((target("avx2")))
+static int unpack_occupancy_avx2(const int n, const int bits,
+    const uint8_t* x, float* y) {
+  int i = 0;
+  if (bits == 8) {
+    const __m256 scale = _mm256_set1_ps(1.f / 255);
+    for (; i + 8 <= n; i += 8) {
+      const __m256i bytes = _mm256_cvtepu8_epi32(
+          _mm_loadl_epi64(reinterpret_cast<const __m128i*>(x + i)));
+      _mm256_storeu_ps(y + i, _mm256_mul_ps(_mm256_cvtepi32_ps(bytes), scale));
+    }
+  } else {
+    const __m256i masks = _mm256_setr_epi32(1, 2, 4, 8, 16, 32, 64, 128);
+    const __m256 one = _mm256_set1_ps(1.f);
+    for (; i + 8 <= n; i += 8) {
+      const __m256i set = _mm256_cmpeq_epi32(_mm256_and_si256(
+          _mm256_set1_epi32(x[i / 8]), masks), masks);
+      _mm256_storeu_ps(y + i, _mm256_and_ps(_mm256_castsi256_ps(set), one));
+    }
+  }
+  return i;
+}
+
+__attribute__((target("avx2")))
+static int unpack_occupancy_avx2(const int n, const int bits,
+    const uint8_t* x, double* y) {
+  int i = 0;
+  if (bits == 8) {
+    const __m256d scale = _mm256_set1_pd(1. / 255);
+    for (; i + 4 <= n; i += 4) {
+      int32_t word;
+      memcpy(&word, x + i, sizeof(word));
+      const __m128i bytes = _mm_cvtepu8_epi32(_mm_cvtsi32_si128(word));
+      _mm256_storeu_pd(y + i, _mm256_mul_pd(_mm256_cvtepi32_pd(bytes), scale));
+    }
+  } else {
+    const __m256i masks[] = {_mm256_setr_epi64x(1, 2, 4, 8),
+        _mm256_setr_epi64x(16, 32, 64, 128)};
+    const __m256d one = _mm256_set1_pd(1.);
+    for (; i + 8 <= n; i += 8) {
+      const __m256i byte = _mm256_set1_epi64x(x[i / 8]);
+      for (int h = 0; h < 2; ++h) {
+        const __m256i set = _mm256_cmpeq_epi64(
+            _mm256_and_si256(byte, masks[h]), masks[h]);
+        _mm256_storeu_pd(y + i + 4 * h,
+            _mm256_and_pd(_mm256_castsi256_pd(set), one));
+      }
+    }
+  }
+  return i;
+}
+#endif
+
+template <typename Dtype>
+void caffe_unpack_occupancy(const int n, const int bits, const uint8_t* x,
+    Dtype* y) {
+  CHECK(bits == 1 || bits == 8) << "Occupancies are packed with 1 or 8 bits";
+  int i = 0;
+#ifdef CAFFE_MATH_X86
+  static const bool avx2 = __builtin_cpu_supports("avx2");
+  if (avx2) { i = unpack_occupancy_avx2(n, bits, x, y); }
+#endif
+  if (bits == 8) {
+    const Dtype scale = Dtype(1) / 255;
+    for (; i < n; ++i) {
+      y[i] = x[i] * scale;
+    }
+  } else {
+    // Whole bytes first, with a fixed trip count the compiler unrolls.
+    for (; i + 8 <= n; i += 8) {
+      const uint8_t byte = x[i / 8];
+      for (int k = 0; k < 8; ++k) {
+        y[i + k] = (byte >> k) & 1;
+      }
+    }
+    for (; i < n; ++i) {
+      y[i] = (x[i / 8] >> (i % 8)) & 1;
+    }
+  }
+}
+
+template void caffe_unpack_occupancy<float>(const int n, const int bits,
+    const uint8_t* x, float* y);
+template void caffe_unpack_occupancy<double>(const int n, const int bits,
+    const uint8_t* x, double* y);
+
 template <>
 void caffe_sqr<float>(const int n, const float* a, float* y) {
   vsSqr(n, a, y);
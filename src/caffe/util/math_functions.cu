@@ -3,7 +3,9 @@
 #include <thrust/functional.h>  // thrust::plus
 #include <thrust/reduce.h>
 
+#include <algorithm>
 #include <cmath>
+#include <vector>
 
 #include "caffe/common.hpp"
 #include "caffe/util/math_functions.hpp"
@@ -299,6 +301,110 @@ void caffe_gpu_div<double>(const int N, const double* a,
       N, a, b, y);
 }
 
+template <typename Dtype>
+__global__ void unpack_occupancy_kernel(const int n, const int bits,
+    const uint8_t* x, Dtype* y) {
+  CUDA_KERNEL_LOOP(index, n) {
+    y[index] = bits == 8 ? x[index] * (Dtype(1) / 255)
+                         : Dtype((x[index >> 3] >> (index & 7)) & 1);
+  }
+}
+
+template <>
+void caffe_gpu_unpack_occupancy<float>(const int n, const int bits,
+    const uint8_t* x, float* y) {
+  CHECK(bits == 1 || bits == 8) << "Occupancies are packed with 1 or 8 bits";
+  // NOLINT_NEXT_LINE(whitespace/operators)
+  unpack_occupancy_kernel<float><<<CAFFE_GET_BLOCKS(n),
+      CAFFE_CUDA_NUM_THREADS>>>(n, bits, x, y);
+}
+
+template <>
+void caffe_gpu_unpack_occupancy<double>(const int n, const int bits,
+    const uint8_t* x, double* y) {
+  CHECK(bits == 1 || bits == 8) << "Occupancies are packed with 1 or 8 bits";
+  // NOLINT_NEXT_LINE(whitespace/operators)
+  unpack_occupancy_kernel<double><<<CAFFE_GET_BLOCKS(n),
+      CAFFE_CUDA_NUM_THREADS>>>(n, bits, x, y);
+}
+
+template <typename Dtype>
+__global__ void max_kernel(const int n, const Dtype* a,
+    const Dtype* b, Dtype* y) {
+  CUDA_KERNEL_LOOP(index, n) {
+    y[index] = max(a[index], b[index]);
+  }
+}
+
+template <>
+void caffe_gpu_max<float>(const int N, const float* a,
+    const float* b, float* y) {
+  // NOLINT_NEXT_LINE(whitespace/operators)
+  max_kernel<float><<<CAFFE_GET_BLOCKS(N), CAFFE_CUDA_NUM_THREADS>>>(
+      N, a, b, y);
+}
+
+template <>
+void caffe_gpu_max<double>(const int N, const double* a,
+    const double* b, double* y) {
+  // NOLINT_NEXT_LINE(whitespace/operators)
+  max_kernel<double><<<CAFFE_GET_BLOCKS(N), CAFFE_CUDA_NUM_THREADS>>>(
+      N, a, b, y);
+}
+
+// The inputs of the N-way max, passed to the kernel by value.
+const int kMaxInputs = 16;
+template <typename Dtype>
+struct MaxInputs {
+  const Dtype* x[kMaxInputs];
+};
+
+template <typename Dtype>
+__global__ void max_n_kernel(const int n, const int num,
+    const MaxInputs<Dtype> inputs, Dtype* y) {
+  CUDA_KERNEL_LOOP(index, n) {
+    Dtype value = inputs.x[0][index];
+    for (int j = 1; j < num; ++j) {
+      value = max(value, inputs.x[j][index]);
+    }
+    y[index] = value;
+  }
+}
+
+template <typename Dtype>
+void caffe_gpu_max(const int N, const int num, const Dtype* const* x,
+    Dtype* y) {
+  CHECK_GE(num, 1);
+  // One pass per kMaxInputs inputs, the later ones starting from y. An input
+  // that y overwrites goes first, so that it is read before.
+  vector<const Dtype*> order(x, x + num);
+  typename vector<const Dtype*>::iterator overwritten =
+      std::find(order.begin(), order.end(), y);
+  if (overwritten != order.end()) {
+    std::iter_swap(order.begin(), overwritten);
+  }
+  int j = 0;
+  while (j < num) {
+    MaxInputs<Dtype> inputs;
+    int count = 0;
+    if (j > 0) {
+      inputs.x[count++] = y;
+    }
+    while (count < kMaxInputs && j < num) {
+      inputs.x[count++] = order[j++];
+    }
+    // NOLINT_NEXT_LINE(whitespace/operators)
+    max_n_kernel<Dtype><<<CAFFE_GET_BLOCKS(N), CAFFE_CUDA_NUM_THREADS>>>(
+        N, count, inputs, y);
+    CUDA_POST_KERNEL_CHECK;
+  }
+}
+
+template void caffe_gpu_max<float>(const int N, const int num,
+    const float* const* x, float* y);
+template void caffe_gpu_max<double>(const int N, const int num,
+    const double* const* x, double* y);
+
 template <typename Dtype>
 __global__ void abs_kernel(const int n, const Dtype* a, Dtype* y) {
   CUDA_KERNEL_LOOP(index, n) {
@@ -0,0 +1,318 @@
+#include <boost/thread/tss.hpp>
+
+#include <algorithm>
+#include <vector>
+
+#include "caffe/util/math_functions.hpp"
+#include "caffe/util/packed_gemm.hpp"
+
+namespace caffe {
+
+// Outputs are computed in register tiles of kMR rows by kNR columns, from
+// panels of kMR rows of A and kNR columns of B, over blocks of kKC of the
+// K dimension so that a panel of B stays in L1, and of kMC rows so that the
+// panels of A of a block stay in L2. kNC bounds the part of B packed at once.
+template <typename Dtype>
+struct GemmShape {
+  static const int kMR = 4;
+  static const int kNR = 64 / sizeof(Dtype);
+  static const int kKC = 256;
+  static const int kMC = 128;
+  static const int kNC = 1024;
+};
+
+inline int round_up(int value, int multiple) {
+  return (value + multiple - 1) / multiple * multiple;
+}
+
+// Packs outer_count x depth_count elements of a matrix whose element
+// (o, d) is data[o * outer_stride + d * depth_stride], from
+// (outer_begin, depth_begin), into panels of width outer elements,
+// depth_count * width apart, laid out as [depth][width] and zero padded.
+template <typename Dtype>
+static void gemm_pack(const Dtype* data, const int outer_stride,
+    const int depth_stride, const int outer_begin, const int outer_count,
+    const int depth_begin, const int depth_count, const int width,
+    Dtype* packed) {
+  for (int o0 = 0; o0 < outer_count; o0 += width) {
+    const int valid = std::min(width, outer_count - o0);
+    const Dtype* panel = data + (outer_begin + o0) * outer_stride +
+        depth_begin * depth_stride;
+    for (int d = 0; d < depth_count; ++d) {
+      const Dtype* in = panel + d * depth_stride;
+      int w = 0;
+      for (; w < valid; ++w) {
+        packed[w] = in[w * outer_stride];
+      }
+      for (; w < width; ++w) {
+        packed[w] = 0;
+      }
+      packed += width;
+    }
+  }
+}
+
+// One kMR x kNR tile of C from kc steps of a panel of A and one of B, of
+// which only rows x cols are stored.
+template <typename Dtype>
+static void gemm_kernel(const int kc, const Dtype* a, const Dtype* b,
+    const Dtype alpha, const Dtype beta, Dtype* c, const int ldc,
+    const int rows, const int cols) {
+  const int kMR = GemmShape<Dtype>::kMR;
+  const int kNR = GemmShape<Dtype>::kNR;
+  // One accumulator row per row of A, so that they can stay in registers.
+  Dtype acc0[kNR] = {}, acc1[kNR] = {}, acc2[kNR] = {}, acc3[kNR] = {};
+  for (int k = 0; k < kc; ++k) {
+    const Dtype a0 = a[0], a1 = a[1], a2 = a[2], a3 = a[3];
+    for (int j = 0; j < kNR; ++j) {
+      const Dtype value = b[j];
+      acc0[j] += a0 * value;
+      acc1[j] += a1 * value;
+      acc2[j] += a2 * value;
+      acc3[j] += a3 * value;
+    }
+    a += kMR;
+    b += kNR;
+  }
+  const Dtype* acc[kMR] = {acc0, acc1, acc2, acc3};
+  for (int r = 0; r < rows; ++r) {
+    Dtype* out = c + r * ldc;
+    if (beta == 0) {
+      for (int j = 0; j < cols; ++j) {
+        out[j] = alpha * acc[r][j];
+      }
+    } else {
+      for (int j = 0; j < cols; ++j) {
+        out[j] = alpha * acc[r][j] + beta * out[j];
+      }
+    }
+  }
+}
+
+// The M x N block of C of one K block, from the packed panels of A and B,
+// a_stride and b_stride apart.
+template <typename Dtype>
+static void gemm_block(const int M, const int N, const int kc,
+    const Dtype alpha, const Dtype* a, const int a_stride, const Dtype* b,
+    const int b_stride, const Dtype beta, Dtype* c, const int ldc) {
+  const int kMR = GemmShape<Dtype>::kMR;
+  const int kNR = GemmShape<Dtype>::kNR;
+  const int kMC = GemmShape<Dtype>::kMC;
+  for (int i0 = 0; i0 < M; i0 += kMC) {
+    const int mc = std::min(kMC, M - i0);
+    for (int j = 0; j < N; j += kNR) {
+      const Dtype* b_panel = b + j / kNR * b_stride;
+      for (int i = i0; i < i0 + mc; i += kMR) {
+        gemm_kernel(kc, a + i / kMR * a_stride, b_panel, alpha, beta,
+            c + i * ldc + j, ldc, std::min(kMR, M - i), std::min(kNR, N - j));
+      }
+    }
+  }
+}
+
+// The packing buffers of A and B of the calling thread.
+template <typename Dtype>
+struct GemmBuffers {
+  std::vector<Dtype> a, b;
+};
+
+template <typename Dtype>
+static GemmBuffers<Dtype>& gemm_buffers() {
+  static boost::thread_specific_ptr<GemmBuffers<Dtype> > buffers;
+  if (!buffers.get()) {
+    buffers.reset(new GemmBuffers<Dtype>());
+  }
+  return *buffers;
+}
+
+// C = alpha * A * B + beta * C, with element (i, k) of A at
+// A[i * a_outer + k * a_depth] and (k, j) of B at B[j * b_outer + k * b_depth]
+// unless they are given packed, whole, in packed_a or packed_b.
+template <typename Dtype>
+static void gemm(const int M, const int N, const int K, const Dtype alpha,
+    const Dtype* A, const int a_outer, const int a_depth,
+    const Dtype* packed_a, const Dtype* B, const int b_outer,
+    const int b_depth, const Dtype* packed_b, const Dtype beta, Dtype* C) {
+  const int kMR = GemmShape<Dtype>::kMR;
+  const int kNR = GemmShape<Dtype>::kNR;
+  const int kKC = GemmShape<Dtype>::kKC;
+  const int kNC = GemmShape<Dtype>::kNC;
+  if (M == 0 || N == 0) {
+    return;
+  }
+  if (K == 0) {
+    caffe_scal(M * N, beta, C);
+    return;
+  }
+  std::vector<Dtype>& a_buffer = gemm_buffers<Dtype>().a;
+  std::vector<Dtype>& b_buffer = gemm_buffers<Dtype>().b;
+  if (!packed_a) {
+    a_buffer.resize(std::max<size_t>(a_buffer.size(),
+        round_up(M, kMR) * std::min(K, kKC)));
+  }
+  if (!packed_b) {
+    b_buffer.resize(std::max<size_t>(b_buffer.size(),
+        round_up(std::min(N, kNC), kNR) * std::min(K, kKC)));
+  }
+  for (int k0 = 0; k0 < K; k0 += kKC) {
+    const int kc = std::min(kKC, K - k0);
+    // Later K blocks accumulate into the first.
+    const Dtype block_beta = k0 ? Dtype(1) : beta;
+    const Dtype* a = packed_a + k0 * kMR;
+    int a_stride = K * kMR;
+    if (!packed_a) {
+      gemm_pack(A, a_outer, a_depth, 0, M, k0, kc, kMR, &a_buffer[0]);
+      a = &a_buffer[0];
+      a_stride = kc * kMR;
+    }
+    for (int j0 = 0; j0 < N; j0 += kNC) {
+      const int nc = std::min(kNC, N - j0);
+      const Dtype* b = packed_b + j0 * K + k0 * kNR;
+      int b_stride = K * kNR;
+      if (!packed_b) {
+        gemm_pack(B, b_outer, b_depth, j0, nc, k0, kc, kNR, &b_buffer[0]);
+        b = &b_buffer[0];
+        b_stride = kc * kNR;
+      }
+      gemm_block(M, nc, kc, alpha, a, a_stride, b, b_stride, block_beta,
+          C + j0, N);
+    }
+  }
+}
+
+template <typename Dtype>
+void PackedMatrix<Dtype>::Pack(Side side, CBLAS_TRANSPOSE trans, int rows,
+    int cols, const Dtype* data) {
+  side_ = side;
+  trans_ = trans;
+  rows_ = rows;
+  cols_ = cols;
+  source_.reset();
+  if (side == LEFT) {
+    // A, M x K, in panels of kMR rows.
+    const int width = GemmShape<Dtype>::kMR;
+    data_.resize(round_up(rows, width) * cols);
+    gemm_pack(data, trans == CblasNoTrans ? cols : 1,
+        trans == CblasNoTrans ? 1 : rows, 0, rows, 0, cols, width, &data_[0]);
+  } else {
+    // B, K x N, in panels of kNR columns.
+    const int width = GemmShape<Dtype>::kNR;
+    data_.resize(round_up(cols, width) * rows);
+    gemm_pack(data, trans == CblasNoTrans ? 1 : rows,
+        trans == CblasNoTrans ? cols : 1, 0, cols, 0, rows, width, &data_[0]);
+  }
+}
+
+template <typename Dtype>
+void PackedMatrix<Dtype>::Pack(Side side, CBLAS_TRANSPOSE trans, int rows,
+    int cols, const Blob<Dtype>& blob, int offset) {
+  const shared_ptr<SyncedMemory>& memory = blob.data();
+  if (source_ == memory && version_ == memory->version() &&
+      offset_ == offset && side_ == side && trans_ == trans &&
+      rows_ == rows && cols_ == cols) {
+    return;
+  }
+  CHECK_LE(offset + rows * cols, blob.count());
+  Pack(side, trans, rows, cols, blob.cpu_data() + offset);
+  source_ = memory;
+  version_ = memory->version();
+  offset_ = offset;
+}
+
+INSTANTIATE_CLASS(PackedMatrix);
+
+template <typename Dtype>
+void caffe_cpu_gemm_builtin(const CBLAS_TRANSPOSE TransA,
+    const CBLAS_TRANSPOSE TransB, const int M, const int N, const int K,
+    const Dtype alpha, const Dtype* A, const Dtype* B, const Dtype beta,
+    Dtype* C) {
+  gemm(M, N, K, alpha, A, TransA == CblasNoTrans ? K : 1,
+      TransA == CblasNoTrans ? 1 : M, static_cast<const Dtype*>(NULL), B,
+      TransB == CblasNoTrans ? 1 : K, TransB == CblasNoTrans ? N : 1,
+      static_cast<const Dtype*>(NULL), beta, C);
+}
+
+template void caffe_cpu_gemm_builtin<float>(const CBLAS_TRANSPOSE TransA,
+    const CBLAS_TRANSPOSE TransB, const int M, const int N, const int K,
+    const float alpha, const float* A, const float* B, const float beta,
+    float* C);
+template void caffe_cpu_gemm_builtin<double>(const CBLAS_TRANSPOSE TransA,
+    const CBLAS_TRANSPOSE TransB, const int M, const int N, const int K,
+    const double alpha, const double* A, const double* B, const double beta,
+    double* C);
+
+template <typename Dtype>
+void caffe_cpu_gemv_builtin(const CBLAS_TRANSPOSE TransA, const int M,
+    const int N, const Dtype alpha, const Dtype* A, const Dtype* x,
+    const Dtype beta, Dtype* y) {
+  if (TransA == CblasNoTrans) {
+    for (int i = 0; i < M; ++i) {
+      const Dtype* row = A + i * N;
+      Dtype sum = 0;
+      for (int j = 0; j < N; ++j) {
+        sum += row[j] * x[j];
+      }
+      y[i] = alpha * sum + (beta == 0 ? Dtype(0) : beta * y[i]);
+    }
+    return;
+  }
+  // y = alpha * A^T x + beta * y, one row of A at a time.
+  if (beta == 0) {
+    caffe_set(N, Dtype(0), y);
+  } else if (beta != 1) {
+    caffe_scal(N, beta, y);
+  }
+  for (int i = 0; i < M; ++i) {
+    const Dtype* row = A + i * N;
+    const Dtype scale = alpha * x[i];
+    for (int j = 0; j < N; ++j) {
+      y[j] += scale * row[j];
+    }
+  }
+}
+
+template void caffe_cpu_gemv_builtin<float>(const CBLAS_TRANSPOSE TransA,
+    const int M, const int N, const float alpha, const float* A,
+    const float* x, const float beta, float* y);
+template void caffe_cpu_gemv_builtin<double>(const CBLAS_TRANSPOSE TransA,
+    const int M, const int N, const double alpha, const double* A,
+    const double* x, const double beta, double* y);
+
+template <typename Dtype>
+void caffe_cpu_gemm_packed(const PackedMatrix<Dtype>& A,
+    const CBLAS_TRANSPOSE TransB, const int N, const Dtype alpha,
+    const Dtype* B, const Dtype beta, Dtype* C) {
+  CHECK_EQ(A.side(), PackedMatrix<Dtype>::LEFT);
+  const int K = A.cols();
+  gemm(A.rows(), N, K, alpha, static_cast<const Dtype*>(NULL), 0, 0,
+      A.data(), B, TransB == CblasNoTrans ? 1 : K,
+      TransB == CblasNoTrans ? N : 1, static_cast<const Dtype*>(NULL), beta,
+      C);
+}
+
+template void caffe_cpu_gemm_packed<float>(const PackedMatrix<float>& A,
+    const CBLAS_TRANSPOSE TransB, const int N, const float alpha,
+    const float* B, const float beta, float* C);
+template void caffe_cpu_gemm_packed<double>(const PackedMatrix<double>& A,
+    const CBLAS_TRANSPOSE TransB, const int N, const double alpha,
+    const double* B, const double beta, double* C);
+
+template <typename Dtype>
+void caffe_cpu_gemm_packed(const CBLAS_TRANSPOSE TransA, const int M,
+    const Dtype alpha, const Dtype* A, const PackedMatrix<Dtype>& B,
+    const Dtype beta, Dtype* C) {
+  CHECK_EQ(B.side(), PackedMatrix<Dtype>::RIGHT);
+  const int K = B.rows();
+  gemm(M, B.cols(), K, alpha, A, TransA == CblasNoTrans ? K : 1,
+      TransA == CblasNoTrans ? 1 : M, static_cast<const Dtype*>(NULL),
+      static_cast<const Dtype*>(NULL), 0, 0, B.data(), beta, C);
+}
+
+template void caffe_cpu_gemm_packed<float>(const CBLAS_TRANSPOSE TransA,
+    const int M, const float alpha, const float* A,
+    const PackedMatrix<float>& B, const float beta, float* C);
+template void caffe_cpu_gemm_packed<double>(const CBLAS_TRANSPOSE TransA,
+    const int M, const double alpha, const double* A,
+    const PackedMatrix<double>& B, const double beta, double* C);
+
+}  // namespace caffe
@@ -0,0 +1,221 @@
+#include <stddef.h>
+#include <stdint.h>
+
+#include "caffe/util/pixel_transform.hpp"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#define CAFFE_PIXEL_X86
+#endif
+
+namespace caffe {
+
+#ifdef CAFFE_PIXEL_X86
+// Loaders of 8 consecutive values of a row as floats, which hold them
+// exactly. The byte loads read no further than the 8th value.
+struct LoadBytes {
+  static const int kStride = 1;
+  __attribute__((target("avx2")))
+  static inline __m256 Load(const uint8_t* x) {
+    return _mm256_cvtepi32_ps(_mm256_cvtepu8_epi32(
+        _mm_loadl_epi64(reinterpret_cast<const __m128i*>(x))));
+  }
+};
+
+// One channel of 3 interleaved ones, as in BGR images: values 0 to 5 are in
+// the first 16 bytes, and values 6 and 7 in the 8 bytes from the 14th.
+struct LoadInterleaved3Bytes {
+  static const int kStride = 3;
+  __attribute__((target("avx2")))
+  static inline __m256 Load(const uint8_t* x) {
+    const __m128i low = _mm_shuffle_epi8(
+        _mm_loadu_si128(reinterpret_cast<const __m128i*>(x)),
+        _mm_setr_epi8(0, 3, 6, 9, 12, 15, -1, -1,
+                      -1, -1, -1, -1, -1, -1, -1, -1));
+    const __m128i high = _mm_shuffle_epi8(
+        _mm_loadl_epi64(reinterpret_cast<const __m128i*>(x + 14)),
+        _mm_setr_epi8(-1, -1, -1, -1, -1, -1, 4, 7,
+                      -1, -1, -1, -1, -1, -1, -1, -1));
+    return _mm256_cvtepi32_ps(_mm256_cvtepu8_epi32(_mm_or_si128(low, high)));
+  }
+};
+
+struct LoadFloats {
+  static const int kStride = 1;
+  __attribute__((target("avx2")))
+  static inline __m256 Load(const float* x) { return _mm256_loadu_ps(x); }
+};
+
+// Transforms the values i to i + 7 of the row. Mirrored, they are reversed
+// in the register and stored as a block from the end of y.
+template <bool kMirror, bool kMeanRow>
+__attribute__((target("avx2")))
+static inline void transform8_avx2(const __m256 x, const int i, const int n,
+    const float* mean_row, const float mean_value, const float scale,
+    float* y) {
+  const __m256 mean = kMeanRow ?
+      _mm256_loadu_ps(mean_row + i) : _mm256_set1_ps(mean_value);
+  const __m256 v = _mm256_mul_ps(_mm256_sub_ps(x, mean),
+      _mm256_set1_ps(scale));
+  if (kMirror) {
+    _mm256_storeu_ps(y + n - i - 8, _mm256_permutevar8x32_ps(v,
+        _mm256_setr_epi32(7, 6, 5, 4, 3, 2, 1, 0)));
+  } else {
+    _mm256_storeu_ps(y + i, v);
+  }
+}
+
+template <bool kMirror, bool kMeanRow>
+__attribute__((target("avx2")))
+static inline void transform8_avx2(const __m256 x, const int i, const int n,
+    const double* mean_row, const double mean_value, const double scale,
+    double* y) {
+  const __m256d halves[2] = {
+    _mm256_cvtps_pd(_mm256_castps256_ps128(x)),
+    _mm256_cvtps_pd(_mm256_extractf128_ps(x, 1))
+  };
+  for (int h = 0; h < 2; ++h) {
+    const int j = i + 4 * h;
+    const __m256d mean = kMeanRow ?
+        _mm256_loadu_pd(mean_row + j) : _mm256_set1_pd(mean_value);
+    const __m256d v = _mm256_mul_pd(_mm256_sub_pd(halves[h], mean),
+        _mm256_set1_pd(scale));
+    if (kMirror) {
+      _mm256_storeu_pd(y + n - j - 4, _mm256_permute4x64_pd(v, 0x1b));
+    } else {
+      _mm256_storeu_pd(y + j, v);
+    }
+  }
+}
+
+// The vectorized part of a row returns the number of values it did.
+template <bool kMirror, bool kMeanRow, typename Loader, typename T,
+    typename Dtype>
+__attribute__((target("avx2")))
+static int transform_row_avx2(const int n, const T* x,
+    const Dtype* mean_row, const Dtype mean_value, const Dtype scale,
+    Dtype* y) {
+  int i = 0;
+  for (; i + 8 <= n; i += 8) {
+    transform8_avx2<kMirror, kMeanRow>(Loader::Load(x + i * Loader::kStride),
+        i, n, mean_row, mean_value, scale, y);
+  }
+  return i;
+}
+
+template <bool kMirror, bool kMeanRow, typename Dtype>
+static int transform_row_avx2(const int n, const uint8_t* x,
+    const int stride, const Dtype* mean_row, const Dtype mean_value,
+    const Dtype scale, Dtype* y) {
+  switch (stride) {
+  case 1:
+    return transform_row_avx2<kMirror, kMeanRow, LoadBytes>(n, x, mean_row,
+        mean_value, scale, y);
+  case 3:
+    return transform_row_avx2<kMirror, kMeanRow, LoadInterleaved3Bytes>(n, x,
+        mean_row, mean_value, scale, y);
+  default:
+    return 0;
+  }
+}
+
+template <bool kMirror, bool kMeanRow, typename Dtype>
+static int transform_row_avx2(const int n, const float* x,
+    const int stride, const Dtype* mean_row, const Dtype mean_value,
+    const Dtype scale, Dtype* y) {
+  if (stride != 1) { return 0; }
+  return transform_row_avx2<kMirror, kMeanRow, LoadFloats>(n, x, mean_row,
+      mean_value, scale, y);
+}
+#endif
+
+// The mirror and the kind of mean are resolved once per row, out of the loop.
+template <bool kMirror, bool kMeanRow, typename T, typename Dtype>
+static void transform_row(const int n, const T* x, const int stride,
+    const Dtype* mean_row, const Dtype mean_value, const Dtype scale,
+    Dtype* y) {
+  int i = 0;
+#ifdef CAFFE_PIXEL_X86
+  static const bool avx2 = __builtin_cpu_supports("avx2");
+  if (avx2) {
+    i = transform_row_avx2<kMirror, kMeanRow>(n, x, stride, mean_row,
+        mean_value, scale, y);
+  }
+#endif
+  for (; i < n; ++i) {
+    const Dtype mean = kMeanRow ? mean_row[i] : mean_value;
+    y[kMirror ? n - 1 - i : i] =
+        (static_cast<Dtype>(x[i * stride]) - mean) * scale;
+  }
+}
+
+template <typename T, typename Dtype>
+void caffe_cpu_transform_row(const int n, const T* x, const int stride,
+    const Dtype* mean_row, const Dtype mean_value, const Dtype scale,
+    const bool mirror, Dtype* y) {
+  if (mirror) {
+    if (mean_row) {
+      transform_row<true, true>(n, x, stride, mean_row, mean_value, scale, y);
+    } else {
+      transform_row<true, false>(n, x, stride, mean_row, mean_value, scale,
+          y);
+    }
+  } else {
+    if (mean_row) {
+      transform_row<false, true>(n, x, stride, mean_row, mean_value, scale,
+          y);
+    } else {
+      transform_row<false, false>(n, x, stride, mean_row, mean_value, scale,
+          y);
+    }
+  }
+}
+
+template <typename Dtype>
+void caffe_cpu_transform_batch(const int num, const int channels,
+    const int height, const int width, const uint8_t* x,
+    const int* augmentation, const int crop_height, const int crop_width,
+    const Dtype* mean, const Dtype* mean_values, const Dtype scale,
+    Dtype* y) {
+  const size_t image_size = static_cast<size_t>(channels) * height * width;
+  for (int n = 0; n < num; ++n) {
+    const int* item = augmentation + 3 * n;
+    for (int c = 0; c < channels; ++c) {
+      for (int h = 0; h < crop_height; ++h) {
+        const int index = (c * height + item[0] + h) * width + item[1];
+        const Dtype mean_value = mean_values ? mean_values[c] : Dtype(0);
+        caffe_cpu_transform_row(crop_width, x + n * image_size + index, 1,
+            mean ? mean + index : NULL, mean_value, scale, item[2] != 0,
+            y + ((static_cast<size_t>(n) * channels + c) * crop_height + h) *
+                crop_width);
+      }
+    }
+  }
+}
+
+template void caffe_cpu_transform_row<uint8_t, float>(const int n,
+    const uint8_t* x, const int stride, const float* mean_row,
+    const float mean_value, const float scale, const bool mirror, float* y);
+template void caffe_cpu_transform_row<uint8_t, double>(const int n,
+    const uint8_t* x, const int stride, const double* mean_row,
+    const double mean_value, const double scale, const bool mirror,
+    double* y);
+template void caffe_cpu_transform_row<float, float>(const int n,
+    const float* x, const int stride, const float* mean_row,
+    const float mean_value, const float scale, const bool mirror, float* y);
+template void caffe_cpu_transform_row<float, double>(const int n,
+    const float* x, const int stride, const double* mean_row,
+    const double mean_value, const double scale, const bool mirror,
+    double* y);
+
+template void caffe_cpu_transform_batch<float>(const int num,
+    const int channels, const int height, const int width, const uint8_t* x,
+    const int* augmentation, const int crop_height, const int crop_width,
+    const float* mean, const float* mean_values, const float scale, float* y);
+template void caffe_cpu_transform_batch<double>(const int num,
+    const int channels, const int height, const int width, const uint8_t* x,
+    const int* augmentation, const int crop_height, const int crop_width,
+    const double* mean, const double* mean_values, const double scale,
+    double* y);
+
+}  // namespace caffe
@@ -0,0 +1,54 @@
+#include "caffe/common.hpp"
+#include "caffe/util/pixel_transform.hpp"
+
+namespace caffe {
+
+template <typename Dtype>
+__global__ void transform_batch_kernel(const int n, const int channels,
+    const int height, const int width, const uint8_t* x,
+    const int* augmentation, const int crop_height, const int crop_width,
+    const Dtype* mean, const Dtype* mean_values, const Dtype scale,
+    Dtype* y) {
+  CUDA_KERNEL_LOOP(index, n) {
+    const int w = index % crop_width;
+    const int h = (index / crop_width) % crop_height;
+    const int c = (index / crop_width / crop_height) % channels;
+    const int item = index / crop_width / crop_height / channels;
+    const int* item_augmentation = augmentation + 3 * item;
+    const int data_index = (c * height + item_augmentation[0] + h) * width +
+        item_augmentation[1] + (item_augmentation[2] ? crop_width - 1 - w : w);
+    const Dtype mean_value = mean ? mean[data_index] :
+        (mean_values ? mean_values[c] : Dtype(0));
+    y[index] = (static_cast<Dtype>(
+        x[static_cast<size_t>(item) * channels * height * width + data_index])
+        - mean_value) * scale;
+  }
+}
+
+template <typename Dtype>
+void caffe_gpu_transform_batch(const int num, const int channels,
+    const int height, const int width, const uint8_t* x,
+    const int* augmentation, const int crop_height, const int crop_width,
+    const Dtype* mean, const Dtype* mean_values, const Dtype scale,
+    Dtype* y) {
+  // One thread per output value of the whole batch.
+  const int n = num * channels * crop_height * crop_width;
+  // NOLINT_NEXT_LINE(whitespace/operators)
+  transform_batch_kernel<Dtype><<<CAFFE_GET_BLOCKS(n),
+                                  CAFFE_CUDA_NUM_THREADS>>>(
+      n, channels, height, width, x, augmentation, crop_height, crop_width,
+      mean, mean_values, scale, y);
+  CUDA_POST_KERNEL_CHECK;
+}
+
+template void caffe_gpu_transform_batch<float>(const int num,
+    const int channels, const int height, const int width, const uint8_t* x,
+    const int* augmentation, const int crop_height, const int crop_width,
+    const float* mean, const float* mean_values, const float scale, float* y);
+template void caffe_gpu_transform_batch<double>(const int num,
+    const int channels, const int height, const int width, const uint8_t* x,
+    const int* augmentation, const int crop_height, const int crop_width,
+    const double* mean, const double* mean_values, const double scale,
+    double* y);
+
+}  // namespace caffe
@@ -1,5 +1,7 @@
 #include "caffe/util/prediction.hpp"
 
+#include <algorithm>
+#include <cmath>
 #include <vector>
 #include <Eigen/Core>
 
@@ -153,7 +155,62 @@ float val_depth= vox[c](i,j);
 }
 	
 
-//takes only blobs and do the work (go to eigen and rotate) AVOID COPYING!
+	template <typename Dtype>
+	VoxelRotation<Dtype>::VoxelRotation(int size,
+	                                    const Dtype* model1,
+	                                    const Dtype* view_mat1,
+	                                    const Dtype* model2,
+	                                    const Dtype* view_mat2,
+	                                    const Dtype* proj_mat,
+	                                    bool trilinear)
+	    : size_(size), trilinear_(trilinear),
+	      params_(voxel_rotation_num_params(size)) {
+	  Eigen::Map<const Eigen::Matrix<Dtype,4,4> > view1(view_mat1);
+	  Eigen::Map<const Eigen::Matrix<Dtype,4,4> > view2(view_mat2);
+	  Eigen::Map<const Eigen::Matrix<Dtype,4,4> > proj(proj_mat);
+	  Eigen::Map<const Eigen::Matrix<Dtype,4,4> > mv1(model1);
+	  Eigen::Map<const Eigen::Matrix<Dtype,4,4> > mv2(model2);
+	  // NDC of viewpoint 2 -> world -> NDC of viewpoint 1, same as
+	  // rotate_coords but computed once instead of once per voxel.
+	  Eigen::Matrix<Dtype,4,4> unproject = (proj * view2 * mv2).inverse();
+	  Eigen::Map<Eigen::Matrix<Dtype,4,4,Eigen::RowMajor> > transform(
+	      params_.data() + kRotationTransform);
+	  transform = proj * view1 * mv1 * unproject;
+	  params_[kRotationP22] = proj(2,2);
+	  params_[kRotationP23] = proj(2,3);
+	  const Eigen::Matrix<Dtype,4,4> proj_copy = proj;
+	  for (int c = 0; c < size; c++) {
+	    params_[kRotationDepths + c] =
+	        z_to_depth<Dtype>(c, size, proj_copy) * 2 - 1;
+	  }
+	}
+
+	template <typename Dtype>
+	void VoxelRotation<Dtype>::Apply(const Dtype* vox, Dtype* output,
+	                                 int z_begin, int z_end) const {
+	  rotate_grid_cpu(params_.data(), size_, trilinear_, vox, output, z_begin,
+	                  z_end);
+	}
+
+	template <typename Dtype>
+	int prediction_voxels_offset(const Blob<Dtype>* pred)
+	{
+		int output_width = pred->width();
+		int output_height = pred->height();
+		//chenger methode selon taille du blob  (unfold ou 3d)
+		if (output_height == output_width*output_width) //if pred from a net, skip first classif layer
+			return output_width * output_height;
+		return 0;
+	}
+
+	template <typename Dtype>
+	const Dtype* prediction_voxels(const Blob<Dtype>* pred, int n)
+	{
+		return pred->cpu_data() + n * pred->count(1) +
+		    prediction_voxels_offset(pred);
+	}
+
+	//takes only blobs and writes the rotated grid straight into output
 	template <typename Dtype>
 	void rotate_blobs(const Blob<Dtype> * pred,
 					  const Dtype* model1,
@@ -161,60 +218,11 @@ float val_depth= vox[c](i,j);
 					  const Dtype* model2,
 					  const Dtype* view_mat2,
 					  const Dtype* proj_mat,
-					  Dtype * output)  //WARNING a voir
+					  Dtype * output)
 	{
-		//go from pred to a Grid<Dtype>
-		int output_channels=pred->channels();
-		int output_width = pred->width();
-		int output_height = pred->height();
-		int size = output_width;
-		
-
-		Grid<Dtype> grid(size);
-		const Dtype* output_data=pred->cpu_data();
-		//chenger methode selon taille du blob  (unfold ou 3d)
-		if (output_height == size*size) //if pred from a net, skip first classif layer
-			output_data+=output_width * output_height;
-
-		for(int c = 0; c < size; c++)
-		{
-			Slice<Dtype> channel(size, size);
-			std::memcpy(channel.data(), output_data, size*size* sizeof(Dtype));
-			output_data += size*size;
-			grid[c] = channel;
-		}
-		//transform viewpoint, view_mat, proj_mat into eigen matrices
-		Eigen::Map<const Eigen::Matrix<Dtype,4,4> > view1(view_mat1);
-		Eigen::Map<const Eigen::Matrix<Dtype,4,4> > view2(view_mat2);
-		Eigen::Map<const Eigen::Matrix<Dtype,4,4> > proj(proj_mat);
-		Eigen::Map<const Eigen::Matrix<Dtype,4,4> > mv1(model1);
-		Eigen::Map<const Eigen::Matrix<Dtype,4,4> > mv2(model2);
-		// std::cout<<view1<<std::endl<<std::endl;
-		// std::cout<<view2<<std::endl<<std::endl;
-		// std::cout<<mv1<<std::endl<<std::endl;
-		// std::cout<<mv2<<std::endl<<std::endl;
-		//compute model
-		// Eigen::Matrix<Dtype,4,4> model;
-		// model = new_view*model_old.inverse();
-		// model=model.inverse();
-
-		//rotate
-		Grid<Dtype> gt12 = rotate_voxels_prediction<Dtype>(grid, mv1, view1, mv2, view2, proj);
-		// std::cout<<"rotate ok"<<std::endl;
-		// cv::Mat pred1 = iso_surface(grid, 0.3);
-		// cv::namedWindow( "pred1", CV_WINDOW_NORMAL );
-		// cv::imshow("pred1",pred1);
-		// cv::Mat pred2 = iso_surface(gt12, 0.3);
-		// cv::namedWindow( "pred2", CV_WINDOW_NORMAL );
-		// cv::imshow("pred2",pred2);
-		// cv::waitKey(0);
-		//put into output
-
-		for(int c = 0; c < size; c++)
-		{
-			std::memcpy(output, gt12[c].data() ,size * size * sizeof(Dtype));
-			output += size*size;
-		}
+		VoxelRotation<Dtype> rotation(pred->width(), model1, view_mat1, model2,
+		                              view_mat2, proj_mat);
+		rotation.Apply(prediction_voxels(pred, 0), output);
 	}
 
 	template <typename Dtype>
@@ -265,6 +273,22 @@ float val_depth= vox[c](i,j);
 	return grid;
 }
 
+	template <typename Dtype>
+	void unpack_voxels_image(const cv::Mat &image, int img_size, int voxels_size,
+	                         cv::Mat *sketch, Grid<Dtype> *vox)
+{
+	CHECK(image.rows == img_size) << "#rows in image should be the size of input image";
+	cv::Mat data_alpha = image(cv::Rect(0,0,img_size,img_size));
+	int from_to[3*2] = {0,0,1,1,2,2};
+	*sketch = cv::Mat(data_alpha.size(),data_alpha.depth()+8*2);
+	cv::mixChannels(&data_alpha,1,sketch,1,from_to,3);
+
+	cv::Mat vox_cv = image(cv::Rect(img_size,0,image.cols-img_size,img_size));
+	int grid_rows = img_size/voxels_size;
+	int grid_cols = voxels_size/grid_rows/4;
+	*vox = unpack_pred_in_image<Dtype>(vox_cv,grid_rows,grid_cols);
+}
+
 template <typename Dtype>
 int CV_type()
 {
@@ -281,8 +305,21 @@ int CV_type()
 		return CV_64F;
 	}
 
+	template Grid<float> rotate_voxels_prediction(const Grid<float> &vox, const Eigen::Matrix<float,4,4> &model1, const Eigen::Matrix<float,4,4> &view1, const Eigen::Matrix<float,4,4> &model2, const Eigen::Matrix<float,4,4> &view2, const Eigen::Matrix<float,4,4> &proj);
+	template Grid<double> rotate_voxels_prediction(const Grid<double> &vox, const Eigen::Matrix<double,4,4> &model1, const Eigen::Matrix<double,4,4> &view1, const Eigen::Matrix<double,4,4> &model2, const Eigen::Matrix<double,4,4> &view2, const Eigen::Matrix<double,4,4> &proj);
+
+	template int prediction_voxels_offset(const Blob<float>* pred);
+	template int prediction_voxels_offset(const Blob<double>* pred);
+	template const float* prediction_voxels(const Blob<float>* pred, int n);
+	template const double* prediction_voxels(const Blob<double>* pred, int n);
+
+	template class VoxelRotation<float>;
+	template class VoxelRotation<double>;
+
 	template 	Grid<float> unpack_pred_in_image( cv::Mat &image, int grid_rows, int grid_cols);
 	template 	Grid<double> unpack_pred_in_image( cv::Mat &image, int grid_rows, int grid_cols);
+	template void unpack_voxels_image(const cv::Mat &image, int img_size, int voxels_size, cv::Mat *sketch, Grid<float> *vox);
+	template void unpack_voxels_image(const cv::Mat &image, int img_size, int voxels_size, cv::Mat *sketch, Grid<double> *vox);
 
 	
 	template void rotate_blobs(const Blob<double> * pred, const double* model1, const double* model2, const double* view_mat1, const double* view_mat2,  const double* proj_mat, double * output);
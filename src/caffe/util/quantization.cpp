@@ -0,0 +1,58 @@
+#include <algorithm>
+#include <cmath>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "caffe/util/quantization.hpp"
+
+namespace caffe {
+
+template <typename Dtype>
+int CalibrateNet(Net<Dtype>* net, int iterations, NetParameter* param) {
+  const vector<shared_ptr<Layer<Dtype> > >& layers = net->layers();
+  std::map<string, Dtype> input_max;
+  for (int iter = 0; iter < iterations; ++iter) {
+    for (int i = 0; i < layers.size(); ++i) {
+      const string type = layers[i]->type();
+      if (type == "Convolution" || type == "InnerProduct") {
+        Dtype& range = input_max[layers[i]->layer_param().name()];
+        const vector<Blob<Dtype>*>& bottom = net->bottom_vecs()[i];
+        for (int j = 0; j < bottom.size(); ++j) {
+          const Dtype* data = bottom[j]->cpu_data();
+          for (int k = 0; k < bottom[j]->count(); ++k) {
+            range = std::max(range, std::fabs(data[k]));
+          }
+        }
+      }
+      net->ForwardFromTo(i, i);
+    }
+  }
+  int quantized = 0;
+  for (int i = 0; i < param->layer_size(); ++i) {
+    LayerParameter* layer = param->mutable_layer(i);
+    typename std::map<string, Dtype>::const_iterator range =
+        input_max.find(layer->name());
+    if (range == input_max.end()) {
+      continue;
+    }
+    // An input that is always zero still needs a scale.
+    const float max = range->second > 0 ? range->second : 1;
+    QuantizationParameter* quantization = layer->type() == "Convolution" ?
+        layer->mutable_convolution_param()->mutable_quantization() :
+        layer->mutable_inner_product_param()->mutable_quantization();
+    quantization->set_precision(QuantizationParameter_Precision_INT8);
+    quantization->set_input_max(max);
+    LOG(INFO) << "Quantizing " << layer->name() << " with inputs up to "
+        << max;
+    ++quantized;
+  }
+  return quantized;
+}
+
+template int CalibrateNet<float>(Net<float>* net, int iterations,
+    NetParameter* param);
+template int CalibrateNet<double>(Net<double>* net, int iterations,
+    NetParameter* param);
+
+}  // namespace caffe
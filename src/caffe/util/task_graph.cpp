@@ -0,0 +1,125 @@
+#include <boost/bind.hpp>
+#include <boost/thread.hpp>
+#include <deque>
+#include <vector>
+
+#include "caffe/util/task_graph.hpp"
+
+namespace caffe {
+
+class TaskGraph::state {
+ public:
+  boost::mutex mutex_;
+  boost::condition_variable ready_;
+  boost::thread::id caller_;
+  int first_;
+  int last_;
+  int remaining_;
+  // Dependencies left to run, indexed from first_.
+  vector<int> pending_;
+  vector<std::deque<int> > queues_;
+  std::deque<int> caller_queue_;
+};
+
+TaskGraph::TaskGraph(int num_tasks)
+    : successors_(num_tasks), predecessors_(num_tasks),
+      on_caller_(num_tasks, false) {
+}
+
+void TaskGraph::AddDependency(int before, int after) {
+  CHECK_NE(before, after);
+  successors_[before].push_back(after);
+  predecessors_[after].push_back(before);
+}
+
+// Runs ready tasks until all of them are done, from the queue of the thread
+// first.
+void TaskGraph::RunTasks(state* s, const boost::function<void(int)>& fn,
+    int queue) {
+  const bool caller = boost::this_thread::get_id() == s->caller_;
+  boost::mutex::scoped_lock lock(s->mutex_);
+  while (true) {
+    int task = -1;
+    if (caller && !s->caller_queue_.empty()) {
+      task = s->caller_queue_.front();
+      s->caller_queue_.pop_front();
+    } else if (!s->queues_[queue].empty()) {
+      task = s->queues_[queue].back();
+      s->queues_[queue].pop_back();
+    } else {
+      for (int i = 1; i < s->queues_.size() && task < 0; ++i) {
+        std::deque<int>& victim = s->queues_[(queue + i) % s->queues_.size()];
+        if (!victim.empty()) {
+          task = victim.front();
+          victim.pop_front();
+        }
+      }
+    }
+    if (task < 0) {
+      if (s->remaining_ == 0) {
+        return;
+      }
+      s->ready_.wait(lock);
+      continue;
+    }
+    lock.unlock();
+    fn(task);
+    lock.lock();
+    bool notify = --s->remaining_ == 0;
+    for (int i = 0; i < successors_[task].size(); ++i) {
+      const int next = successors_[task][i];
+      if (next < s->first_ || next > s->last_ ||
+          --s->pending_[next - s->first_] > 0) {
+        continue;
+      }
+      if (on_caller_[next]) {
+        s->caller_queue_.push_back(next);
+      } else {
+        s->queues_[queue].push_back(next);
+      }
+      notify = true;
+    }
+    if (notify) {
+      s->ready_.notify_all();
+    }
+  }
+}
+
+void TaskGraph::Run(ThreadPool* pool, const boost::function<void(int)>& fn,
+    int first, int last) {
+  if (first > last) {
+    return;
+  }
+  CHECK_GE(first, 0);
+  CHECK_LT(last, num_tasks());
+  state s;
+  s.caller_ = boost::this_thread::get_id();
+  s.first_ = first;
+  s.last_ = last;
+  s.remaining_ = last - first + 1;
+  s.pending_.resize(s.remaining_, 0);
+  s.queues_.resize(pool->num_threads());
+  int initial = 0;
+  for (int task = first; task <= last; ++task) {
+    for (int i = 0; i < predecessors_[task].size(); ++i) {
+      const int before = predecessors_[task][i];
+      if (before >= first && before <= last) {
+        ++s.pending_[task - first];
+      }
+    }
+    if (s.pending_[task - first] > 0) {
+      continue;
+    }
+    if (on_caller_[task]) {
+      s.caller_queue_.push_back(task);
+    } else {
+      s.queues_[initial++ % s.queues_.size()].push_back(task);
+    }
+  }
+  // Each thread of the pool holds one queue until the graph is done, which
+  // leaves one for the calling thread.
+  pool->Run(s.queues_.size(),
+      boost::bind(&TaskGraph::RunTasks, this, &s, boost::cref(fn), _1));
+}
+
+}  // namespace caffe
@@ -0,0 +1,66 @@
+#include <stdint.h>
+#include <string.h>
+
+#include <string>
+
+#include "caffe/util/tensor_record.hpp"
+
+namespace caffe {
+
+static const char kTensorRecordMagic[4] = {'\0', 'C', 'T', 'R'};
+
+bool IsTensorRecord(const char* value, size_t size) {
+  return size >= kTensorRecordHeaderSize &&
+      memcmp(value, kTensorRecordMagic, sizeof(kTensorRecordMagic)) == 0;
+}
+
+void ReadTensorRecord(const char* value, size_t size, TensorRecord* record) {
+  CHECK(IsTensorRecord(value, size)) << "Not a tensor record";
+  // Database values need not be aligned for int32.
+  int32_t header[4];
+  memcpy(header, value + sizeof(kTensorRecordMagic), sizeof(header));
+  record->label = header[0];
+  record->channels = header[1];
+  record->height = header[2];
+  record->width = header[3];
+  CHECK_GT(record->channels, 0);
+  CHECK_GT(record->height, 0);
+  CHECK_GT(record->width, 0);
+  CHECK_EQ(size - kTensorRecordHeaderSize, static_cast<size_t>(
+      record->channels) * record->height * record->width)
+      << "Incorrect tensor record size";
+  record->data = reinterpret_cast<const uint8_t*>(value) +
+      kTensorRecordHeaderSize;
+}
+
+bool DatumAsTensorRecord(const Datum& datum, TensorRecord* record) {
+  const string& data = datum.data();
+  if (datum.encoded() || data.empty() || data.size() !=
+      static_cast<size_t>(datum.channels()) * datum.height() * datum.width()) {
+    return false;
+  }
+  record->label = datum.label();
+  record->channels = datum.channels();
+  record->height = datum.height();
+  record->width = datum.width();
+  record->data = reinterpret_cast<const uint8_t*>(data.data());
+  return true;
+}
+
+void DatumToTensorRecord(const Datum& datum, string* value) {
+  CHECK(!datum.encoded()) << "Encoded datum has no pixels to store";
+  const string& data = datum.data();
+  CHECK_EQ(data.size(), static_cast<size_t>(datum.channels()) *
+      datum.height() * datum.width())
+      << "A tensor record stores uint8 pixels only";
+  const int32_t header[4] = {
+    datum.label(), datum.channels(), datum.height(), datum.width()
+  };
+  value->resize(kTensorRecordHeaderSize + data.size());
+  char* out = &(*value)[0];
+  memcpy(out, kTensorRecordMagic, sizeof(kTensorRecordMagic));
+  memcpy(out + sizeof(kTensorRecordMagic), header, sizeof(header));
+  memcpy(out + kTensorRecordHeaderSize, data.data(), data.size());
+}
+
+}  // namespace caffe
@@ -0,0 +1,129 @@
+#include <boost/thread.hpp>
+#include <exception>
+
+#include "caffe/util/math_functions.hpp"
+#include "caffe/util/thread_pool.hpp"
+
+namespace caffe {
+
+class ThreadPool::sync {
+ public:
+  sync() : job_(NULL), size_(0), next_(0), pending_(0), generation_(0),
+      stop_(false) {}
+
+  boost::mutex run_mutex_;
+  boost::mutex mutex_;
+  boost::condition_variable work_;
+  boost::condition_variable done_;
+  boost::thread_group threads_;
+
+  const boost::function<void(int)>* job_;
+  int size_;
+  int next_;
+  int pending_;
+  uint64_t generation_;
+  bool stop_;
+};
+
+ThreadPool::ThreadPool(int num_threads)
+    : num_threads_(num_threads), sync_(new sync()) {
+  if (num_threads_ <= 0) {
+    num_threads_ = std::max<int>(1, boost::thread::hardware_concurrency());
+  }
+  int device = 0;
+#ifndef CPU_ONLY
+  CUDA_CHECK(cudaGetDevice(&device));
+#endif
+  Caffe::Brew mode = Caffe::mode();
+  int cpu_threads = Caffe::cpu_threads();
+  try {
+    // The calling thread takes part in Run, so spawn one worker less.
+    for (int i = 1; i < num_threads_; ++i) {
+      sync_->threads_.create_thread(boost::bind(&ThreadPool::entry, this,
+          device, mode, caffe_rng_rand(), cpu_threads));
+    }
+  } catch (std::exception& e) {
+    LOG(FATAL) << "Thread exception: " << e.what();
+  }
+}
+
+ThreadPool::~ThreadPool() {
+  {
+    boost::mutex::scoped_lock lock(sync_->mutex_);
+    sync_->stop_ = true;
+  }
+  sync_->work_.notify_all();
+  sync_->threads_.join_all();
+}
+
+void ThreadPool::entry(int device, Caffe::Brew mode, int rand_seed,
+    int cpu_threads) {
+#ifndef CPU_ONLY
+  CUDA_CHECK(cudaSetDevice(device));
+#endif
+  Caffe::set_mode(mode);
+  Caffe::set_random_seed(rand_seed);
+  Caffe::set_cpu_threads(cpu_threads);
+
+  uint64_t seen = 0;
+  while (true) {
+    {
+      boost::mutex::scoped_lock lock(sync_->mutex_);
+      while (!sync_->stop_ && sync_->generation_ == seen) {
+        sync_->work_.wait(lock);
+      }
+      if (sync_->stop_) {
+        return;
+      }
+      seen = sync_->generation_;
+    }
+    RunTasks();
+  }
+}
+
+// Claims and runs tasks of the current job until none are left.
+void ThreadPool::RunTasks() {
+  boost::mutex::scoped_lock lock(sync_->mutex_);
+  while (sync_->next_ < sync_->size_) {
+    const int i = sync_->next_++;
+    const boost::function<void(int)>& job = *sync_->job_;
+    lock.unlock();
+    job(i);
+    lock.lock();
+    if (--sync_->pending_ == 0) {
+      sync_->done_.notify_all();
+    }
+  }
+}
+
+void ThreadPool::Run(int n, const boost::function<void(int)>& fn) {
+  if (num_threads_ == 1 || n <= 1) {
+    for (int i = 0; i < n; ++i) {
+      fn(i);
+    }
+    return;
+  }
+  boost::mutex::scoped_lock run_lock(sync_->run_mutex_);
+  {
+    boost::mutex::scoped_lock lock(sync_->mutex_);
+    sync_->job_ = &fn;
+    sync_->size_ = n;
+    sync_->next_ = 0;
+    sync_->pending_ = n;
+    ++sync_->generation_;
+  }
+  sync_->work_.notify_all();
+  RunTasks();
+  // The workers use fn until they are done, so a caller that is interrupted,
+  // like a prefetch thread being stopped, must still wait for them.
+  boost::this_thread::disable_interruption no_interruption;
+  boost::mutex::scoped_lock lock(sync_->mutex_);
+  while (sync_->pending_ > 0) {
+    sync_->done_.wait(lock);
+  }
+  sync_->job_ = NULL;
+  sync_->size_ = 0;
+  sync_->next_ = 0;
+}
+
+}  // namespace caffe
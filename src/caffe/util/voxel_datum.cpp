@@ -0,0 +1,38 @@
+#include <string>
+
+#include "caffe/util/math_functions.hpp"
+#include "caffe/util/voxel_datum.hpp"
+
+namespace caffe {
+
+template <typename Dtype>
+void EncodeVoxels(int size, const Dtype* voxels, bool bit_packed,
+    VoxelDatum* datum) {
+  const int count = size * size * size;
+  datum->set_voxels_size(size);
+  datum->set_bit_packed(bit_packed);
+  const int bits = bit_packed ? 1 : 8;
+  string* bytes = datum->mutable_voxels();
+  bytes->resize(bit_packed ? (count + 7) / 8 : count);
+  caffe_pack_occupancy(count, bits, voxels,
+                       reinterpret_cast<uint8_t*>(&(*bytes)[0]));
+}
+
+template <typename Dtype>
+void DecodeVoxels(const VoxelDatum& datum, Dtype* voxels) {
+  const int size = datum.voxels_size();
+  const int count = size * size * size;
+  CHECK_EQ(datum.voxels().size(), datum.bit_packed() ? (count + 7) / 8 : count)
+      << "Incorrect voxels size";
+  caffe_unpack_occupancy(count, datum.bit_packed() ? 1 : 8,
+      reinterpret_cast<const uint8_t*>(datum.voxels().data()), voxels);
+}
+
+template void EncodeVoxels<float>(int size, const float* voxels,
+    bool bit_packed, VoxelDatum* datum);
+template void EncodeVoxels<double>(int size, const double* voxels,
+    bool bit_packed, VoxelDatum* datum);
+template void DecodeVoxels<float>(const VoxelDatum& datum, float* voxels);
+template void DecodeVoxels<double>(const VoxelDatum& datum, double* voxels);
+
+}  // namespace caffe
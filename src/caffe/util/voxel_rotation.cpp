@@ -0,0 +1,170 @@
+#include <vector>
+
+#include "caffe/util/voxel_rotation.hpp"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#define CAFFE_VOXEL_ROTATION_X86
+#endif
+
+namespace caffe {
+
+#ifdef CAFFE_VOXEL_ROTATION_X86
+// rot_round: halfway cases away from zero, which no rounding mode of
+// _mm256_round_ps does. x - trunc(x) is exact.
+__attribute__((target("avx2")))
+static inline __m256 rot_round_avx2(const __m256 x) {
+  const __m256 sign_bit = _mm256_set1_ps(-0.0f);
+  const __m256 t = _mm256_round_ps(x, _MM_FROUND_TO_ZERO | _MM_FROUND_NO_EXC);
+  const __m256 up = _mm256_cmp_ps(_mm256_andnot_ps(sign_bit,
+      _mm256_sub_ps(x, t)), _mm256_set1_ps(0.5f), _CMP_GE_OQ);
+  return _mm256_add_ps(t, _mm256_and_ps(up,
+      _mm256_or_ps(_mm256_set1_ps(1.0f), _mm256_and_ps(x, sign_bit))));
+}
+
+// rot_clamp, with the same comparisons.
+__attribute__((target("avx2")))
+static inline __m256 rot_clamp_avx2(__m256 x, const float lo,
+    const float hi) {
+  x = _mm256_blendv_ps(x, _mm256_set1_ps(hi),
+      _mm256_cmp_ps(x, _mm256_set1_ps(hi), _CMP_GT_OQ));
+  return _mm256_blendv_ps(x, _mm256_set1_ps(lo),
+      _mm256_cmp_ps(x, _mm256_set1_ps(lo), _CMP_LT_OQ));
+}
+
+// voxel_rotation_source and voxel_rotation_nearest for 8 columns at a time,
+// with the same operations in the same order and no fused multiply-adds, so
+// that the offsets are those of the scalar loop; then a gather. Returns the
+// number of columns done.
+__attribute__((target("avx2")))
+static int rotate_row_nearest_avx2(const float* params, const int size,
+    const float* base, const float* vox, float* out_row) {
+  const float* t = params + kRotationTransform;
+  const float dx = rot_div(2.0f, static_cast<float>(size));
+  __m256 step[3], row[3];
+  for (int r = 0; r < 3; ++r) {
+    step[r] = _mm256_set1_ps(rot_mul(t[4 * r], dx));
+    row[r] = _mm256_set1_ps(base[r]);
+  }
+  const __m256 step_w = _mm256_set1_ps(rot_mul(t[12], dx));
+  const __m256 row_w = _mm256_set1_ps(base[3]);
+  const __m256 sizef = _mm256_set1_ps(static_cast<float>(size));
+  const __m256 one = _mm256_set1_ps(1.0f);
+  const __m256 two = _mm256_set1_ps(2.0f);
+  const __m256 half = _mm256_set1_ps(0.5f);
+  const __m256 sign_bit = _mm256_set1_ps(-0.0f);
+  const __m256i size_i = _mm256_set1_epi32(size);
+  int j = 0;
+  for (; j + 8 <= size; j += 8) {
+    const __m256 jd = _mm256_add_ps(_mm256_set1_ps(static_cast<float>(j)),
+        _mm256_setr_ps(0, 1, 2, 3, 4, 5, 6, 7));
+    const __m256 inv_w = _mm256_div_ps(one,
+        _mm256_add_ps(row_w, _mm256_mul_ps(jd, step_w)));
+    __m256 coords[3];
+    for (int r = 0; r < 3; ++r) {
+      const __m256 h = _mm256_add_ps(row[r], _mm256_mul_ps(jd, step[r]));
+      coords[r] = rot_clamp_avx2(_mm256_add_ps(_mm256_div_ps(
+          _mm256_mul_ps(h, inv_w), two), half), 0.01f, 0.99f);
+    }
+    const __m256 ui = _mm256_mul_ps(_mm256_sub_ps(one, coords[1]), sizef);
+    const __m256 uj = _mm256_mul_ps(coords[0], sizef);
+    const __m256 d = _mm256_div_ps(_mm256_set1_ps(-params[kRotationP23]),
+        _mm256_add_ps(_mm256_sub_ps(_mm256_mul_ps(coords[2], two), one),
+                      _mm256_set1_ps(params[kRotationP22])));
+    const __m256 z = _mm256_sub_ps(_mm256_mul_ps(_mm256_div_ps(
+        _mm256_xor_ps(_mm256_add_ps(d, _mm256_set1_ps(2.5f)), sign_bit),
+        _mm256_set1_ps(5.5f)), sizef), half);
+    const __m256 uz = _mm256_div_ps(_mm256_sub_ps(z,
+        _mm256_set1_ps(static_cast<float>(size / 16))),
+        _mm256_set1_ps(0.8f));
+    const __m256i zi = _mm256_min_epi32(_mm256_max_epi32(
+        _mm256_cvttps_epi32(rot_round_avx2(uz)), _mm256_setzero_si256()),
+        _mm256_sub_epi32(size_i, _mm256_set1_epi32(1)));
+    const __m256i ii = _mm256_cvttps_epi32(_mm256_floor_ps(ui));
+    const __m256i ji = _mm256_cvttps_epi32(_mm256_floor_ps(uj));
+    const __m256i offsets = _mm256_add_epi32(_mm256_mullo_epi32(
+        _mm256_add_epi32(_mm256_mullo_epi32(zi, size_i), ii), size_i), ji);
+    _mm256_storeu_ps(out_row + j, _mm256_i32gather_ps(vox, offsets, 4));
+  }
+  return j;
+}
+#endif
+
+// Rotates the first columns of a row with SIMD where there is a path for
+// Dtype and the CPU, and returns how many.
+template <typename Dtype>
+static int rotate_row_nearest(const Dtype* params, int size,
+    const Dtype* base, const Dtype* vox, Dtype* out_row) {
+  return 0;
+}
+
+#ifdef CAFFE_VOXEL_ROTATION_X86
+template <>
+int rotate_row_nearest<float>(const float* params, int size,
+    const float* base, const float* vox, float* out_row) {
+  static const bool avx2 = __builtin_cpu_supports("avx2");
+  return avx2 ? rotate_row_nearest_avx2(params, size, base, vox, out_row) :
+      0;
+}
+#endif
+
+template <typename Dtype>
+void rotate_grid_cpu(const Dtype* params, int size, bool trilinear,
+    const Dtype* vox, Dtype* output, int z_begin, int z_end) {
+  std::vector<int> offsets(size);
+  int* off = offsets.data();
+  Dtype base[4];
+  for (int c = z_begin; c < z_end; ++c) {
+    Dtype* out_slice = output + c * size * size;
+    for (int i = 0; i < size; ++i) {
+      voxel_rotation_row(params, size, c, i, base);
+      Dtype* out_row = out_slice + i * size;
+      if (trilinear) {
+        for (int j = 0; j < size; ++j) {
+          Dtype uz, ui, uj;
+          voxel_rotation_source(params, size, base, j, &uz, &ui, &uj);
+          out_row[j] = voxel_rotation_trilinear(vox, size, uz, ui, uj);
+        }
+        continue;
+      }
+      // Float rows go 8 columns at a time with AVX2 where the CPU has it.
+      // The rest of the row computes its offsets, then gathers.
+      const int j_begin = rotate_row_nearest(params, size, base, vox,
+          out_row);
+      for (int j = j_begin; j < size; ++j) {
+        Dtype uz, ui, uj;
+        voxel_rotation_source(params, size, base, j, &uz, &ui, &uj);
+        off[j] = voxel_rotation_nearest(size, uz, ui, uj);
+      }
+      for (int j = j_begin; j < size; ++j) {
+        out_row[j] = vox[off[j]];
+      }
+    }
+  }
+}
+
+template void rotate_grid_cpu<float>(const float* params, int size,
+    bool trilinear, const float* vox, float* output, int z_begin, int z_end);
+template void rotate_grid_cpu<double>(const double* params, int size,
+    bool trilinear, const double* vox, double* output, int z_begin,
+    int z_end);
+
+template <typename Dtype>
+void rotate_blobs_cpu(int num, int size, const Dtype* params,
+    const Dtype* pred, int pred_stride, const int* items, bool trilinear,
+    Dtype* output, int output_stride) {
+  const int num_params = voxel_rotation_num_params(size);
+  for (int n = 0; n < num; ++n) {
+    rotate_grid_cpu(params + n * num_params, size, trilinear,
+        pred + n * pred_stride, output + items[n] * output_stride, 0, size);
+  }
+}
+
+template void rotate_blobs_cpu<float>(int num, int size, const float* params,
+    const float* pred, int pred_stride, const int* items, bool trilinear,
+    float* output, int output_stride);
+template void rotate_blobs_cpu<double>(int num, int size,
+    const double* params, const double* pred, int pred_stride,
+    const int* items, bool trilinear, double* output, int output_stride);
+
+}  // namespace caffe
@@ -0,0 +1,52 @@
+#include "caffe/common.hpp"
+#include "caffe/util/voxel_rotation.hpp"
+
+namespace caffe {
+
+template <typename Dtype>
+__global__ void rotate_blobs_gpu_kernel(const int n, const int size,
+    const Dtype* params, const Dtype* pred, const int pred_stride,
+    const int* items, const bool trilinear, Dtype* output,
+    const int output_stride) {
+  const int num_params = voxel_rotation_num_params(size);
+  const int grid_count = size * size * size;
+  CUDA_KERNEL_LOOP(index, n) {
+    const int item = index / grid_count;
+    const int voxel = index % grid_count;
+    const int c = voxel / (size * size);
+    const int i = (voxel / size) % size;
+    const int j = voxel % size;
+    const Dtype* item_params = params + item * num_params;
+    const Dtype* vox = pred + item * pred_stride;
+    Dtype base[4];
+    voxel_rotation_row(item_params, size, c, i, base);
+    Dtype uz, ui, uj;
+    voxel_rotation_source(item_params, size, base, j, &uz, &ui, &uj);
+    output[items[item] * output_stride + voxel] = trilinear ?
+        voxel_rotation_trilinear(vox, size, uz, ui, uj) :
+        vox[voxel_rotation_nearest(size, uz, ui, uj)];
+  }
+}
+
+template <typename Dtype>
+void rotate_blobs_gpu(int num, int size, const Dtype* params,
+    const Dtype* pred, int pred_stride, const int* items, bool trilinear,
+    Dtype* output, int output_stride) {
+  // One thread per output voxel of the whole batch.
+  const int n = num * size * size * size;
+  // NOLINT_NEXT_LINE(whitespace/operators)
+  rotate_blobs_gpu_kernel<Dtype><<<CAFFE_GET_BLOCKS(n),
+                                   CAFFE_CUDA_NUM_THREADS>>>(
+      n, size, params, pred, pred_stride, items, trilinear, output,
+      output_stride);
+  CUDA_POST_KERNEL_CHECK;
+}
+
+template void rotate_blobs_gpu<float>(int num, int size, const float* params,
+    const float* pred, int pred_stride, const int* items, bool trilinear,
+    float* output, int output_stride);
+template void rotate_blobs_gpu<double>(int num, int size,
+    const double* params, const double* pred, int pred_stride,
+    const int* items, bool trilinear, double* output, int output_stride);
+
+}  // namespace caffe
@@ -0,0 +1,188 @@
+#include "caffe/common.hpp"
+#include "caffe/util/math_functions.hpp"
+#include "caffe/util/winograd.hpp"
+
+namespace caffe {
+
+// The weight transforms G of F(2x2, 3x3) and F(4x4, 3x3). The input and
+// output transforms B^T and A^T are unrolled in winograd_input_column and
+// winograd_output_column below, as they run for every tile.
+static const double kWeightTransform2[4 * 3] = {
+  1,    0,   0,
+  0.5,  0.5, 0.5,
+  0.5, -0.5, 0.5,
+  0,    0,   1
+};
+static const double kWeightTransform4[6 * 3] = {
+  1. / 4,   0,       0,
+  -1. / 6,  -1. / 6, -1. / 6,
+  -1. / 6,  1. / 6,  -1. / 6,
+  1. / 24,  1. / 12, 1. / 6,
+  1. / 24,  -1. / 12, 1. / 6,
+  0,        0,       1
+};
+
+// r = B^T d for a column d of tile + 2 elements, d and r being strided by
+// ds and rs.
+template <typename Dtype>
+inline void winograd_input_column(const int tile, const Dtype* d,
+    const int ds, Dtype* r, const int rs) {
+  if (tile == 2) {
+    r[0] = d[0] - d[2 * ds];
+    r[rs] = d[ds] + d[2 * ds];
+    r[2 * rs] = d[2 * ds] - d[ds];
+    r[3 * rs] = d[ds] - d[3 * ds];
+    return;
+  }
+  const Dtype d1 = d[ds], d2 = d[2 * ds], d3 = d[3 * ds], d4 = d[4 * ds];
+  r[0] = 4 * d[0] - 5 * d2 + d4;
+  r[rs] = d3 + d4 - 4 * (d1 + d2);
+  r[2 * rs] = d4 - d3 + 4 * (d1 - d2);
+  r[3 * rs] = d4 - d2 + 2 * (d3 - d1);
+  r[4 * rs] = d4 - d2 + 2 * (d1 - d3);
+  r[5 * rs] = 4 * d1 - 5 * d3 + d[5 * ds];
+}
+
+// y = A^T m for a column m of tile + 2 elements, m and y being strided by
+// ms and ys.
+template <typename Dtype>
+inline void winograd_output_column(const int tile, const Dtype* m,
+    const int ms, Dtype* y, const int ys) {
+  const Dtype m1 = m[ms], m2 = m[2 * ms], m3 = m[3 * ms];
+  if (tile == 2) {
+    y[0] = m[0] + m1 + m2;
+    y[ys] = m1 - m2 - m3;
+    return;
+  }
+  const Dtype m4 = m[4 * ms];
+  y[0] = m[0] + m1 + m2 + m3 + m4;
+  y[ys] = m1 - m2 + 2 * (m3 - m4);
+  y[2 * ys] = m1 + m2 + 4 * (m3 + m4);
+  y[3 * ys] = m1 - m2 + 8 * (m3 - m4) + m[5 * ms];
+}
+
+static void check_winograd_tile(int tile) {
+  CHECK(tile == 2 || tile == 4) << "Winograd tile must be 2 or 4.";
+}
+
+template <typename Dtype>
+void winograd_weight_transform_cpu(const int tile, const Dtype* weights,
+    const int num_output, const int channels, Dtype* transformed) {
+  check_winograd_tile(tile);
+  const double* weight_transform =
+      tile == 2 ? kWeightTransform2 : kWeightTransform4;
+  const int alpha = tile + 2;
+  const int filters = num_output * channels;
+  Dtype tmp[6 * 3];
+  for (int f = 0; f < filters; ++f) {
+    const Dtype* g = weights + f * 9;
+    // G g, then (G g) G^T.
+    for (int i = 0; i < alpha; ++i) {
+      for (int j = 0; j < 3; ++j) {
+        Dtype sum = 0;
+        for (int l = 0; l < 3; ++l) {
+          sum += weight_transform[i * 3 + l] * g[l * 3 + j];
+        }
+        tmp[i * 3 + j] = sum;
+      }
+    }
+    for (int i = 0; i < alpha; ++i) {
+      for (int j = 0; j < alpha; ++j) {
+        Dtype sum = 0;
+        for (int l = 0; l < 3; ++l) {
+          sum += tmp[i * 3 + l] * weight_transform[j * 3 + l];
+        }
+        transformed[(i * alpha + j) * filters + f] = sum;
+      }
+    }
+  }
+}
+
+template void winograd_weight_transform_cpu<float>(const int tile,
+    const float* weights, const int num_output, const int channels,
+    float* transformed);
+template void winograd_weight_transform_cpu<double>(const int tile,
+    const double* weights, const int num_output, const int channels,
+    double* transformed);
+
+template <typename Dtype>
+void conv_winograd_cpu(const int tile, const Dtype* data, const int channels,
+    const int height, const int width, const int pad_h, const int pad_w,
+    const Dtype* transformed_weights, const int num_output,
+    const int height_out, const int width_out, Dtype* buffer, Dtype* output) {
+  check_winograd_tile(tile);
+  const int alpha = tile + 2;
+  const int elements = alpha * alpha;
+  const int tiles_h = (height_out + tile - 1) / tile;
+  const int tiles_w = (width_out + tile - 1) / tile;
+  const int tiles = tiles_h * tiles_w;
+  Dtype* transformed_input = buffer;
+  Dtype* transformed_output = buffer + elements * channels * tiles;
+  Dtype d[6 * 6], tmp[6 * 6];
+  // B^T d B for every input tile, zero padded at the borders.
+  const int input_stride = channels * tiles;
+  for (int c = 0; c < channels; ++c) {
+    const Dtype* plane = data + c * height * width;
+    for (int t = 0; t < tiles; ++t) {
+      const int h0 = (t / tiles_w) * tile - pad_h;
+      const int w0 = (t % tiles_w) * tile - pad_w;
+      for (int i = 0; i < alpha; ++i) {
+        const int h = h0 + i;
+        for (int j = 0; j < alpha; ++j) {
+          const int w = w0 + j;
+          d[i * alpha + j] = (h >= 0 && h < height && w >= 0 && w < width) ?
+              plane[h * width + w] : Dtype(0);
+        }
+      }
+      for (int j = 0; j < alpha; ++j) {
+        winograd_input_column(tile, d + j, alpha, tmp + j, alpha);
+      }
+      Dtype* v = transformed_input + c * tiles + t;
+      for (int i = 0; i < alpha; ++i) {
+        winograd_input_column(tile, tmp + i * alpha, 1,
+            v + i * alpha * input_stride, input_stride);
+      }
+    }
+  }
+  // One num_output x channels by channels x tiles product per element.
+  for (int e = 0; e < elements; ++e) {
+    caffe_cpu_gemm<Dtype>(CblasNoTrans, CblasNoTrans, num_output, tiles,
+        channels, (Dtype)1., transformed_weights + e * num_output * channels,
+        transformed_input + e * channels * tiles, (Dtype)0.,
+        transformed_output + e * num_output * tiles);
+  }
+  // A^T m A for every output tile, cropped at the borders.
+  const int output_stride = num_output * tiles;
+  for (int k = 0; k < num_output; ++k) {
+    Dtype* plane = output + k * height_out * width_out;
+    for (int t = 0; t < tiles; ++t) {
+      const Dtype* m = transformed_output + k * tiles + t;
+      for (int j = 0; j < alpha; ++j) {
+        winograd_output_column(tile, m + j * output_stride,
+            alpha * output_stride, tmp + j, alpha);
+      }
+      for (int i = 0; i < tile; ++i) {
+        winograd_output_column(tile, tmp + i * alpha, 1, d + i * tile, 1);
+      }
+      const int h0 = (t / tiles_w) * tile;
+      const int w0 = (t % tiles_w) * tile;
+      for (int i = 0; i < tile && h0 + i < height_out; ++i) {
+        for (int j = 0; j < tile && w0 + j < width_out; ++j) {
+          plane[(h0 + i) * width_out + w0 + j] = d[i * tile + j];
+        }
+      }
+    }
+  }
+}
+
+template void conv_winograd_cpu<float>(const int tile, const float* data,
+    const int channels, const int height, const int width, const int pad_h,
+    const int pad_w, const float* transformed_weights, const int num_output,
+    const int height_out, const int width_out, float* buffer, float* output);
+template void conv_winograd_cpu<double>(const int tile, const double* data,
+    const int channels, const int height, const int width, const int pad_h,
+    const int pad_w, const double* transformed_weights, const int num_output,
+    const int height_out, const int width_out, double* buffer,
+    double* output);
+
+}  // namespace caffe
@@ -6,6 +6,7 @@ namespace bp = boost::python;
 #include <gflags/gflags.h>
 #include <glog/logging.h>
 
+#include <cmath>
 #include <cstring>
 #include <map>
 #include <string>
@@ -46,8 +47,19 @@ DEFINE_string(snapshot, "",
 DEFINE_string(weights, "",
     "Optional; the pretrained weights to initialize finetuning, "
     "separated by ','. Cannot be set simultaneously with snapshot.");
+DEFINE_int32(cpu_threads, 1,
+    "Optional; the number of threads CPU layers split their batch over, "
+    "0 for one per core.");
+DEFINE_string(conv_engine, "",
+    "Optional; the engine of all convolution layers (CAFFE, CUDNN, WINOGRAD "
+    "or DIRECT), to compare them with 'time'.");
+DEFINE_string(blas, "",
+    "Optional; the BLAS backend of the CPU GEMMs: linked, builtin, openblas, "
+    "mkl, blis or the path of a cblas library.");
 DEFINE_int32(iterations, 50,
     "The number of iterations to run.");
+DEFINE_string(output, "",
+    "The model definition protocol buffer text file 'calibrate' writes.");
 DEFINE_string(sigint_effect, "stop",
              "Optional; action to take when a SIGINT signal is received: "
               "snapshot, stop or none.");
@@ -326,6 +338,76 @@ int test() {
 RegisterBrewFunction(test);
 
 
+// Calibrate: switch a model to 8-bit inference on the CPU, and compare it to
+// the original.
+int calibrate() {
+  CHECK_GT(FLAGS_model.size(), 0) << "Need a model definition to calibrate.";
+  CHECK_GT(FLAGS_weights.size(), 0) << "Need model weights to calibrate.";
+  CHECK_GT(FLAGS_output.size(), 0)
+      << "Need an output file for the calibrated model definition.";
+  vector<string> stages = get_stages_from_flags();
+  LOG(INFO) << "Use CPU.";
+  Caffe::set_mode(Caffe::CPU);
+
+  caffe::NetParameter int8_param;
+  caffe::ReadNetParamsFromTextFileOrDie(FLAGS_model, &int8_param);
+  int quantized = 0;
+  {
+    Net<float> caffe_net(FLAGS_model, caffe::TEST, FLAGS_level, &stages);
+    caffe_net.CopyTrainedLayersFrom(FLAGS_weights);
+    LOG(INFO) << "Calibrating over " << FLAGS_iterations << " iterations.";
+    quantized = caffe::CalibrateNet(&caffe_net, FLAGS_iterations,
+        &int8_param);
+  }
+  caffe::WriteProtoToTextFile(int8_param, FLAGS_output);
+  LOG(INFO) << "Wrote " << FLAGS_output << " with " << quantized
+      << " INT8 layers.";
+
+  // Run both nets from their first batch on.
+  Net<float> float_net(FLAGS_model, caffe::TEST, FLAGS_level, &stages);
+  float_net.CopyTrainedLayersFrom(FLAGS_weights);
+  Net<float> int8_net(FLAGS_output, caffe::TEST, FLAGS_level, &stages);
+  int8_net.CopyTrainedLayersFrom(FLAGS_weights);
+  LOG(INFO) << "Comparing over " << FLAGS_iterations << " iterations.";
+  const int outputs = float_net.num_outputs();
+  vector<double> float_score(outputs, 0), int8_score(outputs, 0);
+  vector<double> difference(outputs, 0);
+  double float_time = 0, int8_time = 0;
+  Timer timer;
+  for (int i = 0; i < FLAGS_iterations; ++i) {
+    timer.Start();
+    const vector<Blob<float>*>& expected = float_net.Forward();
+    float_time += timer.MilliSeconds();
+    timer.Start();
+    const vector<Blob<float>*>& result = int8_net.Forward();
+    int8_time += timer.MilliSeconds();
+    for (int j = 0; j < outputs; ++j) {
+      const int count = expected[j]->count();
+      for (int k = 0; k < count; ++k) {
+        const float expected_value = expected[j]->cpu_data()[k];
+        const float result_value = result[j]->cpu_data()[k];
+        float_score[j] += expected_value / count;
+        int8_score[j] += result_value / count;
+        difference[j] += std::fabs(expected_value - result_value) / count;
+      }
+    }
+  }
+  // Scores are averaged over the elements of each output and the batches.
+  for (int j = 0; j < outputs; ++j) {
+    const std::string& output_name = float_net.blob_names()[
+        float_net.output_blob_indices()[j]];
+    LOG(INFO) << output_name << ": float " << float_score[j] /
+        FLAGS_iterations << ", int8 " << int8_score[j] / FLAGS_iterations
+        << ", mean |difference| " << difference[j] / FLAGS_iterations;
+  }
+  LOG(INFO) << "Average Forward pass: float " << float_time /
+      FLAGS_iterations << " ms, int8 " << int8_time / FLAGS_iterations
+      << " ms.";
+  return 0;
+}
+RegisterBrewFunction(calibrate);
+
+
 // Time: benchmark the execution time of a model.
 int time() {
   CHECK_GT(FLAGS_model.size(), 0) << "Need a model definition to time.";
@@ -344,7 +426,26 @@ int time() {
     Caffe::set_mode(Caffe::CPU);
   }
   // Instantiate the caffe net.
-  Net<float> caffe_net(FLAGS_model, phase, FLAGS_level, &stages);
+  caffe::NetParameter net_param;
+  caffe::ReadNetParamsFromTextFileOrDie(FLAGS_model, &net_param);
+  net_param.mutable_state()->set_phase(phase);
+  net_param.mutable_state()->set_level(FLAGS_level);
+  for (int i = 0; i < stages.size(); ++i) {
+    net_param.mutable_state()->add_stage(stages[i]);
+  }
+  if (FLAGS_conv_engine.size()) {
+    caffe::ConvolutionParameter_Engine engine;
+    CHECK(caffe::ConvolutionParameter_Engine_Parse(FLAGS_conv_engine, &engine))
+        << "Unknown convolution engine " << FLAGS_conv_engine;
+    LOG(INFO) << "Use the " << FLAGS_conv_engine << " convolution engine.";
+    for (int i = 0; i < net_param.layer_size(); ++i) {
+      if (net_param.layer(i).type() == "Convolution") {
+        net_param.mutable_layer(i)->mutable_convolution_param()->set_engine(
+            engine);
+      }
+    }
+  }
+  Net<float> caffe_net(net_param);
 
   // Do a clean forward and backward pass, so that memory allocation are done
   // and future iterations will be more stable.
@@ -428,10 +529,15 @@ int main(int argc, char** argv) {
       "commands:\n"
       "  train           train or finetune a model\n"
       "  test            score a model\n"
+      "  calibrate       quantize a model to 8 bits and score it\n"
       "  device_query    show GPU diagnostic information\n"
       "  time            benchmark model execution time");
   // Run tool or show usage.
   caffe::GlobalInit(&argc, &argv);
+  Caffe::set_cpu_threads(FLAGS_cpu_threads);
+  if (FLAGS_blas.size()) {
+    caffe::caffe_set_blas_backend(FLAGS_blas);
+  }
   if (argc == 2) {
 #ifdef WITH_PYTHON_LAYER
     try {
@@ -1,5 +1,5 @@
 // This program converts a set of images to a lmdb/leveldb by storing them
-// as Datum proto buffers.
+// as Datum proto buffers, or as raw tensor records with --tensor_records.
 // Usage:
 //   convert_imageset [FLAGS] ROOTFOLDER/ LISTFILE DB_NAME
 //
@@ -23,6 +23,7 @@
 #include "caffe/util/format.hpp"
 #include "caffe/util/io.hpp"
 #include "caffe/util/rng.hpp"
+#include "caffe/util/tensor_record.hpp"
 
 using namespace caffe;  // NOLINT(build/namespaces)
 using std::pair;
@@ -42,6 +43,9 @@ DEFINE_bool(encoded, false,
     "When this option is on, the encoded image will be save in datum");
 DEFINE_string(encode_type, "",
     "Optional: What type should we encode the image as ('png','jpg',...).");
+DEFINE_bool(tensor_records, false,
+    "When this option is on, the pixels are saved as raw tensor records, "
+    "which the Data layer reads in place without parsing a Datum");
 
 int main(int argc, char** argv) {
 #ifdef USE_OPENCV
@@ -90,6 +94,8 @@ int main(int argc, char** argv) {
 
   if (encode_type.size() && !encoded)
     LOG(INFO) << "encode_type specified, assuming encoded=true.";
+  CHECK(!FLAGS_tensor_records || !(encoded || encode_type.size()))
+      << "tensor_records stores decoded pixels only";
 
   int resize_height = std::max<int>(0, FLAGS_resize_height);
   int resize_width = std::max<int>(0, FLAGS_resize_width);
@@ -137,7 +143,11 @@ int main(int argc, char** argv) {
 
     // Put in db
     string out;
-    CHECK(datum.SerializeToString(&out));
+    if (FLAGS_tensor_records) {
+      DatumToTensorRecord(datum, &out);
+    } else {
+      CHECK(datum.SerializeToString(&out));
+    }
     txn->Put(key_str, out);
 
     if (++count % 1000 == 0) {
@@ -0,0 +1,135 @@
+// This program converts a set of voxels images, as read by VoxelsDataLayer, to
+// a lmdb/leveldb of VoxelDatum proto buffers holding the sketch and the
+// occupancy grid undecoded, so that the layer reads them without decoding.
+// Usage:
+//   convert_voxels [FLAGS] ROOTFOLDER/ LISTFILE DB_NAME
+//
+// where ROOTFOLDER is the root folder that holds all the images, and LISTFILE
+// should be a list of files, one per line, in the format as
+//   subfolder1/file1.png
+//   ....
+
+#include <algorithm>
+#include <fstream>  // NOLINT(readability/streams)
+#include <string>
+#include <vector>
+
+#include "boost/scoped_ptr.hpp"
+#include "gflags/gflags.h"
+#include "glog/logging.h"
+
+#include "caffe/proto/caffe.pb.h"
+#include "caffe/util/db.hpp"
+#include "caffe/util/format.hpp"
+#include "caffe/util/io.hpp"
+#include "caffe/util/rng.hpp"
+#include "caffe/util/voxel_datum.hpp"
+
+#ifdef USE_OPENCV
+#include <opencv2/core/core.hpp>
+
+#include "caffe/util/prediction.hpp"
+#endif  // USE_OPENCV
+
+using namespace caffe;  // NOLINT(build/namespaces)
+using boost::scoped_ptr;
+
+DEFINE_bool(shuffle, false,
+    "Randomly shuffle the order of images");
+DEFINE_string(backend, "lmdb",
+        "The backend {lmdb, leveldb} for storing the result");
+DEFINE_int32(img_size, 256, "Size of the sketch part of the images");
+DEFINE_int32(voxels_size, 64, "Size of the occupancy grid");
+DEFINE_bool(bit_packed, false,
+    "When this option is on, store one bit per voxel (occupied if >= 0.5) "
+    "instead of one byte");
+
+int main(int argc, char** argv) {
+#ifdef USE_OPENCV
+  ::google::InitGoogleLogging(argv[0]);
+  // Print output to stderr (while still logging)
+  FLAGS_alsologtostderr = 1;
+
+#ifndef GFLAGS_GFLAGS_H_
+  namespace gflags = google;
+#endif
+
+  gflags::SetUsageMessage("Convert a set of voxels images to the leveldb/lmdb\n"
+        "format read by VoxelsDataLayer with source_type: VOXEL_DB.\n"
+        "Usage:\n"
+        "    convert_voxels [FLAGS] ROOTFOLDER/ LISTFILE DB_NAME\n");
+  gflags::ParseCommandLineFlags(&argc, &argv, true);
+
+  if (argc < 4) {
+    gflags::ShowUsageWithFlagsRestrict(argv[0], "tools/convert_voxels");
+    return 1;
+  }
+
+  std::ifstream infile(argv[2]);
+  std::vector<std::string> lines;
+  std::string line;
+  while (std::getline(infile, line)) {
+    lines.push_back(line);
+  }
+  if (FLAGS_shuffle) {
+    // randomly shuffle data
+    LOG(INFO) << "Shuffling data";
+    shuffle(lines.begin(), lines.end());
+  }
+  LOG(INFO) << "A total of " << lines.size() << " images.";
+
+  // Create new DB
+  scoped_ptr<db::DB> db(db::GetDB(FLAGS_backend));
+  db->Open(argv[3], db::NEW);
+  scoped_ptr<db::Transaction> txn(db->NewTransaction());
+
+  // Storing to db
+  std::string root_folder(argv[1]);
+  const int size = FLAGS_voxels_size;
+  VoxelDatum datum;
+  std::vector<float> voxels(size * size * size);
+  int count = 0;
+
+  for (int line_id = 0; line_id < lines.size(); ++line_id) {
+    cv::Mat cv_img = ReadImageToCVMat(root_folder + lines[line_id], 0, 0,
+                                      true);
+    if (!cv_img.data) {
+      LOG(ERROR) << "Could not open or find file " << lines[line_id];
+      continue;
+    }
+    cv::Mat sketch;
+    Grid<float> grid;
+    unpack_voxels_image(cv_img, FLAGS_img_size, size, &sketch, &grid);
+    CHECK_EQ(grid.size(), size) << "Unexpected grid size in "
+                                << lines[line_id];
+    CVMatToDatum(sketch, datum.mutable_sketch());
+    for (int c = 0; c < size; ++c) {
+      std::copy(grid[c].data(), grid[c].data() + size * size,
+                voxels.begin() + c * size * size);
+    }
+    EncodeVoxels(size, voxels.data(), FLAGS_bit_packed, &datum);
+    // sequential
+    string key_str = caffe::format_int(line_id, 8) + "_" + lines[line_id];
+
+    // Put in db
+    string out;
+    CHECK(datum.SerializeToString(&out));
+    txn->Put(key_str, out);
+
+    if (++count % 1000 == 0) {
+      // Commit db
+      txn->Commit();
+      txn.reset(db->NewTransaction());
+      LOG(INFO) << "Processed " << count << " files.";
+    }
+  }
+  // write the last batch
+  if (count % 1000 != 0) {
+    txn->Commit();
+    LOG(INFO) << "Processed " << count << " files.";
+  }
+#else
+  LOG(FATAL) << "This tool requires OpenCV; compile with USE_OPENCV.";
+#endif  // USE_OPENCV
+  return 0;
+}
@@ -0,0 +1,54 @@
+// This is a script to fuse the BatchNorm, Scale and activation layers of an
+// inference net into the Convolution and InnerProduct layers before them.
+// Usage:
+//    fuse_net net_proto_file_in weights_in net_proto_file_out weights_out
+
+#include <string>
+
+#include "caffe/caffe.hpp"
+#include "caffe/util/fusion.hpp"
+#include "caffe/util/io.hpp"
+#include "caffe/util/upgrade_proto.hpp"
+
+using namespace caffe;  // NOLINT(build/namespaces)
+
+int main(int argc, char** argv) {
+  FLAGS_alsologtostderr = 1;  // Print output to stderr (while still logging)
+  ::google::InitGoogleLogging(argv[0]);
+  if (argc != 5) {
+    LOG(ERROR) << "Usage: fuse_net net_proto_file_in weights_in "
+        << "net_proto_file_out weights_out";
+    return 1;
+  }
+
+  // The TEST net, with the weights of each layer.
+  NetParameter net_param;
+  ReadNetParamsFromTextFileOrDie(argv[1], &net_param);
+  net_param.mutable_state()->set_phase(TEST);
+  NetParameter filtered_param;
+  Net<float>::FilterNet(net_param, &filtered_param);
+  Net<float> net(filtered_param);
+  net.CopyTrainedLayersFrom(argv[2]);
+  for (int i = 0; i < filtered_param.layer_size(); ++i) {
+    LayerParameter* layer_param = filtered_param.mutable_layer(i);
+    const vector<shared_ptr<Blob<float> > >& blobs =
+        net.layer_by_name(layer_param->name())->blobs();
+    layer_param->clear_blobs();
+    for (int j = 0; j < blobs.size(); ++j) {
+      blobs[j]->ToProto(layer_param->add_blobs());
+    }
+  }
+
+  NetParameter fused_param;
+  const int num_fused = FuseNet(filtered_param, &fused_param);
+  WriteProtoToBinaryFile(fused_param, argv[4]);
+  for (int i = 0; i < fused_param.layer_size(); ++i) {
+    fused_param.mutable_layer(i)->clear_blobs();
+  }
+  WriteProtoToTextFile(fused_param, argv[3]);
+
+  LOG(INFO) << "Fused " << num_fused << " layers into "
+      << fused_param.layer_size() << "; wrote " << argv[3] << " and "
+      << argv[4];
+  return 0;
+}